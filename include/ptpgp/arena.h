@@ -0,0 +1,59 @@
+/*
+ * Bump allocator for variable-length values (e.g. MPIs).  Values are
+ * carved out of a caller-owned buffer, or out of malloc()ed blocks if
+ * no buffer is given, and are all released at once by clearing or
+ * freeing the arena.
+ */
+
+/* default size of arena blocks */
+#define PTPGP_ARENA_DEFAULT_BLOCK_SIZE  (16 * 1024)
+
+/* alignment of allocations (relative to the start of the block) */
+#define PTPGP_ARENA_ALIGN               16
+
+typedef struct ptpgp_arena_block_t_ ptpgp_arena_block_t;
+
+typedef struct {
+  /* current block */
+  u8 *buf;
+  size_t buf_len,
+         pos;
+
+  /* size of allocated blocks (zero: buffer is caller-owned) */
+  size_t block_size;
+
+  /* list of allocated blocks (most recent first) */
+  ptpgp_arena_block_t *blocks;
+
+  /* number of octets handed out */
+  size_t num_bytes;
+} ptpgp_arena_t;
+
+/*
+ * Init arena which allocates blocks of the given size (zero: use
+ * PTPGP_ARENA_DEFAULT_BLOCK_SIZE) as needed.
+ */
+ptpgp_err_t
+ptpgp_arena_init(ptpgp_arena_t *a,
+                 size_t block_size);
+
+/*
+ * Init arena backed by a caller-owned buffer; allocations fail with
+ * PTPGP_ERR_ARENA_FULL once the buffer is used up.
+ */
+ptpgp_err_t
+ptpgp_arena_init_buffer(ptpgp_arena_t *a,
+                        u8 *buf,
+                        size_t buf_len);
+
+ptpgp_err_t
+ptpgp_arena_alloc(ptpgp_arena_t *a,
+                  size_t len,
+                  void **ptr);
+
+/* release all allocations (keeps the first block for reuse) */
+ptpgp_err_t
+ptpgp_arena_clear(ptpgp_arena_t *a);
+
+ptpgp_err_t
+ptpgp_arena_free(ptpgp_arena_t *a);
@@ -3,6 +3,11 @@
 
 typedef struct ptpgp_armor_parser_t_ ptpgp_armor_parser_t;
 
+/*
+ * BODY tokens may span several lines, and may include line endings
+ * and trailing whitespace (runs of complete lines are passed straight
+ * from the pushed buffer).
+ */
 typedef enum {
   PTPGP_ARMOR_PARSER_TOKEN_START_ARMOR,
   PTPGP_ARMOR_PARSER_TOKEN_HEADER_NAME,
@@ -45,6 +50,9 @@ struct ptpgp_armor_parser_t_ {
 
   u8 out_buf[PTPGP_ARMOR_PARSER_OUTPUT_BUFFER_SIZE];
   size_t out_buf_len;
+
+  /* number of input octets consumed */
+  uint64_t offset;
 };
 
 ptpgp_err_t
@@ -55,3 +63,24 @@ ptpgp_armor_parser_push(ptpgp_armor_parser_t *p, u8 *src, size_t src_len);
 
 ptpgp_err_t
 ptpgp_armor_parser_done(ptpgp_armor_parser_t *p);
+
+/*
+ * Save parser state to a checkpoint (see checkpoint.h); sets out_len
+ * to the size of the checkpoint.
+ */
+ptpgp_err_t
+ptpgp_armor_parser_save(ptpgp_armor_parser_t *p,
+                        u8 *dst,
+                        size_t dst_len,
+                        size_t *out_len);
+
+/*
+ * Init parser from a checkpoint; the input must be pushed starting at
+ * the checkpoint offset.
+ */
+ptpgp_err_t
+ptpgp_armor_parser_restore(ptpgp_armor_parser_t *p,
+                           u8 *src,
+                           size_t src_len,
+                           ptpgp_armor_parser_cb_t cb,
+                           void *user_data);
@@ -46,6 +46,41 @@ ptpgp_base64_once(bool encode,
                   size_t dst_len,
                   size_t *out_len);
 
+/* size of base64 encoding of num_bytes octets (without line breaks) */
+size_t
+ptpgp_base64_encoded_size(size_t num_bytes);
+
+/*
+ * Get decoded size of base64 input (characters other than base64 digits
+ * are skipped).
+ */
+ptpgp_err_t
+ptpgp_base64_decoded_size(u8 *src,
+                          size_t src_len,
+                          size_t *out_len);
+
+/*
+ * Encode straight into dst, without line breaks (dst_len must be at
+ * least ptpgp_base64_encoded_size(src_len)).
+ */
+ptpgp_err_t
+ptpgp_base64_encode_to(u8 *src,
+                       size_t src_len,
+                       u8 *dst,
+                       size_t dst_len,
+                       size_t *out_len);
+
+/*
+ * Decode straight into dst, skipping whitespace.  The output is never
+ * longer than the input, so dst may be src (decode in place).
+ */
+ptpgp_err_t
+ptpgp_base64_decode_to(u8 *src,
+                       size_t src_len,
+                       u8 *dst,
+                       size_t dst_len,
+                       size_t *out_len);
+
 #define ptpgp_base64_encode(s, sl, d, dl, o) \
   ptpgp_base64_once(1, (s), (sl), (d), (dl), (o))
 
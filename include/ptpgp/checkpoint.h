@@ -0,0 +1,50 @@
+/*
+ * Parser checkpoints.  A checkpoint is a small blob holding the state
+ * of a push parser and the number of input octets it has consumed, so
+ * a long import can save a checkpoint every few megabytes and, after a
+ * crash, restore the parser and continue from the saved offset instead
+ * of reparsing the input from the start.
+ *
+ * Checkpoints contain no pointers (the callback is passed to the
+ * restore function again), so they can be written to disk as-is.  They
+ * must not be saved from within a parser callback.
+ *
+ * checkpoint format (all integers are big-endian):
+ *
+ *   header (32 octets):
+ *     magic        8 octets ("PTPGPCKP")
+ *     version      4 octets
+ *     type         4 octets (ptpgp_checkpoint_type_t)
+ *     offset       8 octets (input octets consumed by the parser)
+ *     length       4 octets (length of state)
+ *     checksum     4 octets (CRC-24 of state)
+ *
+ *   state (parser-specific fields, variable length)
+ */
+
+#define PTPGP_CHECKPOINT_MAGIC                  "PTPGPCKP"
+#define PTPGP_CHECKPOINT_VERSION                1
+#define PTPGP_CHECKPOINT_HEADER_SIZE            32
+
+/* upper bound on the size of any checkpoint */
+#define PTPGP_CHECKPOINT_MAX_SIZE               (8 * 1024)
+
+typedef enum {
+  PTPGP_CHECKPOINT_TYPE_NONE,
+  PTPGP_CHECKPOINT_TYPE_STREAM_PARSER,
+  PTPGP_CHECKPOINT_TYPE_PACKET_PARSER,
+  PTPGP_CHECKPOINT_TYPE_ARMOR_PARSER,
+
+  /* sentinel */
+  PTPGP_CHECKPOINT_TYPE_LAST
+} ptpgp_checkpoint_type_t;
+
+/*
+ * Check checkpoint and get its type and input offset without
+ * restoring it (e.g. to seek the input before restoring the parser).
+ */
+ptpgp_err_t
+ptpgp_checkpoint_get_info(u8 *src,
+                          size_t src_len,
+                          ptpgp_checkpoint_type_t *type,
+                          uint64_t *offset);
@@ -7,3 +7,10 @@ typedef struct {
 ptpgp_err_t ptpgp_crc24_init(ptpgp_crc24_t *);
 ptpgp_err_t ptpgp_crc24_push(ptpgp_crc24_t *, u8 *, size_t);
 ptpgp_err_t ptpgp_crc24_done(ptpgp_crc24_t *);
+
+/*
+ * Get the crc of the concatenation of two inputs from the crcs of the
+ * inputs and the length of the second input (e.g. to merge crcs of
+ * chunks computed in parallel).
+ */
+uint32_t ptpgp_crc24_combine(uint32_t, uint32_t, uint64_t);
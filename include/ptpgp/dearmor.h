@@ -0,0 +1,78 @@
+/*
+ * Dearmor ASCII-armored data in one pass: the armor is parsed, the body
+ * is base64-decoded as the lines are scanned, and the checksum of the
+ * decoded data is verified.  The following tokens are sent to the
+ * callback:
+ *
+ *   START         armor envelope (e.g. "BEGIN PGP PUBLIC KEY BLOCK")
+ *   HEADER_NAME   armor header name
+ *   HEADER_VALUE  armor header value
+ *   DATA          decoded data (in pieces of at most
+ *                 PTPGP_DEARMOR_OUT_BUF_SIZE octets)
+ *   END           end envelope (e.g. "END PGP PUBLIC KEY BLOCK"), sent
+ *                 after the armor checksum (if any) is verified
+ *   DONE          end of input
+ *
+ * The DATA tokens can be pushed straight to a stream parser.  Cleartext
+ * signed messages aren't supported.
+ */
+
+#define PTPGP_DEARMOR_OUT_BUF_SIZE            4096
+
+typedef enum {
+  PTPGP_DEARMOR_TOKEN_START,
+  PTPGP_DEARMOR_TOKEN_HEADER_NAME,
+  PTPGP_DEARMOR_TOKEN_HEADER_VALUE,
+  PTPGP_DEARMOR_TOKEN_DATA,
+  PTPGP_DEARMOR_TOKEN_END,
+  PTPGP_DEARMOR_TOKEN_DONE,
+
+  /* sentinel */
+  PTPGP_DEARMOR_TOKEN_LAST
+} ptpgp_dearmor_token_t;
+
+typedef struct ptpgp_dearmor_t_ ptpgp_dearmor_t;
+
+typedef ptpgp_err_t (*ptpgp_dearmor_cb_t)(ptpgp_dearmor_t *,
+                                          ptpgp_dearmor_token_t,
+                                          u8 *, size_t);
+
+struct ptpgp_dearmor_t_ {
+  ptpgp_err_t last_err;
+
+  ptpgp_armor_parser_t parser;
+
+  /* base64 sextets which haven't been decoded yet */
+  uint32_t bits;
+  size_t num_chars;
+
+  /* got base64 padding (end of body) */
+  bool is_padded;
+
+  /* checksum of decoded data */
+  ptpgp_crc24_t crc24;
+
+  /* checksum from armor (has_crc24 is still set when END is sent if
+   * the checksum was verified) */
+  bool has_crc24;
+  uint32_t armor_crc24;
+
+  u8 out_buf[PTPGP_DEARMOR_OUT_BUF_SIZE];
+  size_t out_buf_len;
+
+  ptpgp_dearmor_cb_t cb;
+  void *user_data;
+};
+
+ptpgp_err_t
+ptpgp_dearmor_init(ptpgp_dearmor_t *d,
+                   ptpgp_dearmor_cb_t cb,
+                   void *user_data);
+
+ptpgp_err_t
+ptpgp_dearmor_push(ptpgp_dearmor_t *d,
+                   u8 *src,
+                   size_t src_len);
+
+ptpgp_err_t
+ptpgp_dearmor_done(ptpgp_dearmor_t *d);
@@ -28,12 +28,14 @@ typedef struct {
     } dsa;
   } params;
 
-  /* output key */
-  ptpgp_pk_key_t key;
+  /* arena for the MPIs of the generated key */
+  ptpgp_arena_t           *arena;
 } ptpgp_pk_genkey_options_t;
 
 struct ptpgp_pk_genkey_context_t_ {
   void                     *engine_data;
+
+  /* generated key (MPIs point into options.arena) */
   ptpgp_pk_key_t            key;
   ptpgp_pk_genkey_options_t options;
 };
@@ -41,3 +43,60 @@ struct ptpgp_pk_genkey_context_t_ {
 ptpgp_err_t
 ptpgp_engine_pk_generate_key(ptpgp_pk_genkey_context_t *, 
                              ptpgp_pk_genkey_options_t *);
+
+/*
+ * Sign and verify digests.  The digest is built up with the hash
+ * context functions (e.g. from the signed data, the hashed signature
+ * fields, and the trailer as a packet is parsed), and is finished by
+ * these functions if it isn't yet.
+ */
+
+/*
+ * Sign digest with secret key; the signature MPIs are stored in the
+ * given arena.
+ */
+ptpgp_err_t
+ptpgp_engine_pk_sign(ptpgp_hash_context_t *digest,
+                     ptpgp_pk_key_t *key,
+                     ptpgp_pk_signature_t *sig,
+                     ptpgp_arena_t *arena);
+
+/*
+ * Verify signature of digest; returns PTPGP_ERR_ENGINE_PK_VERIFY_BAD_SIGNATURE
+ * if the signature doesn't match.
+ */
+ptpgp_err_t
+ptpgp_engine_pk_verify(ptpgp_hash_context_t *digest,
+                       ptpgp_pk_key_t *key,
+                       ptpgp_pk_signature_t *sig);
+
+#define PTPGP_PK_VERIFY_BATCH_MAX_THREADS   256
+
+/* number of jobs claimed by a worker at a time */
+#define PTPGP_PK_VERIFY_BATCH_CHUNK_SIZE    64
+
+typedef struct {
+  ptpgp_hash_context_t *digest;
+  ptpgp_pk_key_t       *key;
+  ptpgp_pk_signature_t *sig;
+
+  /* result (set by ptpgp_engine_pk_verify_batch()) */
+  ptpgp_err_t           err;
+} ptpgp_pk_verify_job_t;
+
+/*
+ * Verify an array of signatures on a pool of num_threads threads
+ * (including the calling thread).  Each thread keeps its own engine
+ * objects for the last key it saw, so jobs should be grouped by key
+ * (key objects are matched by pointer).  Unfinished digests are
+ * finished on the calling thread before the workers start, so jobs
+ * may share a digest.  Jobs whose digest belongs to another engine fail
+ * with PTPGP_ERR_ENGINE_PK_VERIFY_BATCH_ENGINE_MISMATCH.  Returns
+ * PTPGP_OK once all of the jobs have run; the result of each job is
+ * stored in its err field.
+ */
+ptpgp_err_t
+ptpgp_engine_pk_verify_batch(ptpgp_engine_t *engine,
+                             ptpgp_pk_verify_job_t *jobs,
+                             size_t num_jobs,
+                             size_t num_threads);
@@ -29,9 +29,24 @@ typedef struct {
   ptpgp_err_t (*nonce)(ptpgp_engine_t *, u8*, size_t);
 } ptpgp_engine_random_handlers_t;
 
+/* public key handlers (the hash context holds the finished digest) */
 typedef struct {
   ptpgp_err_t (*genkey)(ptpgp_pk_genkey_context_t *);
-  /* TODO: sign and verify */
+  ptpgp_err_t (*sign)(ptpgp_hash_context_t *,
+                      ptpgp_pk_key_t *,
+                      ptpgp_pk_signature_t *,
+                      ptpgp_arena_t *);
+  ptpgp_err_t (*verify)(void *,
+                        ptpgp_hash_context_t *,
+                        ptpgp_pk_key_t *,
+                        ptpgp_pk_signature_t *);
+
+  /*
+   * per-thread verify context (e.g. reusable key objects), passed to
+   * verify (which also accepts a NULL context)
+   */
+  ptpgp_err_t (*verify_init)(ptpgp_engine_t *, void **);
+  void (*verify_done)(void *);
 } ptpgp_engine_pk_handlers_t;
 
 /* forward-reference typedef in engine-structs.h */
@@ -21,6 +21,8 @@ typedef enum {
   PTPGP_ERR_STREAM_PARSER_INVALID_CONTENT_TAG, /* invalid packet content tag */
   PTPGP_ERR_STREAM_PARSER_INVALID_PARTIAL_BODY_LENGTH, /* invalid partial body length */
   PTPGP_ERR_STREAM_PARSER_ALREADY_DONE, /* stream parser already done */
+  PTPGP_ERR_STREAM_PARSER_SKIP_BODY, /* skip packet body (callback result, not an error) */
+  PTPGP_ERR_STREAM_PARSER_BAD_SKIP_LENGTH, /* skip length exceeds packet body */
 
   /* armor parser errors */
   PTPGP_ERR_ARMOR_PARSER_ALREADY_DONE, /* armor parser already done */
@@ -49,6 +51,7 @@ typedef enum {
   PTPGP_ERR_PACKET_PARSER_BAD_MDC_SIZE, /* invalid MDC size */
   PTPGP_ERR_PACKET_PARSER_BAD_PUBLIC_KEY_PACKET, /* bad public key packet */
   PTPGP_ERR_PACKET_PARSER_BAD_SECRET_KEY_CHECKSUM, /* bad secret key checksum */
+  PTPGP_ERR_PACKET_PARSER_KEY_TOO_LARGE, /* public key too large to fingerprint */
 
   /* signature type errors */
   PTPGP_ERR_SIGNATURE_TYPE_UNKNOWN_TYPE, /* unknown signature type */
@@ -130,6 +133,92 @@ typedef enum {
   PTPGP_ERR_ENGINE_PK_GENKEY_CONVERT_MPI_FAILED, /* couldn't convert MPI from engine to native format */
   PTPGP_ERR_ENGINE_PK_GENKEY_INCOMPLETE_KEY_PARAMETER, /* incomplete key parameter in generated key */
   PTPGP_ERR_ENGINE_PK_GENKEY_INCOMPLETE_KEY, /* incomplete generated key */
+  PTPGP_ERR_ENGINE_PK_GENKEY_MISSING_ARENA, /* missing arena for generated key */
+
+  /* engine-pk-sign/verify errors */
+  PTPGP_ERR_ENGINE_PK_UNSUPPORTED_ALGORITHM, /* unsupported public key algorithm */
+  PTPGP_ERR_ENGINE_PK_UNSUPPORTED_HASH, /* unsupported signature hash algorithm */
+  PTPGP_ERR_ENGINE_PK_INCOMPLETE_KEY, /* missing key MPIs */
+  PTPGP_ERR_ENGINE_PK_SIGN_FAILED, /* couldn't sign digest */
+  PTPGP_ERR_ENGINE_PK_VERIFY_FAILED, /* couldn't verify signature */
+  PTPGP_ERR_ENGINE_PK_VERIFY_BAD_SIGNATURE, /* bad signature */
+  PTPGP_ERR_ENGINE_PK_VERIFY_BATCH_BAD_THREAD_COUNT, /* invalid batch verify thread count */
+  PTPGP_ERR_ENGINE_PK_VERIFY_BATCH_ENGINE_MISMATCH, /* digest engine doesn't match batch verify engine */
+
+  /* packet index errors */
+  PTPGP_ERR_PACKET_INDEX_ALREADY_DONE, /* packet index builder already done */
+  PTPGP_ERR_PACKET_INDEX_OPEN_FAILED, /* couldn't open packet index */
+  PTPGP_ERR_PACKET_INDEX_MMAP_FAILED, /* couldn't map packet index */
+  PTPGP_ERR_PACKET_INDEX_BAD_HEADER, /* invalid packet index header */
+  PTPGP_ERR_PACKET_INDEX_BAD_VERSION, /* unsupported packet index version */
+  PTPGP_ERR_PACKET_INDEX_ENTRY_OUT_OF_RANGE, /* packet index entry out of range */
+  PTPGP_ERR_PACKET_INDEX_NOT_FOUND, /* no matching packet index entry */
+
+  /* parallel parser errors */
+  PTPGP_ERR_PARALLEL_PARSER_BAD_THREAD_COUNT, /* invalid parallel parser thread count */
+  PTPGP_ERR_PARALLEL_PARSER_THREAD_FAILED, /* couldn't start parallel parser thread */
+  PTPGP_ERR_PARALLEL_PARSER_NOT_SPLIT, /* parallel parser input not split */
+
+  /* source errors */
+  PTPGP_ERR_SOURCE_NOT_INITIALIZED, /* source not initialized */
+  PTPGP_ERR_SOURCE_OPEN_FAILED, /* couldn't open source */
+  PTPGP_ERR_SOURCE_MMAP_FAILED, /* couldn't map source */
+  PTPGP_ERR_SOURCE_ALLOC_FAILED, /* couldn't allocate source read buffer */
+  PTPGP_ERR_SOURCE_READ_FAILED, /* couldn't read from source */
+  PTPGP_ERR_SOURCE_CLOSE_FAILED, /* couldn't close source */
+
+  /* checkpoint errors */
+  PTPGP_ERR_CHECKPOINT_BUFFER_TOO_SMALL, /* checkpoint buffer too small */
+  PTPGP_ERR_CHECKPOINT_BAD_HEADER, /* invalid checkpoint header */
+  PTPGP_ERR_CHECKPOINT_BAD_VERSION, /* unsupported checkpoint version */
+  PTPGP_ERR_CHECKPOINT_BAD_TYPE, /* checkpoint is for a different parser */
+  PTPGP_ERR_CHECKPOINT_BAD_CHECKSUM, /* checkpoint checksum mismatch */
+  PTPGP_ERR_CHECKPOINT_BAD_STATE, /* invalid or unsupported parser state in checkpoint */
+
+  /* arena errors */
+  PTPGP_ERR_ARENA_ALLOC_FAILED, /* couldn't allocate arena block */
+  PTPGP_ERR_ARENA_FULL, /* arena buffer full */
+
+  /* mpi errors */
+  PTPGP_ERR_MPI_TOO_LARGE, /* MPI too large */
+
+  /* key assembler errors */
+  PTPGP_ERR_KEY_ASSEMBLER_ALREADY_DONE, /* key assembler already done */
+  PTPGP_ERR_KEY_ASSEMBLER_BAD_PACKET_LENGTH, /* invalid key packet length */
+  PTPGP_ERR_KEY_ASSEMBLER_PACKET_TOO_LARGE, /* key packet too large */
+
+  /* key index errors */
+  PTPGP_ERR_KEY_INDEX_ALREADY_DONE, /* key index builder already done */
+  PTPGP_ERR_KEY_INDEX_ALLOC_FAILED, /* couldn't allocate key index */
+  PTPGP_ERR_KEY_INDEX_OPEN_FAILED, /* couldn't open key index */
+  PTPGP_ERR_KEY_INDEX_MMAP_FAILED, /* couldn't map key index */
+  PTPGP_ERR_KEY_INDEX_BAD_HEADER, /* invalid key index header */
+  PTPGP_ERR_KEY_INDEX_BAD_VERSION, /* unsupported key index version */
+  PTPGP_ERR_KEY_INDEX_BAD_ID_LENGTH, /* invalid key ID or fingerprint length */
+  PTPGP_ERR_KEY_INDEX_NOT_FOUND, /* no matching key index entry */
+
+  /* user ID index errors */
+  PTPGP_ERR_USER_ID_INDEX_ALREADY_DONE, /* user ID index builder already done */
+  PTPGP_ERR_USER_ID_INDEX_ALLOC_FAILED, /* couldn't allocate user ID index */
+  PTPGP_ERR_USER_ID_INDEX_TOO_LARGE, /* too many user IDs for user ID index */
+  PTPGP_ERR_USER_ID_INDEX_OPEN_FAILED, /* couldn't open user ID index */
+  PTPGP_ERR_USER_ID_INDEX_MMAP_FAILED, /* couldn't map user ID index */
+  PTPGP_ERR_USER_ID_INDEX_BAD_HEADER, /* invalid user ID index header */
+  PTPGP_ERR_USER_ID_INDEX_BAD_VERSION, /* unsupported user ID index version */
+  PTPGP_ERR_USER_ID_INDEX_BAD_ENTRY, /* invalid user ID index entry */
+  PTPGP_ERR_USER_ID_INDEX_NOT_FOUND, /* no matching user ID index entry */
+  PTPGP_ERR_USER_ID_INDEX_ALREADY_STARTED, /* user ID index builder already started */
+
+  /* hkp errors */
+  PTPGP_ERR_HKP_ALREADY_DONE, /* HKP request handler already done */
+  PTPGP_ERR_HKP_BAD_KEY_OFFSET, /* key offset outside of keyring */
+  PTPGP_ERR_HKP_LINE_TOO_LONG, /* HKP response line too long */
+
+  /* dearmor errors */
+  PTPGP_ERR_DEARMOR_BAD_BASE64, /* invalid base64 data in armor body */
+  PTPGP_ERR_DEARMOR_BAD_CRC24, /* invalid armor checksum */
+  PTPGP_ERR_DEARMOR_CRC24_MISMATCH, /* armor checksum mismatch */
+  PTPGP_ERR_DEARMOR_CLEARTEXT_MESSAGE, /* can't dearmor cleartext signed message */
 
   /* sentinel */
   PTPGP_ERR_LAST
@@ -0,0 +1,144 @@
+/*
+ * HKP request handler (draft-shaw-openpgp-hkp-00).  Takes the request
+ * target of a lookup request (e.g. "/pks/lookup?op=get&search=0x1234ABCD"),
+ * answers it from a keyring and its key and user ID indexes, and
+ * streams the response to the callback:
+ *
+ *   START  sent once, with the response content type (the HTTP status
+ *          is in the status member)
+ *   BODY   response body (sent in pieces of at most
+ *          PTPGP_HKP_OUT_BUF_SIZE octets)
+ *   END    end of response
+ *
+ * Searches starting with "0x" are looked up in the key index (short
+ * key ID, key ID, or v4 fingerprint); other searches are looked up in
+ * the user ID index.
+ */
+
+/* longest search string (after percent-decoding) */
+#define PTPGP_HKP_SEARCH_SIZE               256
+
+/* most keys returned for one request */
+#define PTPGP_HKP_MAX_KEYS                  64
+
+/* size of response buffer */
+#define PTPGP_HKP_OUT_BUF_SIZE              4096
+
+/* HKP request path */
+#define PTPGP_HKP_PATH                      "/pks/lookup"
+
+typedef enum {
+  PTPGP_HKP_OP_NONE,
+  PTPGP_HKP_OP_GET,
+  PTPGP_HKP_OP_INDEX,
+  PTPGP_HKP_OP_VINDEX,
+  PTPGP_HKP_OP_UNKNOWN,
+
+  /* sentinel */
+  PTPGP_HKP_OP_LAST
+} ptpgp_hkp_op_t;
+
+/* request options */
+#define PTPGP_HKP_OPTION_MR                 (1 << 0)
+#define PTPGP_HKP_OPTION_NM                 (1 << 1)
+
+typedef struct {
+  ptpgp_hkp_op_t op;
+
+  /* search string (percent-decoded) */
+  u8 search[PTPGP_HKP_SEARCH_SIZE];
+  size_t search_len;
+  bool has_search;
+
+  /* PTPGP_HKP_OPTION_* */
+  uint32_t options;
+
+  /* fingerprint=on, exact=on */
+  bool fingerprint,
+       exact;
+} ptpgp_hkp_request_t;
+
+typedef enum {
+  PTPGP_HKP_TOKEN_START,
+  PTPGP_HKP_TOKEN_BODY,
+  PTPGP_HKP_TOKEN_END,
+
+  /* sentinel */
+  PTPGP_HKP_TOKEN_LAST
+} ptpgp_hkp_token_t;
+
+typedef struct ptpgp_hkp_t_ ptpgp_hkp_t;
+
+typedef ptpgp_err_t (*ptpgp_hkp_cb_t)(ptpgp_hkp_t *,
+                                      ptpgp_hkp_token_t,
+                                      u8 *, size_t);
+
+struct ptpgp_hkp_t_ {
+  ptpgp_err_t last_err;
+  bool is_done;
+
+  ptpgp_uri_parser_t uri;
+
+  /* parsed request */
+  bool is_lookup;
+  ptpgp_hkp_request_t request;
+
+  /* HTTP status of response */
+  int status;
+
+  /* keyring and indexes (either index may be NULL) */
+  u8 *keyring;
+  size_t keyring_len;
+  ptpgp_key_index_t *key_index;
+  ptpgp_user_id_index_t *user_id_index;
+
+  /* engine for key fingerprints (optional) */
+  ptpgp_engine_t *engine;
+
+  /* header offsets of matching keys */
+  uint64_t keys[PTPGP_HKP_MAX_KEYS];
+  size_t num_keys;
+
+  /* current key (while writing its public packets) */
+  uint64_t key_offset,
+           key_run_start;
+  bool in_key_run,
+       has_key_end;
+
+  /* response helpers */
+  ptpgp_stream_parser_t stream;
+  ptpgp_armor_encoder_t armor;
+  ptpgp_key_assembler_t assembler;
+
+  /* response buffer */
+  u8 buf[PTPGP_HKP_OUT_BUF_SIZE];
+  size_t buf_len;
+
+  ptpgp_hkp_cb_t cb;
+  void *user_data;
+};
+
+/*
+ * Init HKP request handler.  The keyring is a binary key stream (e.g.
+ * a mapped keyring file) which the indexes were built from.  If engine
+ * is non-NULL, it is used for the key fingerprints in index responses.
+ */
+ptpgp_err_t
+ptpgp_hkp_init(ptpgp_hkp_t *h,
+               u8 *keyring,
+               size_t keyring_len,
+               ptpgp_key_index_t *key_index,
+               ptpgp_user_id_index_t *user_id_index,
+               ptpgp_engine_t *engine,
+               ptpgp_hkp_cb_t cb,
+               void *user_data);
+
+/* push request target to handler */
+ptpgp_err_t
+ptpgp_hkp_push(ptpgp_hkp_t *h,
+               u8 *src,
+               size_t src_len);
+
+/* finish request target, and send response */
+ptpgp_err_t
+ptpgp_hkp_done(ptpgp_hkp_t *h);
@@ -0,0 +1,181 @@
+/*
+ * Transferable public key assembler (rfc4880 11.1).  Groups the packets
+ * of a public key stream into keys: the primary key and its direct
+ * signatures, user IDs and attributes with their certifications, and
+ * subkeys with their binding signatures.
+ *
+ * Everything belonging to a key (including the key itself, the packet
+ * bodies, and the MPIs) is allocated from a per-key arena, so a key is
+ * released all at once with ptpgp_key_free().
+ *
+ * Key and signature packets which can't be parsed (e.g. unknown
+ * versions or algorithms) are kept as packet data, with the parser
+ * error in their err field.  Packets which are too large to keep are
+ * skipped and counted in the key (a primary key which is too large
+ * drops the whole key).
+ */
+
+/* size of per-key arena blocks (most keys fit in one block) */
+#define PTPGP_KEY_ASSEMBLER_BLOCK_SIZE      8192
+
+/* largest packet body (e.g. a photo attribute) */
+#define PTPGP_KEY_ASSEMBLER_MAX_PACKET_SIZE (1 << 20)
+
+typedef struct ptpgp_key_signature_t_ ptpgp_key_signature_t;
+
+struct ptpgp_key_signature_t_ {
+  ptpgp_key_signature_t *next;
+
+  u8 version,
+     signature_type,
+     public_key_algorithm,
+     hash_algorithm,
+     left16[2];
+
+  /* v3 fields, or the creation time and issuer subpackets of v4 */
+  uint32_t creation_time;
+  u8 issuer_key_id[8];
+  bool has_issuer_key_id;
+
+  /* signature MPIs (RSA and DSA only) */
+  ptpgp_pk_signature_t sig;
+
+  /* packet body, and result of parsing it */
+  u8 *data;
+  size_t data_len;
+  ptpgp_err_t err;
+};
+
+typedef struct ptpgp_key_public_key_t_ ptpgp_key_public_key_t;
+
+struct ptpgp_key_public_key_t_ {
+  /* next subkey */
+  ptpgp_key_public_key_t *next;
+
+  u8 version;
+  ptpgp_public_key_type_t algorithm;
+  uint32_t creation_time;
+
+  /* key MPIs (RSA and DSA only) */
+  ptpgp_pk_key_t key;
+
+  /* fingerprint (if the assembler has an engine) */
+  ptpgp_key_fingerprint_t fingerprint;
+  bool has_fingerprint;
+
+  /* packet body, and result of parsing it */
+  u8 *data;
+  size_t data_len;
+  ptpgp_err_t err;
+
+  /* direct and revocation signatures (primary key) or binding
+   * signatures (subkeys) */
+  ptpgp_key_signature_t *signatures;
+};
+
+typedef struct ptpgp_key_user_id_t_ ptpgp_key_user_id_t;
+
+struct ptpgp_key_user_id_t_ {
+  ptpgp_key_user_id_t *next;
+
+  /* PTPGP_TAG_USER_ID or PTPGP_TAG_USER_ATTRIBUTE */
+  ptpgp_tag_t tag;
+
+  /* packet body */
+  u8 *data;
+  size_t data_len;
+
+  /* certifications */
+  ptpgp_key_signature_t *signatures;
+};
+
+typedef struct {
+  /* arena holding the key */
+  ptpgp_arena_t arena;
+
+  ptpgp_key_public_key_t primary;
+  ptpgp_key_user_id_t *user_ids;
+  ptpgp_key_public_key_t *subkeys;
+
+  size_t num_user_ids,
+         num_subkeys,
+         num_signatures;
+
+  /* number of packets dropped because they were larger than
+   * PTPGP_KEY_ASSEMBLER_MAX_PACKET_SIZE (with their signatures) */
+  size_t num_oversized_packets;
+} ptpgp_key_t;
+
+/* release key (and everything in it) */
+ptpgp_err_t
+ptpgp_key_free(ptpgp_key_t *key);
+
+typedef struct ptpgp_key_assembler_t_ ptpgp_key_assembler_t;
+
+/*
+ * Called with each assembled key.  The key belongs to the callback,
+ * which releases it with ptpgp_key_free() (now or later).
+ */
+typedef ptpgp_err_t (*ptpgp_key_assembler_cb_t)(ptpgp_key_assembler_t *,
+                                                ptpgp_key_t *);
+
+struct ptpgp_key_assembler_t_ {
+  ptpgp_err_t last_err;
+  bool is_done;
+
+  ptpgp_stream_parser_t stream;
+  ptpgp_packet_parser_t packet;
+
+  /* engine for key fingerprints (optional) */
+  ptpgp_engine_t *engine;
+
+  /* key being assembled */
+  ptpgp_key_t *key;
+
+  /* list tails (where the next entry goes) */
+  ptpgp_key_user_id_t **user_id_tail;
+  ptpgp_key_public_key_t **subkey_tail;
+  ptpgp_key_signature_t **signature_tail;
+
+  /* current packet body */
+  u8 *data;
+  size_t data_len,
+         data_pos;
+
+  /* current key or signature packet, and index of next mpi */
+  ptpgp_key_public_key_t *public_key;
+  ptpgp_key_signature_t *signature;
+  size_t mpi_index;
+
+  /* current signature subpacket (creation time and issuer only) */
+  bool in_hashed_list;
+  ptpgp_signature_subpacket_type_t subpacket_type;
+  u8 subpacket_buf[8];
+  size_t subpacket_len;
+
+  /* number of packets dropped (e.g. before the first public key) */
+  uint64_t num_skipped_packets;
+
+  ptpgp_key_assembler_cb_t cb;
+  void *user_data;
+};
+
+/*
+ * Init key assembler.  If engine is non-NULL, it is used to compute
+ * key fingerprints.
+ */
+ptpgp_err_t
+ptpgp_key_assembler_init(ptpgp_key_assembler_t *a,
+                         ptpgp_engine_t *engine,
+                         ptpgp_key_assembler_cb_t cb,
+                         void *user_data);
+
+/* push packet stream data to assembler */
+ptpgp_err_t
+ptpgp_key_assembler_push(ptpgp_key_assembler_t *a,
+                         u8 *src,
+                         size_t src_len);
+
+/* finish stream and send the last key */
+ptpgp_err_t
+ptpgp_key_assembler_done(ptpgp_key_assembler_t *a);
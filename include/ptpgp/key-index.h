@@ -0,0 +1,152 @@
+/*
+ * key index file format (all integers are big-endian):
+ *
+ *   header (32 octets):
+ *     magic        8 octets ("PTPGPKID")
+ *     version      4 octets
+ *     slot size    4 octets
+ *     num slots    8 octets (a power of two)
+ *     num entries  8 octets
+ *
+ *   slots (PTPGP_KEY_INDEX_SLOT_SIZE octets each):
+ *     id           20 octets (v4 fingerprint, or v3 key ID in the
+ *                  last 8 octets)
+ *     flags        1 octet (PTPGP_KEY_INDEX_FLAG_*, zero if unused)
+ *     reserved     3 octets
+ *     key ofs      8 octets (header offset of the transferable key)
+ *
+ * The slots are an open-addressing hash table with linear probing,
+ * indexed by the low 32 bits of the key ID (the short key ID), so
+ * lookups by fingerprint, key ID, or short key ID all start at the
+ * same slot.  The table is at most half full.
+ */
+
+#define PTPGP_KEY_INDEX_MAGIC                   "PTPGPKID"
+#define PTPGP_KEY_INDEX_VERSION                 1
+#define PTPGP_KEY_INDEX_HEADER_SIZE             32
+#define PTPGP_KEY_INDEX_SLOT_SIZE               32
+
+/* minimum number of slots */
+#define PTPGP_KEY_INDEX_MIN_SLOTS               16
+
+/* buffered start of v3 key packets (holds an 8192-bit modulus) */
+#define PTPGP_KEY_INDEX_V3_BUFFER_SIZE          1034
+
+/* slot flags */
+#define PTPGP_KEY_INDEX_FLAG_USED               (1 << 0)
+#define PTPGP_KEY_INDEX_FLAG_SUBKEY             (1 << 1)
+#define PTPGP_KEY_INDEX_FLAG_FINGERPRINT        (1 << 2)
+
+typedef struct {
+  /* v4 fingerprint (if has_fingerprint) */
+  u8 fingerprint[20];
+  bool has_fingerprint;
+
+  u8 key_id[8];
+  bool is_subkey;
+
+  /* header offset of transferable key (primary key packet) */
+  uint64_t key_offset;
+} ptpgp_key_index_entry_t;
+
+typedef struct ptpgp_key_index_builder_t_ ptpgp_key_index_builder_t;
+
+typedef ptpgp_err_t (*ptpgp_key_index_builder_cb_t)(ptpgp_key_index_builder_t *,
+                                                    u8 *, size_t);
+
+struct ptpgp_key_index_builder_t_ {
+  ptpgp_err_t last_err;
+  bool is_done;
+
+  ptpgp_stream_parser_t parser;
+  ptpgp_engine_t *engine;
+
+  /* current key packet */
+  bool in_key,
+       has_key,
+       is_subkey;
+
+  /* fingerprint of current key packet (hashed from the raw body, or
+   * the buffered start of v3 bodies) */
+  u8 key_version;
+  uint64_t key_len,
+           key_pos;
+  ptpgp_hash_context_t key_hash;
+  u8 key_buf[PTPGP_KEY_INDEX_V3_BUFFER_SIZE];
+  size_t key_buf_len;
+
+  /* header offset of current transferable key */
+  uint64_t key_offset;
+
+  /* number of secret key packets and key packets with unknown
+   * versions (not indexed) */
+  uint64_t num_skipped_keys;
+
+  /* collected slots (written out as a hash table when done) */
+  u8 *slots;
+  uint64_t num_entries,
+           max_entries;
+
+  ptpgp_key_index_builder_cb_t cb;
+  void *user_data;
+};
+
+/*
+ * Init key index builder.  The engine is used to compute key
+ * fingerprints from the packet bodies (so public keys are indexed
+ * whatever their algorithm; secret keys are skipped).  Entries are
+ * collected as the key stream is pushed, and the index is written to
+ * the callback when done.
+ */
+ptpgp_err_t
+ptpgp_key_index_builder_init(ptpgp_key_index_builder_t *b,
+                             ptpgp_engine_t *engine,
+                             ptpgp_key_index_builder_cb_t cb,
+                             void *user_data);
+
+ptpgp_err_t
+ptpgp_key_index_builder_push(ptpgp_key_index_builder_t *b,
+                             u8 *src,
+                             size_t src_len);
+
+ptpgp_err_t
+ptpgp_key_index_builder_done(ptpgp_key_index_builder_t *b);
+
+/* release builder (only needed if it failed or wasn't finished) */
+ptpgp_err_t
+ptpgp_key_index_builder_free(ptpgp_key_index_builder_t *b);
+
+typedef struct {
+  /* mapped index file (if opened with ptpgp_key_index_open()) */
+  void *map;
+  size_t map_len;
+
+  u8 *slots;
+  uint64_t num_slots,
+           num_entries;
+} ptpgp_key_index_t;
+
+ptpgp_err_t
+ptpgp_key_index_load(ptpgp_key_index_t *index,
+                     u8 *src,
+                     size_t src_len);
+
+ptpgp_err_t
+ptpgp_key_index_open(ptpgp_key_index_t *index,
+                     char *path);
+
+ptpgp_err_t
+ptpgp_key_index_close(ptpgp_key_index_t *index);
+
+/*
+ * Find keys by v4 fingerprint (20 octets), key ID (8 octets), or short
+ * key ID (4 octets).  Set *iter to zero before the first call; each
+ * call returns the next matching entry, or
+ * PTPGP_ERR_KEY_INDEX_NOT_FOUND if there are no more matches.
+ */
+ptpgp_err_t
+ptpgp_key_index_find(ptpgp_key_index_t *index,
+                     u8 *id,
+                     size_t id_len,
+                     uint64_t *iter,
+                     ptpgp_key_index_entry_t *entry);
@@ -1,6 +1,25 @@
-#define PTPGP_MPI_BUF_SIZE 8192
+/* largest MPI (in octets); the bit count is a 16-bit value */
+#define PTPGP_MPI_MAX_SIZE 8192
 
+/*
+ * Multiprecision integer (rfc4880 3.2).  Holds a view of the big-endian
+ * magnitude, which is stored elsewhere (e.g. in an arena), so keys stay
+ * small: a 2048-bit RSA key needs about 1 KB instead of 8 KB per MPI.
+ */
 typedef struct {
   size_t num_bits;
-  u8 data[PTPGP_MPI_BUF_SIZE];
+  u8 *data;
 } ptpgp_mpi_t;
+
+/* size of MPI data (in octets) */
+#define PTPGP_MPI_SIZE(m) (((m)->num_bits + 7) / 8)
+
+/*
+ * Init MPI from a big-endian magnitude (leading zero octets are
+ * stripped), copying the data to the given arena.
+ */
+ptpgp_err_t
+ptpgp_mpi_init(ptpgp_mpi_t *m,
+               ptpgp_arena_t *arena,
+               u8 *src,
+               size_t src_len);
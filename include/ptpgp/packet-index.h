@@ -0,0 +1,106 @@
+/*
+ * packet index file format (all integers are big-endian):
+ *
+ *   header (16 octets):
+ *     magic        8 octets ("PTPGPPKI")
+ *     version      4 octets
+ *     entry size   4 octets
+ *
+ *   entries (PTPGP_PACKET_INDEX_ENTRY_SIZE octets each):
+ *     content tag  1 octet
+ *     flags        1 octet (PTPGP_PACKET_FLAG_*)
+ *     reserved     6 octets
+ *     header ofs   8 octets
+ *     body ofs     8 octets
+ *     body length  8 octets
+ *
+ * For partial and indeterminate length packets the body length is the
+ * total span of the packet body in the stream (including any partial
+ * body length octets), so the packet must be re-read with a stream
+ * parser starting at the header offset.
+ */
+
+#define PTPGP_PACKET_INDEX_MAGIC                "PTPGPPKI"
+#define PTPGP_PACKET_INDEX_VERSION              1
+#define PTPGP_PACKET_INDEX_HEADER_SIZE          16
+#define PTPGP_PACKET_INDEX_ENTRY_SIZE           32
+#define PTPGP_PACKET_INDEX_BUILDER_BUFFER_SIZE  \
+  (128 * PTPGP_PACKET_INDEX_ENTRY_SIZE)
+
+typedef struct {
+  ptpgp_tag_t tag;
+  uint32_t flags;
+
+  uint64_t header_offset,
+           body_offset,
+           body_length;
+} ptpgp_packet_index_entry_t;
+
+typedef struct ptpgp_packet_index_builder_t_ ptpgp_packet_index_builder_t;
+
+typedef ptpgp_err_t (*ptpgp_packet_index_builder_cb_t)(ptpgp_packet_index_builder_t *,
+                                                       u8 *, size_t);
+
+struct ptpgp_packet_index_builder_t_ {
+  ptpgp_err_t last_err;
+  bool is_done;
+
+  ptpgp_stream_parser_t parser;
+
+  /* entry for current packet */
+  ptpgp_packet_index_entry_t entry;
+
+  /* number of entries written */
+  uint64_t num_entries;
+
+  u8 buf[PTPGP_PACKET_INDEX_BUILDER_BUFFER_SIZE];
+  size_t buf_len;
+
+  ptpgp_packet_index_builder_cb_t cb;
+  void *user_data;
+};
+
+ptpgp_err_t
+ptpgp_packet_index_builder_init(ptpgp_packet_index_builder_t *b,
+                                ptpgp_packet_index_builder_cb_t cb,
+                                void *user_data);
+
+ptpgp_err_t
+ptpgp_packet_index_builder_push(ptpgp_packet_index_builder_t *b,
+                                u8 *src,
+                                size_t src_len);
+
+ptpgp_err_t
+ptpgp_packet_index_builder_done(ptpgp_packet_index_builder_t *b);
+
+typedef struct {
+  /* mapped index file (if opened with ptpgp_packet_index_open()) */
+  void *map;
+  size_t map_len;
+
+  u8 *entries;
+  uint64_t num_entries;
+} ptpgp_packet_index_t;
+
+ptpgp_err_t
+ptpgp_packet_index_load(ptpgp_packet_index_t *index,
+                        u8 *src,
+                        size_t src_len);
+
+ptpgp_err_t
+ptpgp_packet_index_open(ptpgp_packet_index_t *index,
+                        char *path);
+
+ptpgp_err_t
+ptpgp_packet_index_close(ptpgp_packet_index_t *index);
+
+ptpgp_err_t
+ptpgp_packet_index_get(ptpgp_packet_index_t *index,
+                       uint64_t n,
+                       ptpgp_packet_index_entry_t *entry);
+
+ptpgp_err_t
+ptpgp_packet_index_find_tag(ptpgp_packet_index_t *index,
+                            ptpgp_tag_t tag,
+                            uint64_t start,
+                            uint64_t *n);
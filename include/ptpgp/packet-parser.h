@@ -1,5 +1,8 @@
 #define PTPGP_PACKET_PARSER_BUFFER_SIZE 1024
 
+/* largest public part of a secret key which can be fingerprinted */
+#define PTPGP_PACKET_PARSER_KEY_BUFFER_SIZE 4096
+
 typedef enum {
   PTPGP_PACKET_PARSER_TOKEN_PACKET_START,
   PTPGP_PACKET_PARSER_TOKEN_PACKET_END,
@@ -36,10 +39,22 @@ typedef enum {
   PTPGP_PACKET_PARSER_TOKEN_SECRET_KEY_PACKET_HEADER,
   PTPGP_PACKET_PARSER_TOKEN_SECRET_KEY_PACKET_CHECKSUM,
 
+  PTPGP_PACKET_PARSER_TOKEN_KEY_FINGERPRINT,
+
   /* sentinel */
   PTPGP_PACKET_PARSER_TOKEN_LAST
 } ptpgp_packet_parser_token_t;
 
+/* key fingerprint and key id (rfc4880 12.2) */
+typedef struct {
+  u8 version,
+     fingerprint[20],
+     key_id[8];
+
+  /* 16 (MD5) for v3 keys, 20 (SHA-1) for v4 keys */
+  size_t fingerprint_len;
+} ptpgp_key_fingerprint_t;
+
 typedef struct ptpgp_packet_parser_t_ ptpgp_packet_parser_t;
 
 typedef ptpgp_err_t (*ptpgp_packet_parser_cb_t)(ptpgp_packet_parser_t *,
@@ -96,6 +111,27 @@ struct ptpgp_packet_parser_t_ {
 
   ptpgp_signature_subpacket_header_t subpacket_header;
 
+  /* number of packet body octets consumed */
+  uint64_t offset;
+
+  /* arena for collected mpis (optional) and current mpi */
+  ptpgp_arena_t *mpi_arena;
+  ptpgp_mpi_t mpi;
+
+  /* key fingerprint (optional) */
+  ptpgp_engine_t *key_engine;
+  uint64_t key_body_len;
+  ptpgp_hash_context_t key_hash;
+  ptpgp_key_fingerprint_t key_fingerprint;
+
+  /* buffered public part of secret key */
+  u8 key_buf[PTPGP_PACKET_PARSER_KEY_BUFFER_SIZE];
+  size_t key_buf_len;
+
+  /* signature hash (optional, caller-owned) */
+  ptpgp_hash_context_t *sig_hash;
+  uint32_t sig_hashed_len;
+
   ptpgp_packet_parser_cb_t cb;
   void *user_data;
 };
@@ -105,9 +141,74 @@ ptpgp_packet_parser_init(ptpgp_packet_parser_t *p,
                          ptpgp_tag_t tag,
                          ptpgp_packet_parser_cb_t cb,
                          void *user_data);
+/*
+ * Collect MPIs in the given arena: MPI_BODY fragments are still sent,
+ * and MPI_END is sent with the complete MPI (a ptpgp_mpi_t) instead of
+ * no data.  The arena is not saved in checkpoints, and a checkpoint
+ * can't be saved in the middle of a collected MPI.
+ */
+ptpgp_err_t
+ptpgp_packet_parser_set_mpi_arena(ptpgp_packet_parser_t *p,
+                                  ptpgp_arena_t *arena);
+
+/*
+ * Compute the fingerprint and key id of key packets while they are
+ * parsed, and send them (a ptpgp_key_fingerprint_t) with a
+ * KEY_FINGERPRINT token after the public key MPIs.  body_len is the
+ * packet body length from the packet header; it prefixes the hashed
+ * v4 public key.
+ *
+ * Key material with an unknown layout (e.g. ECDH, ECDSA, and EdDSA
+ * keys) is sent as KEY_DATA; v4 public keys of this kind are hashed
+ * whole, and their fingerprint is sent before PACKET_END.
+ */
+ptpgp_err_t
+ptpgp_packet_parser_set_key_fingerprint(ptpgp_packet_parser_t *p,
+                                        ptpgp_engine_t *engine,
+                                        uint64_t body_len);
+
+/*
+ * Feed the hashed portion of signature packets into the given hash
+ * context as they are parsed: the signature type and creation time of
+ * v3 signatures, or the hashed fields and subpackets of v4 signatures
+ * followed by the trailer (rfc4880 5.2.4).
+ *
+ * The caller initializes the hash and feeds it the signed data first;
+ * this can be done by the PACKET_START callback, once the hash
+ * algorithm is known (clearing the hash there skips the packet).  The
+ * hash is complete by the first MPI_START token (v3) or the
+ * SIGNATURE_SUBPACKET_HASHED_LIST_END token (v4), and the caller
+ * finishes it.
+ */
+ptpgp_err_t
+ptpgp_packet_parser_set_signature_hash(ptpgp_packet_parser_t *p,
+                                       ptpgp_hash_context_t *hash);
+
 ptpgp_err_t
 ptpgp_packet_parser_push(ptpgp_packet_parser_t *p, 
                          u8 *src,
                          size_t src_len);
 ptpgp_err_t
 ptpgp_packet_parser_done(ptpgp_packet_parser_t *p);
+
+/*
+ * Save parser state to a checkpoint (see checkpoint.h); sets out_len
+ * to the size of the checkpoint.  The checkpoint offset is the number
+ * of packet body octets consumed.
+ */
+ptpgp_err_t
+ptpgp_packet_parser_save(ptpgp_packet_parser_t *p,
+                         u8 *dst,
+                         size_t dst_len,
+                         size_t *out_len);
+
+/*
+ * Init parser from a checkpoint; the packet body must be pushed
+ * starting at the checkpoint offset.
+ */
+ptpgp_err_t
+ptpgp_packet_parser_restore(ptpgp_packet_parser_t *p,
+                            u8 *src,
+                            size_t src_len,
+                            ptpgp_packet_parser_cb_t cb,
+                            void *user_data);
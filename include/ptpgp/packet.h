@@ -73,13 +73,17 @@ typedef struct {
 typedef struct {
   ptpgp_compression_type_t              compression_algorithm;
   u8                                   *data;
-  size_t                                data_len;
+
+  /* number of packet data octets read (including current chunk) */
+  uint64_t                              data_len;
 } ptpgp_packet_compressed_data_t;
 
 /* symmetrically encrypted data packet (tag 9, rfc4880 5.7) */
 typedef struct {
   u8                                   *data;
-  size_t                                data_len;
+
+  /* number of packet data octets read (including current chunk) */
+  uint64_t                              data_len;
 } ptpgp_packet_symmetrically_encrypted_data_t;
 
 /* literal data packet (tag 11, rfc4880 5.9) */
@@ -92,14 +96,18 @@ typedef struct {
   uint32_t                              date;
 
   u8                                   *data;
-  size_t                                data_len;
+
+  /* number of literal data octets read (including current chunk) */
+  uint64_t                              data_len;
 } ptpgp_packet_literal_data_t;
 
 /* sym encrypted integrity protected data packet (tag 18, rfc4880 5.13) */
 typedef struct {
   u8                                    version,
                                        *data;
-  size_t                                data_len;
+
+  /* number of packet data octets read (including current chunk) */
+  uint64_t                              data_len;
 } ptpgp_packet_sym_encrypted_integrity_protected_data_t;
 
 typedef struct {
@@ -0,0 +1,94 @@
+/*
+ * Parallel parse driver for large in-memory (usually mmap()ed) packet
+ * streams.  The input is split at packet boundaries, either with a
+ * header-only pre-scan or from a packet index, and each chunk is run
+ * through its own stream parser on a pool of worker threads.  Chunk
+ * results are handed back to the calling thread in stream order.
+ */
+
+#define PTPGP_PARALLEL_PARSER_MAX_THREADS         256
+#define PTPGP_PARALLEL_PARSER_MAX_CHUNKS          1024
+
+/* number of chunks per worker thread (for load balancing) */
+#define PTPGP_PARALLEL_PARSER_CHUNKS_PER_THREAD   4
+
+typedef struct ptpgp_parallel_parser_t_ ptpgp_parallel_parser_t;
+
+typedef struct {
+  /* parent parallel parser */
+  ptpgp_parallel_parser_t *parser;
+
+  /* chunk number (in stream order) */
+  size_t index;
+
+  /* stream offset and length of chunk */
+  uint64_t offset;
+  size_t len;
+
+  /* chunk result */
+  ptpgp_err_t err;
+
+  /* per-chunk data (e.g. a packet parser and results) */
+  void *user_data;
+} ptpgp_parallel_parser_chunk_t;
+
+/*
+ * chunk callbacks: chunk_cb is called on the worker thread before the
+ * chunk is parsed, and merge_cb is called on the calling thread, in
+ * stream order, once the chunk is finished.
+ */
+typedef ptpgp_err_t (*ptpgp_parallel_parser_chunk_cb_t)(ptpgp_parallel_parser_chunk_t *);
+
+struct ptpgp_parallel_parser_t_ {
+  ptpgp_err_t last_err;
+
+  /* input buffer */
+  u8 *src;
+  size_t src_len;
+
+  /* number of worker threads */
+  size_t num_threads;
+
+  /* chunk list */
+  ptpgp_parallel_parser_chunk_t chunks[PTPGP_PARALLEL_PARSER_MAX_CHUNKS];
+  size_t num_chunks;
+
+  /*
+   * callback members (the stream parser callback is called on the
+   * worker threads, with cb_data set to the current chunk)
+   */
+  ptpgp_parallel_parser_chunk_cb_t chunk_cb,
+                                   merge_cb;
+  ptpgp_stream_parser_cb_t cb;
+  void *user_data;
+};
+
+ptpgp_err_t
+ptpgp_parallel_parser_init(ptpgp_parallel_parser_t *p,
+                           size_t num_threads,
+                           ptpgp_parallel_parser_chunk_cb_t chunk_cb,
+                           ptpgp_stream_parser_cb_t cb,
+                           ptpgp_parallel_parser_chunk_cb_t merge_cb,
+                           void *user_data);
+
+/*
+ * Split input with a header-only pre-scan.  If split_tag is non-zero,
+ * chunks only start at packets with the given tag (e.g.
+ * PTPGP_TAG_PUBLIC_KEY, to keep transferable keys in one chunk).
+ */
+ptpgp_err_t
+ptpgp_parallel_parser_split(ptpgp_parallel_parser_t *p,
+                            u8 *src,
+                            size_t src_len,
+                            ptpgp_tag_t split_tag);
+
+/* split input using a packet index of the input */
+ptpgp_err_t
+ptpgp_parallel_parser_split_index(ptpgp_parallel_parser_t *p,
+                                  u8 *src,
+                                  size_t src_len,
+                                  ptpgp_packet_index_t *index,
+                                  ptpgp_tag_t split_tag);
+
+ptpgp_err_t
+ptpgp_parallel_parser_run(ptpgp_parallel_parser_t *p);
@@ -1,3 +1,9 @@
+/*
+ * Public key (MPIs are views into caller-owned storage, see mpi.h).
+ * RSA primes are in OpenSSL order (p > q, iqmp = q^-1 mod p), so the
+ * p, q, and u of an RFC 4880 secret key go to q, p, and iqmp.  Unset
+ * MPIs have no data.
+ */
 typedef union {
   ptpgp_public_key_type_t algorithm;
 
@@ -21,7 +27,12 @@ typedef union {
 
   struct {
     ptpgp_public_key_type_t algorithm;
-    /* TODO */
+
+    ptpgp_mpi_t p,    /* prime */
+                q,    /* group order */
+                g,    /* group generator */
+                y,    /* public key (g^x mod p) */
+                x;    /* secret exponent */
   } dsa;
 
   struct {
@@ -29,3 +40,18 @@ typedef union {
     /* TODO */
   } dh;
 } ptpgp_pk_key_t;
+
+/* public key signature (rfc4880 5.2.2) */
+typedef union {
+  ptpgp_public_key_type_t algorithm;
+
+  struct {
+    ptpgp_public_key_type_t algorithm;
+    ptpgp_mpi_t s;    /* m^d mod n */
+  } rsa;
+
+  struct {
+    ptpgp_public_key_type_t algorithm;
+    ptpgp_mpi_t r, s;
+  } dsa;
+} ptpgp_pk_signature_t;
@@ -23,6 +23,7 @@ extern "C" {
 #include <ptpgp/tag.h>
 #include <ptpgp/type.h>
 #include <ptpgp/key-flag.h>
+#include <ptpgp/arena.h>
 #include <ptpgp/mpi.h>
 #include <ptpgp/pk-key.h>
 
@@ -41,14 +42,23 @@ extern "C" {
 
 #include <ptpgp/packet-header.h>
 #include <ptpgp/uri-parser.h>
+#include <ptpgp/checkpoint.h>
 #include <ptpgp/stream-parser.h>
+#include <ptpgp/packet-index.h>
+#include <ptpgp/parallel-parser.h>
 #include <ptpgp/armor-parser.h>
 #include <ptpgp/armor-encoder.h>
+#include <ptpgp/dearmor.h>
+#include <ptpgp/source.h>
 #include <ptpgp/signature-type.h>
 #include <ptpgp/packet.h>
 #include <ptpgp/signature-subpacket.h>
 #include <ptpgp/signature-subpacket-parser.h>
 #include <ptpgp/packet-parser.h>
+#include <ptpgp/key-assembler.h>
+#include <ptpgp/key-index.h>
+#include <ptpgp/user-id-index.h>
+#include <ptpgp/hkp.h>
 
 #ifdef __cplusplus
 };
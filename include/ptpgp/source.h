@@ -0,0 +1,128 @@
+/*
+ * Input sources.  A source hands out its contents as a sequence of
+ * buffers which can be pushed directly into any of the push parsers:
+ * memory and mmap() sources pass pointers into the caller's buffer or
+ * the mapped pages, and fd sources read into a large, page-aligned
+ * buffer (for pipes and standard input).
+ */
+
+/* default size of mapped windows passed to callbacks */
+#define PTPGP_SOURCE_DEFAULT_READAHEAD    (4 * 1024 * 1024)
+
+/* size of read buffer for fd sources */
+#define PTPGP_SOURCE_READ_BUFFER_SIZE     (1024 * 1024)
+
+typedef enum {
+  PTPGP_SOURCE_TYPE_NONE,
+  PTPGP_SOURCE_TYPE_MEMORY,
+  PTPGP_SOURCE_TYPE_MMAP,
+  PTPGP_SOURCE_TYPE_FD,
+  PTPGP_SOURCE_TYPE_LAST
+} ptpgp_source_type_t;
+
+typedef struct ptpgp_source_t_ ptpgp_source_t;
+
+typedef ptpgp_err_t (*ptpgp_source_cb_t)(ptpgp_source_t *, u8 *, size_t);
+
+struct ptpgp_source_t_ {
+  ptpgp_err_t last_err;
+  ptpgp_source_type_t type;
+
+  /* file descriptor (mmap and fd sources) */
+  int fd;
+  bool close_fd;
+
+  /* source data (memory and mmap sources) */
+  u8 *data;
+  uint64_t data_len;
+
+  /* read buffer (fd sources) */
+  u8 *buf;
+  size_t buf_size;
+
+  /* number of octets handed out */
+  uint64_t offset;
+
+  /*
+   * size of mapped windows; the next window is prefetched while the
+   * current one is parsed (zero: hand out the whole mapping at once)
+   */
+  size_t readahead;
+
+  /* callback members */
+  void *user_data;
+};
+
+ptpgp_err_t
+ptpgp_source_init_memory(ptpgp_source_t *s,
+                         u8 *src,
+                         size_t src_len);
+
+ptpgp_err_t
+ptpgp_source_init_mmap(ptpgp_source_t *s,
+                       int fd);
+
+ptpgp_err_t
+ptpgp_source_init_fd(ptpgp_source_t *s,
+                     int fd);
+
+/*
+ * Open file (or standard input if path is "-"), and map it if
+ * possible; falls back to reads otherwise.
+ */
+ptpgp_err_t
+ptpgp_source_init_file(ptpgp_source_t *s,
+                       char *path);
+
+ptpgp_err_t
+ptpgp_source_set_readahead(ptpgp_source_t *s,
+                           size_t readahead);
+
+/*
+ * Get next buffer from source.  Sets dst_len to zero at the end of
+ * the source.  The buffer is valid until the next call.
+ */
+ptpgp_err_t
+ptpgp_source_next(ptpgp_source_t *s,
+                  u8 **dst,
+                  size_t *dst_len);
+
+/*
+ * Skip up to len octets of the source without reading them (mapped
+ * sources just advance their offset, seekable fd sources seek).  Sets
+ * skip_len to the number of octets skipped, which is zero for pipes.
+ */
+ptpgp_err_t
+ptpgp_source_skip(ptpgp_source_t *s,
+                  uint64_t len,
+                  uint64_t *skip_len);
+
+/* pass remaining contents of source to callback */
+ptpgp_err_t
+ptpgp_source_read(ptpgp_source_t *s,
+                  ptpgp_source_cb_t cb,
+                  void *user_data);
+
+/*
+ * push remaining contents of source to a parser (note: the parser is
+ * not finished, so several sources can be concatenated); bodies skipped
+ * by the stream parser callback are skipped in the source as well
+ */
+ptpgp_err_t
+ptpgp_source_push_stream_parser(ptpgp_source_t *s,
+                                ptpgp_stream_parser_t *p);
+
+ptpgp_err_t
+ptpgp_source_push_armor_parser(ptpgp_source_t *s,
+                               ptpgp_armor_parser_t *p);
+
+ptpgp_err_t
+ptpgp_source_push_dearmor(ptpgp_source_t *s,
+                          ptpgp_dearmor_t *d);
+
+ptpgp_err_t
+ptpgp_source_push_base64(ptpgp_source_t *s,
+                         ptpgp_base64_t *p);
+
+ptpgp_err_t
+ptpgp_source_close(ptpgp_source_t *s);
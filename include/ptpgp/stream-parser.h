@@ -1,10 +1,53 @@
+#ifdef PTPGP_STREAM_PARSER_COMPACT
+/* 
+ * Compact parser (for applications with many concurrent parsers).
+ * Parser states nest at most two deep (body and partial body length),
+ * and the parser buffers at most eleven octets (a five-octet length,
+ * or the start of a packet which is checked when resynchronizing).
+ * Only truncated packets of up to 16 octets are rescanned when
+ * resynchronizing.
+ *
+ * Note: the library and the application must be built with the same
+ * setting, since it changes the size of ptpgp_stream_parser_t.
+ */
+#define PTPGP_STREAM_PARSER_STATE_STACK_DEPTH        4
+#define PTPGP_STREAM_PARSER_BUFFER_SIZE              11
+#define PTPGP_STREAM_PARSER_RESCAN_BUFFER_SIZE       16
+#else /* !PTPGP_STREAM_PARSER_COMPACT */
 #define PTPGP_STREAM_PARSER_STATE_STACK_DEPTH        1024
 #define PTPGP_STREAM_PARSER_BUFFER_SIZE              4096
 
+/* truncated packets up to the largest plausible non-data packet (and
+ * its header) are rescanned when resynchronizing */
+#define PTPGP_STREAM_PARSER_RESCAN_BUFFER_SIZE \
+  (PTPGP_STREAM_PARSER_RESYNC_MAX_LENGTH + 6)
+#endif /* PTPGP_STREAM_PARSER_COMPACT */
+
+/*
+ * Largest plausible body length of packets other than data packets and
+ * user attributes when resynchronizing (see
+ * ptpgp_stream_parser_set_resync()); longer packets are treated as
+ * corrupt, even after a valid packet.
+ */
+#define PTPGP_STREAM_PARSER_RESYNC_MAX_LENGTH        (64 * 1024)
+
+/* largest plausible user attribute (e.g. photo ID) body length */
+#define PTPGP_STREAM_PARSER_RESYNC_MAX_ATTRIBUTE_LENGTH (16 * 1024 * 1024)
+
+/*
+ * largest plausible body length of data packets with a definite length
+ * (larger data is usually sent with partial lengths)
+ */
+#define PTPGP_STREAM_PARSER_RESYNC_MAX_DATA_LENGTH  (16 * 1024 * 1024)
+
 typedef enum {
   PTPGP_STREAM_PARSER_TOKEN_START,
   PTPGP_STREAM_PARSER_TOKEN_BODY,
   PTPGP_STREAM_PARSER_TOKEN_END,
+
+  /* corrupt octets skipped while resynchronizing */
+  PTPGP_STREAM_PARSER_TOKEN_CORRUPT,
+
   PTPGP_STREAM_PARSER_TOKEN_LAST
 } ptpgp_stream_parser_token_t;
 
@@ -20,6 +63,7 @@ typedef enum {
   PTPGP_STREAM_PARSER_STATE_OLD_HEADER_AFTER_TAG,
   PTPGP_STREAM_PARSER_STATE_BODY,
   PTPGP_STREAM_PARSER_STATE_PARTIAL_BODY_LENGTH,
+  PTPGP_STREAM_PARSER_STATE_RESYNC,
   PTPGP_STREAM_PARSER_STATE_LAST
 } ptpgp_stream_parser_state_t;
 
@@ -42,10 +86,41 @@ struct ptpgp_stream_parser_t_ {
   /* cache of last packet header */
   ptpgp_packet_header_t header;
 
-  uint32_t partial_body_length;
+  uint64_t partial_body_length;
+
+  /* number of bytes read from the current packet (or number of
+   * octets in the current corrupt region while resynchronizing) */
+  uint64_t bytes_read;
+
+  /* number of octets consumed from the input stream */
+  uint64_t offset;
+
+  /* stream offsets of the current packet header and body */
+  uint64_t header_offset,
+           body_offset;
+
+  /* skip body of current packet (set when the START callback returns
+   * PTPGP_ERR_STREAM_PARSER_SKIP_BODY) */
+  bool skip_body;
+
+  /* mask of delivered content tags (see PTPGP_TAG_MASK()) */
+  uint64_t tags;
+
+  /* current packet is filtered out (no callbacks are sent) */
+  bool is_filtered;
+
+  /* mask of content tags accepted when resynchronizing (zero: fail
+   * on corrupt packet headers instead) */
+  uint64_t resync_tags;
+
+  /* packet header at the front of the input was checked already */
+  bool header_checked;
 
-  /* number of bytes read from the current packet */
-  uint32_t bytes_read;
+  /* octets of the pending packet (or of the carried octets) kept while
+   * resynchronizing, starting at stream offset rescan_offset */
+  u8 rescan_buf[PTPGP_STREAM_PARSER_RESCAN_BUFFER_SIZE];
+  size_t rescan_len;
+  uint64_t rescan_offset;
 
   /* callback members */
   ptpgp_stream_parser_cb_t cb;
@@ -56,9 +131,86 @@ ptpgp_err_t
 ptpgp_stream_parser_init(ptpgp_stream_parser_t *p,
                          ptpgp_stream_parser_cb_t cb,
                          void *cb_data);
+
+/*
+ * Init parser which only delivers packets whose content tags are in
+ * the given mask; other packets are skipped without any callbacks.
+ */
+ptpgp_err_t
+ptpgp_stream_parser_init_tags(ptpgp_stream_parser_t *p,
+                              uint64_t tags,
+                              ptpgp_stream_parser_cb_t cb,
+                              void *cb_data);
+
+/*
+ * Enable recovery from corrupt input.  An invalid or implausible packet
+ * header does not fail the parser: instead the input is scanned for the
+ * next plausible packet header (a content tag in the given mask, a sane
+ * length, and plausible version numbers and algorithms at the start of
+ * the body), and the octets in between are passed to the callback as
+ * CORRUPT tokens.  A corrupt region may be split across several tokens;
+ * the parser offset is the stream offset of the octets in each token.
+ *
+ * Every packet header must have a tag in the mask and a sane length;
+ * the body checks only apply while scanning corrupt data.  A packet
+ * truncated by the end of the input ends with a CORRUPT token at the
+ * offset of its header instead of an END token, and its octets (which
+ * were passed to the callback already) are scanned again for the next
+ * plausible packet header.  Truncated packets longer than
+ * PTPGP_STREAM_PARSER_RESCAN_BUFFER_SIZE octets (or with skipped
+ * octets, or octets pushed before the parser state was restored from a
+ * checkpoint) can't be rescanned and end with an empty CORRUPT token.
+ *
+ * Restricting the mask to the expected tags (e.g. PTPGP_TAG_MASK_KEYS
+ * for key server dumps) makes false matches in corrupt data much less
+ * likely.  A mask of zero disables recovery.
+ */
+ptpgp_err_t
+ptpgp_stream_parser_set_resync(ptpgp_stream_parser_t *p,
+                               uint64_t tags);
+
 ptpgp_err_t
 ptpgp_stream_parser_push(ptpgp_stream_parser_t *p,
                          u8 *src,
                          size_t src_len);
 ptpgp_err_t
 ptpgp_stream_parser_done(ptpgp_stream_parser_t *p);
+
+/*
+ * Get number of skipped body octets which can be dropped from the
+ * input without pushing them to the parser (e.g. by seeking past them).
+ * Returns zero if the current packet body is not being skipped, and
+ * UINT64_MAX for indeterminate length packets.
+ */
+ptpgp_err_t
+ptpgp_stream_parser_get_skip_length(ptpgp_stream_parser_t *p,
+                                    uint64_t *len);
+
+/* drop len octets of the skipped body from the input */
+ptpgp_err_t
+ptpgp_stream_parser_skip(ptpgp_stream_parser_t *p,
+                         uint64_t len);
+
+/*
+ * Save parser state to a checkpoint (see checkpoint.h); sets out_len
+ * to the size of the checkpoint.  The checkpoint offset is the parser
+ * offset, so skipped bodies and corrupt regions are accounted for.
+ */
+ptpgp_err_t
+ptpgp_stream_parser_save(ptpgp_stream_parser_t *p,
+                         u8 *dst,
+                         size_t dst_len,
+                         size_t *out_len);
+
+/*
+ * Init parser from a checkpoint; the input must be pushed starting at
+ * the checkpoint offset.  A checkpoint saved with a different
+ * PTPGP_STREAM_PARSER_COMPACT setting can be restored as long as the
+ * saved state fits in the parser.
+ */
+ptpgp_err_t
+ptpgp_stream_parser_restore(ptpgp_stream_parser_t *p,
+                            u8 *src,
+                            size_t src_len,
+                            ptpgp_stream_parser_cb_t cb,
+                            void *cb_data);
@@ -27,6 +27,22 @@ typedef enum {
   PTPGP_TAG_LAST                                        = 64
 } ptpgp_tag_t;
 
+/* tag bit masks (for packet filters) */
+#define PTPGP_TAG_MASK(t)   (((uint64_t) 1) << (t))
+#define PTPGP_TAG_MASK_ALL  (~((uint64_t) 0))
+
+/* tags of transferable public and secret keys (rfc4880 11.1, 11.2) */
+#define PTPGP_TAG_MASK_KEYS (                                         \
+  PTPGP_TAG_MASK(PTPGP_TAG_SIGNATURE) |                               \
+  PTPGP_TAG_MASK(PTPGP_TAG_SECRET_KEY) |                              \
+  PTPGP_TAG_MASK(PTPGP_TAG_PUBLIC_KEY) |                              \
+  PTPGP_TAG_MASK(PTPGP_TAG_SECRET_SUBKEY) |                           \
+  PTPGP_TAG_MASK(PTPGP_TAG_TRUST) |                                   \
+  PTPGP_TAG_MASK(PTPGP_TAG_USER_ID) |                                 \
+  PTPGP_TAG_MASK(PTPGP_TAG_PUBLIC_SUBKEY) |                           \
+  PTPGP_TAG_MASK(PTPGP_TAG_USER_ATTRIBUTE)                            \
+)
+
 ptpgp_err_t
 ptpgp_tag_to_s(ptpgp_tag_t tag,
                char *buf,
@@ -0,0 +1,194 @@
+/*
+ * user ID index file format (all integers are big-endian):
+ *
+ *   header (48 octets):
+ *     magic          8 octets ("PTPGPUID")
+ *     version        4 octets
+ *     reserved       4 octets
+ *     num user ids   8 octets
+ *     num trigrams   8 octets
+ *     num postings   8 octets
+ *     text size      8 octets
+ *
+ *   user IDs (24 octets each, in stream order):
+ *     key ofs        8 octets (header offset of the transferable key)
+ *     text ofs       8 octets (offset of user ID in text)
+ *     text len       4 octets
+ *     reserved       4 octets
+ *
+ *   trigrams (16 octets each, sorted by trigram):
+ *     trigram        4 octets (3 case-folded octets, top octet zero)
+ *     num postings   4 octets
+ *     postings ofs   8 octets (index of first posting)
+ *
+ *   postings (4 octets each):
+ *     user ID        4 octets (number of user ID, ascending for each
+ *                    trigram)
+ *
+ *   text (user IDs, as found in the key stream)
+ *
+ * User IDs are split into tokens (runs of ASCII letters and digits and
+ * non-ASCII octets, so "Alice <alice@example.com>" has the tokens
+ * "alice", "alice", "example", and "com"), and each trigram of each
+ * token is indexed.  Case folding is ASCII only.
+ */
+
+#define PTPGP_USER_ID_INDEX_MAGIC               "PTPGPUID"
+#define PTPGP_USER_ID_INDEX_VERSION             1
+#define PTPGP_USER_ID_INDEX_HEADER_SIZE         48
+#define PTPGP_USER_ID_INDEX_USER_ID_SIZE        24
+#define PTPGP_USER_ID_INDEX_TRIGRAM_SIZE        16
+#define PTPGP_USER_ID_INDEX_POSTING_SIZE        4
+
+/* longest indexed user ID (longer user IDs are skipped) */
+#define PTPGP_USER_ID_INDEX_MAX_USER_ID_SIZE    2048
+
+typedef struct {
+  /* number of user ID in index */
+  uint64_t num;
+
+  /* header offset of transferable key (primary key packet) */
+  uint64_t key_offset;
+
+  /* user ID (points into the index) */
+  u8 *user_id;
+  size_t user_id_len;
+} ptpgp_user_id_index_entry_t;
+
+typedef struct ptpgp_user_id_index_builder_t_ ptpgp_user_id_index_builder_t;
+
+typedef ptpgp_err_t (*ptpgp_user_id_index_builder_cb_t)(ptpgp_user_id_index_builder_t *,
+                                                        u8 *, size_t);
+
+struct ptpgp_user_id_index_builder_t_ {
+  ptpgp_err_t last_err;
+  bool is_done;
+
+  ptpgp_stream_parser_t parser;
+
+  /* stream offset of the pushed input (see
+   * ptpgp_user_id_index_builder_append()) */
+  uint64_t offset;
+
+  /* header offset of current transferable key */
+  bool has_key;
+  uint64_t key_offset;
+
+  /* current user ID packet */
+  bool in_user_id;
+  u8 buf[PTPGP_USER_ID_INDEX_MAX_USER_ID_SIZE];
+  size_t buf_len;
+
+  /* number of user IDs which weren't indexed (too long, or not part
+   * of a key) */
+  uint64_t num_skipped_user_ids;
+
+  /* collected user ID entries */
+  u8 *user_ids;
+  uint64_t num_user_ids,
+           max_user_ids;
+
+  /* collected user ID text */
+  u8 *text;
+  uint64_t text_len,
+           max_text_len;
+
+  /* collected postings (trigram in the high 32 bits, user ID number in
+   * the low 32 bits; sorted when done) */
+  uint64_t *postings;
+  uint64_t num_postings,
+           max_postings;
+
+  ptpgp_user_id_index_builder_cb_t cb;
+  void *user_data;
+};
+
+/*
+ * Init user ID index builder.  Entries are collected as the key stream
+ * is pushed, and the index is written to the callback when done.  Only
+ * user IDs of public keys are indexed (user IDs of secret keys are
+ * counted as skipped).
+ */
+ptpgp_err_t
+ptpgp_user_id_index_builder_init(ptpgp_user_id_index_builder_t *b,
+                                 ptpgp_user_id_index_builder_cb_t cb,
+                                 void *user_data);
+
+ptpgp_err_t
+ptpgp_user_id_index_builder_push(ptpgp_user_id_index_builder_t *b,
+                                 u8 *src,
+                                 size_t src_len);
+
+ptpgp_err_t
+ptpgp_user_id_index_builder_done(ptpgp_user_id_index_builder_t *b);
+
+/* release builder (only needed if it failed or wasn't finished) */
+ptpgp_err_t
+ptpgp_user_id_index_builder_free(ptpgp_user_id_index_builder_t *b);
+
+typedef struct {
+  /* mapped index file (if opened with ptpgp_user_id_index_open()) */
+  void *map;
+  size_t map_len;
+
+  u8 *user_ids,
+     *trigrams,
+     *postings,
+     *text;
+
+  uint64_t num_user_ids,
+           num_trigrams,
+           num_postings,
+           text_len;
+} ptpgp_user_id_index_t;
+
+ptpgp_err_t
+ptpgp_user_id_index_load(ptpgp_user_id_index_t *index,
+                         u8 *src,
+                         size_t src_len);
+
+ptpgp_err_t
+ptpgp_user_id_index_open(ptpgp_user_id_index_t *index,
+                         char *path);
+
+ptpgp_err_t
+ptpgp_user_id_index_close(ptpgp_user_id_index_t *index);
+
+/* get user ID by number */
+ptpgp_err_t
+ptpgp_user_id_index_get(ptpgp_user_id_index_t *index,
+                        uint64_t num,
+                        ptpgp_user_id_index_entry_t *entry);
+
+/*
+ * Find user IDs which contain the query (case-insensitive), or which
+ * are equal to it (case-insensitive) if exact is set.  Candidates are
+ * taken from the posting list of the rarest trigram in the query (or
+ * from all user IDs if the query has no trigrams), and checked against
+ * the posting lists of the other trigrams before the text is compared.
+ *
+ * Set *iter to zero before the first call; each call returns the next
+ * matching entry, or PTPGP_ERR_USER_ID_INDEX_NOT_FOUND if there are no
+ * more matches.
+ */
+ptpgp_err_t
+ptpgp_user_id_index_find(ptpgp_user_id_index_t *index,
+                         u8 *query,
+                         size_t query_len,
+                         bool exact,
+                         uint64_t *iter,
+                         ptpgp_user_id_index_entry_t *entry);
+
+/*
+ * Start the index with the entries of an existing index, so the index
+ * of a keyring which grew at the end can be updated by pushing only
+ * the new keys, without parsing the rest of the keyring again.  offset
+ * is the keyring offset of the pushed input (usually the keyring size
+ * when the existing index was built); the pushed input must start at
+ * a key.  Call this before pushing any input.
+ */
+ptpgp_err_t
+ptpgp_user_id_index_builder_append(ptpgp_user_id_index_builder_t *b,
+                                   ptpgp_user_id_index_t *index,
+                                   uint64_t offset);
+
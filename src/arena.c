@@ -0,0 +1,130 @@
+#include <stdlib.h> /* for malloc(), free() */
+#include "internal.h"
+
+#define DIE(err) do {                                                 \
+  D("returning error %s", #err);                                      \
+  return PTPGP_ERR_ARENA_##err;                                       \
+} while (0)
+
+#define ALIGN(n) (                                                    \
+  ((n) + PTPGP_ARENA_ALIGN - 1) & ~((size_t) PTPGP_ARENA_ALIGN - 1)   \
+)
+
+struct ptpgp_arena_block_t_ {
+  ptpgp_arena_block_t *next;
+  size_t size;
+};
+
+/* offset of block data (keeps data aligned) */
+#define BLOCK_HEADER_SIZE ALIGN(sizeof(ptpgp_arena_block_t))
+
+#define BLOCK_DATA(b) ((u8*) (b) + BLOCK_HEADER_SIZE)
+
+ptpgp_err_t
+ptpgp_arena_init(ptpgp_arena_t *a,
+                 size_t block_size) {
+  memset(a, 0, sizeof(ptpgp_arena_t));
+  a->block_size = block_size ? block_size : PTPGP_ARENA_DEFAULT_BLOCK_SIZE;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+ptpgp_err_t
+ptpgp_arena_init_buffer(ptpgp_arena_t *a,
+                        u8 *buf,
+                        size_t buf_len) {
+  memset(a, 0, sizeof(ptpgp_arena_t));
+  a->buf = buf;
+  a->buf_len = buf_len;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+static ptpgp_err_t
+add_block(ptpgp_arena_t *a, size_t len) {
+  ptpgp_arena_block_t *b;
+  size_t size = (len > a->block_size) ? len : a->block_size;
+
+  if ((b = malloc(BLOCK_HEADER_SIZE + size)) == NULL)
+    DIE(ALLOC_FAILED);
+
+  b->size = size;
+  b->next = a->blocks;
+  a->blocks = b;
+
+  /* switch to new block */
+  a->buf = BLOCK_DATA(b);
+  a->buf_len = size;
+  a->pos = 0;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+ptpgp_err_t
+ptpgp_arena_alloc(ptpgp_arena_t *a,
+                  size_t len,
+                  void **ptr) {
+  size_t pos = ALIGN(a->pos);
+
+  if (!a->buf || pos > a->buf_len || len > a->buf_len - pos) {
+    if (!a->block_size)
+      DIE(FULL);
+
+    TRY(add_block(a, len));
+    pos = 0;
+  }
+
+  *ptr = a->buf + pos;
+  a->pos = pos + len;
+  a->num_bytes += len;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+ptpgp_err_t
+ptpgp_arena_clear(ptpgp_arena_t *a) {
+  ptpgp_arena_block_t *b;
+
+  if (a->blocks) {
+    /* free all but the most recent block */
+    while ((b = a->blocks->next) != NULL) {
+      a->blocks->next = b->next;
+      free(b);
+    }
+
+    a->buf = BLOCK_DATA(a->blocks);
+    a->buf_len = a->blocks->size;
+  }
+
+  a->pos = 0;
+  a->num_bytes = 0;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+ptpgp_err_t
+ptpgp_arena_free(ptpgp_arena_t *a) {
+  ptpgp_arena_block_t *b;
+
+  while ((b = a->blocks) != NULL) {
+    a->blocks = b->next;
+    free(b);
+  }
+
+  /* caller-owned buffers are left alone */
+  if (a->block_size) {
+    a->buf = NULL;
+    a->buf_len = 0;
+  }
+
+  a->pos = 0;
+  a->num_bytes = 0;
+
+  /* return success */
+  return PTPGP_OK;
+}
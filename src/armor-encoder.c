@@ -73,7 +73,7 @@ ptpgp_armor_encoder_init(ptpgp_armor_encoder_t *p,
   /* begin armor envelope */
   l = snprintf(
     (char*) buf, sizeof(buf),
-    "-----%s-----\r\n",
+    "-----BEGIN %s-----\r\n",
     p->envelope_name
   );
 
@@ -149,12 +149,12 @@ ptpgp_armor_encoder_push(ptpgp_armor_encoder_t *p,
 
     /* append crc to output buffer */
     buf[0] = '=';
-    TRY(ptpgp_base64_encode(crc, 3, buf + 1, 6, 0));
+    TRY(ptpgp_base64_encode_to(crc, 3, buf + 1, 4, 0));
 
     /* add armor envelope footer to buffer */
     l = snprintf(
       (char*) buf + 5, sizeof(buf) - 5,
-      "\r\n-----%s-----\r\n",
+      "\r\n-----END %s-----\r\n",
       p->envelope_name
     ) + 5;
 
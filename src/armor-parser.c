@@ -52,9 +52,88 @@ ptpgp_armor_parser_init(ptpgp_armor_parser_t *p, ptpgp_armor_parser_cb_t cb, voi
   return PTPGP_OK;
 }
 
+/*
+ * Handle header line (including the newline).
+ */
+static ptpgp_err_t
+header_line(ptpgp_armor_parser_t *p, u8 *line, size_t len) {
+  size_t i;
+
+  /* strip newline */
+  len--;
+
+  /* strip whitespace */
+  while (len > 0 && line[len - 1] == '\r')
+    len--;
+
+  if (len == 0) {
+    /* end of headers */
+    p->state = STATE(BODY);
+  } else if (len < 4) {
+    DIE(p, BAD_HEADER_LINE);
+  } else {
+    for (i = 1; i < len - 1; i++) {
+      if (line[i] == ':' && line[i + 1] == ' ') {
+        /* send header */
+        SEND(p, HEADER_NAME, line, i);
+        SEND(p, HEADER_VALUE, line + i + 2, len - i - 2);
+        break;
+      }
+    }
+  }
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+/*
+ * Handle body line in line buffer (including the newline), and clear
+ * the line buffer.
+ */
+static ptpgp_err_t
+body_line(ptpgp_armor_parser_t *p) {
+  u8 *buf = p->buf;
+  size_t len = p->buf_len;
+
+  /* clear buffer */
+  p->buf_len = 0;
+
+  /* strip trailing whitespace characters */
+  while (len > 0 && WS(buf[len - 1]))
+    len--;
+
+  if (len > 1 && buf[0] == '-' && buf[1] == ' ') {
+    /* handle dash escape */
+    buf[1] = '-';
+
+    /* flush buffer */
+    if (len - 1 > 0)
+      SEND(p, BODY, buf + 1, len - 1);
+  } else if (len == 5 && buf[0] == '=') {
+    /* send crc24 (still encoded) */
+    SEND(p, CRC24, buf + 1, 4);
+
+    /* FIXME: should switch state here */
+  } else if (len > 11 &&
+             !memcmp(buf, "-----", 5) &&
+             !memcmp(buf + len - 5, "-----", 5)) {
+    /* handle end envelope */
+    SEND(p, END_ARMOR, buf + 5, len - 10);
+
+    p->state = STATE(INIT);
+  } else if (len > 0) {
+    /* flush buffer */
+    SEND(p, BODY, buf, len);
+  }
+
+  /* return success */
+  return PTPGP_OK;
+}
+
 ptpgp_err_t
 ptpgp_armor_parser_push(ptpgp_armor_parser_t *p, u8 *src, size_t src_len) {
-  size_t i, j;
+  size_t i;
+  u8 *e;
 
   D("src_len = %d", (int) src_len);
 
@@ -80,6 +159,10 @@ ptpgp_armor_parser_push(ptpgp_armor_parser_t *p, u8 *src, size_t src_len) {
   }
 
   D("past done check");
+
+  /* count consumed octets (partial lines are buffered) */
+  p->offset += src_len;
+
 retry:
   if (src_len > 0) {
     switch (p->state) {
@@ -114,16 +197,12 @@ retry:
 
       break;
     case STATE(SKIP_LINE):
-      for (i = 0; i < src_len; i++) {
-        if (src[i] == '\n') {
-          /* D("got newline"); */
-
-          p->buf_len = 0;
-          SHIFT(i + 1);
+      if ((e = memchr(src, '\n', src_len)) != NULL) {
+        p->buf_len = 0;
+        SHIFT(e - src + 1);
 
-          p->state = STATE(INIT);
-          goto retry;
-        }
+        p->state = STATE(INIT);
+        goto retry;
       }
 
       break;
@@ -177,111 +256,79 @@ retry:
 
       break;
     case STATE(HEADERS):
-      for (i = 0; i < src_len; i++) {
-        p->buf[p->buf_len++] = src[i];
+      e = memchr(src, '\n', src_len);
+      i = e ? (size_t) (e - src + 1) : src_len;
 
-        /* check for buffer overflow */
-        if (p->buf_len == PTPGP_ARMOR_PARSER_BUFFER_SIZE - 1)
-          DIE(p, BIG_HEADER_LINE);
+      /* check line length (the same limit applies to lines handled in
+       * place and to buffered lines) */
+      if (p->buf_len + i >= PTPGP_ARMOR_PARSER_BUFFER_SIZE - 1)
+        DIE(p, BIG_HEADER_LINE);
 
-        if (p->buf[p->buf_len - 1] == '\n') {
-          /* strip newline */
-          p->buf_len--;
+      if (e && !p->buf_len) {
+        /* complete line, handle it in place */
+        TRY(header_line(p, src, i));
+        SHIFT(i);
 
-          /* strip whitespace */
-          while (p->buf_len > 0 && p->buf[p->buf_len - 1] == '\r')
-            p->buf_len--;
+        goto retry;
+      }
 
-          if (p->buf_len == 0) {
-            /* end of headers */
-            p->buf_len = 0;
-            SHIFT(i + 1);
+      /* append (rest of) line to buffer */
+      memcpy(p->buf + p->buf_len, src, i);
+      p->buf_len += i;
+      SHIFT(i);
 
-            p->state = STATE(BODY);
-            goto retry;
-          } else if (p->buf_len < 4) {
-            DIE(p, BAD_HEADER_LINE);
-          } else {
-            for (j = 1; j < p->buf_len - 1; j++) {
-              if (p->buf[j] == ':' && p->buf[j + 1] == ' ') {
-                /* send header */
-                SEND(p, HEADER_NAME, p->buf, j);
-                SEND(p, HEADER_VALUE, p->buf + j + 2, p->buf_len - j - 2);
-
-                /* clear buffer */
-                p->buf_len = 0;
-                SHIFT(i + 1);
-
-                goto retry;
-              }
-            }
-          }
-        }
+      if (e) {
+        TRY(header_line(p, p->buf, p->buf_len));
+        p->buf_len = 0;
+
+        goto retry;
       }
 
       break;
     case STATE(BODY):
-      for (i = 0; i < src_len; i++) {
-        p->buf[p->buf_len++] = src[i];
-
-        if (src[i] == '\n') {
-          /* strip trailing whitespace characters */
-          TRIM_WHITESPACE(p);
-
-          if (p->buf_len > 1 && p->buf[0] == '-' && p->buf[1] == ' ') {
-            /* handle dash escape */
-            p->buf[1] = '-';
-
-            /* flush buffer */
-            if (p->buf_len - 1 > 0)
-              SEND(p, BODY, p->buf + 1, p->buf_len - 1);
-
-            p->buf_len = 0;
-            SHIFT(i + 1);
-          } else if (p->buf_len == 5 && p->buf[0] == '=') {
-            /* send crc24 (still encoded) */
-            SEND(p, CRC24, p->buf + 1, 4);
-
-            /* clear buffer */
-            p->buf_len = 0;
-            SHIFT(i + 1);
+      if (!p->buf_len) {
+        /* find run of complete lines which can be passed straight from
+         * the source buffer (lines starting with '-' or '=' might be
+         * dash-escaped, the checksum, or the end envelope, so they go
+         * through the line buffer) */
+        for (i = 0; i < src_len && src[i] != '-' && src[i] != '='; i = e - src + 1)
+          if ((e = memchr(src + i, '\n', src_len - i)) == NULL)
+            break;
+
+        if (i > 0) {
+          SEND(p, BODY, src, i);
+          SHIFT(i);
 
-            /* FIXME: should switch state here */
-
-            goto retry;
-          } else if (p->buf_len > 11 &&
-                     !memcmp(p->buf, "-----", 5) &&
-                     !memcmp(p->buf + p->buf_len - 5, "-----", 5)) {
-            /* handle end envelope */
-            SEND(p, END_ARMOR, p->buf + 5, p->buf_len - 10);
+          goto retry;
+        }
+      }
 
-            p->buf_len = 0;
-            SHIFT(i + 1);
+      /* append (rest of) line to buffer */
+      e = memchr(src, '\n', src_len);
+      i = e ? (size_t) (e - src + 1) : src_len;
 
-            p->state = STATE(INIT);
-            goto retry;
-          } else {
-            /* flush buffer */
-            if (p->buf_len > 0)
-              SEND(p, BODY, p->buf, p->buf_len);
+      if (p->buf_len + i > PTPGP_ARMOR_PARSER_BUFFER_SIZE - 1) {
+        i = PTPGP_ARMOR_PARSER_BUFFER_SIZE - 1 - p->buf_len;
+        e = NULL;
+      }
 
-            p->buf_len = 0;
-            SHIFT(i + 1);
+      memcpy(p->buf + p->buf_len, src, i);
+      p->buf_len += i;
+      SHIFT(i);
 
-            goto retry;
-          }
-        }
+      if (e) {
+        TRY(body_line(p));
+        goto retry;
+      }
 
-        /* check for buffer overflow */
-        if (p->buf_len == PTPGP_ARMOR_PARSER_BUFFER_SIZE - 1) {
-          /* flush buffer */
-          /* (FIXME: this means long lines aren't properly dash-escaped */
-          if (p->buf_len > 0)
-            SEND(p, BODY, p->buf, p->buf_len);
+      /* check for buffer overflow */
+      if (p->buf_len == PTPGP_ARMOR_PARSER_BUFFER_SIZE - 1) {
+        /* flush buffer */
+        /* (FIXME: this means long lines aren't properly dash-escaped */
+        SEND(p, BODY, p->buf, p->buf_len);
+        p->buf_len = 0;
 
-          p->buf_len = 0;
-          SHIFT(i + 1);
-        }
+        goto retry;
       }
 
       break;
@@ -300,3 +347,53 @@ ptpgp_armor_parser_done(ptpgp_armor_parser_t *p) {
   D("entered");
   return ptpgp_armor_parser_push(p, 0, 0);
 }
+
+static void
+checkpoint(ptpgp_checkpoint_t *c, ptpgp_armor_parser_t *p) {
+  CHECKPOINT_FIELD(c, p->state, 1);
+  CHECKPOINT_CHECK(c, p->state < STATE(LAST));
+
+  CHECKPOINT_BUFFER(c, p->buf, p->buf_len);
+  CHECKPOINT_BUFFER(c, p->out_buf, p->out_buf_len);
+}
+
+ptpgp_err_t
+ptpgp_armor_parser_save(ptpgp_armor_parser_t *p,
+                        u8 *dst,
+                        size_t dst_len,
+                        size_t *out_len) {
+  ptpgp_checkpoint_t c;
+
+  /* a failed parser can't be resumed */
+  if (p->last_err)
+    return p->last_err;
+
+  TRY(ptpgp_checkpoint_save_init(
+    &c, dst, dst_len,
+    PTPGP_CHECKPOINT_TYPE_ARMOR_PARSER, p->offset
+  ));
+
+  checkpoint(&c, p);
+
+  return ptpgp_checkpoint_save_done(&c, out_len);
+}
+
+ptpgp_err_t
+ptpgp_armor_parser_restore(ptpgp_armor_parser_t *p,
+                           u8 *src,
+                           size_t src_len,
+                           ptpgp_armor_parser_cb_t cb,
+                           void *user_data) {
+  ptpgp_checkpoint_t c;
+
+  TRY(ptpgp_armor_parser_init(p, cb, user_data));
+
+  if (ptpgp_checkpoint_load_init(
+    &c, src, src_len,
+    PTPGP_CHECKPOINT_TYPE_ARMOR_PARSER, &(p->offset)
+  ) == PTPGP_OK)
+    checkpoint(&c, p);
+
+  /* a parser with invalid state must not be used */
+  return p->last_err = ptpgp_checkpoint_load_done(&c);
+}
@@ -52,7 +52,7 @@ static char *e_lut = "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
                      "abcdefghijklmnopqrstuvwxyz"
                      "0123456789+/";
 
-static int d_lut[] = {
+static int d_lut[256] = {
   -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
   -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
   -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 62, -1, -1, -1, 63,
@@ -60,7 +60,15 @@ static int d_lut[] = {
   -1,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,
   15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, -1, -1, -1, -1, -1,
   -1, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
-  41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -1, -1, -1, -1, -1
+  41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
 };
 
 #define BITS(n) ((1 << n) - 1)
@@ -140,6 +148,117 @@ convert(ptpgp_base64_t *p) {
   return PTPGP_OK;
 }
 
+/* longest group which can be written without a line break */
+#define MAX_UNWRAPPED_LINE_LEN 56
+
+/*
+ * Encode whole 3-octet groups straight from the source, and set
+ * *num_used to the number of octets consumed.
+ */
+static ptpgp_err_t
+encode_block(ptpgp_base64_t *p, u8 *src, size_t src_len, size_t *num_used) {
+  u8 *s = src, *end = src + src_len - src_len % 3, *o;
+  size_t n, max;
+  uint32_t v;
+
+  while (s < end) {
+    /* make room for a group and a line break */
+    if (p->out_buf_len > PTPGP_BASE64_OUT_BUF_SIZE - 8)
+      FLUSH(p);
+
+    if (p->line_len > MAX_UNWRAPPED_LINE_LEN) {
+      /* group straddles a line break */
+      v = (s[0] << 16) | (s[1] << 8) | s[2];
+      s += 3;
+
+      PUSH(p, e_lut[v >> 18]);
+      PUSH(p, e_lut[(v >> 12) & 63]);
+      PUSH(p, e_lut[(v >> 6) & 63]);
+      PUSH(p, e_lut[v & 63]);
+
+      continue;
+    }
+
+    /* number of groups before the next line break, the end of the
+     * output buffer, or the end of the source */
+    n = (MAX_UNWRAPPED_LINE_LEN - p->line_len) / 4 + 1;
+
+    max = (PTPGP_BASE64_OUT_BUF_SIZE - 4 - p->out_buf_len) / 4;
+    if (n > max)
+      n = max;
+
+    max = (end - s) / 3;
+    if (n > max)
+      n = max;
+
+    o = p->out_buf + p->out_buf_len;
+    p->out_buf_len += 4 * n;
+    p->line_len += 4 * n;
+
+    while (n--) {
+      v = (s[0] << 16) | (s[1] << 8) | s[2];
+      s += 3;
+
+      o[0] = e_lut[v >> 18];
+      o[1] = e_lut[(v >> 12) & 63];
+      o[2] = e_lut[(v >> 6) & 63];
+      o[3] = e_lut[v & 63];
+      o += 4;
+    }
+  }
+
+  *num_used = s - src;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+/*
+ * Decode 4-character groups straight from the source, skipping
+ * characters which aren't base64 digits between groups, and set
+ * *num_used to the number of characters consumed.  Stops at padding
+ * and at groups which are split by other characters.
+ */
+static ptpgp_err_t
+decode_block(ptpgp_base64_t *p, u8 *src, size_t src_len, size_t *num_used) {
+  u8 *s = src, *end = src + src_len, *o;
+  int a, b, c, d;
+
+  while (end - s >= 4) {
+    a = d_lut[s[0]];
+    b = d_lut[s[1]];
+    c = d_lut[s[2]];
+    d = d_lut[s[3]];
+
+    if ((a | b | c | d) < 0) {
+      /* skip line endings, etc */
+      if (a < 0 && s[0] != '=') {
+        s++;
+        continue;
+      }
+
+      break;
+    }
+
+    /* make room for a group */
+    if (p->out_buf_len > PTPGP_BASE64_OUT_BUF_SIZE - 6)
+      FLUSH(p);
+
+    o = p->out_buf + p->out_buf_len;
+    o[0] = (a << 2) | (b >> 4);
+    o[1] = ((b & BITS(4)) << 4) | (c >> 2);
+    o[2] = ((c & BITS(2)) << 6) | d;
+
+    p->out_buf_len += 3;
+    s += 4;
+  }
+
+  *num_used = s - src;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
 ptpgp_err_t
 ptpgp_base64_init(ptpgp_base64_t *p,
                bool encode,
@@ -159,7 +278,7 @@ ptpgp_base64_init(ptpgp_base64_t *p,
 
 ptpgp_err_t
 ptpgp_base64_push(ptpgp_base64_t *p, u8 *src, size_t src_len) {
-  size_t i;
+  size_t i, n;
   int e = FLAG_IS_SET(p, ENCODE);
 
   if (p->last_err)
@@ -186,6 +305,18 @@ ptpgp_base64_push(ptpgp_base64_t *p, u8 *src, size_t src_len) {
   }
 
   for (i = 0; i < src_len; i++) {
+    if (!p->src_buf_len) {
+      /* convert whole groups straight from the source */
+      if (e)
+        TRY(encode_block(p, src + i, src_len - i, &n));
+      else
+        TRY(decode_block(p, src + i, src_len - i, &n));
+
+      i += n;
+      if (i == src_len)
+        break;
+    }
+
     if (e || VALID_BASE64_CHAR(src[i])) {
       p->src_buf[p->src_buf_len++] = src[i];
 
@@ -262,6 +393,10 @@ ptpgp_base64_once(bool    encode,
   once_data_t d;
   ptpgp_base64_t b;
 
+  /* decode straight into the output buffer */
+  if (!encode)
+    return ptpgp_base64_decode_to(src, src_len, dst, dst_len, out_len);
+
   /* populate data handler */
   d.ofs = 0;
   d.dst = dst;
@@ -284,3 +419,148 @@ ptpgp_base64_once(bool    encode,
   /* return success */
   return PTPGP_OK;
 }
+
+size_t
+ptpgp_base64_encoded_size(size_t num_bytes) {
+  return (num_bytes + 2) / 3 * 4;
+}
+
+ptpgp_err_t
+ptpgp_base64_decoded_size(u8 *src,
+                          size_t src_len,
+                          size_t *out_len) {
+  size_t i, n = 0;
+
+  /* count base64 digits */
+  for (i = 0; i < src_len; i++)
+    if (d_lut[src[i]] >= 0)
+      n++;
+
+  /* a single digit can't encode an octet */
+  if (n % 4 == 1)
+    return PTPGP_ERR_BASE64_CORRUPT_INPUT;
+
+  *out_len = n / 4 * 3 + ((n % 4) ? (n % 4) - 1 : 0);
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+ptpgp_err_t
+ptpgp_base64_encode_to(u8 *src,
+                       size_t src_len,
+                       u8 *dst,
+                       size_t dst_len,
+                       size_t *out_len) {
+  u8 *s = src, *end = src + src_len - src_len % 3, *o = dst;
+  uint32_t v;
+
+  /* make sure output buffer is large enough */
+  if (dst_len < ptpgp_base64_encoded_size(src_len))
+    return PTPGP_ERR_BASE64_DEST_BUFFER_TOO_SMALL;
+
+  for (; s < end; s += 3, o += 4) {
+    v = (s[0] << 16) | (s[1] << 8) | s[2];
+
+    o[0] = e_lut[v >> 18];
+    o[1] = e_lut[(v >> 12) & 63];
+    o[2] = e_lut[(v >> 6) & 63];
+    o[3] = e_lut[v & 63];
+  }
+
+  /* encode remaining octets and padding */
+  if (src_len % 3) {
+    v = (s[0] << 16) | ((src_len % 3 == 2) ? (s[1] << 8) : 0);
+
+    o[0] = e_lut[v >> 18];
+    o[1] = e_lut[(v >> 12) & 63];
+    o[2] = (src_len % 3 == 2) ? e_lut[(v >> 6) & 63] : '=';
+    o[3] = '=';
+    o += 4;
+  }
+
+  /* save length (if requested) */
+  if (out_len)
+    *out_len = o - dst;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+ptpgp_err_t
+ptpgp_base64_decode_to(u8 *src,
+                       size_t src_len,
+                       u8 *dst,
+                       size_t dst_len,
+                       size_t *out_len) {
+  size_t i, o = 0, n = 0, num_pad = 0;
+  uint32_t v = 0;
+  int a, b, c, d;
+
+  for (i = 0; i < src_len; i++) {
+    if (!n && src_len - i >= 4) {
+      /* decode whole group */
+      a = d_lut[src[i]];
+      b = d_lut[src[i + 1]];
+      c = d_lut[src[i + 2]];
+      d = d_lut[src[i + 3]];
+
+      if ((a | b | c | d) >= 0) {
+        if (o + 3 > dst_len)
+          return PTPGP_ERR_BASE64_DEST_BUFFER_TOO_SMALL;
+
+        /* (written behind the read position, so in-place is safe) */
+        dst[o++] = (a << 2) | (b >> 4);
+        dst[o++] = ((b & BITS(4)) << 4) | (c >> 2);
+        dst[o++] = ((c & BITS(2)) << 6) | d;
+
+        i += 3;
+        continue;
+      }
+    }
+
+    if ((a = d_lut[src[i]]) >= 0) {
+      /* check for digits after padding */
+      if (num_pad)
+        return PTPGP_ERR_BASE64_CORRUPT_INPUT;
+
+      v = (v << 6) | a;
+    } else if (src[i] == '=') {
+      /* padding ends a group of at least two digits */
+      if (n - num_pad < 2)
+        return PTPGP_ERR_BASE64_CORRUPT_INPUT;
+
+      v <<= 6;
+      num_pad++;
+    } else {
+      /* skip whitespace, etc */
+      continue;
+    }
+
+    if (++n == 4) {
+      if (o + 3 - num_pad > dst_len)
+        return PTPGP_ERR_BASE64_DEST_BUFFER_TOO_SMALL;
+
+      dst[o++] = v >> 16;
+      if (num_pad < 2)
+        dst[o++] = v >> 8;
+      if (num_pad < 1)
+        dst[o++] = v;
+
+      v = 0;
+      n = 0;
+      num_pad = 0;
+    }
+  }
+
+  /* check for incomplete group */
+  if (n > 0)
+    return PTPGP_ERR_BASE64_CORRUPT_INPUT;
+
+  /* save length (if requested) */
+  if (out_len)
+    *out_len = o;
+
+  /* return success */
+  return PTPGP_OK;
+}
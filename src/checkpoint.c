@@ -0,0 +1,204 @@
+#include "internal.h"
+
+#define GET_U32(s) (                                                  \
+  ((uint32_t) (s)[0] << 24) |                                         \
+  ((uint32_t) (s)[1] << 16) |                                         \
+  ((uint32_t) (s)[2] <<  8) |                                         \
+  ((uint32_t) (s)[3])                                                 \
+)
+
+#define GET_U64(s) (                                                  \
+  ((uint64_t) GET_U32(s) << 32) | GET_U32((s) + 4)                    \
+)
+
+static void
+put_u32(u8 *dst, uint32_t v) {
+  dst[0] = (v >> 24) & 0xff;
+  dst[1] = (v >> 16) & 0xff;
+  dst[2] = (v >>  8) & 0xff;
+  dst[3] = v & 0xff;
+}
+
+static void
+put_u64(u8 *dst, uint64_t v) {
+  put_u32(dst, v >> 32);
+  put_u32(dst + 4, v & 0xffffffff);
+}
+
+static uint32_t
+crc24(u8 *src, size_t src_len) {
+  ptpgp_crc24_t crc;
+
+  ptpgp_crc24_init(&crc);
+  ptpgp_crc24_push(&crc, src, src_len);
+  ptpgp_crc24_done(&crc);
+
+  return crc.crc;
+}
+
+ptpgp_err_t
+ptpgp_checkpoint_get_info(u8 *src,
+                          size_t src_len,
+                          ptpgp_checkpoint_type_t *type,
+                          uint64_t *offset) {
+  uint32_t len;
+
+  /* check header */
+  if (src_len < PTPGP_CHECKPOINT_HEADER_SIZE ||
+      memcmp(src, PTPGP_CHECKPOINT_MAGIC, 8))
+    return PTPGP_ERR_CHECKPOINT_BAD_HEADER;
+
+  /* check version */
+  if (GET_U32(src + 8) != PTPGP_CHECKPOINT_VERSION)
+    return PTPGP_ERR_CHECKPOINT_BAD_VERSION;
+
+  /* check for truncated (or trailing) state */
+  len = GET_U32(src + 24);
+  if (len != src_len - PTPGP_CHECKPOINT_HEADER_SIZE)
+    return PTPGP_ERR_CHECKPOINT_BAD_HEADER;
+
+  /* check for corrupt state (e.g. a torn write) */
+  if (GET_U32(src + 28) != crc24(src + PTPGP_CHECKPOINT_HEADER_SIZE, len))
+    return PTPGP_ERR_CHECKPOINT_BAD_CHECKSUM;
+
+  if (type)
+    *type = GET_U32(src + 12);
+  if (offset)
+    *offset = GET_U64(src + 16);
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+ptpgp_err_t
+ptpgp_checkpoint_save_init(ptpgp_checkpoint_t *c,
+                           u8 *dst,
+                           size_t dst_len,
+                           ptpgp_checkpoint_type_t type,
+                           uint64_t offset) {
+  memset(c, 0, sizeof(ptpgp_checkpoint_t));
+
+  if (dst_len < PTPGP_CHECKPOINT_HEADER_SIZE)
+    return c->err = PTPGP_ERR_CHECKPOINT_BUFFER_TOO_SMALL;
+
+  /* write header (length and checksum are written when done) */
+  memcpy(dst, PTPGP_CHECKPOINT_MAGIC, 8);
+  put_u32(dst + 8, PTPGP_CHECKPOINT_VERSION);
+  put_u32(dst + 12, type);
+  put_u64(dst + 16, offset);
+
+  c->buf = dst;
+  c->buf_len = dst_len;
+  c->pos = PTPGP_CHECKPOINT_HEADER_SIZE;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+ptpgp_err_t
+ptpgp_checkpoint_save_done(ptpgp_checkpoint_t *c,
+                           size_t *out_len) {
+  size_t len = c->pos - PTPGP_CHECKPOINT_HEADER_SIZE;
+
+  if (c->err)
+    return c->err;
+
+  /* write state length and checksum */
+  put_u32(c->buf + 24, len);
+  put_u32(c->buf + 28, crc24(c->buf + PTPGP_CHECKPOINT_HEADER_SIZE, len));
+
+  if (out_len)
+    *out_len = c->pos;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+ptpgp_err_t
+ptpgp_checkpoint_load_init(ptpgp_checkpoint_t *c,
+                           u8 *src,
+                           size_t src_len,
+                           ptpgp_checkpoint_type_t type,
+                           uint64_t *offset) {
+  ptpgp_checkpoint_type_t src_type;
+
+  memset(c, 0, sizeof(ptpgp_checkpoint_t));
+  c->is_load = 1;
+
+  if ((c->err = ptpgp_checkpoint_get_info(src, src_len,
+                                          &src_type, offset)) != PTPGP_OK)
+    return c->err;
+
+  /* check parser type */
+  if (src_type != type)
+    return c->err = PTPGP_ERR_CHECKPOINT_BAD_TYPE;
+
+  c->buf = src;
+  c->buf_len = src_len;
+  c->pos = PTPGP_CHECKPOINT_HEADER_SIZE;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+ptpgp_err_t
+ptpgp_checkpoint_load_done(ptpgp_checkpoint_t *c) {
+  /* all of the state must have been used */
+  if (!c->err && c->pos != c->buf_len)
+    c->err = PTPGP_ERR_CHECKPOINT_BAD_STATE;
+
+  return c->err;
+}
+
+void
+ptpgp_checkpoint_number(ptpgp_checkpoint_t *c,
+                        uint64_t *val,
+                        size_t len) {
+  size_t i;
+
+  if (c->err)
+    return;
+
+  if (len > c->buf_len - c->pos) {
+    c->err = c->is_load ? PTPGP_ERR_CHECKPOINT_BAD_STATE :
+                          PTPGP_ERR_CHECKPOINT_BUFFER_TOO_SMALL;
+    return;
+  }
+
+  if (c->is_load) {
+    for (i = 0, *val = 0; i < len; i++)
+      *val = (*val << 8) | c->buf[c->pos + i];
+  } else {
+    /* check for values which don't fit */
+    if (len < 8 && (*val >> (8 * len))) {
+      c->err = PTPGP_ERR_CHECKPOINT_BAD_STATE;
+      return;
+    }
+
+    for (i = 0; i < len; i++)
+      c->buf[c->pos + i] = (*val >> (8 * (len - 1 - i))) & 0xff;
+  }
+
+  c->pos += len;
+}
+
+void
+ptpgp_checkpoint_bytes(ptpgp_checkpoint_t *c,
+                       u8 *buf,
+                       size_t len) {
+  if (c->err)
+    return;
+
+  if (len > c->buf_len - c->pos) {
+    c->err = c->is_load ? PTPGP_ERR_CHECKPOINT_BAD_STATE :
+                          PTPGP_ERR_CHECKPOINT_BUFFER_TOO_SMALL;
+    return;
+  }
+
+  if (c->is_load)
+    memcpy(buf, c->buf + c->pos, len);
+  else
+    memcpy(c->buf + c->pos, buf, len);
+
+  c->pos += len;
+}
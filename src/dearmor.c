@@ -0,0 +1,251 @@
+#include "internal.h"
+
+#define DIE(d, err) do {                                              \
+  D("returning error %s", #err);                                      \
+  return (d)->last_err = PTPGP_ERR_DEARMOR_##err;                     \
+} while (0)
+
+#define SEND(d, t, b, l) do {                                         \
+  ptpgp_err_t err = (d)->cb((d), PTPGP_DEARMOR_TOKEN_##t, (b), (l));  \
+  if (err != PTPGP_OK)                                                \
+    return (d)->last_err = err;                                       \
+} while (0)
+
+#define FLUSH(d) TRY(flush(d))
+
+/* decoder table values for padding and ignored characters */
+#define PAD   0x40
+#define SKIP  0xFF
+
+/* base64 decoder table (0-63: sextet, PAD: '=', SKIP: other) */
+static const u8 lut[256] = {
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x3E, 0xFF, 0xFF, 0xFF, 0x3F,
+  0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0xFF, 0xFF, 0xFF, 0x40, 0xFF, 0xFF,
+  0xFF, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E,
+  0x0F, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+  0x29, 0x2A, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F, 0x30, 0x31, 0x32, 0x33, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+};
+
+/* envelope name of cleartext signed messages */
+#define CLEARTEXT_NAME "BEGIN PGP SIGNED MESSAGE"
+
+static ptpgp_err_t
+flush(ptpgp_dearmor_t *d) {
+  ptpgp_err_t err;
+
+  if (d->out_buf_len > 0) {
+    /* update checksum */
+    err = ptpgp_crc24_push(&(d->crc24), d->out_buf, d->out_buf_len);
+    if (err != PTPGP_OK)
+      return d->last_err = err;
+
+    /* pass decoded data to callback */
+    SEND(d, DATA, d->out_buf, d->out_buf_len);
+
+    /* clear output buffer */
+    d->out_buf_len = 0;
+  }
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+static ptpgp_err_t
+decode(ptpgp_dearmor_t *d, u8 *src, size_t src_len) {
+  u8 *end = src + src_len, *o, c;
+  uint32_t v;
+
+  while (src < end) {
+    if (!d->num_chars && !d->is_padded) {
+      /* decode whole quanta straight from the source (stops at line
+       * endings and padding) */
+      while (end - src >= 4 &&
+             d->out_buf_len <= PTPGP_DEARMOR_OUT_BUF_SIZE - 3 &&
+             !((lut[src[0]] | lut[src[1]] | lut[src[2]] | lut[src[3]]) & 0xC0)) {
+        v = (lut[src[0]] << 18) | (lut[src[1]] << 12) |
+            (lut[src[2]] <<  6) | (lut[src[3]]);
+
+        o = d->out_buf + d->out_buf_len;
+        o[0] = v >> 16;
+        o[1] = v >> 8;
+        o[2] = v;
+
+        d->out_buf_len += 3;
+        src += 4;
+      }
+
+      if (src == end)
+        break;
+    }
+
+    /* make room for a quantum */
+    if (d->out_buf_len > PTPGP_DEARMOR_OUT_BUF_SIZE - 3)
+      FLUSH(d);
+
+    /* decode one character */
+    c = lut[*(src++)];
+
+    if (c == SKIP) {
+      /* skip whitespace and line endings */
+      continue;
+    } else if (c == PAD) {
+      /* ignore trailing padding */
+      if (d->is_padded)
+        continue;
+
+      if (d->num_chars < 2)
+        DIE(d, BAD_BASE64);
+
+      /* decode partial quantum */
+      o = d->out_buf + d->out_buf_len;
+      o[0] = d->bits >> (6 * d->num_chars - 8);
+      if (d->num_chars == 3)
+        o[1] = d->bits >> 2;
+
+      d->out_buf_len += d->num_chars - 1;
+      d->bits = 0;
+      d->num_chars = 0;
+      d->is_padded = 1;
+    } else {
+      /* check for data after padding */
+      if (d->is_padded)
+        DIE(d, BAD_BASE64);
+
+      d->bits = (d->bits << 6) | c;
+
+      if (++d->num_chars == 4) {
+        o = d->out_buf + d->out_buf_len;
+        o[0] = d->bits >> 16;
+        o[1] = d->bits >> 8;
+        o[2] = d->bits;
+
+        d->out_buf_len += 3;
+        d->bits = 0;
+        d->num_chars = 0;
+      }
+    }
+  }
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+static ptpgp_err_t
+armor_cb(ptpgp_armor_parser_t *p,
+         ptpgp_armor_parser_token_t t,
+         u8 *data,
+         size_t data_len) {
+  ptpgp_dearmor_t *d = (ptpgp_dearmor_t*) p->user_data;
+  size_t i;
+  u8 c;
+
+  switch (t) {
+  case PTPGP_ARMOR_PARSER_TOKEN_START_ARMOR:
+    if (data_len == strlen(CLEARTEXT_NAME) &&
+        !memcmp(data, CLEARTEXT_NAME, data_len))
+      DIE(d, CLEARTEXT_MESSAGE);
+
+    /* reset decoder */
+    d->bits = 0;
+    d->num_chars = 0;
+    d->is_padded = 0;
+    d->has_crc24 = 0;
+    d->out_buf_len = 0;
+    TRY(ptpgp_crc24_init(&(d->crc24)));
+
+    SEND(d, START, data, data_len);
+
+    break;
+  case PTPGP_ARMOR_PARSER_TOKEN_HEADER_NAME:
+    SEND(d, HEADER_NAME, data, data_len);
+    break;
+  case PTPGP_ARMOR_PARSER_TOKEN_HEADER_VALUE:
+    SEND(d, HEADER_VALUE, data, data_len);
+    break;
+  case PTPGP_ARMOR_PARSER_TOKEN_BODY:
+    TRY(decode(d, data, data_len));
+    break;
+  case PTPGP_ARMOR_PARSER_TOKEN_CRC24:
+    /* decode armor checksum (always 4 characters) */
+    d->armor_crc24 = 0;
+    for (i = 0; i < data_len; i++) {
+      if ((c = lut[data[i]]) & 0xC0)
+        DIE(d, BAD_CRC24);
+
+      d->armor_crc24 = (d->armor_crc24 << 6) | c;
+    }
+
+    d->has_crc24 = 1;
+
+    break;
+  case PTPGP_ARMOR_PARSER_TOKEN_END_ARMOR:
+    /* check for incomplete quantum */
+    if (d->num_chars > 0)
+      DIE(d, BAD_BASE64);
+
+    /* flush decoded data and finish checksum */
+    FLUSH(d);
+    TRY(ptpgp_crc24_done(&(d->crc24)));
+
+    /* verify checksum */
+    if (d->has_crc24 && d->crc24.crc != d->armor_crc24)
+      DIE(d, CRC24_MISMATCH);
+
+    SEND(d, END, data, data_len);
+
+    break;
+  case PTPGP_ARMOR_PARSER_TOKEN_DONE:
+    SEND(d, DONE, 0, 0);
+    break;
+  default:
+    /* ignore unknown tokens */
+    break;
+  }
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+ptpgp_err_t
+ptpgp_dearmor_init(ptpgp_dearmor_t *d,
+                   ptpgp_dearmor_cb_t cb,
+                   void *user_data) {
+  memset(d, 0, sizeof(ptpgp_dearmor_t));
+
+  d->cb = cb;
+  d->user_data = user_data;
+
+  return ptpgp_armor_parser_init(&(d->parser), armor_cb, d);
+}
+
+ptpgp_err_t
+ptpgp_dearmor_push(ptpgp_dearmor_t *d,
+                   u8 *src,
+                   size_t src_len) {
+  ptpgp_err_t err;
+
+  if (d->last_err)
+    return d->last_err;
+
+  if ((err = ptpgp_armor_parser_push(&(d->parser), src, src_len)) != PTPGP_OK)
+    return d->last_err = err;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+ptpgp_err_t
+ptpgp_dearmor_done(ptpgp_dearmor_t *d) {
+  return ptpgp_dearmor_push(d, 0, 0);
+}
@@ -1,3 +1,4 @@
+#include <pthread.h>
 #include "internal.h"
 
 ptpgp_err_t
@@ -6,9 +7,170 @@ ptpgp_engine_pk_generate_key(ptpgp_pk_genkey_context_t *c,
   /* clear context */
   memset(c, 0, sizeof(ptpgp_pk_genkey_context_t));
 
+  /* key MPIs are stored in the caller's arena */
+  if (!o->arena)
+    return PTPGP_ERR_ENGINE_PK_GENKEY_MISSING_ARENA;
+
   /* save options */
   c->options = *o;
 
   /* call engine */
   return c->options.engine->pk.genkey(c);
 }
+
+static ptpgp_err_t
+finish_digest(ptpgp_hash_context_t *digest) {
+  if (!digest->done)
+    TRY(ptpgp_engine_hash_done(digest));
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+ptpgp_err_t
+ptpgp_engine_pk_sign(ptpgp_hash_context_t *digest,
+                     ptpgp_pk_key_t *key,
+                     ptpgp_pk_signature_t *sig,
+                     ptpgp_arena_t *arena) {
+  TRY(finish_digest(digest));
+
+  /* clear signature */
+  memset(sig, 0, sizeof(ptpgp_pk_signature_t));
+  sig->algorithm = key->algorithm;
+
+  /* call engine */
+  return digest->engine->pk.sign(digest, key, sig, arena);
+}
+
+ptpgp_err_t
+ptpgp_engine_pk_verify(ptpgp_hash_context_t *digest,
+                       ptpgp_pk_key_t *key,
+                       ptpgp_pk_signature_t *sig) {
+  TRY(finish_digest(digest));
+
+  /* check algorithm */
+  if (sig->algorithm != key->algorithm)
+    return PTPGP_ERR_ENGINE_PK_VERIFY_BAD_SIGNATURE;
+
+  /* call engine */
+  return digest->engine->pk.verify(NULL, digest, key, sig);
+}
+
+/* shared state for a batch verify */
+typedef struct {
+  ptpgp_engine_t *engine;
+
+  ptpgp_pk_verify_job_t *jobs;
+  size_t num_jobs;
+
+  pthread_mutex_t mutex;
+
+  /* next job to verify */
+  size_t next_job;
+} batch_t;
+
+/*
+ * verify job on a worker thread (the digest is already finished, and
+ * ctx is a context of the batch engine)
+ */
+static ptpgp_err_t
+verify_job(ptpgp_engine_t *engine, void *ctx, ptpgp_pk_verify_job_t *job) {
+  /* check algorithm */
+  if (job->sig->algorithm != job->key->algorithm)
+    return PTPGP_ERR_ENGINE_PK_VERIFY_BAD_SIGNATURE;
+
+  /* call engine */
+  return engine->pk.verify(ctx, job->digest, job->key, job->sig);
+}
+
+static void *
+batch_worker(void *arg) {
+  batch_t *b = (batch_t*) arg;
+  ptpgp_engine_pk_handlers_t *pk = &(b->engine->pk);
+  void *ctx = NULL;
+  size_t i, end;
+
+  /* init per-thread context (fall back to a fresh one per job) */
+  if (pk->verify_init && pk->verify_init(b->engine, &ctx) != PTPGP_OK)
+    ctx = NULL;
+
+  while (1) {
+    /* claim a run of jobs */
+    pthread_mutex_lock(&(b->mutex));
+    i = b->next_job;
+    end = (b->num_jobs - i > PTPGP_PK_VERIFY_BATCH_CHUNK_SIZE) ?
+      i + PTPGP_PK_VERIFY_BATCH_CHUNK_SIZE : b->num_jobs;
+    b->next_job = end;
+    pthread_mutex_unlock(&(b->mutex));
+
+    if (i >= end)
+      break;
+
+    for (; i < end; i++)
+      if (b->jobs[i].err == PTPGP_OK)
+        b->jobs[i].err = verify_job(b->engine, ctx, b->jobs + i);
+  }
+
+  if (ctx && pk->verify_done)
+    pk->verify_done(ctx);
+
+  return NULL;
+}
+
+ptpgp_err_t
+ptpgp_engine_pk_verify_batch(ptpgp_engine_t *engine,
+                             ptpgp_pk_verify_job_t *jobs,
+                             size_t num_jobs,
+                             size_t num_threads) {
+  pthread_t threads[PTPGP_PK_VERIFY_BATCH_MAX_THREADS];
+  size_t i, max_threads;
+  batch_t b;
+
+  if (!num_threads || num_threads > PTPGP_PK_VERIFY_BATCH_MAX_THREADS)
+    return PTPGP_ERR_ENGINE_PK_VERIFY_BATCH_BAD_THREAD_COUNT;
+
+  memset(&b, 0, sizeof(batch_t));
+  b.engine = engine;
+  b.jobs = jobs;
+  b.num_jobs = num_jobs;
+  pthread_mutex_init(&(b.mutex), NULL);
+
+  /*
+   * finish digests on the calling thread (jobs may share a digest, and
+   * hash contexts aren't thread-safe), so workers only read them; the
+   * per-thread contexts belong to the batch engine, so digests of other
+   * engines are rejected
+   */
+  for (i = 0; i < num_jobs; i++) {
+    if (jobs[i].digest->engine != engine)
+      jobs[i].err = PTPGP_ERR_ENGINE_PK_VERIFY_BATCH_ENGINE_MISMATCH;
+    else
+      jobs[i].err = finish_digest(jobs[i].digest);
+  }
+
+  /* don't start more threads than there are runs of jobs */
+  max_threads = (num_jobs + PTPGP_PK_VERIFY_BATCH_CHUNK_SIZE - 1) /
+                PTPGP_PK_VERIFY_BATCH_CHUNK_SIZE;
+  if (num_threads > max_threads)
+    num_threads = max_threads ? max_threads : 1;
+
+  /*
+   * start workers (the calling thread is one of them, so a failed
+   * pthread_create() just means fewer threads)
+   */
+  for (i = 0; i < num_threads - 1; i++)
+    if (pthread_create(threads + i, NULL, batch_worker, &b))
+      break;
+  num_threads = i;
+
+  batch_worker(&b);
+
+  /* wait for workers */
+  for (i = 0; i < num_threads; i++)
+    pthread_join(threads[i], NULL);
+
+  pthread_mutex_destroy(&(b.mutex));
+
+  /* return success (job results are in jobs[i].err) */
+  return PTPGP_OK;
+}
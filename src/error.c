@@ -23,6 +23,8 @@ static char *errors[] = {
   "invalid packet content tag",
   "invalid partial body length",
   "stream parser already done",
+  "skip packet body (callback result, not an error)",
+  "skip length exceeds packet body",
 
   /* armor parser errors */
   "armor parser already done",
@@ -51,6 +53,7 @@ static char *errors[] = {
   "invalid MDC size (corrupt integrity)",
   "bad public key packet",
   "bad secret key checksum",
+  "public key too large to fingerprint",
 
   /* signature type errors */
   "unknown signature type",
@@ -132,6 +135,92 @@ static char *errors[] = {
   "couldn't convert MPI from engine to native format",
   "incomplete key parameter in generated key",
   "incomplete generated key",
+  "missing arena for generated key",
+
+  /* engine-pk-sign/verify errors */
+  "unsupported public key algorithm",
+  "unsupported signature hash algorithm",
+  "missing key MPIs",
+  "couldn't sign digest",
+  "couldn't verify signature",
+  "bad signature",
+  "invalid batch verify thread count",
+  "digest engine doesn't match batch verify engine",
+
+  /* packet index errors */
+  "packet index builder already done",
+  "couldn't open packet index",
+  "couldn't map packet index",
+  "invalid packet index header",
+  "unsupported packet index version",
+  "packet index entry out of range",
+  "no matching packet index entry",
+
+  /* parallel parser errors */
+  "invalid parallel parser thread count",
+  "couldn't start parallel parser thread",
+  "parallel parser input not split",
+
+  /* source errors */
+  "source not initialized",
+  "couldn't open source",
+  "couldn't map source",
+  "couldn't allocate source read buffer",
+  "couldn't read from source",
+  "couldn't close source",
+
+  /* checkpoint errors */
+  "checkpoint buffer too small",
+  "invalid checkpoint header",
+  "unsupported checkpoint version",
+  "checkpoint is for a different parser",
+  "checkpoint checksum mismatch",
+  "invalid or unsupported parser state in checkpoint",
+
+  /* arena errors */
+  "couldn't allocate arena block",
+  "arena buffer full",
+
+  /* mpi errors */
+  "MPI too large",
+
+  /* key assembler errors */
+  "key assembler already done",
+  "invalid key packet length",
+  "key packet too large",
+
+  /* key index errors */
+  "key index builder already done",
+  "couldn't allocate key index",
+  "couldn't open key index",
+  "couldn't map key index",
+  "invalid key index header",
+  "unsupported key index version",
+  "invalid key ID or fingerprint length",
+  "no matching key index entry",
+
+  /* user ID index errors */
+  "user ID index builder already done",
+  "couldn't allocate user ID index",
+  "too many user IDs for user ID index",
+  "couldn't open user ID index",
+  "couldn't map user ID index",
+  "invalid user ID index header",
+  "unsupported user ID index version",
+  "invalid user ID index entry",
+  "no matching user ID index entry",
+  "user ID index builder already started",
+
+  /* hkp errors */
+  "HKP request handler already done",
+  "key offset outside of keyring",
+  "HKP response line too long",
+
+  /* dearmor errors */
+  "invalid base64 data in armor body",
+  "invalid armor checksum",
+  "armor checksum mismatch",
+  "can't dearmor cleartext signed message",
 
   /* sentinel */
   NULL
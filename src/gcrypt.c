@@ -1,5 +1,6 @@
 #ifdef PTPGP_USE_GCRYPT
 #include "internal.h"
+#include <stdlib.h> /* for calloc(), free() */
 #include <gcrypt.h>
 #include <math.h>
 
@@ -370,11 +371,11 @@ dump_key(gcry_sexp_t *k) {
 
 static ptpgp_err_t
 pk_set_rsa_key_value(ptpgp_pk_key_t *dst,
+                     ptpgp_arena_t *arena,
                      char *s,
                      u8 *src,
                      size_t src_len) {
   ptpgp_mpi_t *n;
-  size_t i;
 
   switch (s[0]) {
   case 'n':
@@ -395,61 +396,36 @@ pk_set_rsa_key_value(ptpgp_pk_key_t *dst,
     n = &(dst->rsa.p);
     break;
   case 'u':
-    /* 
-     * We deliberately ignore this, because it ca be computed from
-     * p and q.  from the gcrypt documentation:
-     *
-     *   For signing and decryption the parameters (p, q, u) are
-     *   optional but greatly improve the performance. Either all of
-     *   these optional parameters must be given
-     *   or none of them. They are mandatory for gcry_pk_testkey.
-     *
-     *   Note that OpenSSL uses slighly different parameters: q < p and
-     *   u = q^-1 \bmod p. To use these parameters you will need to swap
-     *   the values and recompute u. Here is example code to do this:
-     *
-     *     if (gcry_mpi_cmp(p, q) > 0) {
-     *       gcry_mpi_swap(p, q);
-     *       gcry_mpi_invm(u, p, q);
-     *     }
-     *
+    /*
+     * gcrypt wants p < q and u = p^-1 mod q; with p and q swapped
+     * into OpenSSL order, this is iqmp (q^-1 mod p).
      */
-
-    /* return success */
-    return PTPGP_OK;
+    n = &(dst->rsa.iqmp);
+    break;
   default:
     W("unknown rsa key parameter name: %s", s);
     return PTPGP_ERR_ENGINE_PK_GENKEY_UNKNOWN_KEY_PARAMETER_NAME;
   }
 
-  /* set approximate bit count */
-  n->num_bits = (src[0] << 8 | src[1]) * 8;
-
-  /* determine exact bit count */
-  for (i = 0; i < 8; i++) {
-    if (src[2] & (1 << (7 - i))) {
-      n->num_bits -= i;
-      break;
-    }
-  }
+  /* public values appear in both the public and the private key */
+  if (n->data)
+    return PTPGP_OK;
 
   /* check buffer size */
-  if (src_len - 2 > PTPGP_MPI_BUF_SIZE)
+  if (src_len > PTPGP_MPI_MAX_SIZE)
     return PTPGP_ERR_ENGINE_PK_GENKEY_MPI_TOO_LARGE;
 
-  /* copy data */
-  memcpy(n->data, src + 2, src_len - 2);
-
-  /* return success */
-  return PTPGP_OK;
+  /* copy data to arena */
+  return ptpgp_mpi_init(n, arena, src, src_len);
 }
 
 static ptpgp_err_t
 pk_decode_rsa_key_value_pair_sexp(ptpgp_pk_key_t *dst,
+                                  ptpgp_arena_t *arena,
                                   gcry_sexp_t src,
                                   char *list_name) {
   char *s;
-  u8 buf[8194]; /* 8192 + 2 (for length header) */
+  u8 buf[PTPGP_MPI_MAX_SIZE];
   gcry_mpi_t n;
   size_t len;
   int err;
@@ -461,20 +437,20 @@ pk_decode_rsa_key_value_pair_sexp(ptpgp_pk_key_t *dst,
     return PTPGP_ERR_ENGINE_PK_GENKEY_MISSING_KEY_PARAMETER_NAME;
   }
 
-  /* get mpi (FIXME: should the format be _USG?) */
+  /* get mpi */
   if ((n = gcry_sexp_nth_mpi(src, 1, GCRYMPI_FMT_USG)) == NULL) {
     W("couldn't get value mpi");
     gcry_free(s);
     return PTPGP_ERR_ENGINE_PK_GENKEY_MISSING_KEY_PARAMETER_VALUE;
   }
 
-  /* decode mpi to buffer */
-  err = gcry_mpi_scan(&n, GCRYMPI_FMT_PGP, buf, sizeof(buf), &len);
+  /* write mpi magnitude to buffer */
+  err = gcry_mpi_print(GCRYMPI_FMT_USG, buf, sizeof(buf), &len, n);
 
   /* check for error */
   if (err == GCRYPT_OK) {
     /* save value */
-    r = pk_set_rsa_key_value(dst, s, buf, len);
+    r = pk_set_rsa_key_value(dst, arena, s, buf, len);
   } else {
     /* warn about error, set result */
     W("couldn't decode mpi %s.%s", list_name, s);
@@ -493,6 +469,7 @@ pk_decode_rsa_key_value_pair_sexp(ptpgp_pk_key_t *dst,
 
 static ptpgp_err_t
 pk_decode_rsa_key_value_list_sexp(ptpgp_pk_key_t *dst,
+                                  ptpgp_arena_t *arena,
                                   gcry_sexp_t src,
                                   char *list_name) {
   gcry_sexp_t v;
@@ -510,7 +487,7 @@ pk_decode_rsa_key_value_list_sexp(ptpgp_pk_key_t *dst,
     }
 
     /* decode value pair */
-    err = pk_decode_rsa_key_value_pair_sexp(dst, v, list_name);
+    err = pk_decode_rsa_key_value_pair_sexp(dst, arena, v, list_name);
 
     /* release value pair */
     gcry_sexp_release(v);
@@ -531,8 +508,10 @@ rsa_key_tokens[] = {
   NULL
 };
 
-ptpgp_err_t
-pk_decode_rsa_key_sexp(ptpgp_pk_key_t *dst, gcry_sexp_t src) {
+static ptpgp_err_t
+pk_decode_rsa_key_sexp(ptpgp_pk_key_t *dst,
+                       ptpgp_arena_t *arena,
+                       gcry_sexp_t src) {
   gcry_sexp_t t, b;
   size_t i;
   ptpgp_err_t err;
@@ -557,7 +536,7 @@ pk_decode_rsa_key_sexp(ptpgp_pk_key_t *dst, gcry_sexp_t src) {
     }
 
     /* decode value list */
-    err = pk_decode_rsa_key_value_list_sexp(dst, b, rsa_key_tokens[i]);
+    err = pk_decode_rsa_key_value_list_sexp(dst, arena, b, rsa_key_tokens[i]);
 
     /* unconditionally release body exp */
     gcry_sexp_release(b);
@@ -627,7 +606,7 @@ pk_genkey_rsa(ptpgp_pk_genkey_context_t *c) {
   dump_key(&r);
 
   /* decode and save key */
-  ptpgp_err = pk_decode_rsa_key_sexp(&(c->key), r);
+  ptpgp_err = pk_decode_rsa_key_sexp(&(c->key), c->options.arena, r);
 
   /* free rsa s-exp */
   gcry_sexp_release(r);
@@ -657,6 +636,329 @@ pk_genkey(ptpgp_pk_genkey_context_t *c) {
   }
 }
 
+static char *
+get_hash_name(ptpgp_hash_type_t t) {
+  switch (t) {
+  case PTPGP_HASH_TYPE_MD5:
+    return "md5";
+  case PTPGP_HASH_TYPE_SHA1:
+    return "sha1";
+  case PTPGP_HASH_TYPE_RIPEMD160:
+    return "rmd160";
+  case PTPGP_HASH_TYPE_SHA256:
+    return "sha256";
+  case PTPGP_HASH_TYPE_SHA384:
+    return "sha384";
+  case PTPGP_HASH_TYPE_SHA512:
+    return "sha512";
+  default:
+    return NULL;
+  }
+}
+
+/* mpi as an s-exp string argument (gcrypt reads these as unsigned) */
+#define MPI_ARG(m) (int) PTPGP_MPI_SIZE(m), (m)->data
+
+static ptpgp_err_t
+pk_build_data(gcry_sexp_t *r,
+              ptpgp_hash_context_t *digest,
+              ptpgp_pk_key_t *key) {
+  size_t len = digest->hash_len;
+  char *name;
+  int err;
+
+  switch (key->algorithm) {
+  case PTPGP_PUBLIC_KEY_TYPE_RSA:
+  case PTPGP_PUBLIC_KEY_TYPE_RSA_SIGN_ONLY:
+    /* EMSA-PKCS1-v1_5 encoded digest (rfc4880 5.2.2) */
+    if ((name = get_hash_name(digest->algorithm)) == NULL)
+      return PTPGP_ERR_ENGINE_PK_UNSUPPORTED_HASH;
+
+    err = gcry_sexp_build(r, NULL,
+      "(data (flags pkcs1) (hash %s %b))",
+      name, (int) len, digest->hash
+    );
+
+    break;
+  case PTPGP_PUBLIC_KEY_TYPE_DSA:
+    /* digest truncated to the size of q (rfc4880 5.2.2) */
+    if (len > PTPGP_MPI_SIZE(&(key->dsa.q)))
+      len = PTPGP_MPI_SIZE(&(key->dsa.q));
+
+    err = gcry_sexp_build(r, NULL,
+      "(data (flags raw) (value %b))",
+      (int) len, digest->hash
+    );
+
+    break;
+  default:
+    return PTPGP_ERR_ENGINE_PK_UNSUPPORTED_ALGORITHM;
+  }
+
+  /* return result */
+  return (err == GCRYPT_OK) ? PTPGP_OK : PTPGP_ERR_ENGINE_PK_UNSUPPORTED_HASH;
+}
+
+static ptpgp_err_t
+pk_build_public_key(gcry_sexp_t *r, ptpgp_pk_key_t *k) {
+  int err;
+
+  switch (k->algorithm) {
+  case PTPGP_PUBLIC_KEY_TYPE_RSA:
+  case PTPGP_PUBLIC_KEY_TYPE_RSA_SIGN_ONLY:
+    if (!k->rsa.n.data || !k->rsa.e.data)
+      return PTPGP_ERR_ENGINE_PK_INCOMPLETE_KEY;
+
+    err = gcry_sexp_build(r, NULL,
+      "(public-key (rsa (n %b) (e %b)))",
+      MPI_ARG(&(k->rsa.n)), MPI_ARG(&(k->rsa.e))
+    );
+
+    break;
+  case PTPGP_PUBLIC_KEY_TYPE_DSA:
+    if (!k->dsa.p.data || !k->dsa.q.data ||
+        !k->dsa.g.data || !k->dsa.y.data)
+      return PTPGP_ERR_ENGINE_PK_INCOMPLETE_KEY;
+
+    err = gcry_sexp_build(r, NULL,
+      "(public-key (dsa (p %b) (q %b) (g %b) (y %b)))",
+      MPI_ARG(&(k->dsa.p)), MPI_ARG(&(k->dsa.q)),
+      MPI_ARG(&(k->dsa.g)), MPI_ARG(&(k->dsa.y))
+    );
+
+    break;
+  default:
+    return PTPGP_ERR_ENGINE_PK_UNSUPPORTED_ALGORITHM;
+  }
+
+  /* return result */
+  return (err == GCRYPT_OK) ? PTPGP_OK : PTPGP_ERR_ENGINE_PK_INCOMPLETE_KEY;
+}
+
+static ptpgp_err_t
+pk_build_secret_key(gcry_sexp_t *r, ptpgp_pk_key_t *k) {
+  int err;
+
+  switch (k->algorithm) {
+  case PTPGP_PUBLIC_KEY_TYPE_RSA:
+  case PTPGP_PUBLIC_KEY_TYPE_RSA_SIGN_ONLY:
+    if (!k->rsa.n.data || !k->rsa.e.data || !k->rsa.d.data)
+      return PTPGP_ERR_ENGINE_PK_INCOMPLETE_KEY;
+
+    if (k->rsa.p.data && k->rsa.q.data && k->rsa.iqmp.data) {
+      /* swap primes back to gcrypt order (see pk_set_rsa_key_value) */
+      err = gcry_sexp_build(r, NULL,
+        "(private-key (rsa (n %b) (e %b) (d %b) (p %b) (q %b) (u %b)))",
+        MPI_ARG(&(k->rsa.n)), MPI_ARG(&(k->rsa.e)),
+        MPI_ARG(&(k->rsa.d)), MPI_ARG(&(k->rsa.q)),
+        MPI_ARG(&(k->rsa.p)), MPI_ARG(&(k->rsa.iqmp))
+      );
+    } else {
+      err = gcry_sexp_build(r, NULL,
+        "(private-key (rsa (n %b) (e %b) (d %b)))",
+        MPI_ARG(&(k->rsa.n)), MPI_ARG(&(k->rsa.e)),
+        MPI_ARG(&(k->rsa.d))
+      );
+    }
+
+    break;
+  case PTPGP_PUBLIC_KEY_TYPE_DSA:
+    if (!k->dsa.p.data || !k->dsa.q.data || !k->dsa.g.data ||
+        !k->dsa.y.data || !k->dsa.x.data)
+      return PTPGP_ERR_ENGINE_PK_INCOMPLETE_KEY;
+
+    err = gcry_sexp_build(r, NULL,
+      "(private-key (dsa (p %b) (q %b) (g %b) (y %b) (x %b)))",
+      MPI_ARG(&(k->dsa.p)), MPI_ARG(&(k->dsa.q)),
+      MPI_ARG(&(k->dsa.g)), MPI_ARG(&(k->dsa.y)),
+      MPI_ARG(&(k->dsa.x))
+    );
+
+    break;
+  default:
+    return PTPGP_ERR_ENGINE_PK_UNSUPPORTED_ALGORITHM;
+  }
+
+  /* return result */
+  return (err == GCRYPT_OK) ? PTPGP_OK : PTPGP_ERR_ENGINE_PK_INCOMPLETE_KEY;
+}
+
+static ptpgp_err_t
+pk_get_signature_value(ptpgp_mpi_t *dst,
+                       ptpgp_arena_t *arena,
+                       gcry_sexp_t src,
+                       char *name) {
+  u8 buf[PTPGP_MPI_MAX_SIZE];
+  gcry_sexp_t t;
+  gcry_mpi_t n;
+  size_t len;
+  int err;
+
+  /* find value */
+  if ((t = gcry_sexp_find_token(src, name, 0)) == NULL)
+    return PTPGP_ERR_ENGINE_PK_SIGN_FAILED;
+
+  n = gcry_sexp_nth_mpi(t, 1, GCRYMPI_FMT_USG);
+  gcry_sexp_release(t);
+
+  if (!n)
+    return PTPGP_ERR_ENGINE_PK_SIGN_FAILED;
+
+  /* write mpi magnitude to buffer */
+  err = gcry_mpi_print(GCRYMPI_FMT_USG, buf, sizeof(buf), &len, n);
+  gcry_mpi_release(n);
+
+  if (err != GCRYPT_OK)
+    return PTPGP_ERR_ENGINE_PK_SIGN_FAILED;
+
+  /* copy value to arena */
+  return ptpgp_mpi_init(dst, arena, buf, len);
+}
+
+static ptpgp_err_t
+pk_sign(ptpgp_hash_context_t *digest,
+        ptpgp_pk_key_t *key,
+        ptpgp_pk_signature_t *sig,
+        ptpgp_arena_t *arena) {
+  gcry_sexp_t k, d, r;
+  ptpgp_err_t err;
+
+  /* build key and data s-exps */
+  TRY(pk_build_secret_key(&k, key));
+
+  if ((err = pk_build_data(&d, digest, key)) != PTPGP_OK) {
+    gcry_sexp_release(k);
+    return err;
+  }
+
+  /* sign data */
+  err = (gcry_pk_sign(&r, d, k) == GCRYPT_OK) ?
+    PTPGP_OK : PTPGP_ERR_ENGINE_PK_SIGN_FAILED;
+
+  gcry_sexp_release(k);
+  gcry_sexp_release(d);
+
+  if (err != PTPGP_OK)
+    return err;
+
+  /* save signature values */
+  if (key->algorithm == PTPGP_PUBLIC_KEY_TYPE_DSA) {
+    err = pk_get_signature_value(&(sig->dsa.r), arena, r, "r");
+    if (err == PTPGP_OK)
+      err = pk_get_signature_value(&(sig->dsa.s), arena, r, "s");
+  } else {
+    err = pk_get_signature_value(&(sig->rsa.s), arena, r, "s");
+  }
+
+  /* free signature s-exp */
+  gcry_sexp_release(r);
+
+  /* return result */
+  return err;
+}
+
+/* per-thread verify state: the s-exp of the last key */
+typedef struct {
+  ptpgp_pk_key_t *key;
+  gcry_sexp_t key_sexp;
+} pk_verify_context_t;
+
+static ptpgp_err_t
+pk_verify_init(ptpgp_engine_t *e, void **ctx) {
+  UNUSED(e);
+
+  if ((*ctx = calloc(1, sizeof(pk_verify_context_t))) == NULL)
+    return PTPGP_ERR_ENGINE_PK_VERIFY_FAILED;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+static void
+pk_verify_done(void *ctx) {
+  pk_verify_context_t *c = (pk_verify_context_t*) ctx;
+
+  if (c->key)
+    gcry_sexp_release(c->key_sexp);
+
+  free(c);
+}
+
+static ptpgp_err_t
+pk_verify(void *ctx,
+          ptpgp_hash_context_t *digest,
+          ptpgp_pk_key_t *key,
+          ptpgp_pk_signature_t *sig) {
+  pk_verify_context_t *c = (pk_verify_context_t*) ctx;
+  gcry_sexp_t k, d, s;
+  ptpgp_err_t err;
+  int gcry_err;
+
+  /* build signature s-exp */
+  if (key->algorithm == PTPGP_PUBLIC_KEY_TYPE_DSA) {
+    if (!sig->dsa.r.data || !sig->dsa.s.data)
+      return PTPGP_ERR_ENGINE_PK_VERIFY_BAD_SIGNATURE;
+
+    gcry_err = gcry_sexp_build(&s, NULL,
+      "(sig-val (dsa (r %b) (s %b)))",
+      MPI_ARG(&(sig->dsa.r)), MPI_ARG(&(sig->dsa.s))
+    );
+  } else {
+    if (!sig->rsa.s.data)
+      return PTPGP_ERR_ENGINE_PK_VERIFY_BAD_SIGNATURE;
+
+    gcry_err = gcry_sexp_build(&s, NULL,
+      "(sig-val (rsa (s %b)))",
+      MPI_ARG(&(sig->rsa.s))
+    );
+  }
+
+  if (gcry_err != GCRYPT_OK)
+    return PTPGP_ERR_ENGINE_PK_VERIFY_FAILED;
+
+  /* build key s-exp (reused for runs of signatures by the same key) */
+  if (c && c->key == key) {
+    k = c->key_sexp;
+  } else {
+    if ((err = pk_build_public_key(&k, key)) != PTPGP_OK) {
+      gcry_sexp_release(s);
+      return err;
+    }
+
+    if (c) {
+      if (c->key)
+        gcry_sexp_release(c->key_sexp);
+
+      c->key = key;
+      c->key_sexp = k;
+    }
+  }
+
+  /* build data s-exp */
+  if ((err = pk_build_data(&d, digest, key)) == PTPGP_OK) {
+    /* verify signature */
+    switch (gcry_err_code(gcry_pk_verify(s, d, k))) {
+    case GPG_ERR_NO_ERROR:
+      err = PTPGP_OK;
+      break;
+    case GPG_ERR_BAD_SIGNATURE:
+      err = PTPGP_ERR_ENGINE_PK_VERIFY_BAD_SIGNATURE;
+      break;
+    default:
+      err = PTPGP_ERR_ENGINE_PK_VERIFY_FAILED;
+    }
+
+    gcry_sexp_release(d);
+  }
+
+  gcry_sexp_release(s);
+  if (!c)
+    gcry_sexp_release(k);
+
+  /* return result */
+  return err;
+}
+
 /****************/
 /* init methods */
 /****************/
@@ -685,7 +987,12 @@ engine = {
 
   /* public key methods */
   .pk = {
-    .genkey = pk_genkey
+    .genkey = pk_genkey,
+    .sign   = pk_sign,
+    .verify = pk_verify,
+
+    .verify_init = pk_verify_init,
+    .verify_done = pk_verify_done
   }
 };
 
@@ -0,0 +1,926 @@
+#define _POSIX_C_SOURCE 200112L /* for gmtime_r() */
+
+#include <stdio.h>  /* for vsnprintf() */
+#include <stdarg.h> /* for va_list */
+#include <time.h>   /* for gmtime_r() */
+
+#include "internal.h"
+
+#define DIE(h, err) do {                                              \
+  D("returning error %s", #err);                                      \
+  return (h)->last_err = PTPGP_ERR_HKP_##err;                         \
+} while (0)
+
+/* response status codes */
+#define STATUS_OK               200
+#define STATUS_BAD_REQUEST      400
+#define STATUS_NOT_FOUND        404
+#define STATUS_NOT_IMPLEMENTED  501
+
+/* size of keyring pieces pushed while finding the length of a key */
+#define KEY_CHUNK_SIZE          4096
+
+/* longest query parameter name */
+#define MAX_NAME_SIZE           16
+
+static const struct {
+  char *name;
+  ptpgp_hkp_op_t op;
+} ops[] = {
+  { "get",    PTPGP_HKP_OP_GET },
+  { "index",  PTPGP_HKP_OP_INDEX },
+  { "vindex", PTPGP_HKP_OP_VINDEX },
+  { NULL,     PTPGP_HKP_OP_LAST }
+};
+
+static char *armor_headers[] = {
+  "Version", "PTPGP/" PTPGP_VERSION,
+  NULL
+};
+
+static const char hex_digits[] = "0123456789ABCDEF";
+
+/***************/
+/* output      */
+/***************/
+
+static ptpgp_err_t
+flush(ptpgp_hkp_t *h) {
+  ptpgp_err_t err;
+
+  if (h->buf_len > 0) {
+    if ((err = h->cb(h, PTPGP_HKP_TOKEN_BODY, h->buf, h->buf_len)) != PTPGP_OK)
+      return h->last_err = err;
+
+    h->buf_len = 0;
+  }
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+static ptpgp_err_t
+out(ptpgp_hkp_t *h, u8 *src, size_t src_len) {
+  size_t l;
+
+  while (src_len > 0) {
+    /* copy as much as fits into the response buffer */
+    l = sizeof(h->buf) - h->buf_len;
+    if (l > src_len)
+      l = src_len;
+
+    memcpy(h->buf + h->buf_len, src, l);
+    h->buf_len += l;
+    src += l;
+    src_len -= l;
+
+    if (h->buf_len == sizeof(h->buf))
+      TRY(flush(h));
+  }
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+static ptpgp_err_t
+out_str(ptpgp_hkp_t *h, char *s) {
+  return out(h, (u8*) s, strlen(s));
+}
+
+static ptpgp_err_t
+out_fmt(ptpgp_hkp_t *h, char *fmt, ...) {
+  char buf[256];
+  va_list ap;
+  int l;
+
+  va_start(ap, fmt);
+  l = vsnprintf(buf, sizeof(buf), fmt, ap);
+  va_end(ap);
+
+  /* (formatted lines are short) */
+  if (l < 0 || (size_t) l >= sizeof(buf))
+    DIE(h, LINE_TOO_LONG);
+
+  return out(h, (u8*) buf, l);
+}
+
+/* write text, escaping colons, percent signs, and control characters */
+static ptpgp_err_t
+out_mr(ptpgp_hkp_t *h, u8 *src, size_t src_len) {
+  size_t i, start;
+  u8 esc[3];
+
+  for (i = start = 0; i < src_len; i++) {
+    if (src[i] == ':' || src[i] == '%' || src[i] < 0x20 || src[i] == 0x7f) {
+      /* write preceding text, then escaped character */
+      TRY(out(h, src + start, i - start));
+
+      esc[0] = '%';
+      esc[1] = hex_digits[src[i] >> 4];
+      esc[2] = hex_digits[src[i] & 0xf];
+      TRY(out(h, esc, 3));
+
+      start = i + 1;
+    }
+  }
+
+  return out(h, src + start, src_len - start);
+}
+
+/* write text, escaping HTML special characters */
+static ptpgp_err_t
+out_html(ptpgp_hkp_t *h, u8 *src, size_t src_len) {
+  size_t i, start;
+  char *esc;
+
+  for (i = start = 0; i < src_len; i++) {
+    switch (src[i]) {
+    case '<':   esc = "&lt;";   break;
+    case '>':   esc = "&gt;";   break;
+    case '&':   esc = "&amp;";  break;
+    case '"':   esc = "&quot;"; break;
+    default:    esc = NULL;
+    }
+
+    if (esc) {
+      /* write preceding text, then escaped character */
+      TRY(out(h, src + start, i - start));
+      TRY(out_str(h, esc));
+      start = i + 1;
+    }
+  }
+
+  return out(h, src + start, src_len - start);
+}
+
+static ptpgp_err_t
+out_hex(ptpgp_hkp_t *h, u8 *src, size_t src_len) {
+  u8 buf[2];
+  size_t i;
+
+  for (i = 0; i < src_len; i++) {
+    buf[0] = hex_digits[src[i] >> 4];
+    buf[1] = hex_digits[src[i] & 0xf];
+    TRY(out(h, buf, 2));
+  }
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+static ptpgp_err_t
+out_date(ptpgp_hkp_t *h, uint32_t t) {
+  time_t tt = t;
+  struct tm tm;
+
+  if (!gmtime_r(&tt, &tm))
+    return out_str(h, "0000-00-00");
+
+  return out_fmt(h, "%04d-%02d-%02d", tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday);
+}
+
+static ptpgp_err_t
+send_start(ptpgp_hkp_t *h, char *content_type) {
+  ptpgp_err_t err;
+
+  err = h->cb(h, PTPGP_HKP_TOKEN_START, (u8*) content_type, strlen(content_type));
+  if (err != PTPGP_OK)
+    return h->last_err = err;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+/***************/
+/* request     */
+/***************/
+
+static int
+hex_value(u8 c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+
+  /* not a hex digit */
+  return -1;
+}
+
+/* percent-decode query parameter ('+' is a space) */
+static bool
+decode(u8 *src, size_t src_len,
+       u8 *dst, size_t dst_size, size_t *dst_len) {
+  size_t i, l = 0;
+  int hi, lo;
+
+  for (i = 0; i < src_len; i++) {
+    if (l == dst_size)
+      return 0;
+
+    if (src[i] == '%') {
+      if (i + 2 >= src_len)
+        return 0;
+
+      if ((hi = hex_value(src[i + 1])) < 0 || (lo = hex_value(src[i + 2])) < 0)
+        return 0;
+
+      dst[l++] = (hi << 4) | lo;
+      i += 2;
+    } else {
+      dst[l++] = (src[i] == '+') ? ' ' : src[i];
+    }
+  }
+
+  *dst_len = l;
+
+  /* return success */
+  return 1;
+}
+
+#define IS(s, l, v) ((l) == strlen(v) && !memcmp((s), (v), (l)))
+
+static void
+parse_options(ptpgp_hkp_t *h, u8 *src, size_t src_len) {
+  size_t i, start;
+
+  /* comma-separated list of options (unknown ones are ignored) */
+  for (i = start = 0; i <= src_len; i++) {
+    if (i == src_len || src[i] == ',') {
+      if (IS(src + start, i - start, "mr"))
+        h->request.options |= PTPGP_HKP_OPTION_MR;
+      else if (IS(src + start, i - start, "nm"))
+        h->request.options |= PTPGP_HKP_OPTION_NM;
+
+      start = i + 1;
+    }
+  }
+}
+
+static void
+parse_param(ptpgp_hkp_t *h,
+            u8 *name, size_t name_len,
+            u8 *val, size_t val_len) {
+  u8 name_buf[MAX_NAME_SIZE], val_buf[PTPGP_HKP_SEARCH_SIZE];
+  size_t i;
+
+  /* unknown (e.g. long) names are ignored */
+  if (!decode(name, name_len, name_buf, sizeof(name_buf), &name_len))
+    return;
+
+  if (!decode(val, val_len, val_buf, sizeof(val_buf), &val_len)) {
+    h->status = STATUS_BAD_REQUEST;
+    return;
+  }
+
+  if (IS(name_buf, name_len, "op")) {
+    h->request.op = PTPGP_HKP_OP_UNKNOWN;
+
+    for (i = 0; ops[i].name; i++) {
+      if (IS(val_buf, val_len, ops[i].name)) {
+        h->request.op = ops[i].op;
+        break;
+      }
+    }
+  } else if (IS(name_buf, name_len, "search")) {
+    memcpy(h->request.search, val_buf, val_len);
+    h->request.search_len = val_len;
+    h->request.has_search = 1;
+  } else if (IS(name_buf, name_len, "options")) {
+    parse_options(h, val_buf, val_len);
+  } else if (IS(name_buf, name_len, "fingerprint")) {
+    h->request.fingerprint = IS(val_buf, val_len, "on");
+  } else if (IS(name_buf, name_len, "exact")) {
+    h->request.exact = IS(val_buf, val_len, "on");
+  }
+}
+
+static void
+parse_query(ptpgp_hkp_t *h, u8 *src, size_t src_len) {
+  size_t i, start, eq;
+
+  /* split query into name=value pairs */
+  for (i = start = 0; i <= src_len; i++) {
+    if (i == src_len || src[i] == '&') {
+      for (eq = start; eq < i && src[eq] != '='; eq++);
+
+      if (eq < i)
+        parse_param(h, src + start, eq - start, src + eq + 1, i - eq - 1);
+
+      start = i + 1;
+    }
+  }
+}
+
+static ptpgp_err_t
+uri_cb(ptpgp_uri_parser_t *p,
+       ptpgp_uri_parser_token_t t,
+       u8 *src, size_t src_len) {
+  ptpgp_hkp_t *h = (ptpgp_hkp_t*) p->user_data;
+
+  switch (t) {
+  case PTPGP_URI_PARSER_TOKEN_PATH:
+    h->is_lookup = IS(src, src_len, PTPGP_HKP_PATH);
+    break;
+  case PTPGP_URI_PARSER_TOKEN_QUERY:
+    parse_query(h, src, src_len);
+    break;
+  default:
+    /* ignore other tokens */
+    break;
+  }
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+/***************/
+/* key lookup  */
+/***************/
+
+/* add key to result (returns false if the result is full) */
+static bool
+add_key(ptpgp_hkp_t *h, uint64_t key_offset) {
+  size_t i;
+
+  /* skip duplicates (e.g. a key and its subkey) */
+  for (i = 0; i < h->num_keys; i++)
+    if (h->keys[i] == key_offset)
+      return 1;
+
+  if (h->num_keys == PTPGP_HKP_MAX_KEYS)
+    return 0;
+
+  h->keys[h->num_keys++] = key_offset;
+
+  return 1;
+}
+
+static ptpgp_err_t
+find_key_id(ptpgp_hkp_t *h) {
+  u8 *s = h->request.search + 2, id[20];
+  size_t i, l = h->request.search_len - 2;
+  ptpgp_key_index_entry_t e;
+  uint64_t iter = 0;
+  ptpgp_err_t err;
+  int hi, lo;
+
+  /* short key ID, key ID, or v4 fingerprint */
+  if (l != 8 && l != 16 && l != 40) {
+    h->status = STATUS_BAD_REQUEST;
+    return PTPGP_OK;
+  }
+
+  for (i = 0; i < l / 2; i++) {
+    if ((hi = hex_value(s[2 * i])) < 0 || (lo = hex_value(s[2 * i + 1])) < 0) {
+      h->status = STATUS_BAD_REQUEST;
+      return PTPGP_OK;
+    }
+
+    id[i] = (hi << 4) | lo;
+  }
+
+  if (!h->key_index) {
+    h->status = STATUS_NOT_IMPLEMENTED;
+    return PTPGP_OK;
+  }
+
+  while ((err = ptpgp_key_index_find(h->key_index, id, l / 2, &iter, &e)) == PTPGP_OK)
+    if (!add_key(h, e.key_offset))
+      break;
+
+  if (err != PTPGP_OK && err != PTPGP_ERR_KEY_INDEX_NOT_FOUND)
+    return h->last_err = err;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+static ptpgp_err_t
+find_user_id(ptpgp_hkp_t *h) {
+  ptpgp_user_id_index_entry_t e;
+  uint64_t iter = 0;
+  ptpgp_err_t err;
+
+  if (!h->user_id_index) {
+    h->status = STATUS_NOT_IMPLEMENTED;
+    return PTPGP_OK;
+  }
+
+  while ((err = ptpgp_user_id_index_find(
+                  h->user_id_index,
+                  h->request.search, h->request.search_len,
+                  h->request.exact, &iter, &e)) == PTPGP_OK)
+    if (!add_key(h, e.key_offset))
+      break;
+
+  if (err != PTPGP_OK && err != PTPGP_ERR_USER_ID_INDEX_NOT_FOUND)
+    return h->last_err = err;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+static ptpgp_err_t
+find_keys(ptpgp_hkp_t *h) {
+  u8 *s = h->request.search;
+
+  if (h->request.search_len > 2 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X'))
+    TRY(find_key_id(h));
+  else
+    TRY(find_user_id(h));
+
+  if (!h->status)
+    h->status = h->num_keys ? STATUS_OK : STATUS_NOT_FOUND;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+/* write packets of current key (to armor encoder or key assembler) */
+static ptpgp_err_t
+write_key_data(ptpgp_hkp_t *h, uint64_t end) {
+  u8 *src = h->keyring + h->key_offset + h->key_run_start;
+  size_t len = end - h->key_run_start;
+  ptpgp_err_t err;
+
+  if (!h->in_key_run || !len)
+    return PTPGP_OK;
+
+  h->in_key_run = 0;
+
+  if (h->request.op == PTPGP_HKP_OP_GET)
+    err = ptpgp_armor_encoder_push(&(h->armor), src, len);
+  else
+    err = ptpgp_key_assembler_push(&(h->assembler), src, len);
+
+  return (err != PTPGP_OK) ? (h->last_err = err) : PTPGP_OK;
+}
+
+static ptpgp_err_t
+key_packet_cb(ptpgp_stream_parser_t *p,
+              ptpgp_stream_parser_token_t t,
+              ptpgp_packet_header_t *header,
+              u8 *src, size_t src_len) {
+  ptpgp_hkp_t *h = (ptpgp_hkp_t*) p->cb_data;
+
+  UNUSED(src);
+  UNUSED(src_len);
+
+  if (t != PTPGP_STREAM_PARSER_TOKEN_START)
+    return PTPGP_OK;
+
+  /* skip packets after the end of the key (in the same chunk) */
+  if (h->has_key_end)
+    return PTPGP_ERR_STREAM_PARSER_SKIP_BODY;
+
+  switch (header->content_tag) {
+  case PTPGP_TAG_PUBLIC_KEY:
+  case PTPGP_TAG_SECRET_KEY:
+    if (p->header_offset > 0) {
+      /* the key ends where the next key starts */
+      TRY(write_key_data(h, p->header_offset));
+      h->has_key_end = 1;
+    } else if (header->content_tag == PTPGP_TAG_PUBLIC_KEY) {
+      /* start of public key */
+      h->key_run_start = 0;
+      h->in_key_run = 1;
+    } else {
+      /* secret keys are never served */
+      h->has_key_end = 1;
+    }
+
+    break;
+  case PTPGP_TAG_SECRET_SUBKEY:
+    /* drop secret subkey (and its binding signatures) */
+    TRY(write_key_data(h, p->header_offset));
+    break;
+  case PTPGP_TAG_PUBLIC_SUBKEY:
+  case PTPGP_TAG_USER_ID:
+  case PTPGP_TAG_USER_ATTRIBUTE:
+    /* public packets after a secret subkey start a new run */
+    if (!h->in_key_run) {
+      h->key_run_start = p->header_offset;
+      h->in_key_run = 1;
+    }
+
+    break;
+  default:
+    /* signatures and trust packets stay with the preceding packet */
+    break;
+  }
+
+  /* only headers are needed */
+  return PTPGP_ERR_STREAM_PARSER_SKIP_BODY;
+}
+
+/*
+ * write public packets of transferable key at given keyring offset
+ * (secret keys and secret subkeys are never written)
+ */
+static ptpgp_err_t
+write_key(ptpgp_hkp_t *h, uint64_t ofs) {
+  uint64_t pos, n;
+  ptpgp_err_t err;
+
+  if (ofs >= h->keyring_len)
+    DIE(h, BAD_KEY_OFFSET);
+
+  /* walk packet headers */
+  TRY(ptpgp_stream_parser_init(&(h->stream), key_packet_cb, h));
+
+  h->key_offset = ofs;
+  h->in_key_run = 0;
+  h->has_key_end = 0;
+
+  for (pos = ofs; pos < h->keyring_len && !h->has_key_end; pos += n) {
+    n = h->keyring_len - pos;
+    if (n > KEY_CHUNK_SIZE)
+      n = KEY_CHUNK_SIZE;
+
+    if ((err = ptpgp_stream_parser_push(&(h->stream), h->keyring + pos, n)) != PTPGP_OK)
+      return h->last_err = err;
+  }
+
+  /* last key runs to the end of the keyring */
+  if (!h->has_key_end)
+    TRY(write_key_data(h, h->keyring_len - ofs));
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+/***************/
+/* responses   */
+/***************/
+
+static ptpgp_err_t
+armor_cb(ptpgp_armor_encoder_t *e, u8 *src, size_t src_len) {
+  return out((ptpgp_hkp_t*) e->user_data, src, src_len);
+}
+
+/* op=get: armored keys */
+static ptpgp_err_t
+send_keys(ptpgp_hkp_t *h) {
+  ptpgp_err_t err;
+  size_t i;
+
+  TRY(send_start(h, (h->request.options & PTPGP_HKP_OPTION_MR) ?
+                    "application/pgp-keys" : "text/plain"));
+
+  if ((err = ptpgp_armor_encoder_init(
+         &(h->armor), "PGP PUBLIC KEY BLOCK",
+         armor_headers, armor_cb, h)) != PTPGP_OK)
+    return h->last_err = err;
+
+  /* armor public packets of keys straight from the keyring */
+  for (i = 0; i < h->num_keys; i++)
+    TRY(write_key(h, h->keys[i]));
+
+  if ((err = ptpgp_armor_encoder_done(&(h->armor))) != PTPGP_OK)
+    return h->last_err = err;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+static size_t
+key_bits(ptpgp_key_public_key_t *k) {
+  switch (k->algorithm) {
+  case PTPGP_PUBLIC_KEY_TYPE_RSA:
+  case PTPGP_PUBLIC_KEY_TYPE_RSA_ENCRYPT_ONLY:
+  case PTPGP_PUBLIC_KEY_TYPE_RSA_SIGN_ONLY:
+    return k->key.rsa.n.num_bits;
+  case PTPGP_PUBLIC_KEY_TYPE_DSA:
+    return k->key.dsa.p.num_bits;
+  default:
+    /* key MPIs aren't parsed */
+    return 0;
+  }
+}
+
+static char
+key_letter(ptpgp_key_public_key_t *k) {
+  switch (k->algorithm) {
+  case PTPGP_PUBLIC_KEY_TYPE_RSA:
+  case PTPGP_PUBLIC_KEY_TYPE_RSA_ENCRYPT_ONLY:
+  case PTPGP_PUBLIC_KEY_TYPE_RSA_SIGN_ONLY:
+    return 'R';
+  case PTPGP_PUBLIC_KEY_TYPE_DSA:
+    return 'D';
+  case PTPGP_PUBLIC_KEY_TYPE_ELGAMAL_ENCRYPT_ONLY:
+    return 'g';
+  case PTPGP_PUBLIC_KEY_TYPE_ELGAMAL_ENCRYPT_OR_SIGN:
+    return 'G';
+  default:
+    return '?';
+  }
+}
+
+static bool
+is_revoked(ptpgp_key_public_key_t *k) {
+  ptpgp_key_signature_t *s;
+
+  for (s = k->signatures; s; s = s->next)
+    if (s->signature_type == PTPGP_SIGNATURE_TYPE_REVOKATION_KEY ||
+        s->signature_type == PTPGP_SIGNATURE_TYPE_REVOKATION_SUBKEY)
+      return 1;
+
+  return 0;
+}
+
+/* machine-readable key listing */
+static ptpgp_err_t
+write_key_mr(ptpgp_hkp_t *h, ptpgp_key_t *key) {
+  ptpgp_key_public_key_t *k = &(key->primary);
+  ptpgp_key_user_id_t *u;
+
+  /* pub:<keyid>:<algo>:<keylen>:<creationdate>:<expirationdate>:<flags> */
+  TRY(out_str(h, "pub:"));
+
+  if (k->has_fingerprint) {
+    if (h->request.fingerprint && k->version == 4)
+      TRY(out_hex(h, k->fingerprint.fingerprint, k->fingerprint.fingerprint_len));
+    else
+      TRY(out_hex(h, k->fingerprint.key_id, 8));
+  }
+
+  TRY(out_fmt(
+    h, ":%d:%u:%lu::%s\n", k->algorithm, (unsigned int) key_bits(k),
+    (unsigned long) k->creation_time, is_revoked(k) ? "r" : ""
+  ));
+
+  /* uid:<escaped uid string>:<creationdate>:<expirationdate>:<flags> */
+  for (u = key->user_ids; u; u = u->next) {
+    if (u->tag != PTPGP_TAG_USER_ID)
+      continue;
+
+    TRY(out_str(h, "uid:"));
+    TRY(out_mr(h, u->data, u->data_len));
+    TRY(out_str(h, ":::\n"));
+  }
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+static ptpgp_err_t
+write_public_key_html(ptpgp_hkp_t *h, char *type, ptpgp_key_public_key_t *k) {
+  size_t i;
+
+  TRY(out_fmt(h, "%s  %u%c/", type, (unsigned int) key_bits(k), key_letter(k)));
+
+  if (k->has_fingerprint)
+    TRY(out_hex(h, k->fingerprint.key_id + 4, 4));
+  else
+    TRY(out_str(h, "????????"));
+
+  TRY(out_str(h, " "));
+  TRY(out_date(h, k->creation_time));
+
+  if (is_revoked(k))
+    TRY(out_str(h, " *** REVOKED ***"));
+
+  if (h->request.fingerprint && k->has_fingerprint) {
+    /* fingerprint in groups of four digits */
+    TRY(out_str(h, "\n\t Fingerprint="));
+
+    for (i = 0; i < k->fingerprint.fingerprint_len; i += 2) {
+      if (i > 0)
+        TRY(out_str(h, (i == k->fingerprint.fingerprint_len / 2) ? "  " : " "));
+
+      TRY(out_hex(h, k->fingerprint.fingerprint + i, 2));
+    }
+  }
+
+  return out_str(h, "\n");
+}
+
+static ptpgp_err_t
+write_signatures_html(ptpgp_hkp_t *h, ptpgp_key_signature_t *s) {
+  for (; s; s = s->next) {
+    TRY(out_fmt(h, "sig  %02x ", s->signature_type));
+
+    if (s->has_issuer_key_id)
+      TRY(out_hex(h, s->issuer_key_id + 4, 4));
+    else
+      TRY(out_str(h, "????????"));
+
+    TRY(out_str(h, " "));
+    TRY(out_date(h, s->creation_time));
+    TRY(out_str(h, "\n"));
+  }
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+/* human-readable key listing (signatures only for vindex) */
+static ptpgp_err_t
+write_key_html(ptpgp_hkp_t *h, ptpgp_key_t *key) {
+  bool verbose = (h->request.op == PTPGP_HKP_OP_VINDEX);
+  ptpgp_key_public_key_t *k;
+  ptpgp_key_user_id_t *u;
+
+  TRY(write_public_key_html(h, "pub", &(key->primary)));
+  if (verbose)
+    TRY(write_signatures_html(h, key->primary.signatures));
+
+  for (u = key->user_ids; u; u = u->next) {
+    if (u->tag == PTPGP_TAG_USER_ID) {
+      TRY(out_str(h, "uid  "));
+      TRY(out_html(h, u->data, u->data_len));
+      TRY(out_str(h, "\n"));
+    } else {
+      TRY(out_str(h, "uat  [user attribute]\n"));
+    }
+
+    if (verbose)
+      TRY(write_signatures_html(h, u->signatures));
+  }
+
+  for (k = key->subkeys; k; k = k->next) {
+    TRY(write_public_key_html(h, "sub", k));
+    if (verbose)
+      TRY(write_signatures_html(h, k->signatures));
+  }
+
+  return out_str(h, "\n");
+}
+
+static ptpgp_err_t
+key_cb(ptpgp_key_assembler_t *a, ptpgp_key_t *key) {
+  ptpgp_hkp_t *h = (ptpgp_hkp_t*) a->user_data;
+  ptpgp_err_t err;
+
+  if (h->request.options & PTPGP_HKP_OPTION_MR)
+    err = write_key_mr(h, key);
+  else
+    err = write_key_html(h, key);
+
+  /* release key */
+  ptpgp_key_free(key);
+
+  return err;
+}
+
+/* op=index and op=vindex: key listing */
+static ptpgp_err_t
+send_index(ptpgp_hkp_t *h) {
+  bool mr = (h->request.options & PTPGP_HKP_OPTION_MR) ? 1 : 0;
+  ptpgp_err_t err;
+  size_t i;
+
+  TRY(send_start(h, mr ? "text/plain" : "text/html"));
+
+  if (mr) {
+    TRY(out_fmt(h, "info:1:%u\n", (unsigned int) h->num_keys));
+  } else {
+    TRY(out_str(h, "<html><head><title>Search results for '"));
+    TRY(out_html(h, h->request.search, h->request.search_len));
+    TRY(out_str(h, "'</title></head><body><h1>Search results for '"));
+    TRY(out_html(h, h->request.search, h->request.search_len));
+    TRY(out_str(h, "'</h1><pre>\n"));
+  }
+
+  for (i = 0; i < h->num_keys; i++) {
+    /* assemble public packets of key, and list it from the key callback */
+    if ((err = ptpgp_key_assembler_init(&(h->assembler), h->engine, key_cb, h)) != PTPGP_OK)
+      return h->last_err = err;
+
+    TRY(write_key(h, h->keys[i]));
+
+    if ((err = ptpgp_key_assembler_done(&(h->assembler))) != PTPGP_OK)
+      return h->last_err = err;
+  }
+
+  if (!mr)
+    TRY(out_str(h, "</pre></body></html>\n"));
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+static ptpgp_err_t
+send_error(ptpgp_hkp_t *h) {
+  char *msg;
+
+  switch (h->status) {
+  case STATUS_BAD_REQUEST:
+    msg = "Bad Request";
+    break;
+  case STATUS_NOT_FOUND:
+    msg = "Not Found";
+    break;
+  case STATUS_NOT_IMPLEMENTED:
+    msg = "Not Implemented";
+    break;
+  default:
+    msg = "Error";
+  }
+
+  TRY(send_start(h, "text/plain"));
+  return out_fmt(h, "%d %s\n", h->status, msg);
+}
+
+/***************/
+/* public api  */
+/***************/
+
+ptpgp_err_t
+ptpgp_hkp_init(ptpgp_hkp_t *h,
+               u8 *keyring,
+               size_t keyring_len,
+               ptpgp_key_index_t *key_index,
+               ptpgp_user_id_index_t *user_id_index,
+               ptpgp_engine_t *engine,
+               ptpgp_hkp_cb_t cb,
+               void *user_data) {
+  /* clear handler */
+  memset(h, 0, sizeof(ptpgp_hkp_t));
+
+  /* save keyring, indexes, and callback */
+  h->keyring = keyring;
+  h->keyring_len = keyring_len;
+  h->key_index = key_index;
+  h->user_id_index = user_id_index;
+  h->engine = engine;
+  h->cb = cb;
+  h->user_data = user_data;
+
+  /* init request target parser */
+  return ptpgp_uri_parser_init(&(h->uri), uri_cb, h);
+}
+
+ptpgp_err_t
+ptpgp_hkp_push(ptpgp_hkp_t *h,
+               u8 *src,
+               size_t src_len) {
+  /* return last error */
+  if (h->last_err)
+    return h->last_err;
+
+  if (h->is_done)
+    DIE(h, ALREADY_DONE);
+
+  if (!src || !src_len)
+    return ptpgp_hkp_done(h);
+
+  /* unparseable targets (e.g. queries which are too long) are bad
+   * requests rather than errors */
+  if (!h->status && ptpgp_uri_parser_push(&(h->uri), src, src_len) != PTPGP_OK)
+    h->status = STATUS_BAD_REQUEST;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+ptpgp_err_t
+ptpgp_hkp_done(ptpgp_hkp_t *h) {
+  ptpgp_err_t err;
+
+  /* return last error */
+  if (h->last_err)
+    return h->last_err;
+
+  if (h->is_done)
+    DIE(h, ALREADY_DONE);
+
+  h->is_done = 1;
+
+  /* finish request target */
+  if (!h->status && ptpgp_uri_parser_done(&(h->uri)) != PTPGP_OK)
+    h->status = STATUS_BAD_REQUEST;
+
+  /* check request */
+  if (!h->status) {
+    if (!h->is_lookup)
+      h->status = STATUS_NOT_FOUND;
+    else if (h->request.op == PTPGP_HKP_OP_UNKNOWN)
+      h->status = STATUS_NOT_IMPLEMENTED;
+    else if (h->request.op == PTPGP_HKP_OP_NONE || !h->request.has_search)
+      h->status = STATUS_BAD_REQUEST;
+  }
+
+  /* look up keys */
+  if (!h->status)
+    TRY(find_keys(h));
+
+  /* send response */
+  if (h->status != STATUS_OK)
+    TRY(send_error(h));
+  else if (h->request.op == PTPGP_HKP_OP_GET)
+    TRY(send_keys(h));
+  else
+    TRY(send_index(h));
+
+  TRY(flush(h));
+
+  /* send end of response */
+  if ((err = h->cb(h, PTPGP_HKP_TOKEN_END, 0, 0)) != PTPGP_OK)
+    return h->last_err = err;
+
+  /* return success */
+  return PTPGP_OK;
+}
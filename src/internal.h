@@ -24,3 +24,70 @@
   if (try_err != PTPGP_OK)        \
     return try_err;               \
 } while (0)
+
+/*
+ * checkpoint state encoder (see checkpoint.h).  Each parser describes
+ * its state once with the CHECKPOINT_*() macros, and the same function
+ * is used to save and to restore it.  Errors are sticky and returned by
+ * ptpgp_checkpoint_save_done() and ptpgp_checkpoint_load_done().
+ */
+typedef struct {
+  /* restoring (rather than saving) state */
+  bool is_load;
+
+  ptpgp_err_t err;
+
+  u8 *buf;
+  size_t buf_len, pos;
+} ptpgp_checkpoint_t;
+
+/* save or restore integer field as n octets */
+#define CHECKPOINT_FIELD(c, f, n) do {                                \
+  uint64_t ck_val = (f);                                              \
+  ptpgp_checkpoint_number((c), &ck_val, (n));                         \
+  (f) = ck_val;                                                       \
+} while (0)
+
+/* save or restore buffer and its length */
+#define CHECKPOINT_BUFFER(c, b, l) do {                               \
+  CHECKPOINT_FIELD((c), (l), 4);                                      \
+  CHECKPOINT_CHECK((c), (l) <= sizeof(b));                            \
+  ptpgp_checkpoint_bytes((c), (b), (l));                              \
+} while (0)
+
+/* flag restored state as invalid unless condition holds */
+#define CHECKPOINT_CHECK(c, cond) do {                                \
+  if (!(c)->err && !(cond))                                           \
+    (c)->err = PTPGP_ERR_CHECKPOINT_BAD_STATE;                        \
+} while (0)
+
+ptpgp_err_t
+ptpgp_checkpoint_save_init(ptpgp_checkpoint_t *c,
+                           u8 *dst,
+                           size_t dst_len,
+                           ptpgp_checkpoint_type_t type,
+                           uint64_t offset);
+
+ptpgp_err_t
+ptpgp_checkpoint_save_done(ptpgp_checkpoint_t *c,
+                           size_t *out_len);
+
+ptpgp_err_t
+ptpgp_checkpoint_load_init(ptpgp_checkpoint_t *c,
+                           u8 *src,
+                           size_t src_len,
+                           ptpgp_checkpoint_type_t type,
+                           uint64_t *offset);
+
+ptpgp_err_t
+ptpgp_checkpoint_load_done(ptpgp_checkpoint_t *c);
+
+void
+ptpgp_checkpoint_number(ptpgp_checkpoint_t *c,
+                        uint64_t *val,
+                        size_t len);
+
+void
+ptpgp_checkpoint_bytes(ptpgp_checkpoint_t *c,
+                       u8 *buf,
+                       size_t len);
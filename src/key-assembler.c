@@ -0,0 +1,548 @@
+#include "internal.h"
+
+#define DIE(a, err) do {                                              \
+  D("returning error %s", #err);                                      \
+  return (a)->last_err = PTPGP_ERR_KEY_ASSEMBLER_##err;               \
+} while (0)
+
+#define ALLOC(a, ptr, len) do {                                       \
+  void *tmp_ptr;                                                      \
+  ptpgp_err_t err = ptpgp_arena_alloc(                                \
+    &((a)->key->arena), (len), &tmp_ptr                               \
+  );                                                                  \
+                                                                      \
+  if (err != PTPGP_OK)                                                \
+    return (a)->last_err = err;                                       \
+                                                                      \
+  memset(tmp_ptr, 0, (len));                                          \
+  (ptr) = tmp_ptr;                                                    \
+} while (0)
+
+#define GET_U32(s) (                                                  \
+  ((uint32_t) (s)[0] << 24) |                                         \
+  ((uint32_t) (s)[1] << 16) |                                         \
+  ((uint32_t) (s)[2] <<  8) |                                         \
+  ((uint32_t) (s)[3])                                                 \
+)
+
+ptpgp_err_t
+ptpgp_key_free(ptpgp_key_t *key) {
+  /* the key lives in its own arena, so free a copy of the arena */
+  ptpgp_arena_t arena = key->arena;
+
+  return ptpgp_arena_free(&arena);
+}
+
+/* detach current key from assembler */
+static ptpgp_key_t *
+take_key(ptpgp_key_assembler_t *a) {
+  ptpgp_key_t *key = a->key;
+
+  a->key = NULL;
+  a->user_id_tail = NULL;
+  a->subkey_tail = NULL;
+  a->signature_tail = NULL;
+  a->public_key = NULL;
+  a->signature = NULL;
+  a->data = NULL;
+
+  return key;
+}
+
+static void
+free_key(ptpgp_key_assembler_t *a) {
+  ptpgp_key_t *key = take_key(a);
+
+  if (key)
+    ptpgp_key_free(key);
+}
+
+static ptpgp_err_t
+send_key(ptpgp_key_assembler_t *a) {
+  ptpgp_key_t *key = take_key(a);
+
+  /* hand key to callback */
+  return key ? a->cb(a, key) : PTPGP_OK;
+}
+
+static ptpgp_err_t
+start_key(ptpgp_key_assembler_t *a) {
+  ptpgp_arena_t arena;
+  void *ptr;
+  ptpgp_err_t err;
+
+  /* send previous key */
+  TRY(send_key(a));
+
+  /* allocate key from its own arena */
+  TRY(ptpgp_arena_init(&arena, PTPGP_KEY_ASSEMBLER_BLOCK_SIZE));
+  if ((err = ptpgp_arena_alloc(&arena, sizeof(ptpgp_key_t), &ptr)) != PTPGP_OK) {
+    ptpgp_arena_free(&arena);
+    return err;
+  }
+
+  a->key = ptr;
+  memset(a->key, 0, sizeof(ptpgp_key_t));
+  a->key->arena = arena;
+
+  a->user_id_tail = &(a->key->user_ids);
+  a->subkey_tail = &(a->key->subkeys);
+  a->signature_tail = &(a->key->primary.signatures);
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+static void
+set_key_mpi(ptpgp_key_public_key_t *k, size_t i, ptpgp_mpi_t *mpi) {
+  k->key.algorithm = k->algorithm;
+
+  switch (k->algorithm) {
+  case PTPGP_PUBLIC_KEY_TYPE_RSA:
+  case PTPGP_PUBLIC_KEY_TYPE_RSA_ENCRYPT_ONLY:
+  case PTPGP_PUBLIC_KEY_TYPE_RSA_SIGN_ONLY:
+    if (i == 0)
+      k->key.rsa.n = *mpi;
+    else if (i == 1)
+      k->key.rsa.e = *mpi;
+
+    break;
+  case PTPGP_PUBLIC_KEY_TYPE_DSA:
+    if (i == 0)
+      k->key.dsa.p = *mpi;
+    else if (i == 1)
+      k->key.dsa.q = *mpi;
+    else if (i == 2)
+      k->key.dsa.g = *mpi;
+    else if (i == 3)
+      k->key.dsa.y = *mpi;
+
+    break;
+  default:
+    /* other algorithms are only kept as packet data */
+    break;
+  }
+}
+
+static void
+set_signature_mpi(ptpgp_key_signature_t *s, size_t i, ptpgp_mpi_t *mpi) {
+  s->sig.algorithm = s->public_key_algorithm;
+
+  switch (s->public_key_algorithm) {
+  case PTPGP_PUBLIC_KEY_TYPE_RSA:
+  case PTPGP_PUBLIC_KEY_TYPE_RSA_SIGN_ONLY:
+    if (i == 0)
+      s->sig.rsa.s = *mpi;
+
+    break;
+  case PTPGP_PUBLIC_KEY_TYPE_DSA:
+    if (i == 0)
+      s->sig.dsa.r = *mpi;
+    else if (i == 1)
+      s->sig.dsa.s = *mpi;
+
+    break;
+  default:
+    /* other algorithms are only kept as packet data */
+    break;
+  }
+}
+
+static void
+signature_subpacket_end(ptpgp_key_assembler_t *a) {
+  ptpgp_key_signature_t *s = a->signature;
+
+  switch (a->subpacket_type) {
+  case PTPGP_SIGNATURE_SUBPACKET_TYPE_SIGNATURE_CREATION_TIME:
+    /* creation time only counts if it is hashed */
+    if (a->in_hashed_list && a->subpacket_len == 4)
+      s->creation_time = GET_U32(a->subpacket_buf);
+
+    break;
+  case PTPGP_SIGNATURE_SUBPACKET_TYPE_ISSUER:
+    if (a->subpacket_len == 8) {
+      memcpy(s->issuer_key_id, a->subpacket_buf, 8);
+      s->has_issuer_key_id = 1;
+    }
+
+    break;
+  default:
+    /* ignore other subpackets */
+    break;
+  }
+}
+
+/* result of parsing the current packet */
+#define PACKET_ERR(a) (                                               \
+  (a)->public_key ? &((a)->public_key->err) :                         \
+  (a)->signature ? &((a)->signature->err) : NULL                      \
+)
+
+static ptpgp_err_t
+packet_cb(ptpgp_packet_parser_t *pp,
+          ptpgp_packet_parser_token_t t,
+          ptpgp_packet_t *packet,
+          u8 *data, size_t data_len) {
+  ptpgp_key_assembler_t *a = (ptpgp_key_assembler_t*) pp->user_data;
+  ptpgp_key_public_key_t *k = a->public_key;
+  ptpgp_key_signature_t *s = a->signature;
+  ptpgp_signature_subpacket_header_t *sp;
+  size_t n;
+
+  switch (t) {
+  case PTPGP_PACKET_PARSER_TOKEN_KEY_PACKET_HEADER:
+    if (k) {
+      k->version = packet->packet.t6.all.version;
+      k->algorithm = packet->packet.t6.all.public_key_algorithm;
+      k->creation_time = packet->packet.t6.all.creation_time;
+    }
+
+    break;
+  case PTPGP_PACKET_PARSER_TOKEN_KEY_FINGERPRINT:
+    if (k) {
+      memcpy(&(k->fingerprint), data, sizeof(ptpgp_key_fingerprint_t));
+      k->has_fingerprint = 1;
+    }
+
+    break;
+  case PTPGP_PACKET_PARSER_TOKEN_MPI_END:
+    /* (collected mpis are stored in the key arena) */
+    if (data_len == sizeof(ptpgp_mpi_t)) {
+      if (k)
+        set_key_mpi(k, a->mpi_index, (ptpgp_mpi_t*) data);
+      else if (s)
+        set_signature_mpi(s, a->mpi_index, (ptpgp_mpi_t*) data);
+    }
+
+    a->mpi_index++;
+    break;
+  case PTPGP_PACKET_PARSER_TOKEN_PACKET_START:
+    if (s) {
+      /* (the parser keeps v4 fields in versions.v3 as well) */
+      s->version = packet->packet.t2.version;
+      s->signature_type = packet->packet.t2.versions.v3.signature_type;
+      s->public_key_algorithm = packet->packet.t2.versions.v3.public_key_algorithm;
+      s->hash_algorithm = packet->packet.t2.versions.v3.hash_algorithm;
+
+      if (s->version < 4) {
+        s->creation_time = packet->packet.t2.versions.v3.creation_time;
+        memcpy(s->issuer_key_id, packet->packet.t2.versions.v3.signer_key_id, 8);
+        s->has_issuer_key_id = 1;
+        memcpy(s->left16, packet->packet.t2.versions.v3.left16, 2);
+      }
+    }
+
+    break;
+  case PTPGP_PACKET_PARSER_TOKEN_SIGNATURE_SUBPACKET_HASHED_LIST_START:
+    a->in_hashed_list = 1;
+    break;
+  case PTPGP_PACKET_PARSER_TOKEN_SIGNATURE_SUBPACKET_HASHED_LIST_END:
+    a->in_hashed_list = 0;
+    break;
+  case PTPGP_PACKET_PARSER_TOKEN_SIGNATURE_SUBPACKET_START:
+    sp = (ptpgp_signature_subpacket_header_t*) data;
+    a->subpacket_type = sp->type;
+    a->subpacket_len = 0;
+
+    break;
+  case PTPGP_PACKET_PARSER_TOKEN_SIGNATURE_SUBPACKET_BODY:
+    /* collect short subpackets (longer ones are ignored) */
+    n = sizeof(a->subpacket_buf) - a->subpacket_len;
+    if (data_len > n)
+      a->subpacket_len = sizeof(a->subpacket_buf) + 1;
+    else {
+      memcpy(a->subpacket_buf + a->subpacket_len, data, data_len);
+      a->subpacket_len += data_len;
+    }
+
+    break;
+  case PTPGP_PACKET_PARSER_TOKEN_SIGNATURE_SUBPACKET_END:
+    if (s)
+      signature_subpacket_end(a);
+
+    break;
+  case PTPGP_PACKET_PARSER_TOKEN_SIGNATURE_LEFT16:
+    if (s && data_len == 2)
+      memcpy(s->left16, data, 2);
+
+    break;
+  default:
+    /* ignore other tokens */
+    break;
+  }
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+static ptpgp_err_t
+start_packet(ptpgp_key_assembler_t *a,
+             ptpgp_packet_header_t *header) {
+  ptpgp_tag_t tag = header->content_tag;
+  ptpgp_key_public_key_t *k = NULL;
+  ptpgp_key_user_id_t *u;
+  ptpgp_key_signature_t *s = NULL;
+
+  switch (tag) {
+  case PTPGP_TAG_PUBLIC_KEY:
+    TRY(start_key(a));
+    k = &(a->key->primary);
+
+    break;
+  case PTPGP_TAG_PUBLIC_SUBKEY:
+    if (!a->key)
+      return PTPGP_ERR_STREAM_PARSER_SKIP_BODY;
+
+    ALLOC(a, k, sizeof(ptpgp_key_public_key_t));
+    *(a->subkey_tail) = k;
+    a->subkey_tail = &(k->next);
+    a->key->num_subkeys++;
+
+    /* binding signatures follow */
+    a->signature_tail = &(k->signatures);
+
+    break;
+  case PTPGP_TAG_USER_ID:
+  case PTPGP_TAG_USER_ATTRIBUTE:
+    if (!a->key)
+      return PTPGP_ERR_STREAM_PARSER_SKIP_BODY;
+
+    ALLOC(a, u, sizeof(ptpgp_key_user_id_t));
+    u->tag = tag;
+    *(a->user_id_tail) = u;
+    a->user_id_tail = &(u->next);
+    a->key->num_user_ids++;
+
+    /* certifications follow */
+    a->signature_tail = &(u->signatures);
+
+    /* keep packet body */
+    ALLOC(a, a->data, header->length);
+    u->data = a->data;
+    u->data_len = header->length;
+
+    return PTPGP_OK;
+  case PTPGP_TAG_SIGNATURE:
+    if (!a->key || !a->signature_tail)
+      return PTPGP_ERR_STREAM_PARSER_SKIP_BODY;
+
+    ALLOC(a, s, sizeof(ptpgp_key_signature_t));
+    *(a->signature_tail) = s;
+    a->signature_tail = &(s->next);
+    a->key->num_signatures++;
+
+    break;
+  case PTPGP_TAG_SECRET_KEY:
+    /* secret keys end the current key; drop them and their packets */
+    TRY(send_key(a));
+    return PTPGP_ERR_STREAM_PARSER_SKIP_BODY;
+  case PTPGP_TAG_SECRET_SUBKEY:
+    /* drop secret subkeys and their binding signatures */
+    a->signature_tail = NULL;
+    return PTPGP_ERR_STREAM_PARSER_SKIP_BODY;
+  default:
+    /* drop other packets (e.g. trust packets) */
+    return PTPGP_ERR_STREAM_PARSER_SKIP_BODY;
+  }
+
+  /* keep packet body */
+  ALLOC(a, a->data, header->length);
+
+  if (k) {
+    k->data = a->data;
+    k->data_len = header->length;
+  } else {
+    s->data = a->data;
+    s->data_len = header->length;
+  }
+
+  /* parse packet (mpis go to the key arena) */
+  a->public_key = k;
+  a->signature = s;
+  a->mpi_index = 0;
+  a->in_hashed_list = 0;
+
+  ptpgp_packet_parser_init(&(a->packet), tag, packet_cb, a);
+  ptpgp_packet_parser_set_mpi_arena(&(a->packet), &(a->key->arena));
+
+  if (k && a->engine)
+    ptpgp_packet_parser_set_key_fingerprint(
+      &(a->packet), a->engine, header->length
+    );
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+/*
+ * Drop a packet which is too large to keep, along with the packets
+ * which belong to it: an oversized primary key drops the whole key,
+ * and an oversized subkey, user ID, or attribute drops its signatures.
+ */
+static ptpgp_err_t
+skip_packet(ptpgp_key_assembler_t *a,
+            ptpgp_packet_header_t *header) {
+  switch (header->content_tag) {
+  case PTPGP_TAG_PUBLIC_KEY:
+  case PTPGP_TAG_SECRET_KEY:
+    /* send previous key, drop packets until the next key */
+    TRY(send_key(a));
+    return PTPGP_OK;
+  case PTPGP_TAG_PUBLIC_SUBKEY:
+  case PTPGP_TAG_SECRET_SUBKEY:
+  case PTPGP_TAG_USER_ID:
+  case PTPGP_TAG_USER_ATTRIBUTE:
+    a->signature_tail = NULL;
+    break;
+  default:
+    /* drop the packet only */
+    break;
+  }
+
+  if (a->key)
+    a->key->num_oversized_packets++;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+static ptpgp_err_t
+stream_cb(ptpgp_stream_parser_t *p,
+          ptpgp_stream_parser_token_t t,
+          ptpgp_packet_header_t *header,
+          u8 *data, size_t data_len) {
+  ptpgp_key_assembler_t *a = (ptpgp_key_assembler_t*) p->cb_data;
+  ptpgp_err_t err, *packet_err;
+
+  switch (t) {
+  case PTPGP_STREAM_PARSER_TOKEN_START:
+    a->data = NULL;
+    a->data_len = 0;
+    a->data_pos = 0;
+    a->public_key = NULL;
+    a->signature = NULL;
+
+    /* key packets have definite lengths (rfc4880 4.2.2.4) */
+    if (header->flags & (PTPGP_PACKET_FLAG_PARTIAL |
+                         PTPGP_PACKET_FLAG_INDETERMINITE))
+      DIE(a, BAD_PACKET_LENGTH);
+
+    if (header->length > PTPGP_KEY_ASSEMBLER_MAX_PACKET_SIZE) {
+      /* skip oversized packet and flag its key */
+      TRY(skip_packet(a, header));
+      a->num_skipped_packets++;
+
+      return PTPGP_ERR_STREAM_PARSER_SKIP_BODY;
+    }
+
+    err = start_packet(a, header);
+    if (err == PTPGP_ERR_STREAM_PARSER_SKIP_BODY)
+      a->num_skipped_packets++;
+    else if (err != PTPGP_OK)
+      return a->last_err = err;
+    else
+      a->data_len = header->length;
+
+    return err;
+  case PTPGP_STREAM_PARSER_TOKEN_BODY:
+    if (!a->data)
+      return PTPGP_OK;
+
+    if (data_len > a->data_len - a->data_pos)
+      DIE(a, BAD_PACKET_LENGTH);
+
+    /* copy body */
+    memcpy(a->data + a->data_pos, data, data_len);
+    a->data_pos += data_len;
+
+    /*
+     * parse key and signature packets (packets which can't be parsed,
+     * e.g. unknown versions or algorithms, are kept as packet data)
+     */
+    if ((packet_err = PACKET_ERR(a)) != NULL && !*packet_err)
+      *packet_err = ptpgp_packet_parser_push(&(a->packet), data, data_len);
+
+    break;
+  case PTPGP_STREAM_PARSER_TOKEN_END:
+    if ((packet_err = PACKET_ERR(a)) != NULL && !*packet_err)
+      *packet_err = ptpgp_packet_parser_done(&(a->packet));
+
+    a->data = NULL;
+    a->public_key = NULL;
+    a->signature = NULL;
+
+    break;
+  default:
+    /* ignore other tokens */
+    break;
+  }
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+ptpgp_err_t
+ptpgp_key_assembler_init(ptpgp_key_assembler_t *a,
+                         ptpgp_engine_t *engine,
+                         ptpgp_key_assembler_cb_t cb,
+                         void *user_data) {
+  memset(a, 0, sizeof(ptpgp_key_assembler_t));
+
+  a->engine = engine;
+  a->cb = cb;
+  a->user_data = user_data;
+
+  return ptpgp_stream_parser_init_tags(
+    &(a->stream), PTPGP_TAG_MASK_KEYS, stream_cb, a
+  );
+}
+
+ptpgp_err_t
+ptpgp_key_assembler_push(ptpgp_key_assembler_t *a,
+                         u8 *src,
+                         size_t src_len) {
+  ptpgp_err_t err;
+
+  /* return last error */
+  if (a->last_err)
+    return a->last_err;
+
+  if (a->is_done)
+    DIE(a, ALREADY_DONE);
+
+  if (!src || !src_len)
+    return ptpgp_key_assembler_done(a);
+
+  /* drop partial key on error */
+  if ((err = ptpgp_stream_parser_push(&(a->stream), src, src_len)) != PTPGP_OK) {
+    free_key(a);
+    return a->last_err = err;
+  }
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+ptpgp_err_t
+ptpgp_key_assembler_done(ptpgp_key_assembler_t *a) {
+  ptpgp_err_t err;
+
+  /* return last error */
+  if (a->last_err)
+    return a->last_err;
+
+  if (a->is_done)
+    DIE(a, ALREADY_DONE);
+
+  a->is_done = 1;
+
+  /* finish stream, then send last key */
+  if ((err = ptpgp_stream_parser_done(&(a->stream))) != PTPGP_OK ||
+      (err = send_key(a)) != PTPGP_OK) {
+    free_key(a);
+    return a->last_err = err;
+  }
+
+  /* return success */
+  return PTPGP_OK;
+}
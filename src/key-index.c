@@ -0,0 +1,544 @@
+#define _POSIX_C_SOURCE 200112L /* for posix_madvise() */
+
+#include <sys/types.h>  /* for fstat() */
+#include <sys/stat.h>   /* for fstat() */
+#include <sys/mman.h>   /* for mmap() */
+#include <fcntl.h>      /* for open() */
+#include <unistd.h>     /* for close() */
+#include <stdlib.h>     /* for realloc(), calloc(), free() */
+
+#include "internal.h"
+
+#define DIE(b, err) do {                                              \
+  D("returning error %s", #err);                                      \
+  return (b)->last_err = PTPGP_ERR_KEY_INDEX_##err;                   \
+} while (0)
+
+#define GET_U32(s) (                                                  \
+  ((uint32_t) (s)[0] << 24) |                                         \
+  ((uint32_t) (s)[1] << 16) |                                         \
+  ((uint32_t) (s)[2] <<  8) |                                         \
+  ((uint32_t) (s)[3])                                                 \
+)
+
+#define GET_U64(s) (                                                  \
+  ((uint64_t) GET_U32(s) << 32) | GET_U32((s) + 4)                    \
+)
+
+/* slot fields */
+#define SLOT_ID(s)      (s)
+#define SLOT_KEY_ID(s)  ((s) + 12)
+#define SLOT_FLAGS(s)   ((s)[20])
+#define SLOT_OFFSET(s)  ((s) + 24)
+
+/* home slot of a short key id (the last 4 octets of a key id) */
+#define HOME_SLOT(id, num_slots) (GET_U32(id) & ((num_slots) - 1))
+
+/* initial number of collected entries */
+#define MIN_ENTRIES 1024
+
+static void
+put_u32(u8 *dst, uint32_t v) {
+  dst[0] = (v >> 24) & 0xff;
+  dst[1] = (v >> 16) & 0xff;
+  dst[2] = (v >>  8) & 0xff;
+  dst[3] = v & 0xff;
+}
+
+static void
+put_u64(u8 *dst, uint64_t v) {
+  put_u32(dst, v >> 32);
+  put_u32(dst + 4, v & 0xffffffff);
+}
+
+static ptpgp_err_t
+add_entry(ptpgp_key_index_builder_t *b,
+          ptpgp_key_fingerprint_t *fp) {
+  u8 *slot;
+
+  /* grow collected slots */
+  if (b->num_entries == b->max_entries) {
+    uint64_t max = b->max_entries ? 2 * b->max_entries : MIN_ENTRIES;
+
+    if ((slot = realloc(b->slots, max * PTPGP_KEY_INDEX_SLOT_SIZE)) == NULL)
+      DIE(b, ALLOC_FAILED);
+
+    b->slots = slot;
+    b->max_entries = max;
+  }
+
+  /* encode slot */
+  slot = b->slots + b->num_entries * PTPGP_KEY_INDEX_SLOT_SIZE;
+  memset(slot, 0, PTPGP_KEY_INDEX_SLOT_SIZE);
+
+  if (fp->version == 4) {
+    memcpy(SLOT_ID(slot), fp->fingerprint, 20);
+    SLOT_FLAGS(slot) = PTPGP_KEY_INDEX_FLAG_FINGERPRINT;
+  } else {
+    /* v3 keys only have a key id */
+    memcpy(SLOT_KEY_ID(slot), fp->key_id, 8);
+  }
+
+  SLOT_FLAGS(slot) |= PTPGP_KEY_INDEX_FLAG_USED;
+  if (b->is_subkey)
+    SLOT_FLAGS(slot) |= PTPGP_KEY_INDEX_FLAG_SUBKEY;
+
+  put_u64(SLOT_OFFSET(slot), b->key_offset);
+
+  b->num_entries++;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+/* stop fingerprinting the current key packet (it isn't indexed) */
+static void
+skip_key(ptpgp_key_index_builder_t *b) {
+  if (b->key_version == 4)
+    ptpgp_engine_hash_done(&(b->key_hash));
+
+  b->num_skipped_keys++;
+  b->in_key = 0;
+}
+
+/*
+ * Start key fingerprint (rfc4880 12.2) at the first body octet.  v4
+ * fingerprints are the SHA-1 of 0x99, the 2-octet body length, and the
+ * body, so any key is indexed whatever its algorithm; v3 key IDs are
+ * the low 64 bits of the RSA modulus, so the start of v3 bodies is
+ * buffered instead.
+ */
+static ptpgp_err_t
+start_key_hash(ptpgp_key_index_builder_t *b, u8 version) {
+  u8 prefix[3];
+
+  b->key_version = version;
+
+  if (version == 2 || version == 3) {
+    /* buffer body */
+    b->key_buf_len = 0;
+  } else if (version == 4 && b->key_len <= 0xffff) {
+    prefix[0] = 0x99;
+    prefix[1] = (b->key_len >> 8) & 0xff;
+    prefix[2] = b->key_len & 0xff;
+
+    TRY(ptpgp_engine_hash_init(&(b->key_hash), b->engine, PTPGP_HASH_TYPE_SHA1));
+    TRY(ptpgp_engine_hash_push(&(b->key_hash), prefix, sizeof(prefix)));
+  } else {
+    /* unknown version (or bad length) */
+    b->key_version = 0;
+    skip_key(b);
+  }
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+static ptpgp_err_t
+push_key_hash(ptpgp_key_index_builder_t *b, u8 *src, size_t src_len) {
+  size_t n;
+
+  if (b->key_version == 4)
+    return ptpgp_engine_hash_push(&(b->key_hash), src, src_len);
+
+  /* buffer start of v3 body (the modulus comes first) */
+  n = sizeof(b->key_buf) - b->key_buf_len;
+  if (n > src_len)
+    n = src_len;
+
+  memcpy(b->key_buf + b->key_buf_len, src, n);
+  b->key_buf_len += n;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+static ptpgp_err_t
+finish_key_hash(ptpgp_key_index_builder_t *b) {
+  ptpgp_key_fingerprint_t fp;
+  size_t len;
+
+  memset(&fp, 0, sizeof(ptpgp_key_fingerprint_t));
+  fp.version = b->key_version;
+
+  if (b->key_version == 4) {
+    TRY(ptpgp_engine_hash_done(&(b->key_hash)));
+    TRY(ptpgp_engine_hash_read(
+      &(b->key_hash), fp.fingerprint, sizeof(fp.fingerprint),
+      &(fp.fingerprint_len)
+    ));
+
+    if (fp.fingerprint_len != 20) {
+      b->num_skipped_keys++;
+      return PTPGP_OK;
+    }
+
+    memcpy(fp.key_id, fp.fingerprint + 12, 8);
+  } else {
+    /* version, creation time, validity, algorithm, and modulus */
+    len = (b->key_buf_len >= 10) ? 
+          (((b->key_buf[8] << 8) | b->key_buf[9]) + 7) / 8 : 0;
+
+    if (len < 8 || 10 + len > b->key_buf_len) {
+      b->num_skipped_keys++;
+      return PTPGP_OK;
+    }
+
+    memcpy(fp.key_id, b->key_buf + 10 + len - 8, 8);
+  }
+
+  return add_entry(b, &fp);
+}
+
+static ptpgp_err_t
+stream_cb(ptpgp_stream_parser_t *p,
+          ptpgp_stream_parser_token_t t,
+          ptpgp_packet_header_t *header,
+          u8 *src, size_t src_len) {
+  ptpgp_key_index_builder_t *b = p->cb_data;
+
+  switch (t) {
+  case PTPGP_STREAM_PARSER_TOKEN_START:
+    b->in_key = 0;
+
+    switch (header->content_tag) {
+    case PTPGP_TAG_PUBLIC_KEY:
+      /* start of transferable key */
+      b->key_offset = p->header_offset;
+      b->has_key = 1;
+      b->is_subkey = 0;
+      break;
+    case PTPGP_TAG_SECRET_KEY:
+      /* secret keys end the current key, and aren't indexed (the
+       * fingerprint only covers the public part of the body) */
+      b->has_key = 0;
+
+      /* fall-through */
+    case PTPGP_TAG_SECRET_SUBKEY:
+      b->num_skipped_keys++;
+      return PTPGP_ERR_STREAM_PARSER_SKIP_BODY;
+    default:
+      /* subkeys belong to the previous key */
+      if (!b->has_key)
+        return PTPGP_ERR_STREAM_PARSER_SKIP_BODY;
+
+      b->is_subkey = 1;
+    }
+
+    /* fingerprint key packet body (see start_key_hash()) */
+    b->key_len = header->length;
+    b->key_pos = 0;
+    b->key_version = 0;
+    b->in_key = 1;
+
+    break;
+  case PTPGP_STREAM_PARSER_TOKEN_BODY:
+    if (!b->in_key || !src_len)
+      break;
+
+    if (!b->key_pos)
+      TRY(start_key_hash(b, src[0]));
+
+    if (b->in_key)
+      TRY(push_key_hash(b, src, src_len));
+
+    b->key_pos += src_len;
+
+    break;
+  case PTPGP_STREAM_PARSER_TOKEN_END:
+    if (b->in_key && b->key_version) {
+      b->in_key = 0;
+      return finish_key_hash(b);
+    } else if (b->in_key) {
+      /* empty key packet */
+      b->num_skipped_keys++;
+    }
+
+    b->in_key = 0;
+
+    break;
+  default:
+    /* ignore unknown tokens */
+    break;
+  }
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+ptpgp_err_t
+ptpgp_key_index_builder_init(ptpgp_key_index_builder_t *b,
+                             ptpgp_engine_t *engine,
+                             ptpgp_key_index_builder_cb_t cb,
+                             void *user_data) {
+  /* clear builder */
+  memset(b, 0, sizeof(ptpgp_key_index_builder_t));
+
+  /* save engine and callback */
+  b->engine = engine;
+  b->cb = cb;
+  b->user_data = user_data;
+
+  /* init stream parser (other packets are skipped without callbacks) */
+  return ptpgp_stream_parser_init_tags(
+    &(b->parser),
+    PTPGP_TAG_MASK(PTPGP_TAG_PUBLIC_KEY) |
+    PTPGP_TAG_MASK(PTPGP_TAG_PUBLIC_SUBKEY) |
+    PTPGP_TAG_MASK(PTPGP_TAG_SECRET_KEY) |
+    PTPGP_TAG_MASK(PTPGP_TAG_SECRET_SUBKEY),
+    stream_cb, b
+  );
+}
+
+static ptpgp_err_t
+write_index(ptpgp_key_index_builder_t *b) {
+  u8 header[PTPGP_KEY_INDEX_HEADER_SIZE], *table, *src, *dst;
+  uint64_t i, h, num_slots = PTPGP_KEY_INDEX_MIN_SLOTS;
+  ptpgp_err_t err;
+
+  /* get table size (a power of two, at most half full) */
+  while (num_slots < 2 * b->num_entries)
+    num_slots *= 2;
+
+  if ((table = calloc(num_slots, PTPGP_KEY_INDEX_SLOT_SIZE)) == NULL)
+    DIE(b, ALLOC_FAILED);
+
+  /* insert entries */
+  for (i = 0; i < b->num_entries; i++) {
+    src = b->slots + i * PTPGP_KEY_INDEX_SLOT_SIZE;
+
+    /* find free slot */
+    for (h = HOME_SLOT(SLOT_KEY_ID(src) + 4, num_slots);
+         SLOT_FLAGS(table + h * PTPGP_KEY_INDEX_SLOT_SIZE);
+         h = (h + 1) & (num_slots - 1));
+
+    dst = table + h * PTPGP_KEY_INDEX_SLOT_SIZE;
+    memcpy(dst, src, PTPGP_KEY_INDEX_SLOT_SIZE);
+  }
+
+  /* encode header */
+  memcpy(header, PTPGP_KEY_INDEX_MAGIC, 8);
+  put_u32(header + 8, PTPGP_KEY_INDEX_VERSION);
+  put_u32(header + 12, PTPGP_KEY_INDEX_SLOT_SIZE);
+  put_u64(header + 16, num_slots);
+  put_u64(header + 24, b->num_entries);
+
+  /* write header and table */
+  if ((err = b->cb(b, header, sizeof(header))) == PTPGP_OK)
+    err = b->cb(b, table, num_slots * PTPGP_KEY_INDEX_SLOT_SIZE);
+
+  free(table);
+
+  if (err != PTPGP_OK)
+    return b->last_err = err;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+ptpgp_err_t
+ptpgp_key_index_builder_push(ptpgp_key_index_builder_t *b,
+                             u8 *src,
+                             size_t src_len) {
+  ptpgp_err_t err;
+
+  /* return last error */
+  if (b->last_err)
+    return b->last_err;
+
+  if (b->is_done)
+    DIE(b, ALREADY_DONE);
+
+  if ((err = ptpgp_stream_parser_push(&(b->parser), src, src_len)) != PTPGP_OK)
+    return b->last_err = err;
+
+  if (!src || !src_len) {
+    /* write index */
+    err = write_index(b);
+    ptpgp_key_index_builder_free(b);
+
+    if (err != PTPGP_OK)
+      return err;
+
+    /* flag builder as finished */
+    b->is_done = 1;
+  }
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+ptpgp_err_t
+ptpgp_key_index_builder_done(ptpgp_key_index_builder_t *b) {
+  return ptpgp_key_index_builder_push(b, 0, 0);
+}
+
+ptpgp_err_t
+ptpgp_key_index_builder_free(ptpgp_key_index_builder_t *b) {
+  /* release hash of unfinished key packet */
+  if (b->in_key && b->key_version == 4)
+    ptpgp_engine_hash_done(&(b->key_hash));
+
+  b->in_key = 0;
+
+  /* free collected slots */
+  free(b->slots);
+  b->slots = NULL;
+  b->max_entries = 0;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+ptpgp_err_t
+ptpgp_key_index_load(ptpgp_key_index_t *index,
+                     u8 *src,
+                     size_t src_len) {
+  uint64_t num_slots;
+
+  /* clear index */
+  memset(index, 0, sizeof(ptpgp_key_index_t));
+
+  /* check header */
+  if (src_len < PTPGP_KEY_INDEX_HEADER_SIZE ||
+      memcmp(src, PTPGP_KEY_INDEX_MAGIC, 8) ||
+      GET_U32(src + 12) != PTPGP_KEY_INDEX_SLOT_SIZE)
+    return PTPGP_ERR_KEY_INDEX_BAD_HEADER;
+
+  /* check version */
+  if (GET_U32(src + 8) != PTPGP_KEY_INDEX_VERSION)
+    return PTPGP_ERR_KEY_INDEX_BAD_VERSION;
+
+  /* check table size (a power of two which matches the input) */
+  num_slots = GET_U64(src + 16);
+  if (!num_slots || (num_slots & (num_slots - 1)) ||
+      num_slots > (src_len - PTPGP_KEY_INDEX_HEADER_SIZE) / PTPGP_KEY_INDEX_SLOT_SIZE ||
+      src_len != PTPGP_KEY_INDEX_HEADER_SIZE + num_slots * PTPGP_KEY_INDEX_SLOT_SIZE ||
+      GET_U64(src + 24) > num_slots / 2)
+    return PTPGP_ERR_KEY_INDEX_BAD_HEADER;
+
+  /* save table */
+  index->slots = src + PTPGP_KEY_INDEX_HEADER_SIZE;
+  index->num_slots = num_slots;
+  index->num_entries = GET_U64(src + 24);
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+ptpgp_err_t
+ptpgp_key_index_open(ptpgp_key_index_t *index,
+                     char *path) {
+  struct stat st;
+  void *map;
+  ptpgp_err_t err;
+  int fd;
+
+  /* open index file */
+  if ((fd = open(path, O_RDONLY)) == -1)
+    return PTPGP_ERR_KEY_INDEX_OPEN_FAILED;
+
+  if (fstat(fd, &st)) {
+    close(fd);
+    return PTPGP_ERR_KEY_INDEX_OPEN_FAILED;
+  }
+
+  if (st.st_size < PTPGP_KEY_INDEX_HEADER_SIZE) {
+    close(fd);
+    return PTPGP_ERR_KEY_INDEX_BAD_HEADER;
+  }
+
+  /* map index (the mapping outlives the descriptor) */
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if (map == MAP_FAILED)
+    return PTPGP_ERR_KEY_INDEX_MMAP_FAILED;
+
+  /* lookups are random access */
+  posix_madvise(map, st.st_size, POSIX_MADV_RANDOM);
+
+  if ((err = ptpgp_key_index_load(index, map, st.st_size)) != PTPGP_OK) {
+    munmap(map, st.st_size);
+    return err;
+  }
+
+  /* save mapping */
+  index->map = map;
+  index->map_len = st.st_size;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+ptpgp_err_t
+ptpgp_key_index_close(ptpgp_key_index_t *index) {
+  if (index->map && munmap(index->map, index->map_len))
+    return PTPGP_ERR_KEY_INDEX_MMAP_FAILED;
+
+  /* clear index */
+  memset(index, 0, sizeof(ptpgp_key_index_t));
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+static bool
+slot_matches(u8 *slot, u8 *id, size_t id_len) {
+  switch (id_len) {
+  case 20:
+    return (SLOT_FLAGS(slot) & PTPGP_KEY_INDEX_FLAG_FINGERPRINT) &&
+           !memcmp(SLOT_ID(slot), id, 20);
+  case 8:
+    return !memcmp(SLOT_KEY_ID(slot), id, 8);
+  default:
+    return !memcmp(SLOT_KEY_ID(slot) + 4, id, 4);
+  }
+}
+
+ptpgp_err_t
+ptpgp_key_index_find(ptpgp_key_index_t *index,
+                     u8 *id,
+                     size_t id_len,
+                     uint64_t *iter,
+                     ptpgp_key_index_entry_t *entry) {
+  uint64_t i, h;
+  u8 *slot;
+
+  if (id_len != 20 && id_len != 8 && id_len != 4)
+    return PTPGP_ERR_KEY_INDEX_BAD_ID_LENGTH;
+
+  /* probe from home slot (the table always has free slots) */
+  for (i = *iter; i < index->num_slots; i++) {
+    h = (HOME_SLOT(id + id_len - 4, index->num_slots) + i) & (index->num_slots - 1);
+    slot = index->slots + h * PTPGP_KEY_INDEX_SLOT_SIZE;
+
+    /* stop at first free slot */
+    if (!SLOT_FLAGS(slot))
+      break;
+
+    if (slot_matches(slot, id, id_len)) {
+      /* decode entry */
+      memset(entry, 0, sizeof(ptpgp_key_index_entry_t));
+
+      if (SLOT_FLAGS(slot) & PTPGP_KEY_INDEX_FLAG_FINGERPRINT) {
+        memcpy(entry->fingerprint, SLOT_ID(slot), 20);
+        entry->has_fingerprint = 1;
+      }
+
+      memcpy(entry->key_id, SLOT_KEY_ID(slot), 8);
+      entry->is_subkey = (SLOT_FLAGS(slot) & PTPGP_KEY_INDEX_FLAG_SUBKEY) ? 1 : 0;
+      entry->key_offset = GET_U64(SLOT_OFFSET(slot));
+
+      /* continue after this slot */
+      *iter = i + 1;
+
+      /* return success */
+      return PTPGP_OK;
+    }
+  }
+
+  /* no more matches */
+  *iter = index->num_slots;
+  return PTPGP_ERR_KEY_INDEX_NOT_FOUND;
+}
@@ -0,0 +1,32 @@
+#include "internal.h"
+
+ptpgp_err_t
+ptpgp_mpi_init(ptpgp_mpi_t *m,
+               ptpgp_arena_t *arena,
+               u8 *src,
+               size_t src_len) {
+  void *data;
+  size_t i;
+
+  /* strip leading zero octets */
+  while (src_len > 0 && !src[0]) {
+    src++;
+    src_len--;
+  }
+
+  if (src_len > PTPGP_MPI_MAX_SIZE)
+    return PTPGP_ERR_MPI_TOO_LARGE;
+
+  /* count bits */
+  m->num_bits = src_len * 8;
+  for (i = 0; src_len > 0 && i < 8 && !(src[0] & (0x80 >> i)); i++)
+    m->num_bits--;
+
+  /* copy data */
+  TRY(ptpgp_arena_alloc(arena, src_len, &data));
+  memcpy(data, src, src_len);
+  m->data = data;
+
+  /* return success */
+  return PTPGP_OK;
+}
@@ -1,4 +1,5 @@
 #ifdef PTPGP_USE_OPENSSL
+#include <stdlib.h> /* for calloc(), free() */
 #include "internal.h"
 
 /****************/
@@ -424,6 +425,35 @@ dump_rsa(RSA *rsa) {
   dump_bn("iqmp", rsa->iqmp);
 }
 
+static ptpgp_err_t
+set_bn(ptpgp_mpi_t *dst, ptpgp_arena_t *arena, BIGNUM *bn) {
+  u8 buf[PTPGP_MPI_MAX_SIZE];
+  size_t len;
+
+  /* check buffer size */
+  if (!bn || (size_t) BN_num_bytes(bn) > sizeof(buf))
+    return PTPGP_ERR_ENGINE_PK_GENKEY_MPI_TOO_LARGE;
+
+  /* write magnitude to buffer, then copy it to arena */
+  len = BN_bn2bin(bn, buf);
+  return ptpgp_mpi_init(dst, arena, buf, len);
+}
+
+static ptpgp_err_t
+set_rsa_key(ptpgp_pk_key_t *dst, ptpgp_arena_t *arena, RSA *rsa) {
+  TRY(set_bn(&(dst->rsa.n), arena, rsa->n));
+  TRY(set_bn(&(dst->rsa.e), arena, rsa->e));
+  TRY(set_bn(&(dst->rsa.d), arena, rsa->d));
+  TRY(set_bn(&(dst->rsa.p), arena, rsa->p));
+  TRY(set_bn(&(dst->rsa.q), arena, rsa->q));
+  TRY(set_bn(&(dst->rsa.dmp1), arena, rsa->dmp1));
+  TRY(set_bn(&(dst->rsa.dmq1), arena, rsa->dmq1));
+  TRY(set_bn(&(dst->rsa.iqmp), arena, rsa->iqmp));
+
+  /* return success */
+  return PTPGP_OK;
+}
+
 static void
 pk_genkey_rsa_cb(int step, int n, void *cb_data) {
   ptpgp_pk_genkey_context_t *c = (ptpgp_pk_genkey_context_t*) cb_data;
@@ -454,6 +484,7 @@ pk_genkey_rsa_cb(int step, int n, void *cb_data) {
 static ptpgp_err_t
 pk_genkey_rsa(ptpgp_pk_genkey_context_t *c) {
   RSA *rsa;
+  ptpgp_err_t err;
 
   /* generate key */
   rsa = RSA_generate_key(c->options.num_bits,
@@ -468,17 +499,20 @@ pk_genkey_rsa(ptpgp_pk_genkey_context_t *c) {
   dump_rsa(rsa);
 
   /* populate key structure */
-  /* TODO */
+  err = set_rsa_key(&(c->key), c->options.arena, rsa);
 
   /* free rsa structure */
   RSA_free(rsa);
 
-  /* return success */
-  return PTPGP_OK;
+  /* return result */
+  return err;
 }
 
 static ptpgp_err_t
 pk_genkey(ptpgp_pk_genkey_context_t *c) {
+  /* save algorithm */
+  c->key.algorithm = c->options.algorithm;
+
   switch(c->options.algorithm) {
   case PTPGP_PUBLIC_KEY_TYPE_RSA:
   case PTPGP_PUBLIC_KEY_TYPE_RSA_ENCRYPT_ONLY:
@@ -489,6 +523,272 @@ pk_genkey(ptpgp_pk_genkey_context_t *c) {
   }
 }
 
+/* convert mpi to bignum (NULL for unset mpis) */
+static BIGNUM *
+get_bn(ptpgp_mpi_t *m) {
+  return m->data ? BN_bin2bn(m->data, PTPGP_MPI_SIZE(m), NULL) : NULL;
+}
+
+static ptpgp_err_t
+get_rsa_key(RSA **r, ptpgp_pk_key_t *k, bool secret) {
+  RSA *rsa;
+
+  if (!k->rsa.n.data || !k->rsa.e.data || (secret && !k->rsa.d.data))
+    return PTPGP_ERR_ENGINE_PK_INCOMPLETE_KEY;
+
+  if ((rsa = RSA_new()) == NULL)
+    return secret ? PTPGP_ERR_ENGINE_PK_SIGN_FAILED :
+                    PTPGP_ERR_ENGINE_PK_VERIFY_FAILED;
+
+  rsa->n = get_bn(&(k->rsa.n));
+  rsa->e = get_bn(&(k->rsa.e));
+
+  if (secret) {
+    rsa->d = get_bn(&(k->rsa.d));
+
+    /* (CRT values are only used if all of them are set) */
+    rsa->p = get_bn(&(k->rsa.p));
+    rsa->q = get_bn(&(k->rsa.q));
+    rsa->dmp1 = get_bn(&(k->rsa.dmp1));
+    rsa->dmq1 = get_bn(&(k->rsa.dmq1));
+    rsa->iqmp = get_bn(&(k->rsa.iqmp));
+  }
+
+  *r = rsa;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+static ptpgp_err_t
+get_dsa_key(DSA **r, ptpgp_pk_key_t *k, bool secret) {
+  DSA *dsa;
+
+  if (!k->dsa.p.data || !k->dsa.q.data || !k->dsa.g.data ||
+      !k->dsa.y.data || (secret && !k->dsa.x.data))
+    return PTPGP_ERR_ENGINE_PK_INCOMPLETE_KEY;
+
+  if ((dsa = DSA_new()) == NULL)
+    return secret ? PTPGP_ERR_ENGINE_PK_SIGN_FAILED :
+                    PTPGP_ERR_ENGINE_PK_VERIFY_FAILED;
+
+  dsa->p = get_bn(&(k->dsa.p));
+  dsa->q = get_bn(&(k->dsa.q));
+  dsa->g = get_bn(&(k->dsa.g));
+  dsa->pub_key = get_bn(&(k->dsa.y));
+
+  if (secret)
+    dsa->priv_key = get_bn(&(k->dsa.x));
+
+  *r = dsa;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+static ptpgp_err_t
+pk_sign(ptpgp_hash_context_t *digest,
+        ptpgp_pk_key_t *key,
+        ptpgp_pk_signature_t *sig,
+        ptpgp_arena_t *arena) {
+  const EVP_MD *md;
+  ptpgp_err_t err;
+  u8 buf[PTPGP_MPI_MAX_SIZE];
+  unsigned int len;
+  RSA *rsa;
+  DSA *dsa;
+  DSA_SIG *s;
+
+  switch (key->algorithm) {
+  case PTPGP_PUBLIC_KEY_TYPE_RSA:
+  case PTPGP_PUBLIC_KEY_TYPE_RSA_SIGN_ONLY:
+    if ((md = get_hash_algorithm(digest->algorithm)) == NULL)
+      return PTPGP_ERR_ENGINE_PK_UNSUPPORTED_HASH;
+
+    TRY(get_rsa_key(&rsa, key, 1));
+
+    if ((size_t) RSA_size(rsa) > sizeof(buf)) {
+      RSA_free(rsa);
+      return PTPGP_ERR_ENGINE_PK_SIGN_FAILED;
+    }
+
+    /* EMSA-PKCS1-v1_5 encoded digest (rfc4880 5.2.2) */
+    if (RSA_sign(EVP_MD_type(md), digest->hash, digest->hash_len,
+                 buf, &len, rsa)) {
+      err = ptpgp_mpi_init(&(sig->rsa.s), arena, buf, len);
+    } else {
+      err = PTPGP_ERR_ENGINE_PK_SIGN_FAILED;
+    }
+
+    RSA_free(rsa);
+    return err;
+  case PTPGP_PUBLIC_KEY_TYPE_DSA:
+    TRY(get_dsa_key(&dsa, key, 1));
+
+    /* (DSA_do_sign() truncates the digest to the size of q) */
+    if ((s = DSA_do_sign(digest->hash, digest->hash_len, dsa)) != NULL) {
+      err = set_bn(&(sig->dsa.r), arena, s->r);
+      if (err == PTPGP_OK)
+        err = set_bn(&(sig->dsa.s), arena, s->s);
+
+      DSA_SIG_free(s);
+    } else {
+      err = PTPGP_ERR_ENGINE_PK_SIGN_FAILED;
+    }
+
+    DSA_free(dsa);
+    return err;
+  default:
+    return PTPGP_ERR_ENGINE_PK_UNSUPPORTED_ALGORITHM;
+  }
+}
+
+/*
+ * per-thread verify state: the RSA or DSA object of the last key (with
+ * its cached Montgomery contexts)
+ */
+typedef struct {
+  ptpgp_pk_key_t *key;
+  RSA *rsa;
+  DSA *dsa;
+} pk_verify_context_t;
+
+static ptpgp_err_t
+pk_verify_init(ptpgp_engine_t *e, void **ctx) {
+  UNUSED(e);
+
+  if ((*ctx = calloc(1, sizeof(pk_verify_context_t))) == NULL)
+    return PTPGP_ERR_ENGINE_PK_VERIFY_FAILED;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+static void
+pk_verify_context_clear(pk_verify_context_t *c) {
+  if (c->rsa)
+    RSA_free(c->rsa);
+  if (c->dsa)
+    DSA_free(c->dsa);
+
+  memset(c, 0, sizeof(pk_verify_context_t));
+}
+
+static void
+pk_verify_done(void *ctx) {
+  pk_verify_context_clear((pk_verify_context_t*) ctx);
+  free(ctx);
+}
+
+static ptpgp_err_t
+pk_verify_rsa(RSA *rsa,
+              ptpgp_hash_context_t *digest,
+              ptpgp_pk_signature_t *sig) {
+  const EVP_MD *md;
+  u8 buf[PTPGP_MPI_MAX_SIZE];
+  size_t len, sig_len;
+
+  if ((md = get_hash_algorithm(digest->algorithm)) == NULL)
+    return PTPGP_ERR_ENGINE_PK_UNSUPPORTED_HASH;
+
+  /* left-pad signature to the size of the modulus */
+  len = RSA_size(rsa);
+  sig_len = PTPGP_MPI_SIZE(&(sig->rsa.s));
+
+  if (len > sizeof(buf) || sig_len > len)
+    return PTPGP_ERR_ENGINE_PK_VERIFY_BAD_SIGNATURE;
+
+  memset(buf, 0, len - sig_len);
+  memcpy(buf + len - sig_len, sig->rsa.s.data, sig_len);
+
+  return RSA_verify(EVP_MD_type(md), digest->hash, digest->hash_len,
+                    buf, len, rsa) ?
+    PTPGP_OK : PTPGP_ERR_ENGINE_PK_VERIFY_BAD_SIGNATURE;
+}
+
+static ptpgp_err_t
+pk_verify_dsa(DSA *dsa,
+              ptpgp_hash_context_t *digest,
+              ptpgp_pk_signature_t *sig) {
+  ptpgp_err_t err;
+  DSA_SIG *s;
+
+  if ((s = DSA_SIG_new()) == NULL)
+    return PTPGP_ERR_ENGINE_PK_VERIFY_FAILED;
+
+  s->r = get_bn(&(sig->dsa.r));
+  s->s = get_bn(&(sig->dsa.s));
+
+  /* (DSA_do_verify() truncates the digest to the size of q) */
+  switch (DSA_do_verify(digest->hash, digest->hash_len, s, dsa)) {
+  case 1:
+    err = PTPGP_OK;
+    break;
+  case 0:
+    err = PTPGP_ERR_ENGINE_PK_VERIFY_BAD_SIGNATURE;
+    break;
+  default:
+    err = PTPGP_ERR_ENGINE_PK_VERIFY_FAILED;
+  }
+
+  DSA_SIG_free(s);
+  return err;
+}
+
+static ptpgp_err_t
+pk_verify(void *ctx,
+          ptpgp_hash_context_t *digest,
+          ptpgp_pk_key_t *key,
+          ptpgp_pk_signature_t *sig) {
+  pk_verify_context_t *c = (pk_verify_context_t*) ctx, tmp;
+  ptpgp_err_t err;
+
+  switch (key->algorithm) {
+  case PTPGP_PUBLIC_KEY_TYPE_RSA:
+  case PTPGP_PUBLIC_KEY_TYPE_RSA_SIGN_ONLY:
+    if (!sig->rsa.s.data)
+      return PTPGP_ERR_ENGINE_PK_VERIFY_BAD_SIGNATURE;
+
+    break;
+  case PTPGP_PUBLIC_KEY_TYPE_DSA:
+    if (!sig->dsa.r.data || !sig->dsa.s.data)
+      return PTPGP_ERR_ENGINE_PK_VERIFY_BAD_SIGNATURE;
+
+    break;
+  default:
+    return PTPGP_ERR_ENGINE_PK_UNSUPPORTED_ALGORITHM;
+  }
+
+  /* without a context, use a temporary one */
+  if (!c) {
+    memset(&tmp, 0, sizeof(pk_verify_context_t));
+    c = &tmp;
+  }
+
+  /* get key object (reused for runs of signatures by the same key) */
+  if (c->key != key) {
+    pk_verify_context_clear(c);
+
+    if (key->algorithm == PTPGP_PUBLIC_KEY_TYPE_DSA)
+      TRY(get_dsa_key(&(c->dsa), key, 0));
+    else
+      TRY(get_rsa_key(&(c->rsa), key, 0));
+
+    c->key = key;
+  }
+
+  if (c->dsa)
+    err = pk_verify_dsa(c->dsa, digest, sig);
+  else
+    err = pk_verify_rsa(c->rsa, digest, sig);
+
+  if (c == &tmp)
+    pk_verify_context_clear(c);
+
+  /* return result */
+  return err;
+}
+
 /****************/
 /* init methods */
 /****************/
@@ -517,7 +817,12 @@ engine = {
 
   /* public key methods */
   .pk = {
-    .genkey = pk_genkey
+    .genkey = pk_genkey,
+    .sign   = pk_sign,
+    .verify = pk_verify,
+
+    .verify_init = pk_verify_init,
+    .verify_done = pk_verify_done
   }
 };
 
@@ -0,0 +1,300 @@
+#define _POSIX_C_SOURCE 200112L /* for posix_madvise() */
+
+#include <sys/types.h>  /* for fstat() */
+#include <sys/stat.h>   /* for fstat() */
+#include <sys/mman.h>   /* for mmap() */
+#include <fcntl.h>      /* for open() */
+#include <unistd.h>     /* for close() */
+
+#include "internal.h"
+
+#define DIE(b, err) do {                                              \
+  D("returning error %s", #err);                                      \
+  return (b)->last_err = PTPGP_ERR_PACKET_INDEX_##err;                \
+} while (0)
+
+#define GET_U32(s) (                                                  \
+  ((uint32_t) (s)[0] << 24) |                                         \
+  ((uint32_t) (s)[1] << 16) |                                         \
+  ((uint32_t) (s)[2] <<  8) |                                         \
+  ((uint32_t) (s)[3])                                                 \
+)
+
+#define GET_U64(s) (                                                  \
+  ((uint64_t) GET_U32(s) << 32) | GET_U32((s) + 4)                    \
+)
+
+static void
+put_u32(u8 *dst, uint32_t v) {
+  dst[0] = (v >> 24) & 0xff;
+  dst[1] = (v >> 16) & 0xff;
+  dst[2] = (v >>  8) & 0xff;
+  dst[3] = v & 0xff;
+}
+
+static void
+put_u64(u8 *dst, uint64_t v) {
+  put_u32(dst, v >> 32);
+  put_u32(dst + 4, v & 0xffffffff);
+}
+
+static ptpgp_err_t
+flush(ptpgp_packet_index_builder_t *b) {
+  if (b->buf_len > 0) {
+    ptpgp_err_t err = b->cb(b, b->buf, b->buf_len);
+
+    if (err != PTPGP_OK)
+      return b->last_err = err;
+
+    b->buf_len = 0;
+  }
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+static ptpgp_err_t
+write_entry(ptpgp_packet_index_builder_t *b) {
+  ptpgp_packet_index_entry_t *e = &(b->entry);
+  u8 *dst;
+
+  /* flush full write buffer */
+  if (b->buf_len + PTPGP_PACKET_INDEX_ENTRY_SIZE > sizeof(b->buf))
+    TRY(flush(b));
+
+  /* encode entry */
+  dst = b->buf + b->buf_len;
+  memset(dst, 0, PTPGP_PACKET_INDEX_ENTRY_SIZE);
+  dst[0] = e->tag;
+  dst[1] = e->flags & 0xff;
+  put_u64(dst +  8, e->header_offset);
+  put_u64(dst + 16, e->body_offset);
+  put_u64(dst + 24, e->body_length);
+
+  b->buf_len += PTPGP_PACKET_INDEX_ENTRY_SIZE;
+  b->num_entries++;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+static ptpgp_err_t
+stream_cb(ptpgp_stream_parser_t *p,
+          ptpgp_stream_parser_token_t t,
+          ptpgp_packet_header_t *header,
+          u8 *src, size_t src_len) {
+  ptpgp_packet_index_builder_t *b = p->cb_data;
+
+  UNUSED(src);
+  UNUSED(src_len);
+
+  switch (t) {
+  case PTPGP_STREAM_PARSER_TOKEN_START:
+    /* save header (the partial flag is cleared by the last chunk, so
+     * the flags must be saved here) */
+    b->entry.tag = header->content_tag;
+    b->entry.flags = header->flags;
+    b->entry.header_offset = p->header_offset;
+    b->entry.body_offset = p->body_offset;
+    b->entry.body_length = 0;
+
+    /* only the packet boundaries are needed */
+    return PTPGP_ERR_STREAM_PARSER_SKIP_BODY;
+  case PTPGP_STREAM_PARSER_TOKEN_END:
+    /* stream offset is at the end of the packet body */
+    b->entry.body_length = p->offset - b->entry.body_offset;
+    TRY(write_entry(b));
+
+    break;
+  default:
+    /* ignore unknown tokens */
+    break;
+  }
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+ptpgp_err_t
+ptpgp_packet_index_builder_init(ptpgp_packet_index_builder_t *b,
+                                ptpgp_packet_index_builder_cb_t cb,
+                                void *user_data) {
+  /* clear builder */
+  memset(b, 0, sizeof(ptpgp_packet_index_builder_t));
+
+  /* save callback */
+  b->cb = cb;
+  b->user_data = user_data;
+
+  /* init stream parser */
+  TRY(ptpgp_stream_parser_init(&(b->parser), stream_cb, b));
+
+  /* write file header */
+  memcpy(b->buf, PTPGP_PACKET_INDEX_MAGIC, 8);
+  put_u32(b->buf + 8, PTPGP_PACKET_INDEX_VERSION);
+  put_u32(b->buf + 12, PTPGP_PACKET_INDEX_ENTRY_SIZE);
+  b->buf_len = PTPGP_PACKET_INDEX_HEADER_SIZE;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+ptpgp_err_t
+ptpgp_packet_index_builder_push(ptpgp_packet_index_builder_t *b,
+                                u8 *src,
+                                size_t src_len) {
+  ptpgp_err_t err;
+
+  /* return last error */
+  if (b->last_err)
+    return b->last_err;
+
+  if (b->is_done)
+    DIE(b, ALREADY_DONE);
+
+  if ((err = ptpgp_stream_parser_push(&(b->parser), src, src_len)) != PTPGP_OK)
+    return b->last_err = err;
+
+  if (!src || !src_len) {
+    /* flush remaining entries */
+    TRY(flush(b));
+
+    /* flag builder as finished */
+    b->is_done = 1;
+  }
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+ptpgp_err_t
+ptpgp_packet_index_builder_done(ptpgp_packet_index_builder_t *b) {
+  return ptpgp_packet_index_builder_push(b, 0, 0);
+}
+
+ptpgp_err_t
+ptpgp_packet_index_load(ptpgp_packet_index_t *index,
+                        u8 *src,
+                        size_t src_len) {
+  /* clear index */
+  memset(index, 0, sizeof(ptpgp_packet_index_t));
+
+  /* check header */
+  if (src_len < PTPGP_PACKET_INDEX_HEADER_SIZE ||
+      memcmp(src, PTPGP_PACKET_INDEX_MAGIC, 8) ||
+      GET_U32(src + 12) != PTPGP_PACKET_INDEX_ENTRY_SIZE)
+    return PTPGP_ERR_PACKET_INDEX_BAD_HEADER;
+
+  /* check version */
+  if (GET_U32(src + 8) != PTPGP_PACKET_INDEX_VERSION)
+    return PTPGP_ERR_PACKET_INDEX_BAD_VERSION;
+
+  /* check for truncated entries */
+  src_len -= PTPGP_PACKET_INDEX_HEADER_SIZE;
+  if (src_len % PTPGP_PACKET_INDEX_ENTRY_SIZE)
+    return PTPGP_ERR_PACKET_INDEX_BAD_HEADER;
+
+  /* save entries */
+  index->entries = src + PTPGP_PACKET_INDEX_HEADER_SIZE;
+  index->num_entries = src_len / PTPGP_PACKET_INDEX_ENTRY_SIZE;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+ptpgp_err_t
+ptpgp_packet_index_open(ptpgp_packet_index_t *index,
+                        char *path) {
+  struct stat st;
+  void *map;
+  ptpgp_err_t err;
+  int fd;
+
+  /* open index file */
+  if ((fd = open(path, O_RDONLY)) == -1)
+    return PTPGP_ERR_PACKET_INDEX_OPEN_FAILED;
+
+  if (fstat(fd, &st)) {
+    close(fd);
+    return PTPGP_ERR_PACKET_INDEX_OPEN_FAILED;
+  }
+
+  if (st.st_size < PTPGP_PACKET_INDEX_HEADER_SIZE) {
+    close(fd);
+    return PTPGP_ERR_PACKET_INDEX_BAD_HEADER;
+  }
+
+  /* map index (the mapping outlives the descriptor) */
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if (map == MAP_FAILED)
+    return PTPGP_ERR_PACKET_INDEX_MMAP_FAILED;
+
+  /* lookups are random access */
+  posix_madvise(map, st.st_size, POSIX_MADV_RANDOM);
+
+  if ((err = ptpgp_packet_index_load(index, map, st.st_size)) != PTPGP_OK) {
+    munmap(map, st.st_size);
+    return err;
+  }
+
+  /* save mapping */
+  index->map = map;
+  index->map_len = st.st_size;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+ptpgp_err_t
+ptpgp_packet_index_close(ptpgp_packet_index_t *index) {
+  if (index->map && munmap(index->map, index->map_len))
+    return PTPGP_ERR_PACKET_INDEX_MMAP_FAILED;
+
+  /* clear index */
+  memset(index, 0, sizeof(ptpgp_packet_index_t));
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+ptpgp_err_t
+ptpgp_packet_index_get(ptpgp_packet_index_t *index,
+                       uint64_t n,
+                       ptpgp_packet_index_entry_t *entry) {
+  u8 *src;
+
+  if (n >= index->num_entries)
+    return PTPGP_ERR_PACKET_INDEX_ENTRY_OUT_OF_RANGE;
+
+  /* decode entry */
+  src = index->entries + n * PTPGP_PACKET_INDEX_ENTRY_SIZE;
+  entry->tag = src[0];
+  entry->flags = src[1];
+  entry->header_offset = GET_U64(src +  8);
+  entry->body_offset = GET_U64(src + 16);
+  entry->body_length = GET_U64(src + 24);
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+ptpgp_err_t
+ptpgp_packet_index_find_tag(ptpgp_packet_index_t *index,
+                            ptpgp_tag_t tag,
+                            uint64_t start,
+                            uint64_t *n) {
+  uint64_t i;
+
+  /* scan tag octets only */
+  for (i = start; i < index->num_entries; i++) {
+    if (index->entries[i * PTPGP_PACKET_INDEX_ENTRY_SIZE] == tag) {
+      *n = i;
+      return PTPGP_OK;
+    }
+  }
+
+  /* return failure */
+  return PTPGP_ERR_PACKET_INDEX_NOT_FOUND;
+}
@@ -1,9 +1,12 @@
 #include "internal.h"
 
 #define FLAG_DONE (1 << 0)
+#define FLAG_KEY_HASH (1 << 1)
+#define FLAG_SIG_HASH (1 << 2)
 
 #define FLAG_IS_SET(p, f) ((p)->flags & FLAG_##f)
 #define FLAG_SET(p, f) do { (p)->flags |= FLAG_##f; } while (0)
+#define FLAG_CLEAR(p, f) do { (p)->flags &= ~FLAG_##f; } while (0)
 
 #define DIE(p, err) do {                                              \
   D("returning error %s", #err);                                      \
@@ -43,8 +46,12 @@
     sizeof(ptpgp_signature_subpacket_header_t)                        \
   );                                                                  \
                                                                       \
-  /* save subpacket size and type */                                  \
-  (p)->subpacket_header.size = (s);                                   \
+  /* check subpacket size (includes the type octet) */                \
+  if (!(s) || (p)->buf_len - 1 + (s) > (p)->remaining_bytes)          \
+    DIE((p), INVALID_SUBPACKET_HEADER);                               \
+                                                                      \
+  /* save subpacket body size and type */                             \
+  (p)->subpacket_header.size = (s) - 1;                               \
   (p)->subpacket_header.type = (t);                                   \
                                                                       \
   /* flag critical subheaders */                                      \
@@ -65,6 +72,254 @@
   );                                                                  \
 } while (0)
 
+#define SEND_MPI_START(p, n) do {                                     \
+  SEND((p), MPI_START, (u8*) &(n), sizeof(size_t));                   \
+                                                                      \
+  /* collect mpi in arena */                                          \
+  if ((p)->mpi_arena) {                                               \
+    ptpgp_err_t err = mpi_start((p), (n));                            \
+    if (err != PTPGP_OK)                                              \
+      return (p)->last_err = err;                                     \
+  }                                                                   \
+} while (0)
+
+#define SEND_MPI_BODY(p, b, l) do {                                   \
+  /* append fragment to collected mpi */                              \
+  if ((p)->mpi.data) {                                                \
+    size_t ofs = PTPGP_MPI_SIZE(&((p)->mpi)) - (p)->remaining_bytes;  \
+    memcpy((p)->mpi.data + ofs, (b), (l));                            \
+  }                                                                   \
+                                                                      \
+  SEND((p), MPI_BODY, (b), (l));                                      \
+} while (0)
+
+#define SEND_MPI_END(p) do {                                          \
+  if ((p)->mpi.data) {                                                \
+    /* send collected mpi */                                          \
+    SEND((p), MPI_END, (u8*) &((p)->mpi), sizeof(ptpgp_mpi_t));       \
+    (p)->mpi.data = NULL;                                             \
+  } else {                                                            \
+    SEND((p), MPI_END, 0, 0);                                         \
+  }                                                                   \
+} while (0)
+
+#define KEY_HASH_PUSH(p, b, l, is_body) do {                          \
+  if (FLAG_IS_SET((p), KEY_HASH)) {                                   \
+    ptpgp_err_t err = key_hash_push((p), (b), (l), (is_body));        \
+    if (err != PTPGP_OK)                                              \
+      return (p)->last_err = err;                                     \
+  }                                                                   \
+} while (0)
+
+#define SIG_HASH_PUSH(p, b, l) do {                                   \
+  if (FLAG_IS_SET((p), SIG_HASH)) {                                   \
+    ptpgp_err_t err = ptpgp_engine_hash_push((p)->sig_hash, (b), (l));\
+    if (err != PTPGP_OK)                                              \
+      return (p)->last_err = err;                                     \
+  }                                                                   \
+} while (0)
+
+/* first octet of the packet header (buffered or at the front of src) */
+#define FIRST_OCTET(p) ((p)->buf_len ? (p)->buf[0] : src[0])
+
+/*
+ * Get len octets of fixed-size fields (e.g. a packet header or an MPI
+ * length), and shift them out of the input.  Returns a pointer straight
+ * into src if all of the fields are there (the common case), and
+ * buffers fields split across pushes otherwise.  Returns NULL if the
+ * fields are not complete yet.
+ */
+static u8 *
+get_fields(ptpgp_packet_parser_t *p,
+           u8 **src,
+           size_t *src_len,
+           size_t len) {
+  u8 *r = NULL;
+  size_t n;
+
+  if (!p->buf_len && *src_len >= len) {
+    /* decode fields in place */
+    r = *src;
+    n = len;
+  } else {
+    /* buffer split fields */
+    n = len - p->buf_len;
+    if (n > *src_len)
+      n = *src_len;
+
+    memcpy(p->buf + p->buf_len, *src, n);
+    p->buf_len += n;
+
+    if (p->buf_len == len) {
+      r = p->buf;
+      p->buf_len = 0;
+    }
+  }
+
+  /* shift input */
+  *src += n;
+  *src_len -= n;
+
+  return r;
+}
+
+static ptpgp_err_t
+mpi_start(ptpgp_packet_parser_t *p, size_t num_bits) {
+  void *data;
+
+  TRY(ptpgp_arena_alloc(p->mpi_arena, (num_bits + 7) / 8, &data));
+
+  p->mpi.num_bits = num_bits;
+  p->mpi.data = data;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+/*
+ * Start key fingerprint (rfc4880 12.2).  v4 fingerprints are the SHA-1
+ * of 0x99, the 2-octet length of the public key, and the public key
+ * fields; the length of the public part of a secret key isn't known
+ * until it's parsed, so it is buffered instead.  v3 fingerprints are
+ * the MD5 of the MPI bodies.
+ */
+static ptpgp_err_t
+key_hash_init(ptpgp_packet_parser_t *p, u8 *h, size_t h_len) {
+  ptpgp_key_fingerprint_t *fp = &(p->key_fingerprint);
+  u8 prefix[3];
+
+  memset(fp, 0, sizeof(ptpgp_key_fingerprint_t));
+  fp->version = h[0];
+  p->key_buf_len = 0;
+
+  if (fp->version == 3) {
+    TRY(ptpgp_engine_hash_init(
+      &(p->key_hash), p->key_engine, PTPGP_HASH_TYPE_MD5
+    ));
+  } else if (p->packet.tag == PTPGP_TAG_SECRET_KEY ||
+             p->packet.tag == PTPGP_TAG_SECRET_SUBKEY) {
+    /* buffer public part of secret key */
+    memcpy(p->key_buf, h, h_len);
+    p->key_buf_len = h_len;
+  } else {
+    if (p->key_body_len > 0xffff)
+      return PTPGP_ERR_PACKET_PARSER_BAD_PUBLIC_KEY_PACKET;
+
+    prefix[0] = 0x99;
+    prefix[1] = (p->key_body_len >> 8) & 0xff;
+    prefix[2] = p->key_body_len & 0xff;
+
+    TRY(ptpgp_engine_hash_init(
+      &(p->key_hash), p->key_engine, PTPGP_HASH_TYPE_SHA1
+    ));
+    TRY(ptpgp_engine_hash_push(&(p->key_hash), prefix, sizeof(prefix)));
+    TRY(ptpgp_engine_hash_push(&(p->key_hash), h, h_len));
+  }
+
+  FLAG_SET(p, KEY_HASH);
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+static ptpgp_err_t
+key_hash_push(ptpgp_packet_parser_t *p,
+              u8 *src,
+              size_t src_len,
+              bool is_body) {
+  ptpgp_key_fingerprint_t *fp = &(p->key_fingerprint);
+  size_t n;
+
+  if (fp->version == 3) {
+    /* v3 fingerprints only cover the mpi bodies */
+    if (!is_body)
+      return PTPGP_OK;
+
+    /* v3 key id is the low 64 bits of the modulus (the first mpi) */
+    if (p->num_mpis == p->packet.packet.t6.all.num_mpis) {
+      n = (src_len < 8) ? src_len : 8;
+      memmove(fp->key_id, fp->key_id + n, 8 - n);
+      memcpy(fp->key_id + 8 - n, src + src_len - n, n);
+    }
+  }
+
+  if (p->key_buf_len > 0) {
+    if (src_len > sizeof(p->key_buf) - p->key_buf_len)
+      return PTPGP_ERR_PACKET_PARSER_KEY_TOO_LARGE;
+
+    /* buffer public part of secret key */
+    memcpy(p->key_buf + p->key_buf_len, src, src_len);
+    p->key_buf_len += src_len;
+
+    /* return success */
+    return PTPGP_OK;
+  }
+
+  return ptpgp_engine_hash_push(&(p->key_hash), src, src_len);
+}
+
+static ptpgp_err_t
+key_hash_done(ptpgp_packet_parser_t *p) {
+  ptpgp_key_fingerprint_t *fp = &(p->key_fingerprint);
+  u8 prefix[3];
+
+  FLAG_CLEAR(p, KEY_HASH);
+
+  if (p->key_buf_len > 0) {
+    /* hash buffered public part of secret key */
+    prefix[0] = 0x99;
+    prefix[1] = (p->key_buf_len >> 8) & 0xff;
+    prefix[2] = p->key_buf_len & 0xff;
+
+    TRY(ptpgp_engine_hash_init(
+      &(p->key_hash), p->key_engine, PTPGP_HASH_TYPE_SHA1
+    ));
+    TRY(ptpgp_engine_hash_push(&(p->key_hash), prefix, sizeof(prefix)));
+    TRY(ptpgp_engine_hash_push(&(p->key_hash), p->key_buf, p->key_buf_len));
+    p->key_buf_len = 0;
+  }
+
+  TRY(ptpgp_engine_hash_done(&(p->key_hash)));
+  TRY(ptpgp_engine_hash_read(
+    &(p->key_hash), fp->fingerprint, sizeof(fp->fingerprint),
+    &(fp->fingerprint_len)
+  ));
+
+  /* v4 key id is the low 64 bits of the fingerprint */
+  if (fp->version == 4)
+    memcpy(fp->key_id, fp->fingerprint + fp->fingerprint_len - 8, 8);
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+static void
+key_hash_close(ptpgp_packet_parser_t *p) {
+  /* release engine hash context */
+  if (FLAG_IS_SET(p, KEY_HASH) && !p->key_buf_len)
+    ptpgp_engine_hash_done(&(p->key_hash));
+
+  FLAG_CLEAR(p, KEY_HASH);
+  p->key_buf_len = 0;
+}
+
+/* append v4 signature trailer (rfc4880 5.2.4) to signature hash */
+static ptpgp_err_t
+sig_hash_done(ptpgp_packet_parser_t *p) {
+  u8 trailer[6];
+
+  trailer[0] = p->packet.packet.t2.version;
+  trailer[1] = 0xff;
+  trailer[2] = (p->sig_hashed_len >> 24) & 0xff;
+  trailer[3] = (p->sig_hashed_len >> 16) & 0xff;
+  trailer[4] = (p->sig_hashed_len >>  8) & 0xff;
+  trailer[5] = p->sig_hashed_len & 0xff;
+
+  FLAG_CLEAR(p, SIG_HASH);
+
+  return ptpgp_engine_hash_push(p->sig_hash, trailer, sizeof(trailer));
+}
+
 ptpgp_err_t
 ptpgp_packet_parser_init(ptpgp_packet_parser_t *p,
                          ptpgp_tag_t tag,
@@ -82,11 +337,41 @@ ptpgp_packet_parser_init(ptpgp_packet_parser_t *p,
 }
 
 ptpgp_err_t
-ptpgp_packet_parser_push(ptpgp_packet_parser_t *p,
-                         u8 *src,
-                         size_t src_len) {
+ptpgp_packet_parser_set_mpi_arena(ptpgp_packet_parser_t *p,
+                                  ptpgp_arena_t *arena) {
+  p->mpi_arena = arena;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+ptpgp_err_t
+ptpgp_packet_parser_set_key_fingerprint(ptpgp_packet_parser_t *p,
+                                        ptpgp_engine_t *engine,
+                                        uint64_t body_len) {
+  p->key_engine = engine;
+  p->key_body_len = body_len;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+ptpgp_err_t
+ptpgp_packet_parser_set_signature_hash(ptpgp_packet_parser_t *p,
+                                       ptpgp_hash_context_t *hash) {
+  p->sig_hash = hash;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+static ptpgp_err_t
+push(ptpgp_packet_parser_t *p,
+     u8 *src,
+     size_t src_len) {
   size_t i;
   uint32_t sp_size, sp_type;
+  u8 *h;
 
   if (p->last_err)
     return p->last_err;
@@ -98,12 +383,27 @@ ptpgp_packet_parser_push(ptpgp_packet_parser_t *p,
     /* mark parser as done */
     FLAG_SET(p, DONE);
 
+    /* send fingerprint of opaque key material */
+    if (p->state == STATE(KEY_DATA) && FLAG_IS_SET(p, KEY_HASH)) {
+      ptpgp_err_t err = key_hash_done(p);
+      if (err != PTPGP_OK)
+        return p->last_err = err;
+
+      SEND(
+        p, KEY_FINGERPRINT,
+        (u8*) &(p->key_fingerprint), sizeof(ptpgp_key_fingerprint_t)
+      );
+    }
+
     SEND(p, PACKET_END, 0, 0);
 
     /* return success */
     return PTPGP_OK;
   }
 
+  /* count consumed octets (the parser buffers what it can't use yet) */
+  p->offset += src_len;
+
 retry:
   if (src_len > 0) {
     switch (p->packet.tag) {
@@ -111,70 +411,59 @@ retry:
     case PTPGP_TAG_PUBLIC_KEY_ENCRYPTED_SESSION_KEY:
       switch (p->state) {
       case STATE(INIT):
-        for (i = 0; i < src_len; i++) {
-          p->buf[p->buf_len++] = src[i];
-
-          if (p->buf_len == 10) {
-            /* verify version number of packet */
-            if (p->buf[0] != 3) {
-              D("packet version = %d", p->buf[0]);
-              DIE(p, BAD_PACKET_VERSION);
-            }
+        /* verify version number of packet */
+        if (FIRST_OCTET(p) != 3) {
+          D("packet version = %d", FIRST_OCTET(p));
+          DIE(p, BAD_PACKET_VERSION);
+        }
 
-            /* populate packet */
-            p->packet.packet.t1.version = p->buf[0];
-            memcpy(p->packet.packet.t1.key_id, p->buf + 1, 8);
-            p->packet.packet.t1.algorithm = p->buf[9];
+        if ((h = get_fields(p, &src, &src_len, 10)) == NULL)
+          break;
 
-            /* send packet header */
-            SEND(p, PACKET_START, 0, 0);
+        /* populate packet */
+        p->packet.packet.t1.version = h[0];
+        memcpy(p->packet.packet.t1.key_id, h + 1, 8);
+        p->packet.packet.t1.algorithm = h[9];
 
-            /* clear buffer */
-            p->buf_len = 0;
-            SHIFT(i + 1);
+        /* send packet header */
+        SEND(p, PACKET_START, 0, 0);
 
-            /* switch state */
-            p->state = STATE(MPI_LIST);
-            goto retry;
-          }
-        }
+        /* switch state */
+        p->state = STATE(MPI_LIST);
+        goto retry;
 
         break;
       case STATE(MPI_LIST):
-        for (i = 0; i < src_len; i++) {
-          p->buf[p->buf_len++] = src[i];
-
-          if (p->buf_len == 2) {
-            size_t num_bits = (p->buf[0] << 8) | p->buf[1];
+        do {
+          size_t num_bits;
 
-            p->remaining_bytes = (num_bits + 7) / 8;
+          if ((h = get_fields(p, &src, &src_len, 2)) == NULL)
+            break;
 
-            /* send packet */
-            SEND(p, MPI_START, (u8*) &(num_bits), sizeof(size_t));
+          num_bits = (h[0] << 8) | h[1];
+          p->remaining_bytes = (num_bits + 7) / 8;
 
-            /* clear buffer */
-            p->buf_len = 0;
-            SHIFT(i + 1);
+          /* send packet */
+          SEND_MPI_START(p, num_bits);
 
-            /* switch state */
-            p->state = STATE(MPI_BODY);
-            goto retry;
-          }
-        }
+          /* switch state */
+          p->state = STATE(MPI_BODY);
+          goto retry;
+        } while (0);
 
         break;
       case STATE(MPI_BODY):
         if (src_len < p->remaining_bytes) {
           /* send mpi body fragment */
-          SEND(p, MPI_BODY, src, src_len);
+          SEND_MPI_BODY(p, src, src_len);
           p->remaining_bytes -= src_len;
 
           /* return success */
           return PTPGP_OK;
         } else {
           /* send final mpi body fragment and end notice */
-          SEND(p, MPI_BODY, src, p->remaining_bytes);
-          SEND(p, MPI_END, 0, 0);
+          SEND_MPI_BODY(p, src, p->remaining_bytes);
+          SEND_MPI_END(p);
 
           /* switch state */
           p->state = STATE(MPI_LIST);
@@ -194,106 +483,109 @@ retry:
     case PTPGP_TAG_SIGNATURE:
       switch (p->state) {
       case STATE(INIT):
-        for (i = 0; i < src_len; i++) {
-          p->buf[p->buf_len++] = src[i];
+        /* verify version number of packet */
+        if (FIRST_OCTET(p) < 2 || FIRST_OCTET(p) > 4) {
+          D("bad signature packet version = %d", FIRST_OCTET(p));
+          DIE(p, BAD_PACKET_VERSION);
+        }
 
-          /* verify version number of packet */
-          if (p->buf[0] < 2 || p->buf[0] > 4) {
-            D("bad signature packet version = %d", p->buf[0]);
-            DIE(p, BAD_PACKET_VERSION);
-          }
+        if (FIRST_OCTET(p) < 4) {
+          /* v2/v3 signature packet (rfc4880 5.2.2) */
+          ptpgp_packet_signature_t *pp = &(p->packet.packet.t2);
 
-          if (p->buf[0] < 4 && p->buf_len == 19) {
-            /* v2/v3 signature packet (rfc4880 5.2.2) */
-            ptpgp_packet_signature_t *pp = &(p->packet.packet.t2);
+          if ((h = get_fields(p, &src, &src_len, 19)) == NULL)
+            break;
 
-            /* populate packet version */
-            pp->version = p->buf[0];
+          /* populate packet version */
+          pp->version = h[0];
 
-            /* verify hashed material length */
-            if (p->buf[1] != 5)
-              DIE(p, BAD_HASHED_MATERIAL_LENGTH);
+          /* verify hashed material length */
+          if (h[1] != 5)
+            DIE(p, BAD_HASHED_MATERIAL_LENGTH);
 
-            pp->versions.v3.signature_type = p->buf[2];
-            pp->versions.v3.creation_time =
-              (p->buf[3] << 24) |
-              (p->buf[4] << 16) |
-              (p->buf[5] <<  8) |
-              (p->buf[6]);
+          pp->versions.v3.signature_type = h[2];
+          pp->versions.v3.creation_time = ((uint32_t) h[3] << 24) |
+                                          (h[4] << 16) |
+                                          (h[5] <<  8) |
+                                          (h[6]);
 
-            memcpy(pp->versions.v3.signer_key_id, p->buf + 7, 8);
-            pp->versions.v3.public_key_algorithm = p->buf[15];
-            pp->versions.v3.hash_algorithm = p->buf[16];
-            memcpy(pp->versions.v3.left16, p->buf + 17, 2);
+          memcpy(pp->versions.v3.signer_key_id, h + 7, 8);
+          pp->versions.v3.public_key_algorithm = h[15];
+          pp->versions.v3.hash_algorithm = h[16];
+          memcpy(pp->versions.v3.left16, h + 17, 2);
 
-            /* send packet header */
-            SEND(p, PACKET_START, 0, 0);
+          /* send packet header */
+          SEND(p, PACKET_START, 0, 0);
 
-            /* clear buffer */
-            p->buf_len = 0;
-            SHIFT(i + 1);
+          /* hash signature type and creation time (rfc4880 5.2.4) */
+          if (p->sig_hash) {
+            ptpgp_err_t err = ptpgp_engine_hash_push(p->sig_hash, h + 2, 5);
+            if (err != PTPGP_OK)
+              return p->last_err = err;
+          }
 
-            /* switch state */
-            p->state = STATE(MPI_LIST);
-            goto retry;
-          } else if (p->buf[0] == 4 && p->buf_len == 6) {
-            /* v4 signature packet (rfc4880 5.2.3) */
+          /* switch state */
+          p->state = STATE(MPI_LIST);
+          goto retry;
+        } else {
+          /* v4 signature packet (rfc4880 5.2.3) */
+          ptpgp_packet_signature_t *pp = &(p->packet.packet.t2);
 
-            ptpgp_packet_signature_t *pp = &(p->packet.packet.t2);
+          if ((h = get_fields(p, &src, &src_len, 6)) == NULL)
+            break;
 
-            /* populate packet version */
-            pp->version = p->buf[0];
+          /* populate packet version */
+          pp->version = h[0];
 
-            /* populate signature type, pk algo, and hash algo */
-            pp->versions.v3.signature_type = p->buf[1];
-            pp->versions.v3.public_key_algorithm = p->buf[2];
-            pp->versions.v3.hash_algorithm = p->buf[3];
+          /* populate signature type, pk algo, and hash algo */
+          pp->versions.v3.signature_type = h[1];
+          pp->versions.v3.public_key_algorithm = h[2];
+          pp->versions.v3.hash_algorithm = h[3];
 
-            /* send packet header */
-            SEND(p, PACKET_START, 0, 0);
+          /* send packet header */
+          SEND(p, PACKET_START, 0, 0);
 
-            p->remaining_bytes = (p->buf[4] << 8) | p->buf[5];
+          p->remaining_bytes = (h[4] << 8) | h[5];
 
-            /* send hashed list start */
-            SEND(p, SIGNATURE_SUBPACKET_HASHED_LIST_START, 0, 0);
+          /* hash version through hashed subpacket list size */
+          if (p->sig_hash) {
+            FLAG_SET(p, SIG_HASH);
+            p->sig_hashed_len = 6 + p->remaining_bytes;
+            SIG_HASH_PUSH(p, h, 6);
+          }
 
-            p->buf_len = 0;
-            SHIFT(i + 1);
+          /* send hashed list start */
+          SEND(p, SIGNATURE_SUBPACKET_HASHED_LIST_START, 0, 0);
 
-            p->state = STATE(SIGNATURE_SUBPACKET_HASHED_LIST);
-            goto retry;
-          }
+          p->state = STATE(SIGNATURE_SUBPACKET_HASHED_LIST);
+          goto retry;
         }
 
         break;
       case STATE(MPI_LIST):
-        for (i = 0; i < src_len; i++) {
-          p->buf[p->buf_len++] = src[i];
-
-          if (p->buf_len == 2) {
-            size_t num_bits = (p->buf[0] << 8) | p->buf[1];
+        do {
+          size_t num_bits;
 
-            p->remaining_bytes = (num_bits + 7) / 8;
+          if ((h = get_fields(p, &src, &src_len, 2)) == NULL)
+            break;
 
-            /* send packet */
-            SEND(p, MPI_START, (u8*) &(num_bits), sizeof(size_t));
+          num_bits = (h[0] << 8) | h[1];
+          p->remaining_bytes = (num_bits + 7) / 8;
 
-            /* clear buffer */
-            p->buf_len = 0;
-            SHIFT(i + 1);
+          /* send packet */
+          SEND_MPI_START(p, num_bits);
 
-            /* switch state */
-            p->state = STATE(MPI_BODY);
-            goto retry;
-          }
-        }
+          /* switch state */
+          p->state = STATE(MPI_BODY);
+          goto retry;
+        } while (0);
 
         break;
       case STATE(MPI_BODY):
         if (src_len < p->remaining_bytes) {
           /* send mpi body fragment */
           if (src_len > 0) {
-            SEND(p, MPI_BODY, src, src_len);
+            SEND_MPI_BODY(p, src, src_len);
             p->remaining_bytes -= src_len;
           }
 
@@ -302,12 +594,12 @@ retry:
         } else {
           /* send final mpi body fragment and end notice */
           if (p->remaining_bytes > 0) {
-            SEND(p, MPI_BODY, src, p->remaining_bytes);
+            SEND_MPI_BODY(p, src, p->remaining_bytes);
             SHIFT(p->remaining_bytes);
           }
 
           /* send end notice */
-          SEND(p, MPI_END, 0, 0);
+          SEND_MPI_END(p);
 
           /* switch state */
           p->state = STATE(MPI_LIST);
@@ -317,6 +609,13 @@ retry:
         break;
       case STATE(SIGNATURE_SUBPACKET_HASHED_LIST):
         if (!p->remaining_bytes) {
+          /* finish hashed portion of signature */
+          if (FLAG_IS_SET(p, SIG_HASH)) {
+            ptpgp_err_t err = sig_hash_done(p);
+            if (err != PTPGP_OK)
+              return p->last_err = err;
+          }
+
           /* send hashed list end */
           SEND(p, SIGNATURE_SUBPACKET_HASHED_LIST_END, 0, 0);
 
@@ -331,6 +630,7 @@ retry:
             sp_size = p->buf[0];
             sp_type = p->buf[1];
 
+            SIG_HASH_PUSH(p, p->buf, p->buf_len);
             SEND_SUBPACKET_HEADER(p, sp_size, sp_type);
 
             SHIFT(i + 1);
@@ -341,6 +641,7 @@ retry:
             sp_size = ((p->buf[0] - 192) << 8) + p->buf[1] + 192;
             sp_type = p->buf[2];
 
+            SIG_HASH_PUSH(p, p->buf, p->buf_len);
             SEND_SUBPACKET_HEADER(p, sp_size, sp_type);
 
             SHIFT(i + 1);
@@ -354,6 +655,7 @@ retry:
                       (p->buf[4]);
             sp_type = p->buf[5];
 
+            SIG_HASH_PUSH(p, p->buf, p->buf_len);
             SEND_SUBPACKET_HEADER(p, sp_size, sp_type);
 
             SHIFT(i + 1);
@@ -371,6 +673,7 @@ retry:
         if (src_len < p->subpacket_header.size) {
           /* send hashed subpacket fragment */
           if (src_len > 0) {
+            SIG_HASH_PUSH(p, src, src_len);
             SEND(p, SIGNATURE_SUBPACKET_BODY, src, src_len);
             p->subpacket_header.size -= src_len;
           }
@@ -378,8 +681,10 @@ retry:
           /* return success */
           return PTPGP_OK;
         } else {
-          if (p->subpacket_header.size > 0)
+          if (p->subpacket_header.size > 0) {
+            SIG_HASH_PUSH(p, src, p->subpacket_header.size);
             SEND(p, SIGNATURE_SUBPACKET_BODY, src, p->subpacket_header.size);
+          }
 
           SEND(p, SIGNATURE_SUBPACKET_END, 0, 0);
 
@@ -590,29 +895,30 @@ retry:
 
     /* one-pass signature packet (t4, rfc4880 5.4) */
     case PTPGP_TAG_ONE_PASS_SIGNATURE:
-      for (i = 0; i < src_len; i++) {
-        p->buf[p->buf_len++] = src[i];
+      /* any data after the packet fields is an error */
+      if (p->state != STATE(INIT))
+        DIE(p, INVALID_STATE);
 
-        /* verify version number of packet */
-        if (p->buf[0] != 3) {
-          D("bad one pass signature packet version = %d", p->buf[0]);
-          DIE(p, BAD_PACKET_VERSION);
-        }
+      /* verify version number of packet */
+      if (FIRST_OCTET(p) != 3) {
+        D("bad one pass signature packet version = %d", FIRST_OCTET(p));
+        DIE(p, BAD_PACKET_VERSION);
+      }
+
+      if ((h = get_fields(p, &src, &src_len, 13)) == NULL)
+        break;
 
-        if (p->buf_len == 13) {
-          p->packet.packet.t4.version               = p->buf[0];
-          p->packet.packet.t4.signature_type        = p->buf[1];
-          p->packet.packet.t4.hash_algorithm        = p->buf[2];
-          p->packet.packet.t4.public_key_algorithm  = p->buf[3];
-          memcpy(p->packet.packet.t4.key_id, p->buf + 4, 8);
-          p->packet.packet.t4.nested                = p->buf[12];
+      p->packet.packet.t4.version               = h[0];
+      p->packet.packet.t4.signature_type        = h[1];
+      p->packet.packet.t4.hash_algorithm        = h[2];
+      p->packet.packet.t4.public_key_algorithm  = h[3];
+      memcpy(p->packet.packet.t4.key_id, h + 4, 8);
+      p->packet.packet.t4.nested                = h[12];
 
-          SEND(p, ONE_PASS_SIGNATURE, 0, 0);
-          SHIFT(i + 1);
+      SEND(p, ONE_PASS_SIGNATURE, 0, 0);
 
-          return PTPGP_OK;
-        }
-      }
+      p->state = STATE(LAST);
+      goto retry;
 
       break;
 
@@ -639,6 +945,9 @@ retry:
 
         break;
       case STATE(PACKET_DATA):
+        /* count packet data */
+        p->packet.packet.t8.data_len += src_len;
+
         SEND(p, PACKET_DATA, src, src_len);
         return PTPGP_OK;
 
@@ -652,6 +961,9 @@ retry:
 
     /* symmetrically encrypted data packet (t9, rfc4880 5.7) */
     case PTPGP_TAG_SYMMETRICALLY_ENCRYPTED_DATA:
+      /* count packet data */
+      p->packet.packet.t9.data_len += src_len;
+
       SEND(p, PACKET_DATA, src, src_len);
       return PTPGP_OK;
 
@@ -671,21 +983,18 @@ retry:
         for (i = 0; i < src_len; i++) {
           p->buf[p->buf_len++] = src[i];
 
-          /* XXX: fixme */
           if (p->buf_len == 2) {
             p->packet.packet.t11.format = p->buf[0];
             p->packet.packet.t11.file_name_len = p->buf[1];
-
-            goto retry;
           } else if (p->buf_len > 2) {
             if (p->buf_len == (size_t) 2 + p->buf[1] + 4) {
               /* decode date */
-              p->packet.packet.t11.date = (p->buf[2 + p->buf[1] + 0] << 24) |
+              p->packet.packet.t11.date = ((uint32_t) p->buf[2 + p->buf[1] + 0] << 24) |
                                           (p->buf[2 + p->buf[1] + 1] << 16) |
                                           (p->buf[2 + p->buf[1] + 2] <<  8) |
                                           (p->buf[2 + p->buf[1] + 3]);
               /* save file name */
-              p->packet.packet.t11.file_name = (p->buf[1]) ? p->buf + 1 : NULL;
+              p->packet.packet.t11.file_name = (p->buf[1]) ? p->buf + 2 : NULL;
                 
               /* send literal data header */
               SEND(p, LITERAL_DATA, 0, 0);
@@ -705,6 +1014,9 @@ retry:
 
         break;
       case STATE(PACKET_DATA):
+        /* count packet data */
+        p->packet.packet.t11.data_len += src_len;
+
         SEND(p, PACKET_DATA, src, src_len);
         return PTPGP_OK;
 
@@ -745,6 +1057,9 @@ retry:
         
         break;
       case STATE(PACKET_DATA):
+        /* count packet data */
+        p->packet.packet.t18.data_len += src_len;
+
         SEND(p, PACKET_DATA, src, src_len);
         return PTPGP_OK;
       default:
@@ -794,89 +1109,109 @@ retry:
     case PTPGP_TAG_SECRET_SUBKEY:
       switch (p->state) {
       case STATE(INIT):
-        for (i = 0; i < src_len; i++) {
-          p->buf[p->buf_len++] = src[i];
+        do {
+          ptpgp_packet_public_key_t *pk = &(p->packet.packet.t6);
+          ptpgp_type_info_t *info;
+          ptpgp_err_t err;
 
-          if (p->buf_len > 4) {
-            ptpgp_err_t err;
-            ptpgp_type_info_t *info;
-
-            if (p->buf_len == 5) {
-              /* populate shared fields */
-              p->packet.packet.t6.all.version = p->buf[0];
-              p->packet.packet.t6.all.creation_time = (p->buf[1] << 24) |
-                                                      (p->buf[2] << 16) |
-                                                      (p->buf[3] <<  8) |
-                                                      (p->buf[4]);
-            } else if ((p->buf_len == 8 && p->buf[0] == 3) ||
-                       (p->buf_len == 6 && p->buf[0] == 4)) {
-              if (p->buf[0] == 3) {
-                p->packet.packet.t6.v3.valid_days = (p->buf[5] << 8) |
-                                                    (p->buf[6]);
-                p->packet.packet.t6.all.public_key_algorithm = p->buf[7];
-              } else {
-                p->packet.packet.t6.all.public_key_algorithm = p->buf[5];
-              }
+          /* verify version number of packet */
+          if (FIRST_OCTET(p) != 3 && FIRST_OCTET(p) != 4) {
+            D("bad key packet version = %d", FIRST_OCTET(p));
+            DIE(p, BAD_PUBLIC_KEY_PACKET);
+          }
 
-              /* get public key algorithm info */
-              err = ptpgp_type_info(
-                PTPGP_TYPE_PUBLIC_KEY,
-                p->packet.packet.t6.all.public_key_algorithm,
-                &info
-              );
+          /* v3 headers have an extra validity period */
+          h = get_fields(p, &src, &src_len, (FIRST_OCTET(p) == 3) ? 8 : 6);
+          if (!h)
+            break;
+
+          /* populate shared fields */
+          pk->all.version = h[0];
+          pk->all.creation_time = ((uint32_t) h[1] << 24) |
+                                  (h[2] << 16) |
+                                  (h[3] <<  8) |
+                                  (h[4]);
+
+          if (h[0] == 3) {
+            pk->v3.valid_days = (h[5] << 8) | h[6];
+            pk->all.public_key_algorithm = h[7];
+          } else {
+            pk->all.public_key_algorithm = h[5];
+          }
+
+          /* start key fingerprint */
+          if (p->key_engine) {
+            err = key_hash_init(p, h, (h[0] == 3) ? 8 : 6);
+            if (err != PTPGP_OK)
+              return p->last_err = err;
+          }
 
-              /* check for error */
-              if (err != PTPGP_OK)
-                return p->last_err = err;
+          /* get public key algorithm info */
+          err = ptpgp_type_info(
+            PTPGP_TYPE_PUBLIC_KEY,
+            pk->all.public_key_algorithm,
+            &info
+          );
 
-              /* get num remaining mpis */
-              p->packet.packet.t6.all.num_mpis = PTPGP_INFO_PUBLIC_KEY_NUM_PUBLIC_MPIS(info);
-              p->packet.packet.t5.num_mpis     = PTPGP_INFO_PUBLIC_KEY_NUM_PRIVATE_MPIS(info);
-              p->num_mpis = PTPGP_INFO_PUBLIC_KEY_NUM_PUBLIC_MPIS(info);
+          if (err != PTPGP_OK || !PTPGP_INFO_PUBLIC_KEY_NUM_PUBLIC_MPIS(info)) {
+            /*
+             * unknown key material (e.g. ECDH, ECDSA, or EdDSA): pass
+             * the rest of the body as KEY_DATA.  v4 public keys are
+             * still fingerprinted (the whole body is public), but the
+             * public part of a secret key can't be found, and v3
+             * fingerprints only cover the MPI bodies.
+             */
+            pk->all.num_mpis = 0;
 
-              /* send packet info */
-              SEND(p, KEY_PACKET_HEADER, 0, 0);
+            if (h[0] == 3 || p->key_buf_len > 0)
+              key_hash_close(p);
 
-              p->buf_len = 0;
-              SHIFT(i + i);
+            /* send packet info */
+            SEND(p, KEY_PACKET_HEADER, 0, 0);
 
-              p->state = STATE(MPI_LIST);
-              goto retry;
-            } else if (p->buf_len > 8) {
-              DIE(p, BAD_PUBLIC_KEY_PACKET);
-            }
+            p->state = STATE(KEY_DATA);
+            goto retry;
           }
-        }
+
+          /* get num remaining mpis */
+          pk->all.num_mpis = PTPGP_INFO_PUBLIC_KEY_NUM_PUBLIC_MPIS(info);
+          p->packet.packet.t5.num_mpis = PTPGP_INFO_PUBLIC_KEY_NUM_PRIVATE_MPIS(info);
+          p->num_mpis = PTPGP_INFO_PUBLIC_KEY_NUM_PUBLIC_MPIS(info);
+
+          /* send packet info */
+          SEND(p, KEY_PACKET_HEADER, 0, 0);
+
+          p->state = STATE(MPI_LIST);
+          goto retry;
+        } while (0);
 
         break;
       case STATE(MPI_LIST):
-        for (i = 0; i < src_len; i++) {
-          p->buf[p->buf_len++] = src[i];
-
-          if (p->buf_len == 2) {
-            size_t num_bits = (p->buf[0] << 8) | p->buf[1];
+        do {
+          size_t num_bits;
 
-            p->remaining_bytes = (num_bits + 7) / 8;
+          if ((h = get_fields(p, &src, &src_len, 2)) == NULL)
+            break;
 
-            /* send packet */
-            SEND(p, MPI_START, (u8*) &(num_bits), sizeof(size_t));
+          num_bits = (h[0] << 8) | h[1];
+          p->remaining_bytes = (num_bits + 7) / 8;
+          KEY_HASH_PUSH(p, h, 2, 0);
 
-            /* clear buffer */
-            p->buf_len = 0;
-            SHIFT(i + 1);
+          /* send packet */
+          SEND_MPI_START(p, num_bits);
 
-            /* switch state */
-            p->state = STATE(MPI_BODY);
-            goto retry;
-          }
-        }
+          /* switch state */
+          p->state = STATE(MPI_BODY);
+          goto retry;
+        } while (0);
 
         break;
       case STATE(MPI_BODY):
         if (src_len < p->remaining_bytes) {
           /* send mpi body fragment */
           if (src_len > 0) {
-            SEND(p, MPI_BODY, src, src_len);
+            KEY_HASH_PUSH(p, src, src_len, 1);
+            SEND_MPI_BODY(p, src, src_len);
             p->remaining_bytes -= src_len;
           }
 
@@ -885,16 +1220,29 @@ retry:
         } else {
           /* send final mpi body fragment and end notice */
           if (p->remaining_bytes > 0) {
-            SEND(p, MPI_BODY, src, p->remaining_bytes);
+            KEY_HASH_PUSH(p, src, p->remaining_bytes, 1);
+            SEND_MPI_BODY(p, src, p->remaining_bytes);
             SHIFT(p->remaining_bytes);
           }
 
           /* send end notice */
-          SEND(p, MPI_END, 0, 0);
+          SEND_MPI_END(p);
 
           /* decriment mpi count */
           p->num_mpis--;
 
+          /* send fingerprint after the public key mpis */
+          if (!p->num_mpis && FLAG_IS_SET(p, KEY_HASH)) {
+            ptpgp_err_t err = key_hash_done(p);
+            if (err != PTPGP_OK)
+              return p->last_err = err;
+
+            SEND(
+              p, KEY_FINGERPRINT,
+              (u8*) &(p->key_fingerprint), sizeof(ptpgp_key_fingerprint_t)
+            );
+          }
+
           /* switch state */
           if (p->num_mpis > 0)
             p->state = STATE(MPI_LIST);
@@ -1068,7 +1416,7 @@ retry:
             SEND(p, SECRET_KEY_PACKET_HEADER, 0, 0);
 
             p->buf_len = 0;
-            SHIFT(1);
+            SHIFT(i + 1);
 
             p->state = STATE(MPI_LIST);
             goto retry;
@@ -1088,7 +1436,7 @@ retry:
 
             /* clear buffer, shift input */
             p->buf_len = 0;
-            SHIFT(1);
+            SHIFT(i + 1);
 
             /* any packet data after this is an error */
             p->state = STATE(LAST);
@@ -1098,6 +1446,13 @@ retry:
           }
         }
 
+        break;
+      case STATE(KEY_DATA):
+        /* hash and send opaque key material */
+        KEY_HASH_PUSH(p, src, src_len, 1);
+        SEND(p, KEY_DATA, src, src_len);
+        return PTPGP_OK;
+
         break;
       default:
         /* if we reach here, it's an error */
@@ -1131,7 +1486,192 @@ retry:
   return PTPGP_OK;
 };
 
+ptpgp_err_t
+ptpgp_packet_parser_push(ptpgp_packet_parser_t *p,
+                         u8 *src,
+                         size_t src_len) {
+  ptpgp_err_t err = push(p, src, src_len);
+
+  /* release key hash if the packet failed or ended early */
+  if ((err != PTPGP_OK || !src || !src_len) && FLAG_IS_SET(p, KEY_HASH))
+    key_hash_close(p);
+
+  return err;
+}
+
 ptpgp_err_t
 ptpgp_packet_parser_done(ptpgp_packet_parser_t *p) {
   return ptpgp_packet_parser_push(p, 0, 0);
 }
+
+static void
+checkpoint_s2k(ptpgp_checkpoint_t *c, ptpgp_s2k_t *s2k) {
+  CHECKPOINT_FIELD(c, s2k->type, 1);
+  CHECKPOINT_FIELD(c, s2k->algorithm, 1);
+  ptpgp_checkpoint_bytes(c, s2k->salt, sizeof(s2k->salt));
+  CHECKPOINT_FIELD(c, s2k->count, 4);
+}
+
+static void
+checkpoint_public_key(ptpgp_checkpoint_t *c, ptpgp_packet_public_key_t *k) {
+  CHECKPOINT_FIELD(c, k->all.version, 1);
+  CHECKPOINT_FIELD(c, k->all.public_key_algorithm, 1);
+  CHECKPOINT_FIELD(c, k->all.num_mpis, 1);
+  CHECKPOINT_FIELD(c, k->all.creation_time, 4);
+  CHECKPOINT_FIELD(c, k->v3.valid_days, 4);
+}
+
+/*
+ * Save or restore the packet fields decoded so far.  Pointers in the
+ * packet (e.g. the literal data file name) are only valid during
+ * callbacks, so they are not part of the state.
+ */
+static void
+checkpoint_packet(ptpgp_checkpoint_t *c, ptpgp_packet_t *pk) {
+  switch (pk->tag) {
+  case PTPGP_TAG_PUBLIC_KEY_ENCRYPTED_SESSION_KEY:
+    CHECKPOINT_FIELD(c, pk->packet.t1.version, 1);
+    CHECKPOINT_FIELD(c, pk->packet.t1.algorithm, 1);
+    ptpgp_checkpoint_bytes(c, pk->packet.t1.key_id, 8);
+
+    break;
+  case PTPGP_TAG_SIGNATURE:
+    /* the parser keeps the v4 header fields in versions.v3 as well */
+    CHECKPOINT_FIELD(c, pk->packet.t2.version, 1);
+    CHECKPOINT_FIELD(c, pk->packet.t2.versions.v3.creation_time, 4);
+    CHECKPOINT_FIELD(c, pk->packet.t2.versions.v3.signature_type, 1);
+    ptpgp_checkpoint_bytes(c, pk->packet.t2.versions.v3.signer_key_id, 8);
+    CHECKPOINT_FIELD(c, pk->packet.t2.versions.v3.public_key_algorithm, 1);
+    CHECKPOINT_FIELD(c, pk->packet.t2.versions.v3.hash_algorithm, 1);
+    ptpgp_checkpoint_bytes(c, pk->packet.t2.versions.v3.left16, 2);
+
+    break;
+  case PTPGP_TAG_SYMMETRIC_ENCRYPTED_SESSION_KEY:
+    CHECKPOINT_FIELD(c, pk->packet.t3.version, 1);
+    CHECKPOINT_FIELD(c, pk->packet.t3.algorithm, 1);
+    checkpoint_s2k(c, &(pk->packet.t3.s2k));
+
+    break;
+  case PTPGP_TAG_ONE_PASS_SIGNATURE:
+    CHECKPOINT_FIELD(c, pk->packet.t4.version, 1);
+    CHECKPOINT_FIELD(c, pk->packet.t4.signature_type, 1);
+    CHECKPOINT_FIELD(c, pk->packet.t4.hash_algorithm, 1);
+    CHECKPOINT_FIELD(c, pk->packet.t4.public_key_algorithm, 1);
+    ptpgp_checkpoint_bytes(c, pk->packet.t4.key_id, 8);
+    CHECKPOINT_FIELD(c, pk->packet.t4.nested, 1);
+
+    break;
+  case PTPGP_TAG_SECRET_KEY:
+  case PTPGP_TAG_SECRET_SUBKEY:
+    checkpoint_public_key(c, &(pk->packet.t5.public_key));
+    CHECKPOINT_FIELD(c, pk->packet.t5.plaintext_secret_key, 1);
+    CHECKPOINT_FIELD(c, pk->packet.t5.key_usage, 1);
+    CHECKPOINT_FIELD(c, pk->packet.t5.num_mpis, 1);
+    ptpgp_checkpoint_bytes(c, pk->packet.t5.iv, sizeof(pk->packet.t5.iv));
+    CHECKPOINT_FIELD(c, pk->packet.t5.symmetric_algorithm, 1);
+    checkpoint_s2k(c, &(pk->packet.t5.s2k));
+
+    break;
+  case PTPGP_TAG_PUBLIC_KEY:
+  case PTPGP_TAG_PUBLIC_SUBKEY:
+    checkpoint_public_key(c, &(pk->packet.t6));
+
+    break;
+  case PTPGP_TAG_COMPRESSED_DATA:
+    CHECKPOINT_FIELD(c, pk->packet.t8.compression_algorithm, 1);
+    CHECKPOINT_FIELD(c, pk->packet.t8.data_len, 8);
+
+    break;
+  case PTPGP_TAG_SYMMETRICALLY_ENCRYPTED_DATA:
+    CHECKPOINT_FIELD(c, pk->packet.t9.data_len, 8);
+
+    break;
+  case PTPGP_TAG_LITERAL_DATA:
+    CHECKPOINT_FIELD(c, pk->packet.t11.format, 1);
+    CHECKPOINT_FIELD(c, pk->packet.t11.file_name_len, 1);
+    CHECKPOINT_FIELD(c, pk->packet.t11.date, 4);
+    CHECKPOINT_FIELD(c, pk->packet.t11.data_len, 8);
+
+    break;
+  case PTPGP_TAG_SYM_ENCRYPTED_INTEGRITY_PROTECTED_DATA:
+    CHECKPOINT_FIELD(c, pk->packet.t18.version, 1);
+    CHECKPOINT_FIELD(c, pk->packet.t18.data_len, 8);
+
+    break;
+  default:
+    /* no decoded fields */
+    break;
+  }
+}
+
+static void
+checkpoint(ptpgp_checkpoint_t *c, ptpgp_packet_parser_t *p) {
+  CHECKPOINT_FIELD(c, p->flags, 4);
+
+  /* (the LAST state flags trailing data after a key packet) */
+  CHECKPOINT_FIELD(c, p->state, 1);
+  CHECKPOINT_CHECK(c, p->state <= STATE(LAST));
+
+  CHECKPOINT_FIELD(c, p->packet.tag, 1);
+  checkpoint_packet(c, &(p->packet));
+
+  CHECKPOINT_BUFFER(c, p->buf, p->buf_len);
+  CHECKPOINT_FIELD(c, p->remaining_bytes, 8);
+  CHECKPOINT_FIELD(c, p->num_mpis, 4);
+
+  /* (mpis collected in an arena and key and signature hashes can't be saved) */
+  CHECKPOINT_CHECK(
+    c, !p->mpi.data && !FLAG_IS_SET(p, KEY_HASH) && !FLAG_IS_SET(p, SIG_HASH)
+  );
+
+  CHECKPOINT_FIELD(c, p->symmetric_block_size, 4);
+  CHECKPOINT_CHECK(
+    c, p->symmetric_block_size <= sizeof(p->packet.packet.t5.iv)
+  );
+
+  /* current signature subpacket */
+  CHECKPOINT_FIELD(c, p->subpacket_header.type, 1);
+  CHECKPOINT_FIELD(c, p->subpacket_header.size, 8);
+  CHECKPOINT_FIELD(c, p->subpacket_header.critical, 1);
+}
+
+ptpgp_err_t
+ptpgp_packet_parser_save(ptpgp_packet_parser_t *p,
+                         u8 *dst,
+                         size_t dst_len,
+                         size_t *out_len) {
+  ptpgp_checkpoint_t c;
+
+  /* a failed parser can't be resumed */
+  if (p->last_err)
+    return p->last_err;
+
+  TRY(ptpgp_checkpoint_save_init(
+    &c, dst, dst_len,
+    PTPGP_CHECKPOINT_TYPE_PACKET_PARSER, p->offset
+  ));
+
+  checkpoint(&c, p);
+
+  return ptpgp_checkpoint_save_done(&c, out_len);
+}
+
+ptpgp_err_t
+ptpgp_packet_parser_restore(ptpgp_packet_parser_t *p,
+                            u8 *src,
+                            size_t src_len,
+                            ptpgp_packet_parser_cb_t cb,
+                            void *user_data) {
+  ptpgp_checkpoint_t c;
+
+  TRY(ptpgp_packet_parser_init(p, 0, cb, user_data));
+
+  if (ptpgp_checkpoint_load_init(
+    &c, src, src_len,
+    PTPGP_CHECKPOINT_TYPE_PACKET_PARSER, &(p->offset)
+  ) == PTPGP_OK)
+    checkpoint(&c, p);
+
+  /* a parser with invalid state must not be used */
+  return p->last_err = ptpgp_checkpoint_load_done(&c);
+}
@@ -0,0 +1,370 @@
+#include <pthread.h>
+#include "internal.h"
+
+#define DIE(p, err) do {                                              \
+  D("returning error %s", #err);                                      \
+  return (p)->last_err = PTPGP_ERR_PARALLEL_PARSER_##err;             \
+} while (0)
+
+/* shared state for a single run */
+typedef struct {
+  ptpgp_parallel_parser_t *p;
+
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+
+  /* next chunk to parse */
+  size_t next_chunk;
+
+  /* abort flag (set by the calling thread on error) */
+  bool abort;
+
+  /* per-chunk finished flags */
+  bool done[PTPGP_PARALLEL_PARSER_MAX_CHUNKS];
+} run_t;
+
+typedef struct {
+  ptpgp_parallel_parser_t *p;
+  ptpgp_tag_t split_tag;
+
+  /* minimum chunk size */
+  uint64_t chunk_size;
+} scan_t;
+
+static ptpgp_err_t
+add_chunk(ptpgp_parallel_parser_t *p, uint64_t offset) {
+  ptpgp_parallel_parser_chunk_t *c;
+
+  /* last chunk runs to the end of the input */
+  if (offset >= p->src_len || p->num_chunks >= PTPGP_PARALLEL_PARSER_MAX_CHUNKS)
+    return PTPGP_OK;
+
+  if (p->num_chunks > 0) {
+    c = p->chunks + p->num_chunks - 1;
+
+    /* ignore empty chunks */
+    if (offset <= c->offset)
+      return PTPGP_OK;
+
+    /* set length of previous chunk */
+    c->len = offset - c->offset;
+  }
+
+  /* add chunk */
+  c = p->chunks + p->num_chunks;
+  c->parser = p;
+  c->index = p->num_chunks;
+  c->offset = offset;
+  c->len = p->src_len - offset;
+
+  p->num_chunks++;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+static void
+reset_chunks(ptpgp_parallel_parser_t *p, u8 *src, size_t src_len) {
+  memset(p->chunks, 0, sizeof(p->chunks));
+  p->num_chunks = 0;
+
+  p->src = src;
+  p->src_len = src_len;
+}
+
+static uint64_t
+get_chunk_size(ptpgp_parallel_parser_t *p) {
+  size_t n = p->num_threads * PTPGP_PARALLEL_PARSER_CHUNKS_PER_THREAD;
+
+  if (n > PTPGP_PARALLEL_PARSER_MAX_CHUNKS)
+    n = PTPGP_PARALLEL_PARSER_MAX_CHUNKS;
+
+  return p->src_len / n + 1;
+}
+
+ptpgp_err_t
+ptpgp_parallel_parser_init(ptpgp_parallel_parser_t *p,
+                           size_t num_threads,
+                           ptpgp_parallel_parser_chunk_cb_t chunk_cb,
+                           ptpgp_stream_parser_cb_t cb,
+                           ptpgp_parallel_parser_chunk_cb_t merge_cb,
+                           void *user_data) {
+  /* clear parser */
+  memset(p, 0, sizeof(ptpgp_parallel_parser_t));
+
+  /* check thread count */
+  if (num_threads < 1 || num_threads > PTPGP_PARALLEL_PARSER_MAX_THREADS)
+    DIE(p, BAD_THREAD_COUNT);
+
+  p->num_threads = num_threads;
+
+  /* save callbacks */
+  p->chunk_cb = chunk_cb;
+  p->cb = cb;
+  p->merge_cb = merge_cb;
+  p->user_data = user_data;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+static ptpgp_err_t
+scan_cb(ptpgp_stream_parser_t *sp,
+        ptpgp_stream_parser_token_t t,
+        ptpgp_packet_header_t *header,
+        u8 *src, size_t src_len) {
+  scan_t *s = sp->cb_data;
+  ptpgp_parallel_parser_t *p = s->p;
+
+  UNUSED(src);
+  UNUSED(src_len);
+
+  /* only packet headers are interesting */
+  if (t != PTPGP_STREAM_PARSER_TOKEN_START)
+    return PTPGP_OK;
+
+  /* start new chunk once the current chunk is large enough */
+  if ((!s->split_tag || header->content_tag == s->split_tag) &&
+      sp->header_offset >= p->chunks[p->num_chunks - 1].offset + s->chunk_size)
+    TRY(add_chunk(p, sp->header_offset));
+
+  /* packet bodies are never needed */
+  return PTPGP_ERR_STREAM_PARSER_SKIP_BODY;
+}
+
+ptpgp_err_t
+ptpgp_parallel_parser_split(ptpgp_parallel_parser_t *p,
+                            u8 *src,
+                            size_t src_len,
+                            ptpgp_tag_t split_tag) {
+  ptpgp_stream_parser_t sp;
+  scan_t s;
+  ptpgp_err_t err;
+
+  /* return last error */
+  if (p->last_err)
+    return p->last_err;
+
+  reset_chunks(p, src, src_len);
+
+  /* add first chunk */
+  TRY(add_chunk(p, 0));
+  if (!p->num_chunks)
+    return PTPGP_OK;
+
+  s.p = p;
+  s.split_tag = split_tag;
+  s.chunk_size = get_chunk_size(p);
+
+  /* scan packet headers (packet bodies are skipped) */
+  TRY(ptpgp_stream_parser_init(&sp, scan_cb, &s));
+
+  if ((err = ptpgp_stream_parser_push(&sp, src, src_len)) != PTPGP_OK ||
+      (err = ptpgp_stream_parser_done(&sp)) != PTPGP_OK)
+    return p->last_err = err;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+ptpgp_err_t
+ptpgp_parallel_parser_split_index(ptpgp_parallel_parser_t *p,
+                                  u8 *src,
+                                  size_t src_len,
+                                  ptpgp_packet_index_t *index,
+                                  ptpgp_tag_t split_tag) {
+  ptpgp_packet_index_entry_t e;
+  uint64_t chunk_size, target, n = 0;
+  ptpgp_err_t err;
+
+  /* return last error */
+  if (p->last_err)
+    return p->last_err;
+
+  reset_chunks(p, src, src_len);
+
+  /* add first chunk */
+  TRY(add_chunk(p, 0));
+  if (!p->num_chunks)
+    return PTPGP_OK;
+
+  chunk_size = get_chunk_size(p);
+
+  for (target = chunk_size; target < src_len; target += chunk_size) {
+    uint64_t lo = n, hi = index->num_entries;
+
+    /* find first packet at or after target */
+    while (lo < hi) {
+      uint64_t mid = lo + (hi - lo) / 2;
+
+      TRY(ptpgp_packet_index_get(index, mid, &e));
+
+      if (e.header_offset < target)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+    if (lo >= index->num_entries)
+      break;
+
+    n = lo;
+
+    /* find next packet with split tag */
+    if (split_tag) {
+      err = ptpgp_packet_index_find_tag(index, split_tag, n, &n);
+
+      if (err == PTPGP_ERR_PACKET_INDEX_NOT_FOUND)
+        break;
+      else if (err != PTPGP_OK)
+        return p->last_err = err;
+    }
+
+    TRY(ptpgp_packet_index_get(index, n, &e));
+
+    /* check for stale index */
+    if (e.body_offset + e.body_length > src_len)
+      return p->last_err = PTPGP_ERR_PACKET_INDEX_ENTRY_OUT_OF_RANGE;
+
+    TRY(add_chunk(p, e.header_offset));
+
+    /* skip past this chunk */
+    if (e.header_offset > target)
+      target = e.header_offset;
+  }
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+static ptpgp_err_t
+parse_chunk(ptpgp_parallel_parser_chunk_t *c) {
+  ptpgp_parallel_parser_t *p = c->parser;
+  ptpgp_stream_parser_t sp;
+
+  if (p->chunk_cb)
+    TRY(p->chunk_cb(c));
+
+  TRY(ptpgp_stream_parser_init(&sp, p->cb, c));
+
+  /* report absolute stream offsets */
+  sp.offset = c->offset;
+
+  TRY(ptpgp_stream_parser_push(&sp, p->src + c->offset, c->len));
+  TRY(ptpgp_stream_parser_done(&sp));
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+static void *
+worker(void *arg) {
+  run_t *r = arg;
+  ptpgp_parallel_parser_chunk_t *c;
+
+  while (1) {
+    /* get next chunk */
+    pthread_mutex_lock(&(r->mutex));
+
+    if (r->abort || r->next_chunk >= r->p->num_chunks) {
+      pthread_mutex_unlock(&(r->mutex));
+      break;
+    }
+
+    c = r->p->chunks + r->next_chunk++;
+    pthread_mutex_unlock(&(r->mutex));
+
+    /* parse chunk */
+    c->err = parse_chunk(c);
+
+    /* flag chunk as finished */
+    pthread_mutex_lock(&(r->mutex));
+    r->done[c->index] = 1;
+    pthread_cond_broadcast(&(r->cond));
+    pthread_mutex_unlock(&(r->mutex));
+  }
+
+  return NULL;
+}
+
+ptpgp_err_t
+ptpgp_parallel_parser_run(ptpgp_parallel_parser_t *p) {
+  pthread_t threads[PTPGP_PARALLEL_PARSER_MAX_THREADS];
+  size_t i, num_threads;
+  ptpgp_err_t err = PTPGP_OK;
+  run_t r;
+
+  /* return last error */
+  if (p->last_err)
+    return p->last_err;
+
+  if (!p->src)
+    DIE(p, NOT_SPLIT);
+
+  memset(&r, 0, sizeof(run_t));
+  r.p = p;
+  pthread_mutex_init(&(r.mutex), NULL);
+  pthread_cond_init(&(r.cond), NULL);
+
+  /* start workers */
+  num_threads = (p->num_threads < p->num_chunks) ? p->num_threads : p->num_chunks;
+  for (i = 0; i < num_threads; i++) {
+    if (pthread_create(threads + i, NULL, worker, &r)) {
+      err = PTPGP_ERR_PARALLEL_PARSER_THREAD_FAILED;
+      num_threads = i;
+      break;
+    }
+  }
+
+  if (!num_threads)
+    r.abort = 1;
+
+  /*
+   * merge chunks in stream order; chunks are handed out in order, so
+   * after an abort the started chunks are always a prefix of the list
+   */
+  for (i = 0; i < p->num_chunks; i++) {
+    ptpgp_parallel_parser_chunk_t *c = p->chunks + i;
+    bool started;
+
+    /* wait for chunk (unless it will never be started) */
+    pthread_mutex_lock(&(r.mutex));
+    while (!r.done[i] && !(r.abort && i >= r.next_chunk))
+      pthread_cond_wait(&(r.cond), &(r.mutex));
+    started = r.done[i];
+    pthread_mutex_unlock(&(r.mutex));
+
+    if (!started)
+      break;
+
+    if (err == PTPGP_OK && c->err != PTPGP_OK)
+      err = c->err;
+
+    if (p->merge_cb) {
+      ptpgp_err_t merge_err = p->merge_cb(c);
+
+      if (err == PTPGP_OK && merge_err != PTPGP_OK)
+        err = merge_err;
+    }
+
+    /* stop handing out chunks after the first error */
+    if (err != PTPGP_OK) {
+      pthread_mutex_lock(&(r.mutex));
+      r.abort = 1;
+      pthread_mutex_unlock(&(r.mutex));
+    }
+  }
+
+  /* wait for workers */
+  for (i = 0; i < num_threads; i++)
+    pthread_join(threads[i], NULL);
+
+  pthread_cond_destroy(&(r.cond));
+  pthread_mutex_destroy(&(r.mutex));
+
+  if (err != PTPGP_OK)
+    return p->last_err = err;
+
+  /* return success */
+  return PTPGP_OK;
+}
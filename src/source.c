@@ -0,0 +1,378 @@
+#define _POSIX_C_SOURCE 200112L /* for posix_memalign(), posix_madvise() */
+
+#include <sys/types.h>  /* for fstat() */
+#include <sys/stat.h>   /* for fstat() */
+#include <sys/mman.h>   /* for mmap() */
+#include <fcntl.h>      /* for open() */
+#include <unistd.h>     /* for read(), lseek(), close(), sysconf() */
+#include <stdlib.h>     /* for posix_memalign(), free() */
+#include <errno.h>
+
+#include "internal.h"
+
+#define DIE(s, err) do {                                              \
+  D("returning error %s", #err);                                      \
+  return (s)->last_err = PTPGP_ERR_SOURCE_##err;                      \
+} while (0)
+
+/* push remaining contents of source to a push parser */
+#define PUSH_ALL(s, fn, p) do {                                       \
+  u8 *buf;                                                            \
+  size_t buf_len;                                                     \
+  ptpgp_err_t err;                                                    \
+                                                                      \
+  while (1) {                                                         \
+    TRY(ptpgp_source_next((s), &buf, &buf_len));                      \
+                                                                      \
+    if (!buf_len)                                                     \
+      break;                                                          \
+                                                                      \
+    if ((err = fn((p), buf, buf_len)) != PTPGP_OK)                    \
+      return (s)->last_err = err;                                     \
+  }                                                                   \
+} while (0)
+
+static size_t
+page_size(void) {
+  long r = sysconf(_SC_PAGESIZE);
+  return (r > 0) ? (size_t) r : 4096;
+}
+
+static void
+prefetch(ptpgp_source_t *s, uint64_t ofs, uint64_t len) {
+  /* posix_madvise() needs a page-aligned address */
+  uint64_t pad = ofs % page_size();
+  posix_madvise(s->data + ofs - pad, len + pad, POSIX_MADV_WILLNEED);
+}
+
+static void
+clear(ptpgp_source_t *s) {
+  memset(s, 0, sizeof(ptpgp_source_t));
+  s->fd = -1;
+  s->readahead = PTPGP_SOURCE_DEFAULT_READAHEAD;
+}
+
+ptpgp_err_t
+ptpgp_source_init_memory(ptpgp_source_t *s,
+                         u8 *src,
+                         size_t src_len) {
+  clear(s);
+
+  s->type = PTPGP_SOURCE_TYPE_MEMORY;
+  s->data = src;
+  s->data_len = src_len;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+static ptpgp_err_t
+map(ptpgp_source_t *s, int fd) {
+  struct stat st;
+  void *addr;
+
+  if (fstat(fd, &st))
+    DIE(s, OPEN_FAILED);
+
+  /* only regular files can be mapped */
+  if (!S_ISREG(st.st_mode) || (uint64_t) st.st_size != (size_t) st.st_size)
+    DIE(s, MMAP_FAILED);
+
+  s->type = PTPGP_SOURCE_TYPE_MMAP;
+  s->fd = fd;
+
+  /* empty files can't be mapped (and don't need to be) */
+  if (!st.st_size)
+    return PTPGP_OK;
+
+  addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (addr == MAP_FAILED) {
+    s->type = PTPGP_SOURCE_TYPE_NONE;
+    s->fd = -1;
+    DIE(s, MMAP_FAILED);
+  }
+
+  s->data = addr;
+  s->data_len = st.st_size;
+
+  /* input is read front to back */
+  posix_madvise(s->data, s->data_len, POSIX_MADV_SEQUENTIAL);
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+ptpgp_err_t
+ptpgp_source_init_mmap(ptpgp_source_t *s,
+                       int fd) {
+  clear(s);
+  return map(s, fd);
+}
+
+ptpgp_err_t
+ptpgp_source_init_fd(ptpgp_source_t *s,
+                     int fd) {
+  void *buf;
+
+  clear(s);
+
+  /* allocate page-aligned read buffer */
+  if (posix_memalign(&buf, page_size(), PTPGP_SOURCE_READ_BUFFER_SIZE))
+    DIE(s, ALLOC_FAILED);
+
+  s->type = PTPGP_SOURCE_TYPE_FD;
+  s->fd = fd;
+  s->buf = buf;
+  s->buf_size = PTPGP_SOURCE_READ_BUFFER_SIZE;
+
+  /* hint sequential access (ignored for pipes) */
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+ptpgp_err_t
+ptpgp_source_init_file(ptpgp_source_t *s,
+                       char *path) {
+  int fd;
+
+  clear(s);
+
+  if (!strncmp(path, "-", 2)) {
+    /* read standard input */
+    fd = STDIN_FILENO;
+  } else if ((fd = open(path, O_RDONLY)) == -1) {
+    DIE(s, OPEN_FAILED);
+  }
+
+  /* map file, fall back to reads (e.g. for pipes) */
+  if (map(s, fd) != PTPGP_OK && ptpgp_source_init_fd(s, fd) != PTPGP_OK) {
+    if (fd != STDIN_FILENO)
+      close(fd);
+
+    return s->last_err;
+  }
+
+  /* close descriptor if we opened it */
+  s->close_fd = (fd != STDIN_FILENO);
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+ptpgp_err_t
+ptpgp_source_set_readahead(ptpgp_source_t *s,
+                           size_t readahead) {
+  size_t ps = page_size();
+
+  /* round up to page size, so windows stay page-aligned */
+  s->readahead = (readahead + ps - 1) / ps * ps;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+ptpgp_err_t
+ptpgp_source_next(ptpgp_source_t *s,
+                  u8 **dst,
+                  size_t *dst_len) {
+  uint64_t len;
+  ssize_t r;
+
+  /* return last error */
+  if (s->last_err)
+    return s->last_err;
+
+  *dst_len = 0;
+
+  switch (s->type) {
+  case PTPGP_SOURCE_TYPE_MEMORY:
+    /* hand out remaining buffer */
+    *dst = s->data + s->offset;
+    *dst_len = s->data_len - s->offset;
+    s->offset = s->data_len;
+
+    break;
+  case PTPGP_SOURCE_TYPE_MMAP:
+    len = s->data_len - s->offset;
+
+    if (s->readahead > 0 && len > s->readahead) {
+      uint64_t next_len;
+
+      len = s->readahead;
+
+      /* prefetch the window after this one */
+      next_len = s->data_len - s->offset - len;
+      if (next_len > s->readahead)
+        next_len = s->readahead;
+
+      prefetch(s, s->offset + len, next_len);
+    }
+
+    *dst = s->data + s->offset;
+    *dst_len = len;
+    s->offset += len;
+
+    break;
+  case PTPGP_SOURCE_TYPE_FD:
+    do {
+      r = read(s->fd, s->buf, s->buf_size);
+    } while (r == -1 && errno == EINTR);
+
+    if (r == -1)
+      DIE(s, READ_FAILED);
+
+    *dst = s->buf;
+    *dst_len = r;
+    s->offset += r;
+
+    break;
+  default:
+    DIE(s, NOT_INITIALIZED);
+  }
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+ptpgp_err_t
+ptpgp_source_read(ptpgp_source_t *s,
+                  ptpgp_source_cb_t cb,
+                  void *user_data) {
+  s->user_data = user_data;
+  PUSH_ALL(s, cb, s);
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+ptpgp_err_t
+ptpgp_source_skip(ptpgp_source_t *s,
+                  uint64_t len,
+                  uint64_t *skip_len) {
+  struct stat st;
+  off_t pos;
+
+  /* return last error */
+  if (s->last_err)
+    return s->last_err;
+
+  *skip_len = 0;
+
+  switch (s->type) {
+  case PTPGP_SOURCE_TYPE_MEMORY:
+  case PTPGP_SOURCE_TYPE_MMAP:
+    /* advance offset (skipped pages are never touched) */
+    if (len > s->data_len - s->offset)
+      len = s->data_len - s->offset;
+
+    break;
+  case PTPGP_SOURCE_TYPE_FD:
+    /* pipes can't seek, so skipped data has to be read */
+    if ((pos = lseek(s->fd, 0, SEEK_CUR)) == -1 ||
+        fstat(s->fd, &st) || !S_ISREG(st.st_mode))
+      return PTPGP_OK;
+
+    /* clamp to end of file */
+    if (pos >= st.st_size)
+      return PTPGP_OK;
+    if (len > (uint64_t) (st.st_size - pos))
+      len = st.st_size - pos;
+
+    if (lseek(s->fd, len, SEEK_CUR) == -1)
+      DIE(s, READ_FAILED);
+
+    break;
+  default:
+    DIE(s, NOT_INITIALIZED);
+  }
+
+  s->offset += len;
+  *skip_len = len;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+ptpgp_err_t
+ptpgp_source_push_stream_parser(ptpgp_source_t *s,
+                                ptpgp_stream_parser_t *p) {
+  u8 *buf;
+  size_t buf_len;
+  uint64_t len;
+  ptpgp_err_t err;
+
+  while (1) {
+    TRY(ptpgp_source_next(s, &buf, &buf_len));
+
+    if (!buf_len)
+      break;
+
+    if ((err = ptpgp_stream_parser_push(p, buf, buf_len)) != PTPGP_OK)
+      return s->last_err = err;
+
+    /* seek past the rest of a skipped packet body */
+    if ((err = ptpgp_stream_parser_get_skip_length(p, &len)) != PTPGP_OK)
+      return s->last_err = err;
+
+    if (len > 0) {
+      TRY(ptpgp_source_skip(s, len, &len));
+
+      if ((err = ptpgp_stream_parser_skip(p, len)) != PTPGP_OK)
+        return s->last_err = err;
+    }
+  }
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+ptpgp_err_t
+ptpgp_source_push_armor_parser(ptpgp_source_t *s,
+                               ptpgp_armor_parser_t *p) {
+  PUSH_ALL(s, ptpgp_armor_parser_push, p);
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+ptpgp_err_t
+ptpgp_source_push_dearmor(ptpgp_source_t *s,
+                          ptpgp_dearmor_t *d) {
+  PUSH_ALL(s, ptpgp_dearmor_push, d);
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+ptpgp_err_t
+ptpgp_source_push_base64(ptpgp_source_t *s,
+                         ptpgp_base64_t *p) {
+  PUSH_ALL(s, ptpgp_base64_push, p);
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+ptpgp_err_t
+ptpgp_source_close(ptpgp_source_t *s) {
+  ptpgp_err_t r = PTPGP_OK;
+
+  /* unmap file */
+  if (s->type == PTPGP_SOURCE_TYPE_MMAP && s->data &&
+      munmap(s->data, s->data_len))
+    r = PTPGP_ERR_SOURCE_CLOSE_FAILED;
+
+  /* free read buffer */
+  free(s->buf);
+
+  /* close file */
+  if (s->close_fd && close(s->fd))
+    r = PTPGP_ERR_SOURCE_CLOSE_FAILED;
+
+  clear(s);
+
+  /* return result */
+  return r;
+}
@@ -42,9 +42,10 @@
   if ((n) > src_len)                                                  \
     DIE((p), INPUT_BUFFER_OVERFLOW);                                  \
                                                                       \
-  /* shift input buffer ptr and length */                             \
+  /* shift input buffer ptr and length, update stream offset */      \
   src += (n);                                                         \
   src_len -= (n);                                                     \
+  (p)->offset += (n);                                                 \
 } while (0)
 
 #define ASSERT_VALID_CONTENT_TAG(p) do {                              \
@@ -64,13 +65,446 @@
     return (p)->last_err = err;                                       \
 } while (0)
 
+#define SEND_START(p) do {                                            \
+  ptpgp_err_t err;                                                    \
+                                                                      \
+  D("sending START to callback");                                     \
+                                                                      \
+  /* save stream offset of packet body */                             \
+  (p)->body_offset = (p)->offset;                                     \
+                                                                      \
+  /* check tag filter */                                              \
+  (p)->is_filtered = !((p)->tags &                                    \
+                       PTPGP_TAG_MASK((p)->header.content_tag));      \
+                                                                      \
+  if ((p)->is_filtered) {                                             \
+    /* skip entire packet */                                          \
+    err = PTPGP_ERR_STREAM_PARSER_SKIP_BODY;                          \
+  } else {                                                            \
+    err = (p)->cb(                                                    \
+      (p), PTPGP_STREAM_PARSER_TOKEN_START,                           \
+      &((p)->header), 0, 0                                            \
+    );                                                                \
+  }                                                                   \
+                                                                      \
+  /* check for skip request */                                        \
+  (p)->skip_body = (err == PTPGP_ERR_STREAM_PARSER_SKIP_BODY);        \
+                                                                      \
+  if (err != PTPGP_OK && !(p)->skip_body)                             \
+    return (p)->last_err = err;                                       \
+} while (0)
+
+/* send end of packet, unless the packet is filtered out */
+#define SEND_END(p) do {                                              \
+  if (!(p)->is_filtered)                                              \
+    SEND(p, END, 0, 0);                                               \
+} while (0)
+
+/* send corrupt octets, and add them to the size of the corrupt region */
+#define SEND_CORRUPT(p, b, l) do {                                    \
+  if ((l) > 0) {                                                      \
+    SEND(p, CORRUPT, b, l);                                           \
+    (p)->bytes_read += (l);                                           \
+  }                                                                   \
+} while (0)
+
+/* send body data, unless the callback asked to skip the body */
+#define SEND_BODY(p, b, l) do {                                       \
+  if (!(p)->skip_body)                                                \
+    SEND(p, BODY, b, l);                                              \
+} while (0)
+
+/*
+ * Decode a complete packet header from the front of src.  Sets
+ * header_len to the size of the header, or to zero if src does not
+ * contain the entire header (the caller falls back to the byte-wise
+ * state machine in that case).
+ */
+static ptpgp_err_t
+decode_header(u8 *src,
+              size_t src_len,
+              ptpgp_packet_header_t *header,
+              uint64_t *partial_body_length,
+              size_t *header_len) {
+  int c = src[0];
+
+  *header_len = 0;
+  memset(header, 0, sizeof(ptpgp_packet_header_t));
+
+  /* check packet header tag (RFC2440 S4.2: bit 7 is always 1) */
+  if (!(c & 0x80))
+    return PTPGP_ERR_STREAM_PARSER_BAD_PACKET_TAG;
+
+  if (c & (1 << 6)) {
+    /* new-style packet header */
+    header->flags |= PTPGP_PACKET_FLAG_NEW_PACKET;
+    header->content_tag = (c & 0x3f);
+
+    if (!IS_VALID_CONTENT_TAG(header->content_tag))
+      return PTPGP_ERR_STREAM_PARSER_INVALID_CONTENT_TAG;
+
+    if (src_len < 2)
+      return PTPGP_OK;
+
+    if (src[1] < 192) {
+      /* one-octet length (rfc4880 4.2.2.1) */
+      header->length = src[1];
+      *header_len = 2;
+    } else if (src[1] <= 223) {
+      /* two-octet length (rfc4880 4.2.2.2) */
+      if (src_len < 3)
+        return PTPGP_OK;
+
+      header->length = ((src[1] - 192) << 8) + src[2] + 192;
+      *header_len = 3;
+    } else if (src[1] == 255) {
+      /* five-octet length (rfc4880 4.2.2.3) */
+      if (src_len < 6)
+        return PTPGP_OK;
+
+      header->length = ((uint32_t) src[2] << 24) |
+                       ((uint32_t) src[3] << 16) |
+                       ((uint32_t) src[4] <<  8) |
+                       ((uint32_t) src[5]);
+      *header_len = 6;
+    } else {
+      /* partial body length (rfc4880 4.2.2.4) */
+      header->flags |= PTPGP_PACKET_FLAG_PARTIAL;
+      *partial_body_length = 1 << (src[1] & 0x1f);
+      *header_len = 2;
+    }
+  } else {
+    /* old-style packet header */
+    header->content_tag = (c & 0x3f) >> 2;
+
+    if (!IS_VALID_CONTENT_TAG(header->content_tag))
+      return PTPGP_ERR_STREAM_PARSER_INVALID_CONTENT_TAG;
+
+    switch (c & 0x3) {
+    case 0:
+      if (src_len < 2)
+        return PTPGP_OK;
+
+      header->length = src[1];
+      *header_len = 2;
+
+      break;
+    case 1:
+      if (src_len < 3)
+        return PTPGP_OK;
+
+      header->length = (src[1] << 8) | src[2];
+      *header_len = 3;
+
+      break;
+    case 2:
+      if (src_len < 5)
+        return PTPGP_OK;
+
+      header->length = ((uint32_t) src[1] << 24) |
+                       ((uint32_t) src[2] << 16) |
+                       ((uint32_t) src[3] <<  8) |
+                       ((uint32_t) src[4]);
+      *header_len = 5;
+
+      break;
+    default:
+      /* indeterminate length */
+      header->flags |= PTPGP_PACKET_FLAG_INDETERMINITE;
+      *header_len = 1;
+    }
+  }
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+/* number of body octets checked when resynchronizing */
+#define MAX_BODY_CHECK_LEN 6
+
+/*
+ * size of resync check window: longest packet header (new-style,
+ * five-octet length) and checked body octets
+ */
+#define MAX_CHECK_LEN (6 + MAX_BODY_CHECK_LEN)
+
+/*
+ * packets whose contents can't be checked (and packets with partial or
+ * indeterminate lengths) are accepted after a valid packet, but are
+ * never used to resynchronize
+ */
+#define UNCHECKED_TAGS (                                              \
+  PTPGP_TAG_MASK(PTPGP_TAG_SYMMETRICALLY_ENCRYPTED_DATA) |            \
+  PTPGP_TAG_MASK(PTPGP_TAG_TRUST) |                                   \
+  PTPGP_TAG_MASK(PTPGP_TAG_MODIFICATION_DETECTION_CODE) |             \
+  PTPGP_TAG_MASK(PTPGP_TAG_PRIVATE_OR_EXPERIMENTAL_60) |              \
+  PTPGP_TAG_MASK(PTPGP_TAG_PRIVATE_OR_EXPERIMENTAL_61) |              \
+  PTPGP_TAG_MASK(PTPGP_TAG_PRIVATE_OR_EXPERIMENTAL_62) |              \
+  PTPGP_TAG_MASK(PTPGP_TAG_PRIVATE_OR_EXPERIMENTAL_63)                \
+)
+
+/* results of check_header() */
+#define HEADER_IMPLAUSIBLE  0
+#define HEADER_PLAUSIBLE    1
+#define HEADER_INCOMPLETE   2
+
+static bool
+is_data_tag(ptpgp_tag_t t) {
+  return t == PTPGP_TAG_COMPRESSED_DATA ||
+         t == PTPGP_TAG_SYMMETRICALLY_ENCRYPTED_DATA ||
+         t == PTPGP_TAG_LITERAL_DATA ||
+         t == PTPGP_TAG_SYM_ENCRYPTED_INTEGRITY_PROTECTED_DATA;
+}
+
+static bool
+is_known_algorithm(ptpgp_type_t t, u8 a) {
+  ptpgp_type_info_t *info;
+  return ptpgp_type_info(t, a, &info) == PTPGP_OK;
+}
+
+static bool
+is_signature_type(u8 t) {
+  switch (t) {
+  case PTPGP_SIGNATURE_TYPE_DOCUMENT_BINARY:
+  case PTPGP_SIGNATURE_TYPE_DOCUMENT_TEXT:
+  case PTPGP_SIGNATURE_TYPE_STANDALONE:
+  case PTPGP_SIGNATURE_TYPE_CERTIFICATION_GENERIC:
+  case PTPGP_SIGNATURE_TYPE_CERTIFICATION_PERSONA:
+  case PTPGP_SIGNATURE_TYPE_CERTIFICATION_CASUAL:
+  case PTPGP_SIGNATURE_TYPE_CERTIFICATION_POSITIVE:
+  case PTPGP_SIGNATURE_TYPE_BINDING_SUBKEY:
+  case PTPGP_SIGNATURE_TYPE_BINDING_PRIMARY_KEY:
+  case PTPGP_SIGNATURE_TYPE_KEY:
+  case PTPGP_SIGNATURE_TYPE_REVOKATION_KEY:
+  case PTPGP_SIGNATURE_TYPE_REVOKATION_SUBKEY:
+  case PTPGP_SIGNATURE_TYPE_REVOKATION_CERTIFICATION:
+  case PTPGP_SIGNATURE_TYPE_TIMESTAMP:
+  case PTPGP_SIGNATURE_TYPE_THIRD_PARTY_CONFIRMATION:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+/*
+ * Check a decoded packet header for plausibility when resynchronizing:
+ * only data packets may have partial or indeterminate lengths (and the
+ * first partial body must be at least 512 octets, see rfc4880 4.2.2.4),
+ * and the body length must be sane for the content tag (and long
+ * enough for the octets checked by is_plausible_body()).  Data packets
+ * with any other length are common in corrupt data, so their length
+ * is bounded too.
+ */
+static bool
+is_plausible_header(ptpgp_packet_header_t *header,
+                    uint64_t partial_body_length) {
+  if (header->flags & PTPGP_PACKET_FLAG_INDETERMINITE)
+    return is_data_tag(header->content_tag);
+
+  if (header->flags & PTPGP_PACKET_FLAG_PARTIAL)
+    return is_data_tag(header->content_tag) && partial_body_length >= 512;
+
+  switch (header->content_tag) {
+  case PTPGP_TAG_SYMMETRICALLY_ENCRYPTED_DATA:
+    /* initialization vector and check octets */
+    return header->length >= 10;
+  case PTPGP_TAG_COMPRESSED_DATA:
+    /* algorithm and compressed data */
+    return header->length >= 2 &&
+           header->length <= PTPGP_STREAM_PARSER_RESYNC_MAX_DATA_LENGTH;
+  case PTPGP_TAG_LITERAL_DATA:
+    /* format, file name length, and date */
+    return header->length >= 6 &&
+           header->length <= PTPGP_STREAM_PARSER_RESYNC_MAX_DATA_LENGTH;
+  case PTPGP_TAG_SYM_ENCRYPTED_INTEGRITY_PROTECTED_DATA:
+    /* version, smallest prefix (8-octet block size), and mdc packet */
+    return header->length >= 33 &&
+           header->length <= PTPGP_STREAM_PARSER_RESYNC_MAX_DATA_LENGTH;
+  case PTPGP_TAG_ONE_PASS_SIGNATURE:
+    return header->length == 13;
+  case PTPGP_TAG_MARKER:
+    return header->length == 3;
+  case PTPGP_TAG_MODIFICATION_DETECTION_CODE:
+    return header->length == 20;
+  case PTPGP_TAG_USER_ID:
+    /* may be empty */
+    return header->length <= PTPGP_STREAM_PARSER_RESYNC_MAX_LENGTH;
+  case PTPGP_TAG_TRUST:
+    /* implementation-defined, but only a few octets in practice */
+    return header->length <= 16;
+  case PTPGP_TAG_USER_ATTRIBUTE:
+    return header->length >= 2 &&
+           header->length <= PTPGP_STREAM_PARSER_RESYNC_MAX_ATTRIBUTE_LENGTH;
+  case PTPGP_TAG_PUBLIC_KEY_ENCRYPTED_SESSION_KEY:
+  case PTPGP_TAG_SIGNATURE:
+    return header->length >= 12 &&
+           header->length <= PTPGP_STREAM_PARSER_RESYNC_MAX_LENGTH;
+  case PTPGP_TAG_SECRET_KEY:
+  case PTPGP_TAG_PUBLIC_KEY:
+  case PTPGP_TAG_SECRET_SUBKEY:
+  case PTPGP_TAG_PUBLIC_SUBKEY:
+    return header->length >= 8 &&
+           header->length <= PTPGP_STREAM_PARSER_RESYNC_MAX_LENGTH;
+  case PTPGP_TAG_SYMMETRIC_ENCRYPTED_SESSION_KEY:
+    return header->length >= 4 &&
+           header->length <= PTPGP_STREAM_PARSER_RESYNC_MAX_LENGTH;
+  default:
+    return header->length > 0 &&
+           header->length <= PTPGP_STREAM_PARSER_RESYNC_MAX_LENGTH;
+  }
+}
+
+/*
+ * Check the first body octets of a packet (version numbers, algorithms,
+ * and signature types) for plausibility when resynchronizing.  The
+ * body has at least min(header length, MAX_BODY_CHECK_LEN) octets.
+ */
+static bool
+is_plausible_body(ptpgp_packet_header_t *header, u8 *src) {
+  size_t i;
+
+  switch (header->content_tag) {
+  case PTPGP_TAG_PUBLIC_KEY_ENCRYPTED_SESSION_KEY:
+    return src[0] == 3;
+  case PTPGP_TAG_SIGNATURE:
+    if (src[0] == 2 || src[0] == 3) {
+      /* length of hashed material, signature type */
+      return src[1] == 5 && is_signature_type(src[2]);
+    } else if (src[0] == 4) {
+      /* signature type, algorithms, and hashed subpacket length */
+      return is_signature_type(src[1]) &&
+             is_known_algorithm(PTPGP_TYPE_PUBLIC_KEY, src[2]) &&
+             is_known_algorithm(PTPGP_TYPE_HASH, src[3]) &&
+             ((src[4] << 8) | src[5]) + 6u <= header->length;
+    }
+
+    return 0;
+  case PTPGP_TAG_SYMMETRIC_ENCRYPTED_SESSION_KEY:
+    /* version, algorithm, and s2k specifier */
+    return src[0] == 4 &&
+           is_known_algorithm(PTPGP_TYPE_SYMMETRIC, src[1]) &&
+           is_known_algorithm(PTPGP_TYPE_S2K, src[2]);
+  case PTPGP_TAG_ONE_PASS_SIGNATURE:
+    return src[0] == 3 &&
+           is_signature_type(src[1]) &&
+           is_known_algorithm(PTPGP_TYPE_HASH, src[2]) &&
+           is_known_algorithm(PTPGP_TYPE_PUBLIC_KEY, src[3]);
+  case PTPGP_TAG_SECRET_KEY:
+  case PTPGP_TAG_PUBLIC_KEY:
+  case PTPGP_TAG_SECRET_SUBKEY:
+  case PTPGP_TAG_PUBLIC_SUBKEY:
+    if (src[0] == 2 || src[0] == 3)
+      return 1;
+
+    /* version, creation time, and algorithm */
+    return src[0] == 4 && is_known_algorithm(PTPGP_TYPE_PUBLIC_KEY, src[5]);
+  case PTPGP_TAG_COMPRESSED_DATA:
+    return is_known_algorithm(PTPGP_TYPE_COMPRESSION, src[0]) ||
+           (src[0] >= 100 && src[0] <= 110);
+  case PTPGP_TAG_MARKER:
+    return !memcmp(src, "PGP", 3);
+  case PTPGP_TAG_LITERAL_DATA:
+    /* data format, and file name must fit in the body */
+    return (src[0] == 'b' || src[0] == 't' || src[0] == 'u' ||
+            src[0] == 'l' || src[0] == '1') &&
+           src[1] + 6u <= header->length;
+  case PTPGP_TAG_USER_ID:
+    /* no control characters */
+    for (i = 0; i < header->length && i < MAX_BODY_CHECK_LEN; i++)
+      if (src[i] < 0x20 || src[i] == 0x7f)
+        return 0;
+
+    return 1;
+  case PTPGP_TAG_USER_ATTRIBUTE:
+    /* type of first subpacket (after its length) must be image */
+    i = (src[0] < 192) ? 1 : (src[0] < 255) ? 2 : 5;
+    return i < header->length && src[i] == 1;
+  case PTPGP_TAG_SYM_ENCRYPTED_INTEGRITY_PROTECTED_DATA:
+    return src[0] == 1;
+  default:
+    /* nothing to check */
+    return 1;
+  }
+}
+
+/*
+ * Check for a plausible packet header with a content tag in the given
+ * mask at the front of src.  The result only depends on the header and
+ * the first few body octets, so it does not change with the way the
+ * input is split into buffers.
+ *
+ * Every header must pass the length checks above.  If is_resync is
+ * set, then src is not at a packet boundary, and the packet must also
+ * pass the body checks and have a definite length.  Otherwise src
+ * follows a valid packet, and the body is not checked: the body
+ * heuristics would reject valid packets (e.g. keys with newer
+ * algorithms).
+ */
+static int
+check_header(u8 *src, size_t src_len, uint64_t tags, bool is_resync) {
+  ptpgp_packet_header_t header;
+  uint64_t partial_body_length = 0, len;
+  size_t header_len;
+
+  if (decode_header(src, src_len, &header,
+                    &partial_body_length, &header_len) != PTPGP_OK)
+    return HEADER_IMPLAUSIBLE;
+
+  if (is_resync)
+    tags &= ~UNCHECKED_TAGS;
+
+  if (!(tags & PTPGP_TAG_MASK(header.content_tag)))
+    return HEADER_IMPLAUSIBLE;
+
+  if (!header_len)
+    return HEADER_INCOMPLETE;
+
+  if (!is_plausible_header(&header, partial_body_length))
+    return HEADER_IMPLAUSIBLE;
+
+  if (!is_resync)
+    return HEADER_PLAUSIBLE;
+
+  if (header.flags & (PTPGP_PACKET_FLAG_PARTIAL |
+                      PTPGP_PACKET_FLAG_INDETERMINITE))
+    return HEADER_IMPLAUSIBLE;
+
+  /* get number of body octets to check (empty packets have none) */
+  len = MAX_BODY_CHECK_LEN;
+  if (header.length < len)
+    len = header.length;
+
+  if (!len)
+    return HEADER_PLAUSIBLE;
+
+  if (src_len - header_len < len)
+    return HEADER_INCOMPLETE;
+
+  if (!is_plausible_body(&header, src + header_len))
+    return HEADER_IMPLAUSIBLE;
+
+  /* return success */
+  return HEADER_PLAUSIBLE;
+}
+
 ptpgp_err_t
 ptpgp_stream_parser_init(ptpgp_stream_parser_t *p, 
                          ptpgp_stream_parser_cb_t cb, 
                          void *cb_data) {
+  return ptpgp_stream_parser_init_tags(p, PTPGP_TAG_MASK_ALL, cb, cb_data);
+}
+
+ptpgp_err_t
+ptpgp_stream_parser_init_tags(ptpgp_stream_parser_t *p,
+                              uint64_t tags,
+                              ptpgp_stream_parser_cb_t cb,
+                              void *cb_data) {
   /* clear parser */
   memset(p, 0, sizeof(ptpgp_stream_parser_t));
 
+  /* save tag filter */
+  p->tags = tags;
+
   /* save callback */
   p->cb = cb;
   p->cb_data = cb_data;
@@ -80,10 +514,69 @@ ptpgp_stream_parser_init(ptpgp_stream_parser_t *p,
 }
 
 ptpgp_err_t
-ptpgp_stream_parser_push(ptpgp_stream_parser_t *p, 
-                         unsigned char *src, 
-                         size_t src_len) {
-  int c;
+ptpgp_stream_parser_set_resync(ptpgp_stream_parser_t *p,
+                               uint64_t tags) {
+  p->resync_tags = tags;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+/*
+ * Keep the pending octets (the current packet, or the octets carried
+ * while resynchronizing) after src was parsed, so that a truncated
+ * packet can be rescanned.  Pending octets which don't fit in the
+ * rescan buffer, or which were skipped, are dropped.
+ */
+static void
+retain(ptpgp_stream_parser_t *p, u8 *src, size_t src_len) {
+  uint64_t src_offset = p->offset - src_len, start;
+  size_t n;
+
+  /* get stream offset of pending octets */
+  if (!p->state_len)
+    start = p->offset;
+  else if (PEEK(p) == PTPGP_STREAM_PARSER_STATE_RESYNC)
+    start = p->offset - p->buf_len;
+  else
+    start = p->header_offset;
+
+  if (start >= src_offset) {
+    /* pending octets start in src */
+    p->rescan_offset = start;
+    p->rescan_len = 0;
+    n = start - src_offset;
+  } else if (start >= p->rescan_offset &&
+             p->rescan_offset + p->rescan_len == src_offset) {
+    /* drop retained octets before the pending ones */
+    n = start - p->rescan_offset;
+    memmove(p->rescan_buf, p->rescan_buf + n, p->rescan_len - n);
+    p->rescan_offset = start;
+    p->rescan_len -= n;
+    n = 0;
+  } else {
+    /* pending octets were not retained */
+    n = src_len + 1;
+  }
+
+  if (n > src_len ||
+      p->rescan_len + (src_len - n) > PTPGP_STREAM_PARSER_RESCAN_BUFFER_SIZE) {
+    /* pending octets can't be rescanned */
+    p->rescan_offset = p->offset;
+    p->rescan_len = 0;
+    return;
+  }
+
+  memcpy(p->rescan_buf + p->rescan_len, src + n, src_len - n);
+  p->rescan_len += src_len - n;
+}
+
+static ptpgp_err_t
+parse(ptpgp_stream_parser_t *p,
+      u8 *src,
+      size_t src_len) {
+  int c, r;
+  size_t i;
 
   /* return last error */
   if (p->last_err)
@@ -93,12 +586,53 @@ ptpgp_stream_parser_push(ptpgp_stream_parser_t *p,
     DIE(p, ALREADY_DONE);
 
   if (!src || !src_len) {
-    if (p->state_len > 0) {
+    while (p->state_len > 0) {
       if (PEEK(p) == PTPGP_STREAM_PARSER_STATE_BODY &&
           p->header.flags & PTPGP_PACKET_FLAG_INDETERMINITE) {
         /* reached end of indeterminite packet */
-        SEND(p, END, 0, 0);
+        SEND_END(p);
+        POP(p);
+      } else if (PEEK(p) == PTPGP_STREAM_PARSER_STATE_BODY &&
+                 !(p->header.flags & PTPGP_PACKET_FLAG_PARTIAL) &&
+                 p->bytes_read == p->header.length) {
+        /* empty body at the very end of the input */
+        SEND_END(p);
         POP(p);
+      } else if (PEEK(p) == PTPGP_STREAM_PARSER_STATE_RESYNC) {
+        /* corrupt region runs to the end of the input */
+        p->offset -= p->buf_len;
+        SEND_CORRUPT(p, p->buf, p->buf_len);
+        p->offset += p->buf_len;
+        p->buf_len = 0;
+        POP(p);
+      } else if (p->resync_tags &&
+                 p->header_offset >= p->rescan_offset &&
+                 p->rescan_offset + p->rescan_len == p->offset) {
+        u8 *buf = p->rescan_buf + (p->header_offset - p->rescan_offset);
+        size_t len = p->offset - p->header_offset;
+
+        D("rescanning truncated packet at offset %d",
+          (int) p->header_offset);
+
+        /* packet is truncated, so its header is corrupt: rewind to it
+         * and scan its retained octets for the next plausible header */
+        p->offset = p->header_offset;
+        p->state_len = 0;
+        p->buf_len = 0;
+        p->bytes_read = 0;
+        p->header_checked = 0;
+        PUSH(p, RESYNC);
+
+        TRY(parse(p, buf, len));
+      } else if (p->resync_tags) {
+        uint64_t offset = p->offset;
+
+        /* packet is truncated, and its octets were not retained: send
+         * an empty corrupt region at its header instead of END */
+        p->offset = p->header_offset;
+        SEND(p, CORRUPT, NULL, 0);
+        p->offset = offset;
+        p->state_len = 0;
       } else {
         DIE(p, INCOMPLETE_PACKET);
       }
@@ -120,8 +654,81 @@ retry:
     D("c = %d", c);
 
     if (!p->state_len) {
-      /* clear buffer and packet header */
+      ptpgp_err_t err;
+      size_t header_len;
+
+      /* clear buffer and partial body length */
       p->buf_len = 0;
+      p->partial_body_length = 0;
+
+      /* save stream offset of packet header */
+      p->header_offset = p->offset;
+
+      if (p->resync_tags && !p->header_checked) {
+        r = check_header(src, src_len, p->resync_tags, 0);
+
+        if (r != HEADER_PLAUSIBLE) {
+          D("corrupt or incomplete packet header, resynchronizing");
+
+          /* start new corrupt region */
+          p->bytes_read = 0;
+          PUSH(p, RESYNC);
+
+          if (r == HEADER_INCOMPLETE) {
+            /* carry octets until the header can be checked */
+            memcpy(p->buf, src, src_len);
+            p->buf_len = src_len;
+            p->offset += src_len;
+
+            return PTPGP_OK;
+          }
+
+          goto retry;
+        }
+      }
+
+      /* clear replayed header flag (see RESYNC state below) */
+      p->header_checked = 0;
+
+      /* fast path: decode entire header directly from input buffer */
+      err = decode_header(src, src_len, &(p->header),
+                          &(p->partial_body_length), &header_len);
+
+      if (err != PTPGP_OK)
+        return p->last_err = err;
+
+      if (header_len > 0) {
+        D("fast path: tag = %d, header_len = %d",
+          p->header.content_tag, (int) header_len);
+
+        /* shift header, clear packet byte count */
+        SHIFT(header_len);
+        p->bytes_read = 0;
+
+        if (!(p->header.flags & (PTPGP_PACKET_FLAG_PARTIAL |
+                                 PTPGP_PACKET_FLAG_INDETERMINITE)) &&
+            p->header.length <= src_len) {
+          /* entire packet is in the input buffer */
+          SEND_START(p);
+
+          if (p->header.length > 0)
+            SEND_BODY(p, src, p->header.length);
+
+          SHIFT(p->header.length);
+
+          SEND_END(p);
+          goto retry;
+        }
+
+        /* emit packet header, read body from subsequent input */
+        SEND_START(p);
+
+        PUSH(p, BODY);
+        goto retry;
+      }
+
+      /* header is split across input buffers: clear packet header and
+       * fall back to the byte-at-a-time state machine below */
       memset(&(p->header), 0, sizeof(ptpgp_packet_header_t));
 
       /* check packet header tag (RFC2440 S4.2: bit 7 is always 1) */
@@ -226,10 +833,10 @@ retry:
           p->header.length = (p->buf[0] << 8) | 
                              (p->buf[1]);
         } else if (p->buf_len == 4) {
-          p->header.length = (p->buf[0] << 24) | 
-                             (p->buf[1] << 16) |
-                             (p->buf[2] <<  8) |
-                             (p->buf[3]);
+          p->header.length = ((uint32_t) p->buf[0] << 24) |
+                             ((uint32_t) p->buf[1] << 16) |
+                             ((uint32_t) p->buf[2] <<  8) |
+                             ((uint32_t) p->buf[3]);
         } else {
           /* never reached */
           DIE(p, INVALID_PACKET_LENGTH);
@@ -238,7 +845,7 @@ retry:
         D("packet length = %d bytes", (int) p->header.length);
         p->buf_len = 0;
 
-        SEND(p, START, 0, 0);
+        SEND_START(p);
 
         SWAP(p, BODY);
         goto retry;
@@ -258,31 +865,31 @@ retry:
           p->header.length = p->buf[0];
 
           /* emit packet header */
-          SEND(p, START, 0, 0);
+          SEND_START(p);
 
           SWAP(p, BODY);
           goto retry;
         } else if (p->buf_len == 2 && p->buf[0] >= 192 && p->buf[0] <= 223) {
           D("new-style two-octet packet length (rfc4880 4.2.2.2)");
 
-          p->header.length = ((p->buf[0] - 192) << 8) |
+          p->header.length = ((p->buf[0] - 192) << 8) +
                               (p->buf[1] + 192);
 
           /* emit packet header */
-          SEND(p, START, 0, 0);
+          SEND_START(p);
 
           SWAP(p, BODY);
           goto retry;
         } else if (p->buf_len == 5 && p->buf[0] == 255) {
           D("new-style five-octet packet length (rfc4880 4.2.2.3)");
 
-          p->header.length = (p->buf[1] << 24) | 
-                             (p->buf[2] << 16) |
-                             (p->buf[3] <<  8) |
-                             (p->buf[4]);
+          p->header.length = ((uint32_t) p->buf[1] << 24) |
+                             ((uint32_t) p->buf[2] << 16) |
+                             ((uint32_t) p->buf[3] <<  8) |
+                             ((uint32_t) p->buf[4]);
 
           /* emit packet header */
-          SEND(p, START, 0, 0);
+          SEND_START(p);
 
           SWAP(p, BODY);
           goto retry;
@@ -294,10 +901,10 @@ retry:
           p->header.length = 0;
           p->partial_body_length = 1 << (p->buf[0] & 0x1f);
 
-          D("partial_body_length = %d", p->partial_body_length);
+          D("partial_body_length = %d", (int) p->partial_body_length);
 
           /* emit packet header */
-          SEND(p, START, 0, 0);
+          SEND_START(p);
 
           SWAP(p, BODY);
           goto retry;
@@ -308,17 +915,24 @@ retry:
         /* never reached */
         break;
       case PTPGP_STREAM_PARSER_STATE_BODY:
-        if (p->header.flags & PTPGP_PACKET_FLAG_PARTIAL) { 
+        if (p->header.flags & PTPGP_PACKET_FLAG_INDETERMINITE) {
+          /* indeterminite packets run to the end of the input */
+          SEND_BODY(p, src, src_len);
+          p->offset += src_len;
+
+          return PTPGP_OK;
+        } else if (p->header.flags & PTPGP_PACKET_FLAG_PARTIAL) {
           if (src_len < p->partial_body_length) {
             if (src_len > 0) {
-              SEND(p, BODY, src, src_len);
+              SEND_BODY(p, src, src_len);
               p->partial_body_length -= src_len;
+              p->offset += src_len;
             }
 
             return PTPGP_OK;
           } else {
             if (p->partial_body_length > 0) {
-              SEND(p, BODY, src, p->partial_body_length);
+              SEND_BODY(p, src, p->partial_body_length);
 
               SHIFT(p->partial_body_length);
             }
@@ -334,18 +948,19 @@ retry:
         } else {
           if (p->bytes_read + src_len < p->header.length) {
             if (src_len > 0) {
-              SEND(p, BODY, src, src_len);
+              SEND_BODY(p, src, src_len);
               p->bytes_read += src_len;
+              p->offset += src_len;
             }
 
             return PTPGP_OK;
           } else {
             if (p->header.length - p->bytes_read > 0) {
-              SEND(p, BODY, src, p->header.length - p->bytes_read);
+              SEND_BODY(p, src, p->header.length - p->bytes_read);
               SHIFT(p->header.length - p->bytes_read);
             }
 
-            SEND(p, END, 0, 0);
+            SEND_END(p);
 
             POP(p);
             goto retry;
@@ -380,7 +995,7 @@ retry:
           p->header.flags ^= PTPGP_PACKET_FLAG_PARTIAL;
 
           /* save header length */
-          p->header.length = ((p->buf[0] - 192) << 8) |
+          p->header.length = ((p->buf[0] - 192) << 8) +
                               (p->buf[1] + 192);
 
           /* dump header length */
@@ -395,10 +1010,10 @@ retry:
           p->header.flags ^= PTPGP_PACKET_FLAG_PARTIAL;
 
           /* save header length */
-          p->header.length = (p->buf[1] << 24) | 
-                             (p->buf[2] << 16) |
-                             (p->buf[3] <<  8) |
-                             (p->buf[4]);
+          p->header.length = ((uint32_t) p->buf[1] << 24) |
+                             ((uint32_t) p->buf[2] << 16) |
+                             ((uint32_t) p->buf[3] <<  8) |
+                             ((uint32_t) p->buf[4]);
 
           /* dump header length */
           D("header.length = %d", (int) p->header.length);
@@ -411,7 +1026,7 @@ retry:
           /* save partial body length */
           p->partial_body_length = 1 << (p->buf[0] & 0x1f);
 
-          D("partial_body_length = %d", p->partial_body_length);
+          D("partial_body_length = %d", (int) p->partial_body_length);
 
           POP(p);
           goto retry;
@@ -419,6 +1034,95 @@ retry:
 
         goto retry;
 
+        /* never reached */
+        break;
+      case PTPGP_STREAM_PARSER_STATE_RESYNC:
+        if (p->buf_len > 0) {
+          u8 tmp[2 * MAX_CHECK_LEN];
+          size_t n = (src_len < MAX_CHECK_LEN) ? src_len : MAX_CHECK_LEN;
+
+          /* join octets carried from the previous input buffer with
+           * the start of this one */
+          memcpy(tmp, p->buf, p->buf_len);
+          memcpy(tmp + p->buf_len, src, n);
+          n += p->buf_len;
+
+          /* check for a header starting in the carried octets */
+          r = HEADER_IMPLAUSIBLE;
+          for (i = 0; i < p->buf_len; i++) {
+            /* the first carried octet is at a packet boundary unless
+             * corrupt octets were sent already */
+            r = check_header(tmp + i, n - i, p->resync_tags,
+                             i || p->bytes_read);
+            if (r != HEADER_IMPLAUSIBLE)
+              break;
+          }
+
+          /* rewind offset to the carried octets, send corrupt ones */
+          p->offset -= p->buf_len;
+          SEND_CORRUPT(p, p->buf, i);
+          p->offset += i;
+
+          if (r == HEADER_INCOMPLETE) {
+            /* header is still incomplete, carry remaining octets */
+            memmove(p->buf, p->buf + i, p->buf_len - i);
+            p->buf_len -= i;
+            p->offset += p->buf_len;
+
+            memcpy(p->buf + p->buf_len, src, src_len);
+            p->buf_len += src_len;
+            p->offset += src_len;
+
+            return PTPGP_OK;
+          } else if (r == HEADER_PLAUSIBLE) {
+            u8 hdr[MAX_CHECK_LEN];
+            size_t hdr_len = p->buf_len - i;
+
+            D("resynchronized in carried octets");
+
+            memcpy(hdr, p->buf + i, hdr_len);
+            p->buf_len = 0;
+            POP(p);
+
+            /* replay carried octets of header (already checked) */
+            p->header_checked = 1;
+            TRY(parse(p, hdr, hdr_len));
+            goto retry;
+          }
+
+          /* no header in carried octets */
+          p->offset += p->buf_len - i;
+          p->buf_len = 0;
+        }
+
+        /* scan for next plausible packet header (the first octet of a
+         * corrupt region is known to be bad) */
+        r = HEADER_IMPLAUSIBLE;
+        for (i = p->bytes_read ? 0 : 1; i < src_len; i++) {
+          r = check_header(src + i, src_len - i, p->resync_tags, 1);
+          if (r != HEADER_IMPLAUSIBLE)
+            break;
+        }
+
+        SEND_CORRUPT(p, src, i);
+        SHIFT(i);
+
+        if (r == HEADER_INCOMPLETE) {
+          /* header may continue in the next input buffer */
+          memcpy(p->buf, src, src_len);
+          p->buf_len = src_len;
+          p->offset += src_len;
+
+          return PTPGP_OK;
+        } else if (r == HEADER_PLAUSIBLE) {
+          D("resynchronized at offset %d", (int) p->offset);
+
+          POP(p);
+          goto retry;
+        }
+
+        return PTPGP_OK;
+
         /* never reached */
         break;
       default:
@@ -432,7 +1136,147 @@ retry:
   return PTPGP_OK;
 }
 
+ptpgp_err_t
+ptpgp_stream_parser_push(ptpgp_stream_parser_t *p, 
+                         unsigned char *src, 
+                         size_t src_len) {
+  TRY(parse(p, src, src_len));
+
+  if (p->resync_tags && src && src_len > 0)
+    retain(p, src, src_len);
+
+  /* return success */
+  return PTPGP_OK;
+}
+
 ptpgp_err_t
 ptpgp_stream_parser_done(ptpgp_stream_parser_t *p) {
   return ptpgp_stream_parser_push(p, 0, 0);
 }
+
+ptpgp_err_t
+ptpgp_stream_parser_get_skip_length(ptpgp_stream_parser_t *p,
+                                    uint64_t *len) {
+  *len = 0;
+
+  /* return last error */
+  if (p->last_err)
+    return p->last_err;
+
+  /* check for skipped body */
+  if (!p->skip_body || PEEK(p) != PTPGP_STREAM_PARSER_STATE_BODY)
+    return PTPGP_OK;
+
+  if (p->header.flags & PTPGP_PACKET_FLAG_INDETERMINITE) {
+    /* indeterminite packets run to the end of the input */
+    *len = UINT64_MAX;
+  } else if (p->header.flags & PTPGP_PACKET_FLAG_PARTIAL) {
+    /* remainder of current partial body chunk */
+    *len = p->partial_body_length;
+  } else {
+    /* remainder of packet body */
+    *len = p->header.length - p->bytes_read;
+  }
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+ptpgp_err_t
+ptpgp_stream_parser_skip(ptpgp_stream_parser_t *p,
+                         uint64_t len) {
+  uint64_t max_len;
+
+  TRY(ptpgp_stream_parser_get_skip_length(p, &max_len));
+
+  if (len > max_len)
+    DIE(p, BAD_SKIP_LENGTH);
+
+  if (p->header.flags & PTPGP_PACKET_FLAG_INDETERMINITE) {
+    /* nothing to do */
+  } else if (p->header.flags & PTPGP_PACKET_FLAG_PARTIAL) {
+    p->partial_body_length -= len;
+  } else {
+    p->bytes_read += len;
+  }
+
+  /* update stream offset */
+  p->offset += len;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+static void
+checkpoint(ptpgp_checkpoint_t *c, ptpgp_stream_parser_t *p) {
+  size_t i;
+
+  /* state stack */
+  CHECKPOINT_FIELD(c, p->state_len, 4);
+  CHECKPOINT_CHECK(c, p->state_len < PTPGP_STREAM_PARSER_STATE_STACK_DEPTH);
+
+  for (i = 0; i < p->state_len && !c->err; i++) {
+    CHECKPOINT_FIELD(c, p->state[i], 1);
+    CHECKPOINT_CHECK(c, p->state[i] < PTPGP_STREAM_PARSER_STATE_LAST);
+  }
+
+  CHECKPOINT_FIELD(c, p->is_done, 1);
+  CHECKPOINT_BUFFER(c, p->buf, p->buf_len);
+  CHECKPOINT_FIELD(c, p->remaining_length_octets, 4);
+
+  /* current packet header */
+  CHECKPOINT_FIELD(c, p->header.flags, 4);
+  CHECKPOINT_FIELD(c, p->header.content_tag, 1);
+  CHECKPOINT_FIELD(c, p->header.length, 8);
+
+  CHECKPOINT_FIELD(c, p->partial_body_length, 8);
+  CHECKPOINT_FIELD(c, p->bytes_read, 8);
+  CHECKPOINT_FIELD(c, p->header_offset, 8);
+  CHECKPOINT_FIELD(c, p->body_offset, 8);
+  CHECKPOINT_FIELD(c, p->skip_body, 1);
+  CHECKPOINT_FIELD(c, p->tags, 8);
+  CHECKPOINT_FIELD(c, p->is_filtered, 1);
+  CHECKPOINT_FIELD(c, p->resync_tags, 8);
+  CHECKPOINT_FIELD(c, p->header_checked, 1);
+}
+
+ptpgp_err_t
+ptpgp_stream_parser_save(ptpgp_stream_parser_t *p,
+                         u8 *dst,
+                         size_t dst_len,
+                         size_t *out_len) {
+  ptpgp_checkpoint_t c;
+
+  /* a failed parser can't be resumed */
+  if (p->last_err)
+    return p->last_err;
+
+  TRY(ptpgp_checkpoint_save_init(
+    &c, dst, dst_len,
+    PTPGP_CHECKPOINT_TYPE_STREAM_PARSER, p->offset
+  ));
+
+  checkpoint(&c, p);
+
+  return ptpgp_checkpoint_save_done(&c, out_len);
+}
+
+ptpgp_err_t
+ptpgp_stream_parser_restore(ptpgp_stream_parser_t *p,
+                            u8 *src,
+                            size_t src_len,
+                            ptpgp_stream_parser_cb_t cb,
+                            void *cb_data) {
+  ptpgp_checkpoint_t c;
+
+  TRY(ptpgp_stream_parser_init(p, cb, cb_data));
+
+  if (ptpgp_checkpoint_load_init(
+    &c, src, src_len,
+    PTPGP_CHECKPOINT_TYPE_STREAM_PARSER, &(p->offset)
+  ) == PTPGP_OK)
+    checkpoint(&c, p);
+
+  /* a parser with invalid state must not be used */
+  return p->last_err = ptpgp_checkpoint_load_done(&c);
+}
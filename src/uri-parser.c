@@ -114,6 +114,12 @@ ptpgp_uri_parser_push(ptpgp_uri_parser_t *p,
 retry:
   switch (p->state) {
   case STATE(INIT):
+    if (!p->buf_len && src[0] == '/') {
+      /* request target (e.g. "/pks/lookup?op=get"), starts with path */
+      p->state = STATE(PATH);
+      goto retry;
+    }
+
     for (i = 0; i < src_len; i++) {
       p->buf[p->buf_len++] = src[i];
 
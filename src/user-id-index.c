@@ -0,0 +1,779 @@
+#define _POSIX_C_SOURCE 200112L /* for posix_madvise() */
+
+#include <sys/types.h>  /* for fstat() */
+#include <sys/stat.h>   /* for fstat() */
+#include <sys/mman.h>   /* for mmap() */
+#include <fcntl.h>      /* for open() */
+#include <unistd.h>     /* for close() */
+#include <stdlib.h>     /* for realloc(), qsort(), free() */
+
+#include "internal.h"
+
+#define DIE(b, err) do {                                              \
+  D("returning error %s", #err);                                      \
+  return (b)->last_err = PTPGP_ERR_USER_ID_INDEX_##err;               \
+} while (0)
+
+#define GET_U32(s) (                                                  \
+  ((uint32_t) (s)[0] << 24) |                                         \
+  ((uint32_t) (s)[1] << 16) |                                         \
+  ((uint32_t) (s)[2] <<  8) |                                         \
+  ((uint32_t) (s)[3])                                                 \
+)
+
+#define GET_U64(s) (                                                  \
+  ((uint64_t) GET_U32(s) << 32) | GET_U32((s) + 4)                    \
+)
+
+/* ascii case folding */
+#define FOLD(c) (((c) >= 'A' && (c) <= 'Z') ? ((c) + ('a' - 'A')) : (c))
+
+/* token octets (after folding) */
+#define IS_TOKEN(c) (                                                 \
+  ((c) >= 'a' && (c) <= 'z') ||                                       \
+  ((c) >= '0' && (c) <= '9') ||                                       \
+  ((c) >= 0x80)                                                       \
+)
+
+/* trigram at s (folded), or zero if it crosses a token boundary */
+#define TRIGRAM(s) (                                                  \
+  (IS_TOKEN(FOLD((s)[0])) &&                                          \
+   IS_TOKEN(FOLD((s)[1])) &&                                          \
+   IS_TOKEN(FOLD((s)[2]))) ? (                                        \
+    ((uint32_t) FOLD((s)[0]) << 16) |                                 \
+    ((uint32_t) FOLD((s)[1]) <<  8) |                                 \
+    ((uint32_t) FOLD((s)[2]))                                         \
+  ) : 0                                                               \
+)
+
+/* section entry accessors */
+#define USER_ID(i, n)  ((i)->user_ids + (n) * PTPGP_USER_ID_INDEX_USER_ID_SIZE)
+#define TRIGRAM_ENTRY(i, n) ((i)->trigrams + (n) * PTPGP_USER_ID_INDEX_TRIGRAM_SIZE)
+#define POSTING(i, n)  GET_U32((i)->postings + (n) * PTPGP_USER_ID_INDEX_POSTING_SIZE)
+
+/* most query trigrams used to narrow down candidates */
+#define MAX_QUERY_TRIGRAMS 16
+
+/* size of output buffer used when writing the index */
+#define WRITE_BUFFER_SIZE 4096
+
+/* posting list of a query trigram */
+typedef struct {
+  uint64_t first,
+           num,
+           pos;
+} posting_list_t;
+
+static void
+put_u32(u8 *dst, uint32_t v) {
+  dst[0] = (v >> 24) & 0xff;
+  dst[1] = (v >> 16) & 0xff;
+  dst[2] = (v >>  8) & 0xff;
+  dst[3] = v & 0xff;
+}
+
+static void
+put_u64(u8 *dst, uint64_t v) {
+  put_u32(dst, v >> 32);
+  put_u32(dst + 4, v & 0xffffffff);
+}
+
+/*
+ * Make room for num more elements of the given size in a growable
+ * array.
+ */
+static ptpgp_err_t
+grow(ptpgp_user_id_index_builder_t *b,
+     void **ptr,
+     uint64_t len,
+     uint64_t *max,
+     uint64_t num,
+     size_t size) {
+  uint64_t new_max = *max ? *max : 1024;
+  void *p;
+
+  if (len + num <= *max)
+    return PTPGP_OK;
+
+  while (new_max < len + num)
+    new_max *= 2;
+
+  if ((p = realloc(*ptr, new_max * size)) == NULL)
+    DIE(b, ALLOC_FAILED);
+
+  *ptr = p;
+  *max = new_max;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+static int
+cmp_postings(const void *a, const void *b) {
+  uint64_t x = *((uint64_t*) a), y = *((uint64_t*) b);
+  return (x < y) ? -1 : ((x > y) ? 1 : 0);
+}
+
+static ptpgp_err_t
+add_user_id(ptpgp_user_id_index_builder_t *b) {
+  uint64_t i, j, num = b->num_user_ids, first = b->num_postings;
+  uint32_t trigram;
+  u8 *dst;
+
+  /* user ID numbers are 32 bits wide */
+  if (num >= UINT32_MAX)
+    DIE(b, TOO_LARGE);
+
+  /* make room for entry, text, and postings */
+  TRY(grow(b, (void**) &(b->user_ids), b->num_user_ids, &(b->max_user_ids),
+           1, PTPGP_USER_ID_INDEX_USER_ID_SIZE));
+  TRY(grow(b, (void**) &(b->text), b->text_len, &(b->max_text_len),
+           b->buf_len, 1));
+  TRY(grow(b, (void**) &(b->postings), b->num_postings, &(b->max_postings),
+           b->buf_len, sizeof(uint64_t)));
+
+  /* encode entry */
+  dst = b->user_ids + num * PTPGP_USER_ID_INDEX_USER_ID_SIZE;
+  memset(dst, 0, PTPGP_USER_ID_INDEX_USER_ID_SIZE);
+  put_u64(dst, b->key_offset);
+  put_u64(dst + 8, b->text_len);
+  put_u32(dst + 16, b->buf_len);
+  b->num_user_ids++;
+
+  /* append text */
+  memcpy(b->text + b->text_len, b->buf, b->buf_len);
+  b->text_len += b->buf_len;
+
+  /* add postings */
+  for (i = 0; i + 3 <= b->buf_len; i++)
+    if ((trigram = TRIGRAM(b->buf + i)) != 0)
+      b->postings[b->num_postings++] = ((uint64_t) trigram << 32) | num;
+
+  /* drop duplicate trigrams of this user ID */
+  qsort(b->postings + first, b->num_postings - first, sizeof(uint64_t), cmp_postings);
+  for (i = j = first; i < b->num_postings; i++)
+    if (j == first || b->postings[j - 1] != b->postings[i])
+      b->postings[j++] = b->postings[i];
+  b->num_postings = j;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+static ptpgp_err_t
+stream_cb(ptpgp_stream_parser_t *p,
+          ptpgp_stream_parser_token_t t,
+          ptpgp_packet_header_t *header,
+          u8 *src, size_t src_len) {
+  ptpgp_user_id_index_builder_t *b = p->cb_data;
+
+  switch (t) {
+  case PTPGP_STREAM_PARSER_TOKEN_START:
+    b->in_user_id = 0;
+
+    switch (header->content_tag) {
+    case PTPGP_TAG_PUBLIC_KEY:
+      /* start of transferable key (the body isn't needed) */
+      b->key_offset = b->offset + p->header_offset;
+      b->has_key = 1;
+      return PTPGP_ERR_STREAM_PARSER_SKIP_BODY;
+    case PTPGP_TAG_SECRET_KEY:
+      /* user IDs of secret keys aren't indexed (only public keys are
+       * served) */
+      b->has_key = 0;
+      return PTPGP_ERR_STREAM_PARSER_SKIP_BODY;
+    default:
+      /* skip user IDs outside of keys, and user IDs which are too long */
+      if (!b->has_key ||
+          (!(header->flags & (PTPGP_PACKET_FLAG_PARTIAL |
+                              PTPGP_PACKET_FLAG_INDETERMINITE)) &&
+           header->length > PTPGP_USER_ID_INDEX_MAX_USER_ID_SIZE)) {
+        b->num_skipped_user_ids++;
+        return PTPGP_ERR_STREAM_PARSER_SKIP_BODY;
+      }
+
+      b->in_user_id = 1;
+      b->buf_len = 0;
+    }
+
+    break;
+  case PTPGP_STREAM_PARSER_TOKEN_BODY:
+    if (!b->in_user_id)
+      break;
+
+    if (b->buf_len + src_len > PTPGP_USER_ID_INDEX_MAX_USER_ID_SIZE) {
+      /* user ID with partial body is too long */
+      b->num_skipped_user_ids++;
+      b->in_user_id = 0;
+      break;
+    }
+
+    memcpy(b->buf + b->buf_len, src, src_len);
+    b->buf_len += src_len;
+
+    break;
+  case PTPGP_STREAM_PARSER_TOKEN_END:
+    if (b->in_user_id)
+      TRY(add_user_id(b));
+
+    b->in_user_id = 0;
+
+    break;
+  default:
+    /* ignore unknown tokens */
+    break;
+  }
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+ptpgp_err_t
+ptpgp_user_id_index_builder_init(ptpgp_user_id_index_builder_t *b,
+                                 ptpgp_user_id_index_builder_cb_t cb,
+                                 void *user_data) {
+  /* clear builder */
+  memset(b, 0, sizeof(ptpgp_user_id_index_builder_t));
+
+  /* save callback */
+  b->cb = cb;
+  b->user_data = user_data;
+
+  /* init stream parser (other packets are skipped without callbacks) */
+  return ptpgp_stream_parser_init_tags(
+    &(b->parser),
+    PTPGP_TAG_MASK(PTPGP_TAG_PUBLIC_KEY) |
+    PTPGP_TAG_MASK(PTPGP_TAG_SECRET_KEY) |
+    PTPGP_TAG_MASK(PTPGP_TAG_USER_ID),
+    stream_cb, b
+  );
+}
+
+ptpgp_err_t
+ptpgp_user_id_index_builder_append(ptpgp_user_id_index_builder_t *b,
+                                   ptpgp_user_id_index_t *index,
+                                   uint64_t offset) {
+  ptpgp_user_id_index_entry_t e;
+  uint64_t i, j, first, num;
+  u8 *t;
+
+  /* return last error */
+  if (b->last_err)
+    return b->last_err;
+
+  if (b->is_done)
+    DIE(b, ALREADY_DONE);
+
+  /* existing entries go first */
+  if (b->num_user_ids > 0 || b->parser.offset > 0)
+    DIE(b, ALREADY_STARTED);
+
+  if (index->num_user_ids >= UINT32_MAX)
+    DIE(b, TOO_LARGE);
+
+  /* check text bounds of user IDs */
+  for (i = 0; i < index->num_user_ids; i++)
+    if (ptpgp_user_id_index_get(index, i, &e) != PTPGP_OK)
+      DIE(b, BAD_ENTRY);
+
+  /* make room for entries, text, and postings */
+  TRY(grow(b, (void**) &(b->user_ids), 0, &(b->max_user_ids),
+           index->num_user_ids, PTPGP_USER_ID_INDEX_USER_ID_SIZE));
+  TRY(grow(b, (void**) &(b->text), 0, &(b->max_text_len),
+           index->text_len, 1));
+  TRY(grow(b, (void**) &(b->postings), 0, &(b->max_postings),
+           index->num_postings, sizeof(uint64_t)));
+
+  /* copy entries and text (entries are in stream order already) */
+  if (index->num_user_ids > 0)
+    memcpy(b->user_ids, index->user_ids,
+           index->num_user_ids * PTPGP_USER_ID_INDEX_USER_ID_SIZE);
+  if (index->text_len > 0)
+    memcpy(b->text, index->text, index->text_len);
+
+  /* expand posting lists back to collected postings */
+  for (i = 0; i < index->num_trigrams; i++) {
+    t = TRIGRAM_ENTRY(index, i);
+    first = GET_U64(t + 8);
+    num = GET_U32(t + 4);
+
+    /* check posting list bounds (and room for it) */
+    if (first > index->num_postings ||
+        num > index->num_postings - first ||
+        num > index->num_postings - b->num_postings)
+      DIE(b, BAD_ENTRY);
+
+    for (j = 0; j < num; j++) {
+      if (POSTING(index, first + j) >= index->num_user_ids)
+        DIE(b, BAD_ENTRY);
+
+      b->postings[b->num_postings++] = ((uint64_t) GET_U32(t) << 32) |
+                                       POSTING(index, first + j);
+    }
+  }
+
+  b->num_user_ids = index->num_user_ids;
+  b->text_len = index->text_len;
+
+  /* save stream offset of pushed input */
+  b->offset = offset;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+typedef struct {
+  ptpgp_user_id_index_builder_t *b;
+  u8 buf[WRITE_BUFFER_SIZE];
+  size_t len;
+} writer_t;
+
+static ptpgp_err_t
+writer_flush(writer_t *w) {
+  ptpgp_err_t err;
+
+  if (w->len > 0 && (err = w->b->cb(w->b, w->buf, w->len)) != PTPGP_OK)
+    return w->b->last_err = err;
+
+  w->len = 0;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+/* get room for len octets in output buffer */
+static ptpgp_err_t
+writer_get(writer_t *w, size_t len, u8 **dst) {
+  if (w->len + len > sizeof(w->buf))
+    TRY(writer_flush(w));
+
+  *dst = w->buf + w->len;
+  w->len += len;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+static ptpgp_err_t
+write_index(ptpgp_user_id_index_builder_t *b) {
+  u8 header[PTPGP_USER_ID_INDEX_HEADER_SIZE], *dst;
+  uint64_t i, j, num_trigrams = 0;
+  ptpgp_err_t err;
+  writer_t w;
+
+  /* sort postings by trigram, then by user ID */
+  if (b->num_postings > 0)
+    qsort(b->postings, b->num_postings, sizeof(uint64_t), cmp_postings);
+
+  /* count trigrams */
+  for (i = 0; i < b->num_postings; i++)
+    if (!i || (b->postings[i - 1] >> 32) != (b->postings[i] >> 32))
+      num_trigrams++;
+
+  /* encode header */
+  memset(header, 0, sizeof(header));
+  memcpy(header, PTPGP_USER_ID_INDEX_MAGIC, 8);
+  put_u32(header + 8, PTPGP_USER_ID_INDEX_VERSION);
+  put_u64(header + 16, b->num_user_ids);
+  put_u64(header + 24, num_trigrams);
+  put_u64(header + 32, b->num_postings);
+  put_u64(header + 40, b->text_len);
+
+  /* write header and user IDs */
+  if ((err = b->cb(b, header, sizeof(header))) != PTPGP_OK ||
+      (b->num_user_ids > 0 &&
+       (err = b->cb(b, b->user_ids,
+                    b->num_user_ids * PTPGP_USER_ID_INDEX_USER_ID_SIZE)) != PTPGP_OK))
+    return b->last_err = err;
+
+  memset(&w, 0, sizeof(writer_t));
+  w.b = b;
+
+  /* write trigrams */
+  for (i = 0; i < b->num_postings; i = j) {
+    /* find end of posting list */
+    for (j = i + 1; j < b->num_postings &&
+                    (b->postings[j] >> 32) == (b->postings[i] >> 32); j++);
+
+    TRY(writer_get(&w, PTPGP_USER_ID_INDEX_TRIGRAM_SIZE, &dst));
+    put_u32(dst, b->postings[i] >> 32);
+    put_u32(dst + 4, j - i);
+    put_u64(dst + 8, i);
+  }
+
+  /* write postings */
+  for (i = 0; i < b->num_postings; i++) {
+    TRY(writer_get(&w, PTPGP_USER_ID_INDEX_POSTING_SIZE, &dst));
+    put_u32(dst, b->postings[i] & 0xffffffff);
+  }
+
+  TRY(writer_flush(&w));
+
+  /* write text */
+  if (b->text_len > 0 && (err = b->cb(b, b->text, b->text_len)) != PTPGP_OK)
+    return b->last_err = err;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+ptpgp_err_t
+ptpgp_user_id_index_builder_push(ptpgp_user_id_index_builder_t *b,
+                                 u8 *src,
+                                 size_t src_len) {
+  ptpgp_err_t err;
+
+  /* return last error */
+  if (b->last_err)
+    return b->last_err;
+
+  if (b->is_done)
+    DIE(b, ALREADY_DONE);
+
+  if ((err = ptpgp_stream_parser_push(&(b->parser), src, src_len)) != PTPGP_OK)
+    return b->last_err = err;
+
+  if (!src || !src_len) {
+    /* write index */
+    err = write_index(b);
+    ptpgp_user_id_index_builder_free(b);
+
+    if (err != PTPGP_OK)
+      return err;
+
+    /* flag builder as finished */
+    b->is_done = 1;
+  }
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+ptpgp_err_t
+ptpgp_user_id_index_builder_done(ptpgp_user_id_index_builder_t *b) {
+  return ptpgp_user_id_index_builder_push(b, 0, 0);
+}
+
+ptpgp_err_t
+ptpgp_user_id_index_builder_free(ptpgp_user_id_index_builder_t *b) {
+  /* free collected entries, text, and postings */
+  free(b->user_ids);
+  free(b->text);
+  free(b->postings);
+
+  b->user_ids = NULL;
+  b->text = NULL;
+  b->postings = NULL;
+  b->max_user_ids = b->max_text_len = b->max_postings = 0;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+ptpgp_err_t
+ptpgp_user_id_index_load(ptpgp_user_id_index_t *index,
+                         u8 *src,
+                         size_t src_len) {
+  uint64_t left;
+
+  /* clear index */
+  memset(index, 0, sizeof(ptpgp_user_id_index_t));
+
+  /* check header */
+  if (src_len < PTPGP_USER_ID_INDEX_HEADER_SIZE ||
+      memcmp(src, PTPGP_USER_ID_INDEX_MAGIC, 8))
+    return PTPGP_ERR_USER_ID_INDEX_BAD_HEADER;
+
+  /* check version */
+  if (GET_U32(src + 8) != PTPGP_USER_ID_INDEX_VERSION)
+    return PTPGP_ERR_USER_ID_INDEX_BAD_VERSION;
+
+  index->num_user_ids = GET_U64(src + 16);
+  index->num_trigrams = GET_U64(src + 24);
+  index->num_postings = GET_U64(src + 32);
+  index->text_len = GET_U64(src + 40);
+
+  /* check section sizes (one at a time, so they can't overflow) */
+  left = src_len - PTPGP_USER_ID_INDEX_HEADER_SIZE;
+  index->user_ids = src + PTPGP_USER_ID_INDEX_HEADER_SIZE;
+
+  if (index->num_user_ids > left / PTPGP_USER_ID_INDEX_USER_ID_SIZE)
+    return PTPGP_ERR_USER_ID_INDEX_BAD_HEADER;
+  left -= index->num_user_ids * PTPGP_USER_ID_INDEX_USER_ID_SIZE;
+  index->trigrams = USER_ID(index, index->num_user_ids);
+
+  if (index->num_trigrams > left / PTPGP_USER_ID_INDEX_TRIGRAM_SIZE)
+    return PTPGP_ERR_USER_ID_INDEX_BAD_HEADER;
+  left -= index->num_trigrams * PTPGP_USER_ID_INDEX_TRIGRAM_SIZE;
+  index->postings = TRIGRAM_ENTRY(index, index->num_trigrams);
+
+  if (index->num_postings > left / PTPGP_USER_ID_INDEX_POSTING_SIZE)
+    return PTPGP_ERR_USER_ID_INDEX_BAD_HEADER;
+  left -= index->num_postings * PTPGP_USER_ID_INDEX_POSTING_SIZE;
+  index->text = index->postings + index->num_postings * PTPGP_USER_ID_INDEX_POSTING_SIZE;
+
+  if (index->text_len != left) {
+    memset(index, 0, sizeof(ptpgp_user_id_index_t));
+    return PTPGP_ERR_USER_ID_INDEX_BAD_HEADER;
+  }
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+ptpgp_err_t
+ptpgp_user_id_index_open(ptpgp_user_id_index_t *index,
+                         char *path) {
+  struct stat st;
+  void *map;
+  ptpgp_err_t err;
+  int fd;
+
+  /* open index file */
+  if ((fd = open(path, O_RDONLY)) == -1)
+    return PTPGP_ERR_USER_ID_INDEX_OPEN_FAILED;
+
+  if (fstat(fd, &st)) {
+    close(fd);
+    return PTPGP_ERR_USER_ID_INDEX_OPEN_FAILED;
+  }
+
+  if (st.st_size < PTPGP_USER_ID_INDEX_HEADER_SIZE) {
+    close(fd);
+    return PTPGP_ERR_USER_ID_INDEX_BAD_HEADER;
+  }
+
+  /* map index (the mapping outlives the descriptor) */
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if (map == MAP_FAILED)
+    return PTPGP_ERR_USER_ID_INDEX_MMAP_FAILED;
+
+  /* lookups are random access */
+  posix_madvise(map, st.st_size, POSIX_MADV_RANDOM);
+
+  if ((err = ptpgp_user_id_index_load(index, map, st.st_size)) != PTPGP_OK) {
+    munmap(map, st.st_size);
+    return err;
+  }
+
+  /* save mapping */
+  index->map = map;
+  index->map_len = st.st_size;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+ptpgp_err_t
+ptpgp_user_id_index_close(ptpgp_user_id_index_t *index) {
+  if (index->map && munmap(index->map, index->map_len))
+    return PTPGP_ERR_USER_ID_INDEX_MMAP_FAILED;
+
+  /* clear index */
+  memset(index, 0, sizeof(ptpgp_user_id_index_t));
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+ptpgp_err_t
+ptpgp_user_id_index_get(ptpgp_user_id_index_t *index,
+                        uint64_t num,
+                        ptpgp_user_id_index_entry_t *entry) {
+  uint64_t ofs, len;
+  u8 *src;
+
+  if (num >= index->num_user_ids)
+    return PTPGP_ERR_USER_ID_INDEX_NOT_FOUND;
+
+  /* check text bounds */
+  src = USER_ID(index, num);
+  ofs = GET_U64(src + 8);
+  len = GET_U32(src + 16);
+  if (ofs > index->text_len || len > index->text_len - ofs)
+    return PTPGP_ERR_USER_ID_INDEX_BAD_ENTRY;
+
+  /* decode entry */
+  entry->num = num;
+  entry->key_offset = GET_U64(src);
+  entry->user_id = index->text + ofs;
+  entry->user_id_len = len;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+/* find trigram entry (binary search) */
+static u8 *
+find_trigram(ptpgp_user_id_index_t *index, uint32_t trigram) {
+  uint64_t lo = 0, hi = index->num_trigrams, mid;
+  uint32_t v;
+
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    v = GET_U32(TRIGRAM_ENTRY(index, mid));
+
+    if (v == trigram)
+      return TRIGRAM_ENTRY(index, mid);
+    else if (v < trigram)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  /* not found */
+  return NULL;
+}
+
+static bool
+user_id_matches(ptpgp_user_id_index_entry_t *e,
+                u8 *query,
+                size_t query_len,
+                bool exact) {
+  size_t i, j;
+
+  if (exact && e->user_id_len != query_len)
+    return 0;
+
+  if (query_len > e->user_id_len)
+    return 0;
+
+  /* case-insensitive substring search (user IDs are short) */
+  for (i = 0; i + query_len <= e->user_id_len; i++) {
+    for (j = 0; j < query_len && FOLD(e->user_id[i + j]) == FOLD(query[j]); j++);
+
+    if (j == query_len)
+      return 1;
+
+    if (exact)
+      break;
+  }
+
+  /* no match */
+  return 0;
+}
+
+/* get posting list of trigram entry */
+static ptpgp_err_t
+get_posting_list(ptpgp_user_id_index_t *index,
+                 u8 *t,
+                 posting_list_t *list) {
+  list->first = GET_U64(t + 8);
+  list->num = GET_U32(t + 4);
+  list->pos = 0;
+
+  /* check posting list bounds */
+  if (list->first > index->num_postings ||
+      list->num > index->num_postings - list->first)
+    return PTPGP_ERR_USER_ID_INDEX_BAD_ENTRY;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+/*
+ * Check whether posting list contains user ID.  User IDs are checked
+ * in ascending order, so the search gallops forward from the previous
+ * position.
+ */
+static bool
+posting_list_has(ptpgp_user_id_index_t *index,
+                 posting_list_t *list,
+                 uint64_t num) {
+  uint64_t lo = list->pos, hi, mid, step = 1;
+
+  /* find range containing the first posting >= num */
+  while (lo + step < list->num && POSTING(index, list->first + lo + step) < num) {
+    lo += step;
+    step *= 2;
+  }
+
+  hi = (lo + step < list->num) ? lo + step + 1 : list->num;
+
+  /* find first posting >= num */
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+
+    if (POSTING(index, list->first + mid) < num)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  list->pos = lo;
+
+  return lo < list->num && POSTING(index, list->first + lo) == num;
+}
+
+ptpgp_err_t
+ptpgp_user_id_index_find(ptpgp_user_id_index_t *index,
+                         u8 *query,
+                         size_t query_len,
+                         bool exact,
+                         uint64_t *iter,
+                         ptpgp_user_id_index_entry_t *entry) {
+  posting_list_t lists[MAX_QUERY_TRIGRAMS], tmp;
+  uint64_t i, num_candidates = index->num_user_ids, num;
+  size_t j, num_lists = 0;
+  uint32_t trigram;
+  u8 *t;
+
+  /* get posting lists of query trigrams */
+  for (i = 0; i + 3 <= query_len; i++) {
+    if ((trigram = TRIGRAM(query + i)) == 0)
+      continue;
+
+    if ((t = find_trigram(index, trigram)) == NULL) {
+      /* no user ID has this trigram */
+      *iter = UINT64_MAX;
+      return PTPGP_ERR_USER_ID_INDEX_NOT_FOUND;
+    }
+
+    /* (the text check catches trigrams beyond the limit) */
+    if (num_lists == MAX_QUERY_TRIGRAMS)
+      continue;
+
+    TRY(get_posting_list(index, t, lists + num_lists));
+
+    /* keep the rarest trigram first */
+    if (num_lists > 0 && lists[num_lists].num < lists[0].num) {
+      tmp = lists[0];
+      lists[0] = lists[num_lists];
+      lists[num_lists] = tmp;
+    }
+
+    num_lists++;
+  }
+
+  /* candidates are the user IDs with the rarest trigram (or all) */
+  if (num_lists > 0)
+    num_candidates = lists[0].num;
+
+  /* check candidates */
+  for (i = *iter; i < num_candidates; i++) {
+    num = (num_lists > 0) ? POSTING(index, lists[0].first + i) : i;
+    if (num >= index->num_user_ids)
+      return PTPGP_ERR_USER_ID_INDEX_BAD_ENTRY;
+
+    /* skip user IDs without all the other trigrams */
+    for (j = 1; j < num_lists && posting_list_has(index, lists + j, num); j++);
+    if (j < num_lists)
+      continue;
+
+    TRY(ptpgp_user_id_index_get(index, num, entry));
+
+    if (user_id_matches(entry, query, query_len, exact)) {
+      /* continue after this candidate */
+      *iter = i + 1;
+
+      /* return success */
+      return PTPGP_OK;
+    }
+  }
+
+  /* no more matches */
+  *iter = UINT64_MAX;
+  return PTPGP_ERR_USER_ID_INDEX_NOT_FOUND;
+}
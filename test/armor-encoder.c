@@ -1,18 +1,41 @@
 #include "test-common.h"
 
 #define USAGE \
-  "%s - Test PTPGP ASCII-armor encoder.\n"
+  "%s - Test PTPGP ASCII-armor encoder.\n"                            \
+  "(-c: check that the armored input parses back to the input)\n"
+
+#define ENVELOPE_NAME "ARMORED STUFF"
 
 static char *headers[] = {
   "Version", "PTPGP/" PTPGP_VERSION,
   NULL
 };
 
+typedef struct {
+  /* armored output (check mode) */
+  bool check;
+  buffer_t armor;
+
+  /* input (check mode) */
+  buffer_t input;
+
+  /* decoded body and checksums (check mode) */
+  ptpgp_base64_t base64;
+  ptpgp_crc24_t crc24;
+  buffer_t body;
+  bool got_start,
+       got_end,
+       got_crc;
+  u8 crc[3];
+} context_t;
+
 static ptpgp_err_t
 encoder_cb(ptpgp_armor_encoder_t *e, u8 *data, size_t data_len) {
-  FILE *fh = (FILE*) e->user_data;
+  context_t *c = (context_t*) e->user_data;
 
-  if (!fwrite(data, 1, data_len, fh))
+  if (c->check)
+    buffer_append(&(c->armor), data, data_len);
+  else if (!fwrite(data, 1, data_len, stdout))
     ptpgp_sys_die("Couldn't write to output stream:");
 
   return PTPGP_OK;
@@ -21,6 +44,10 @@ encoder_cb(ptpgp_armor_encoder_t *e, u8 *data, size_t data_len) {
 static void
 read_cb(u8 *data, size_t data_len, void *user_data) {
   ptpgp_armor_encoder_t *e = (ptpgp_armor_encoder_t*) user_data;
+  context_t *c = (context_t*) e->user_data;
+
+  if (c->check)
+    buffer_append(&(c->input), data, data_len);
 
   PTPGP_ASSERT(
     ptpgp_armor_encoder_push(e, data, data_len),
@@ -28,9 +55,121 @@ read_cb(u8 *data, size_t data_len, void *user_data) {
   );
 }
 
+static ptpgp_err_t
+base64_cb(ptpgp_base64_t *b, u8 *data, size_t data_len) {
+  context_t *c = (context_t*) b->user_data;
+
+  buffer_append(&(c->body), data, data_len);
+
+  PTPGP_ASSERT(
+    ptpgp_crc24_push(&(c->crc24), data, data_len),
+    "push data to crc24 context"
+  );
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+static void
+check_name(char *what, u8 *data, size_t data_len) {
+  if (data_len != strlen(what) || memcmp(data, what, data_len))
+    ptpgp_sys_die("bad envelope line (expected \"%s\", got \"%.*s\")",
+                  what, (int) data_len, data);
+}
+
+static ptpgp_err_t
+parser_cb(ptpgp_armor_parser_t *p,
+          ptpgp_armor_parser_token_t t,
+          u8 *data,
+          size_t data_len) {
+  context_t *c = (context_t*) p->user_data;
+
+  switch (t) {
+  case PTPGP_ARMOR_PARSER_TOKEN_START_ARMOR:
+    check_name("BEGIN " ENVELOPE_NAME, data, data_len);
+    c->got_start = 1;
+    break;
+  case PTPGP_ARMOR_PARSER_TOKEN_BODY:
+    PTPGP_ASSERT(
+      ptpgp_base64_push(&(c->base64), data, data_len),
+      "decode armor body"
+    );
+
+    break;
+  case PTPGP_ARMOR_PARSER_TOKEN_CRC24:
+    PTPGP_ASSERT(
+      ptpgp_base64_decode(data, data_len, c->crc, 3, 0),
+      "decode armor checksum"
+    );
+
+    c->got_crc = 1;
+    break;
+  case PTPGP_ARMOR_PARSER_TOKEN_END_ARMOR:
+    check_name("END " ENVELOPE_NAME, data, data_len);
+    c->got_end = 1;
+    break;
+  default:
+    /* ignore other tokens */
+    break;
+  }
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+static void
+check(context_t *c) {
+  ptpgp_armor_parser_t p;
+  uint32_t crc;
+
+  PTPGP_ASSERT(ptpgp_crc24_init(&(c->crc24)), "init crc24 context");
+  PTPGP_ASSERT(
+    ptpgp_base64_init(&(c->base64), 0, base64_cb, c),
+    "init base64 decoder"
+  );
+
+  /* parse armored output */
+  PTPGP_ASSERT(
+    ptpgp_armor_parser_init(&p, parser_cb, c),
+    "init armor parser"
+  );
+
+  PTPGP_ASSERT(
+    ptpgp_armor_parser_push(&p, c->armor.data, c->armor.data_len),
+    "parse armored output"
+  );
+
+  PTPGP_ASSERT(ptpgp_armor_parser_done(&p), "finish armor parser");
+  PTPGP_ASSERT(ptpgp_base64_done(&(c->base64)), "finish base64 decoder");
+  PTPGP_ASSERT(ptpgp_crc24_done(&(c->crc24)), "finish crc24 context");
+
+  if (!c->got_start || !c->got_end || !c->got_crc)
+    ptpgp_sys_die("missing envelope line or checksum");
+
+  /* compare body and checksum */
+  if (c->body.data_len != c->input.data_len ||
+      (c->body.data_len > 0 &&
+       memcmp(c->body.data, c->input.data, c->body.data_len)))
+    ptpgp_sys_die("armored body doesn't match input");
+
+  crc = (c->crc[0] << 16) | (c->crc[1] << 8) | c->crc[2];
+  if (crc != c->crc24.crc)
+    ptpgp_sys_die("checksum mismatch (body: %06x, armor: %06x)",
+                  c->crc24.crc, crc);
+
+  printf("ok (%u octets)\n", (unsigned int) c->input.data_len);
+
+  free(c->armor.data);
+  free(c->input.data);
+  free(c->body.data);
+}
+
 int main(int argc, char *argv[]) {
-  int i;
+  int i, first = 1;
   ptpgp_armor_encoder_t e;
+  context_t c;
+
+  memset(&c, 0, sizeof(context_t));
 
   /* check for help option */
   if (argc > 1) {
@@ -39,19 +178,24 @@ int main(int argc, char *argv[]) {
         print_usage_and_exit(argv[0], USAGE);
   }
 
+  if (argc > 1 && !strncmp(argv[1], "-c", 3)) {
+    c.check = 1;
+    first++;
+  }
+
   /* initialize armor encoder */
   PTPGP_ASSERT(
     ptpgp_armor_encoder_init(
-      &e, "ARMORED STUFF", 
-      headers, encoder_cb, stdout
+      &e, ENVELOPE_NAME,
+      headers, encoder_cb, &c
     ),
 
     "initialize armor encoder context"
   );
 
-  if (argc > 1) {
+  if (argc > first) {
     /* dump each input file */
-    for (i = 1; i < argc; i++)
+    for (i = first; i < argc; i++)
       file_read(argv[i], read_cb, &e);
   } else {
     /* read from standard input */
@@ -64,6 +208,9 @@ int main(int argc, char *argv[]) {
     "finalize armor encoder context"
   );
 
+  if (c.check)
+    check(&c);
+
   /* return success */
   return EXIT_SUCCESS;
 }
@@ -1,7 +1,9 @@
 #include "test-common.h"
 
 #define USAGE \
-  "%s - Test PTPGP ASCII-armor decoder.\n"
+  "%s - Test PTPGP ASCII-armor decoder.\n"                            \
+  "(-l: check the header line limit, with lines pushed whole and\n"  \
+  "one octet at a time)\n"
 
 typedef struct {
   ptpgp_base64_t base64;
@@ -224,10 +226,85 @@ dump(char *path) {
   );
 }
 
+static ptpgp_err_t
+null_cb(ptpgp_armor_parser_t *a,
+        ptpgp_armor_parser_token_t t,
+        u8 *data,
+        size_t data_len) {
+  UNUSED(a);
+  UNUSED(t);
+  UNUSED(data);
+  UNUSED(data_len);
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+/* parse armor with header line of given length (including newline) */
+static ptpgp_err_t
+parse_header_line(size_t line_len, bool whole) {
+  static char *start = "-----BEGIN PGP MESSAGE-----\n",
+              *end = "\nowE=\n-----END PGP MESSAGE-----\n";
+  ptpgp_armor_parser_t a;
+  ptpgp_err_t err = PTPGP_OK;
+  u8 buf[4096];
+  size_t i, len;
+
+  /* build armor ("Comment: xxx...") */
+  len = strlen(start);
+  memcpy(buf, start, len);
+  memcpy(buf + len, "Comment: ", 9);
+  memset(buf + len + 9, 'x', line_len - 10);
+  buf[len + line_len - 1] = '\n';
+  len += line_len;
+  memcpy(buf + len, end, strlen(end));
+  len += strlen(end);
+
+  PTPGP_ASSERT(
+    ptpgp_armor_parser_init(&a, null_cb, NULL),
+    "init armor parser"
+  );
+
+  if (whole)
+    err = ptpgp_armor_parser_push(&a, buf, len);
+  else
+    for (i = 0; err == PTPGP_OK && i < len; i++)
+      err = ptpgp_armor_parser_push(&a, buf + i, 1);
+
+  if (err == PTPGP_OK)
+    err = ptpgp_armor_parser_done(&a);
+
+  return err;
+}
+
+static void
+check_header_lines(void) {
+  size_t max = PTPGP_ARMOR_PARSER_BUFFER_SIZE - 2;
+  ptpgp_err_t err;
+  int whole;
+
+  for (whole = 0; whole < 2; whole++) {
+    PTPGP_ASSERT(
+      parse_header_line(max, whole),
+      "parse %u octet header line (%s)",
+      (unsigned int) max, whole ? "whole" : "octets"
+    );
+
+    err = parse_header_line(max + 1, whole);
+    if (err != PTPGP_ERR_ARMOR_PARSER_BIG_HEADER_LINE)
+      ptpgp_die(err, "%u octet header line (%s) wasn't rejected",
+                (unsigned int) max + 1, whole ? "whole" : "octets");
+  }
+
+  printf("header line limit ok (%u octets)\n", (unsigned int) max);
+}
+
 int main(int argc, char *argv[]) {
   int i;
 
-  if (argc > 1) {
+  if (argc > 1 && !strncmp(argv[1], "-l", 3)) {
+    check_header_lines();
+  } else if (argc > 1) {
     /* check for help option */
     for (i = 1; i < argc; i++)
       if (IS_HELP(argv[i]))
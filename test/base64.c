@@ -5,8 +5,14 @@
   !strncmp((s), "--encode", 9)  \
 )
 
+#define IS_IN_PLACE(s) (        \
+  !strncmp((s), "-p", 3) ||     \
+  !strncmp((s), "--in-place", 11) \
+)
+
 #define USAGE \
-  "%s - Test PTPGP Base-64 encoder/decoder.\n"
+  "%s - Test PTPGP Base-64 encoder/decoder.\n"                  \
+  "(-e: encode, -p: decode input in place, otherwise decode)\n"
 
 static ptpgp_err_t
 base64_cb(ptpgp_base64_t *b, u8 *data, size_t data_len) {
@@ -31,6 +37,37 @@ read_cb(u8 *data, size_t data_len, void *user_data) {
   );
 }
 
+static void
+decode_in_place(char *path) {
+  buffer_t b = { NULL, 0 };
+  size_t len, out_len;
+
+  /* read input file */
+  file_read(path, buffer_append_cb, &b);
+
+  PTPGP_ASSERT(
+    ptpgp_base64_decoded_size(b.data, b.data_len, &len),
+    "get decoded size"
+  );
+
+  /* decode input buffer in place */
+  PTPGP_ASSERT(
+    ptpgp_base64_decode_to(b.data, b.data_len, b.data, b.data_len, &out_len),
+    "decode \"%s\" in place", path
+  );
+
+  if (out_len != len)
+    ptpgp_sys_die("decoded size mismatch (expected %u, got %u)",
+                  (unsigned int) len, (unsigned int) out_len);
+
+  /* write output */
+  if (out_len > 0 && !fwrite(b.data, out_len, 1, stdout))
+    ptpgp_sys_die("Couldn't write decoded data:");
+
+  free(b.data);
+  fflush(stdout);
+}
+
 static void
 dump(char *path, bool encode) {
   ptpgp_base64_t b;
@@ -57,7 +94,7 @@ dump(char *path, bool encode) {
 
 int main(int argc, char *argv[]) {
   size_t i;
-  bool encode = 0;
+  bool encode = 0, in_place = 0;
 
   /* check command-line arguments */
   if (argc < 2) 
@@ -70,11 +107,18 @@ int main(int argc, char *argv[]) {
 
   /* get encode flag */
   encode = (argc > 1) && IS_ENCODE(argv[1]);
+  in_place = (argc > 1) && IS_IN_PLACE(argv[1]);
 
   /* dump file(s) */
   if (argc > 2) {
-    for (i = 2; (int) i < argc; i++)
-      dump(argv[i], encode);
+    for (i = 2; (int) i < argc; i++) {
+      if (in_place)
+        decode_in_place(argv[i]);
+      else
+        dump(argv[i], encode);
+    }
+  } else if (in_place) {
+    decode_in_place("-");
   } else {
     dump("-", encode);
   }
@@ -4,8 +4,11 @@
 INC="-I../include -DPTPGP_DEBUG -O2"
 # INC="-I../include -O2"
 
+# use compact stream parser state
+# INC="$INC -DPTPGP_STREAM_PARSER_COMPACT"
+
 # libs
-LIBS="-lm"
+LIBS="-lm -pthread"
 
 # add gcrypt support
 INC="$INC -DPTPGP_USE_GCRYPT $(libgcrypt-config --cflags)"
@@ -18,7 +21,9 @@ LIBS="$LIBS -lcrypto"
 # list of tests to compile
 TESTS="stream error armor base64 armor-encoder uri-parser      \
        gcrypt-hash openssl-hash gcrypt-encrypt openssl-encrypt \
-       gcrypt-genkey openssl-genkey"
+       gcrypt-genkey openssl-genkey gcrypt-sign openssl-sign   \
+       packet-index parallel large-stream checkpoint          \
+       key-assembler key-index user-id-index hkp dearmor crc24"
 
 cd ../src
 for i in *.c; do
@@ -31,5 +36,11 @@ for i in *.c; do
 done
 
 for i in $TESTS; do
-  cc -o ./$i{,.o} test-common.o ../src/*.o $LIBS
+  # sign tests share their driver code
+  case $i in
+    *-sign) OBJS="test-common.o sign-common.o" ;;
+    *)      OBJS="test-common.o" ;;
+  esac
+
+  cc -o ./$i{,.o} $OBJS ../src/*.o $LIBS
 done
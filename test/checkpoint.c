@@ -0,0 +1,290 @@
+#include <stdio.h>
+#include "test-common.h"
+
+#define USAGE \
+  "Usage: %s [-a] <input> [chunk size]...\n"                          \
+  "\n"                                                                \
+  "Push input to the stream and packet parsers (or the armor parser\n"\
+  "with -a) in chunks of the given sizes (default: 1, 7, and 4096),\n"\
+  "restoring fresh parsers from a checkpoint after every chunk, and\n"\
+  "check that the callbacks see the same tokens as without\n"         \
+  "checkpoints.\n"
+
+typedef struct {
+  ptpgp_stream_parser_t sp;
+  ptpgp_packet_parser_t pp;
+  ptpgp_armor_parser_t ap;
+
+  /* packet parser is active (saved with the checkpoints) */
+  bool in_packet;
+
+  /* hash of tokens and data seen by the callbacks */
+  uint32_t hash;
+} context_t;
+
+typedef struct {
+  u8 *data;
+  size_t data_len;
+} input_t;
+
+static void
+add_hash(context_t *c, int t, u8 *data, size_t data_len) {
+  size_t i;
+
+  /* FNV-1a */
+  c->hash = (c->hash ^ (t & 0xff)) * 16777619;
+  for (i = 0; i < data_len; i++)
+    c->hash = (c->hash ^ data[i]) * 16777619;
+}
+
+static ptpgp_err_t
+packet_cb(ptpgp_packet_parser_t *p,
+          ptpgp_packet_parser_token_t t,
+          ptpgp_packet_t *packet,
+          u8 *data, size_t data_len) {
+  context_t *c = (context_t*) p->user_data;
+
+  UNUSED(packet);
+  add_hash(c, 0x80 | t, data, data_len);
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+static ptpgp_err_t
+stream_cb(ptpgp_stream_parser_t *p,
+          ptpgp_stream_parser_token_t t,
+          ptpgp_packet_header_t *header,
+          u8 *data, size_t data_len) {
+  context_t *c = (context_t*) p->cb_data;
+
+  add_hash(c, t, data, data_len);
+
+  switch (t) {
+  case PTPGP_STREAM_PARSER_TOKEN_START:
+    c->in_packet = 1;
+    return ptpgp_packet_parser_init(&(c->pp), header->content_tag, packet_cb, c);
+  case PTPGP_STREAM_PARSER_TOKEN_BODY:
+    return ptpgp_packet_parser_push(&(c->pp), data, data_len);
+  case PTPGP_STREAM_PARSER_TOKEN_END:
+    c->in_packet = 0;
+    return ptpgp_packet_parser_done(&(c->pp));
+  default:
+    /* ignore unknown tokens */
+    return PTPGP_OK;
+  }
+}
+
+static ptpgp_err_t
+armor_cb(ptpgp_armor_parser_t *p,
+         ptpgp_armor_parser_token_t t,
+         u8 *data, size_t data_len) {
+  add_hash((context_t*) p->user_data, t, data, data_len);
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+static void
+read_cb(u8 *data, size_t data_len, void *user_data) {
+  input_t *in = (input_t*) user_data;
+
+  /* append data to input buffer */
+  if ((in->data = realloc(in->data, in->data_len + data_len)) == NULL)
+    ptpgp_sys_die("Couldn't allocate input buffer:");
+
+  memcpy(in->data + in->data_len, data, data_len);
+  in->data_len += data_len;
+}
+
+static void
+restore(context_t *c, bool armor, uint64_t ofs) {
+  u8 sp_buf[PTPGP_CHECKPOINT_MAX_SIZE],
+     pp_buf[PTPGP_CHECKPOINT_MAX_SIZE];
+  size_t sp_len, pp_len = 0;
+  ptpgp_checkpoint_type_t type;
+  uint64_t saved_ofs;
+
+  if (armor) {
+    PTPGP_ASSERT(
+      ptpgp_armor_parser_save(&(c->ap), sp_buf, sizeof(sp_buf), &sp_len),
+      "save armor parser"
+    );
+
+    /* clobber parser, then restore it */
+    memset(&(c->ap), 0xff, sizeof(ptpgp_armor_parser_t));
+    PTPGP_ASSERT(
+      ptpgp_armor_parser_restore(&(c->ap), sp_buf, sp_len, armor_cb, c),
+      "restore armor parser"
+    );
+  } else {
+    PTPGP_ASSERT(
+      ptpgp_stream_parser_save(&(c->sp), sp_buf, sizeof(sp_buf), &sp_len),
+      "save stream parser"
+    );
+
+    if (c->in_packet) {
+      PTPGP_ASSERT(
+        ptpgp_packet_parser_save(&(c->pp), pp_buf, sizeof(pp_buf), &pp_len),
+        "save packet parser"
+      );
+    }
+
+    /* clobber parsers, then restore them */
+    memset(&(c->sp), 0xff, sizeof(ptpgp_stream_parser_t));
+    memset(&(c->pp), 0xff, sizeof(ptpgp_packet_parser_t));
+
+    PTPGP_ASSERT(
+      ptpgp_stream_parser_restore(&(c->sp), sp_buf, sp_len, stream_cb, c),
+      "restore stream parser"
+    );
+
+    if (c->in_packet) {
+      PTPGP_ASSERT(
+        ptpgp_packet_parser_restore(&(c->pp), pp_buf, pp_len, packet_cb, c),
+        "restore packet parser"
+      );
+    }
+  }
+
+  /* check checkpoint offset */
+  PTPGP_ASSERT(
+    ptpgp_checkpoint_get_info(sp_buf, sp_len, &type, &saved_ofs),
+    "get checkpoint info"
+  );
+
+  if (type != (armor ? PTPGP_CHECKPOINT_TYPE_ARMOR_PARSER :
+                       PTPGP_CHECKPOINT_TYPE_STREAM_PARSER))
+    ptpgp_sys_die("checkpoint type mismatch (got %d)", type);
+
+  if (saved_ofs != ofs)
+    ptpgp_sys_die(
+      "checkpoint offset mismatch (expected %llu, got %llu)",
+      (unsigned long long) ofs, (unsigned long long) saved_ofs
+    );
+
+  /* check that damaged checkpoints are rejected */
+  sp_buf[sp_len - 1] ^= 1;
+  if (ptpgp_checkpoint_get_info(sp_buf, sp_len, 0, 0) !=
+      PTPGP_ERR_CHECKPOINT_BAD_CHECKSUM)
+    ptpgp_sys_die("corrupt checkpoint not detected");
+
+  if (ptpgp_checkpoint_get_info(sp_buf, sp_len - 1, 0, 0) !=
+      PTPGP_ERR_CHECKPOINT_BAD_HEADER)
+    ptpgp_sys_die("truncated checkpoint not detected");
+
+  if (pp_len > 0 &&
+      ptpgp_stream_parser_restore(&(c->sp), pp_buf, pp_len, stream_cb, c) !=
+      PTPGP_ERR_CHECKPOINT_BAD_TYPE)
+    ptpgp_sys_die("checkpoint type mismatch not detected");
+
+  /* restore again (the checks above clobbered the stream parser) */
+  sp_buf[sp_len - 1] ^= 1;
+  if (!armor)
+    PTPGP_ASSERT(
+      ptpgp_stream_parser_restore(&(c->sp), sp_buf, sp_len, stream_cb, c),
+      "restore stream parser"
+    );
+}
+
+static uint32_t
+run(input_t *in, bool armor, size_t chunk_size, bool use_checkpoints) {
+  context_t c;
+  size_t ofs, len;
+
+  memset(&c, 0, sizeof(context_t));
+  c.hash = 2166136261U;
+
+  if (armor) {
+    PTPGP_ASSERT(
+      ptpgp_armor_parser_init(&(c.ap), armor_cb, &c),
+      "init armor parser"
+    );
+  } else {
+    PTPGP_ASSERT(
+      ptpgp_stream_parser_init(&(c.sp), stream_cb, &c),
+      "init stream parser"
+    );
+  }
+
+  for (ofs = 0; ofs < in->data_len; ofs += len) {
+    len = in->data_len - ofs;
+    if (len > chunk_size)
+      len = chunk_size;
+
+    if (armor) {
+      PTPGP_ASSERT(
+        ptpgp_armor_parser_push(&(c.ap), in->data + ofs, len),
+        "push armor parser"
+      );
+    } else {
+      PTPGP_ASSERT(
+        ptpgp_stream_parser_push(&(c.sp), in->data + ofs, len),
+        "push stream parser"
+      );
+    }
+
+    if (use_checkpoints)
+      restore(&c, armor, ofs + len);
+  }
+
+  if (armor) {
+    PTPGP_ASSERT(ptpgp_armor_parser_done(&(c.ap)), "finish armor parser");
+  } else {
+    PTPGP_ASSERT(ptpgp_stream_parser_done(&(c.sp)), "finish stream parser");
+  }
+
+  /* return hash of callback tokens */
+  return c.hash;
+}
+
+static void
+check(input_t *in, bool armor, size_t chunk_size) {
+  uint32_t expected = run(in, armor, chunk_size, 0),
+           got = run(in, armor, chunk_size, 1);
+
+  if (got != expected)
+    ptpgp_sys_die(
+      "chunk size %u: token hash mismatch (expected %08x, got %08x)",
+      (unsigned int) chunk_size, expected, got
+    );
+
+  printf("chunk size %u: ok\n", (unsigned int) chunk_size);
+}
+
+int main(int argc, char *argv[]) {
+  input_t in;
+  bool armor = 0;
+  int i, first = 1;
+
+  /* check for help option */
+  if (argc > 1 && IS_HELP(argv[1]))
+    print_usage_and_exit(argv[0], USAGE);
+
+  if (argc > 1 && !strncmp(argv[1], "-a", 3)) {
+    armor = 1;
+    first++;
+  }
+
+  if (argc <= first)
+    print_usage_and_exit(argv[0], USAGE);
+
+  /* read input */
+  memset(&in, 0, sizeof(input_t));
+  file_read(argv[first], read_cb, &in);
+
+  if (argc > first + 1) {
+    /* check given chunk sizes */
+    for (i = first + 1; i < argc; i++)
+      check(&in, armor, atoi(argv[i]) > 0 ? atoi(argv[i]) : 1);
+  } else {
+    check(&in, armor, 1);
+    check(&in, armor, 7);
+    check(&in, armor, 4096);
+  }
+
+  free(in.data);
+
+  /* return success */
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include "test-common.h"
+
+#define USAGE \
+  "Usage: %s [input...]\n"                                            \
+  "\n"                                                                \
+  "Print the crc24 of each input, and check it against a bitwise crc\n" \
+  "and against crcs combined from pieces of the input.\n"
+
+/* textbook bitwise crc24 (RFC 4880, section 6.1) */
+static uint32_t
+bitwise_crc(u8 *src, size_t src_len) {
+  uint32_t crc = 0xB704CE;
+  int i;
+
+  while (src_len--) {
+    crc ^= (*(src++)) << 16;
+
+    for (i = 0; i < 8; i++) {
+      crc <<= 1;
+      if (crc & 0x1000000)
+        crc ^= 0x1864CFB;
+    }
+  }
+
+  return crc & 0xFFFFFF;
+}
+
+static uint32_t
+get_crc(u8 *src, size_t src_len) {
+  ptpgp_crc24_t c;
+
+  PTPGP_ASSERT(ptpgp_crc24_init(&c), "init crc24 context");
+
+  if (src_len > 0)
+    PTPGP_ASSERT(ptpgp_crc24_push(&c, src, src_len), "push crc24 data");
+
+  PTPGP_ASSERT(ptpgp_crc24_done(&c), "finish crc24 context");
+
+  return c.crc;
+}
+
+static void
+check(char *path) {
+  buffer_t b = { NULL, 0 };
+  size_t i, ofs[] = { 0, 1, 7, 8, 9, 4095 };
+  uint32_t crc, expected, a, z;
+
+  /* read input file */
+  file_read(path, buffer_append_cb, &b);
+
+  crc = get_crc(b.data, b.data_len);
+  expected = bitwise_crc(b.data, b.data_len);
+
+  if (crc != expected)
+    ptpgp_sys_die("%s: crc mismatch (expected %06x, got %06x)",
+                  path, expected, crc);
+
+  /* combine crcs of both halves at each split point */
+  for (i = 0; i < sizeof(ofs) / sizeof(size_t) + 2; i++) {
+    size_t o = (i < 6) ? ofs[i] : (i == 6) ? b.data_len / 2 : b.data_len;
+
+    if (o > b.data_len)
+      continue;
+
+    a = get_crc(b.data, o);
+    z = get_crc(b.data + o, b.data_len - o);
+
+    if (ptpgp_crc24_combine(a, z, b.data_len - o) != crc)
+      ptpgp_sys_die("%s: combined crc mismatch at offset %u",
+                    path, (unsigned int) o);
+  }
+
+  printf("%s: %06x\n", path, crc);
+
+  free(b.data);
+}
+
+int main(int argc, char *argv[]) {
+  int i;
+
+  /* check for help option */
+  for (i = 1; i < argc; i++)
+    if (IS_HELP(argv[i]))
+      print_usage_and_exit(argv[0], USAGE);
+
+  if (argc > 1) {
+    for (i = 1; i < argc; i++)
+      check(argv[i]);
+  } else {
+    /* read from standard input */
+    check("-");
+  }
+
+  /* return success */
+  return EXIT_SUCCESS;
+}
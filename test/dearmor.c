@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include "test-common.h"
+
+#define USAGE \
+  "Usage: %s [-p] [input...]\n"                                       \
+  "\n"                                                                \
+  "Dearmor ASCII-armored input, verify the armor checksums, and write\n" \
+  "the decoded data to standard output (or, with -p, push it to a\n"  \
+  "stream parser and print the packet tags and lengths).\n"
+
+typedef struct {
+  /* push decoded data to stream parser */
+  bool use_parser;
+  ptpgp_stream_parser_t parser;
+
+  /* armor has started (stream parser is active) */
+  bool in_armor;
+} context_t;
+
+static ptpgp_err_t
+stream_cb(ptpgp_stream_parser_t *p,
+          ptpgp_stream_parser_token_t t,
+          ptpgp_packet_header_t *header,
+          u8 *data,
+          size_t data_len) {
+  UNUSED(p);
+  UNUSED(data);
+  UNUSED(data_len);
+
+  if (t == PTPGP_STREAM_PARSER_TOKEN_START)
+    printf("packet: tag %d, length %llu\n", header->content_tag,
+           (unsigned long long) header->length);
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+static ptpgp_err_t
+dearmor_cb(ptpgp_dearmor_t *d,
+           ptpgp_dearmor_token_t t,
+           u8 *data,
+           size_t data_len) {
+  context_t *c = (context_t*) d->user_data;
+
+  switch (t) {
+  case PTPGP_DEARMOR_TOKEN_START:
+    fprintf(stderr, "armor: %.*s\n", (int) data_len, data);
+
+    if (c->use_parser) {
+      PTPGP_ASSERT(
+        ptpgp_stream_parser_init(&(c->parser), stream_cb, c),
+        "init stream parser"
+      );
+
+      c->in_armor = 1;
+    }
+
+    break;
+  case PTPGP_DEARMOR_TOKEN_HEADER_NAME:
+    fprintf(stderr, "armor header: %.*s: ", (int) data_len, data);
+    break;
+  case PTPGP_DEARMOR_TOKEN_HEADER_VALUE:
+    fprintf(stderr, "%.*s\n", (int) data_len, data);
+    break;
+  case PTPGP_DEARMOR_TOKEN_DATA:
+    if (c->use_parser) {
+      PTPGP_ASSERT(
+        ptpgp_stream_parser_push(&(c->parser), data, data_len),
+        "push decoded data to stream parser"
+      );
+    } else if (!fwrite(data, data_len, 1, stdout)) {
+      ptpgp_sys_die("Couldn't write decoded data to standard output:");
+    }
+
+    break;
+  case PTPGP_DEARMOR_TOKEN_END:
+    fprintf(
+      stderr, "armor: %.*s (%s)\n", (int) data_len, data,
+      d->has_crc24 ? "checksum ok" : "no checksum"
+    );
+
+    if (c->in_armor) {
+      PTPGP_ASSERT(
+        ptpgp_stream_parser_done(&(c->parser)),
+        "finish stream parser"
+      );
+
+      c->in_armor = 0;
+    }
+
+    break;
+  default:
+    /* ignore other tokens */
+    break;
+  }
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+static void
+dearmor(context_t *c, char *path) {
+  ptpgp_source_t src;
+  ptpgp_dearmor_t d;
+
+  PTPGP_ASSERT(
+    ptpgp_dearmor_init(&d, dearmor_cb, c),
+    "init dearmor context"
+  );
+
+  /* open input file */
+  PTPGP_ASSERT(
+    ptpgp_source_init_file(&src, path),
+    "open input file \"%s\"", path
+  );
+
+  /* dearmor input file */
+  PTPGP_ASSERT(
+    ptpgp_source_push_dearmor(&src, &d),
+    "dearmor \"%s\"", path
+  );
+
+  PTPGP_ASSERT(ptpgp_dearmor_done(&d), "finish dearmor context");
+
+  /* close input file */
+  PTPGP_ASSERT(
+    ptpgp_source_close(&src),
+    "close input file \"%s\"", path
+  );
+}
+
+int main(int argc, char *argv[]) {
+  context_t c;
+  int i, first = 1;
+
+  memset(&c, 0, sizeof(context_t));
+
+  /* check for help option */
+  for (i = 1; i < argc; i++)
+    if (IS_HELP(argv[i]))
+      print_usage_and_exit(argv[0], USAGE);
+
+  if (argc > 1 && !strncmp(argv[1], "-p", 3)) {
+    c.use_parser = 1;
+    first++;
+  }
+
+  if (argc > first) {
+    /* dearmor each input file */
+    for (i = first; i < argc; i++)
+      dearmor(&c, argv[i]);
+  } else {
+    /* read from standard input */
+    dearmor(&c, "-");
+  }
+
+  /* return success */
+  return EXIT_SUCCESS;
+}
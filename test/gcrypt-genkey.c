@@ -29,18 +29,36 @@ generate_key(ptpgp_engine_t *e,
              size_t num_bits) {
   ptpgp_pk_genkey_context_t c;
   ptpgp_pk_genkey_options_t o;
+  ptpgp_arena_t arena;
+
+  /* init arena for key MPIs */
+  PTPGP_ASSERT(ptpgp_arena_init(&arena, 0), "init arena");
 
   /* populate genkey options */
+  memset(&o, 0, sizeof(ptpgp_pk_genkey_options_t));
   o.engine    = e;
   o.algorithm = algo;
   o.num_bits  = num_bits;
   /* FIXME */
   o.params.rsa.e = 65537;
+  o.arena     = &arena;
 
   PTPGP_ASSERT(
     ptpgp_engine_pk_generate_key(&c, &o),
     "generate public key"
   );
+
+  /* check modulus size */
+  if (c.key.rsa.n.num_bits != num_bits)
+    ptpgp_sys_die(
+      "modulus size mismatch (expected %u bits, got %u)",
+      (unsigned int) num_bits, (unsigned int) c.key.rsa.n.num_bits
+    );
+
+  printf("generated %u-bit key (%u bytes of MPIs)\n",
+         (unsigned int) num_bits, (unsigned int) arena.num_bytes);
+
+  PTPGP_ASSERT(ptpgp_arena_free(&arena), "free arena");
 }
 
 int main(int argc, char *argv[]) {
@@ -0,0 +1,22 @@
+#include "sign-common.h"
+
+#define USAGE \
+  "%s - Sign and verify input files with a generated RSA key (or a\n" \
+  "given RSA or DSA key), and verify keyring self-signatures.\n" \
+  "\n" \
+  "Usage:\n" \
+  "  gcrypt-sign [-s <secret key>] <hash algorithm> <input...>\n" \
+  "  gcrypt-sign -k <keyring...>\n" \
+  "\n" \
+  "Options:\n" \
+  "  -s secret key  - sign with the RSA or DSA key in the given\n" \
+  "                   (unprotected) secret key file instead\n" \
+  "  -k keyring     - verify the self-signatures of RSA and DSA keys\n" \
+  "                   (certifications, subkey bindings, and direct\n" \
+  "                   key signatures) in the given keyrings\n" \
+  "  hash algorithm - digest algorithm (e.g. \"sha256\")\n" \
+  "  input          - input files to sign\n"
+
+int main(int argc, char *argv[]) {
+  return sign_main(argc, argv, USAGE, init_gcrypt);
+}
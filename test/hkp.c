@@ -0,0 +1,362 @@
+#define _POSIX_C_SOURCE 200112L /* for clock_gettime() */
+
+#include <stdio.h>
+#include <time.h>         /* for clock_gettime() */
+#include <unistd.h>       /* for read(), write(), close() */
+#include <sys/socket.h>   /* for socket() */
+#include <netinet/in.h>   /* for struct sockaddr_in */
+#include <arpa/inet.h>    /* for htonl() */
+#include "test-common.h"
+
+#define USAGE \
+  "Usage:\n"                                                          \
+  "  %1$s <keyring> <key index> <user ID index> <target>...\n"        \
+  "      Answer HKP requests (e.g. \"/pks/lookup?op=get&search=0x1234ABCD\")\n" \
+  "      and print the responses.\n"                                  \
+  "  %1$s -n <count> <keyring> <key index> <user ID index> <target>...\n" \
+  "      Answer each request count times and print the request rate.\n" \
+  "  %1$s -p <port> <keyring> <key index> <user ID index>\n"          \
+  "      Serve HKP requests over HTTP on the loopback interface.\n"   \
+  "  %1$s -s <keyring> <key index> <user ID index> <target>...\n"     \
+  "      Check that no secret key packets are served (op=get\n"      \
+  "      responses are dearmored and their packets checked).\n"
+
+typedef struct {
+  ptpgp_source_t keyring;
+  ptpgp_key_index_t key_index;
+  ptpgp_user_id_index_t user_id_index;
+  ptpgp_engine_t engine;
+} context_t;
+
+typedef struct {
+  /* output mode */
+  enum { OUT_PRINT, OUT_COUNT, OUT_HTTP, OUT_CHECK } mode;
+
+  /* response size (OUT_COUNT) */
+  uint64_t num_bytes;
+
+  /* response body and status (OUT_CHECK) */
+  u8 *body;
+  size_t body_len;
+  int status;
+
+  /* packet counts of dearmored response (OUT_CHECK) */
+  uint64_t num_packets,
+           num_public_keys;
+
+  /* client socket (OUT_HTTP) */
+  int fd;
+} output_t;
+
+static void
+write_all(int fd, u8 *src, size_t src_len) {
+  ssize_t l;
+
+  while (src_len > 0) {
+    if ((l = write(fd, src, src_len)) <= 0)
+      ptpgp_sys_die("Couldn't write response:");
+
+    src += l;
+    src_len -= l;
+  }
+}
+
+static ptpgp_err_t
+response_cb(ptpgp_hkp_t *h,
+            ptpgp_hkp_token_t t,
+            u8 *data, size_t data_len) {
+  output_t *o = (output_t*) h->user_data;
+  char buf[256];
+  int l;
+
+  switch (o->mode) {
+  case OUT_PRINT:
+    if (t == PTPGP_HKP_TOKEN_START)
+      printf("status: %d\ncontent-type: %.*s\n\n", h->status, (int) data_len, data);
+    else if (t == PTPGP_HKP_TOKEN_BODY && !fwrite(data, data_len, 1, stdout))
+      ptpgp_sys_die("Couldn't write response:");
+
+    break;
+  case OUT_COUNT:
+    o->num_bytes += data_len;
+    break;
+  case OUT_HTTP:
+    if (t == PTPGP_HKP_TOKEN_START) {
+      l = snprintf(
+        buf, sizeof(buf),
+        "HTTP/1.0 %d %s\r\nContent-Type: %.*s\r\nConnection: close\r\n\r\n",
+        h->status, (h->status == 200) ? "OK" : "Error", (int) data_len, data
+      );
+
+      write_all(o->fd, (u8*) buf, l);
+    } else if (t == PTPGP_HKP_TOKEN_BODY) {
+      write_all(o->fd, data, data_len);
+    }
+
+    break;
+  case OUT_CHECK:
+    if (t == PTPGP_HKP_TOKEN_START) {
+      o->status = h->status;
+    } else if (t == PTPGP_HKP_TOKEN_BODY) {
+      if ((o->body = realloc(o->body, o->body_len + data_len)) == NULL)
+        ptpgp_sys_die("Couldn't allocate response buffer:");
+
+      memcpy(o->body + o->body_len, data, data_len);
+      o->body_len += data_len;
+    }
+
+    break;
+  }
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+static void
+handle(context_t *c, output_t *o, char *target, size_t target_len) {
+  ptpgp_hkp_t h;
+
+  PTPGP_ASSERT(
+    ptpgp_hkp_init(
+      &h, c->keyring.data, c->keyring.data_len,
+      &(c->key_index), &(c->user_id_index), &(c->engine),
+      response_cb, o
+    ),
+    "initialize HKP request handler"
+  );
+
+  PTPGP_ASSERT(
+    ptpgp_hkp_push(&h, (u8*) target, target_len),
+    "push request target"
+  );
+
+  PTPGP_ASSERT(ptpgp_hkp_done(&h), "answer HKP request");
+}
+
+static ptpgp_err_t
+check_packet_cb(ptpgp_stream_parser_t *p,
+                ptpgp_stream_parser_token_t t,
+                ptpgp_packet_header_t *header,
+                u8 *src, size_t src_len) {
+  output_t *o = (output_t*) p->cb_data;
+
+  UNUSED(src);
+  UNUSED(src_len);
+
+  if (t != PTPGP_STREAM_PARSER_TOKEN_START)
+    return PTPGP_OK;
+
+  switch (header->content_tag) {
+  case PTPGP_TAG_SECRET_KEY:
+  case PTPGP_TAG_SECRET_SUBKEY:
+    ptpgp_die(0, "secret key packet served at offset %llu",
+              (unsigned long long) p->header_offset);
+    break;
+  case PTPGP_TAG_PUBLIC_KEY:
+    o->num_public_keys++;
+    break;
+  default:
+    break;
+  }
+
+  o->num_packets++;
+
+  return PTPGP_ERR_STREAM_PARSER_SKIP_BODY;
+}
+
+static ptpgp_err_t
+check_dearmor_cb(ptpgp_dearmor_t *d,
+                 ptpgp_dearmor_token_t t,
+                 u8 *data, size_t data_len) {
+  ptpgp_stream_parser_t *p = (ptpgp_stream_parser_t*) d->user_data;
+
+  if (t == PTPGP_DEARMOR_TOKEN_DATA)
+    return ptpgp_stream_parser_push(p, data, data_len);
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+static void
+check(context_t *c, char *target) {
+  ptpgp_stream_parser_t p;
+  ptpgp_dearmor_t d;
+  output_t o;
+
+  memset(&o, 0, sizeof(output_t));
+  o.mode = OUT_CHECK;
+
+  handle(c, &o, target, strlen(target));
+
+  if (o.status == 200 && strstr(target, "op=get")) {
+    /* dearmor keys, and check their packets */
+    PTPGP_ASSERT(
+      ptpgp_stream_parser_init(&p, check_packet_cb, &o),
+      "init stream parser"
+    );
+
+    PTPGP_ASSERT(
+      ptpgp_dearmor_init(&d, check_dearmor_cb, &p),
+      "init dearmor context"
+    );
+
+    PTPGP_ASSERT(ptpgp_dearmor_push(&d, o.body, o.body_len), "dearmor response");
+    PTPGP_ASSERT(ptpgp_dearmor_done(&d), "finish dearmor context");
+    PTPGP_ASSERT(ptpgp_stream_parser_done(&p), "finish stream parser");
+  }
+
+  printf(
+    "%s: status %d, %llu keys, %llu packets, no secret packets\n",
+    target, o.status, (unsigned long long) o.num_public_keys,
+    (unsigned long long) o.num_packets
+  );
+
+  free(o.body);
+}
+
+static void
+benchmark(context_t *c, char *target, long count) {
+  struct timespec t0, t1;
+  output_t o;
+  double secs;
+  long i;
+
+  memset(&o, 0, sizeof(output_t));
+  o.mode = OUT_COUNT;
+
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  for (i = 0; i < count; i++)
+    handle(c, &o, target, strlen(target));
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+
+  secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+  printf(
+    "%s: %ld requests, %llu bytes, %.0f requests/s\n", target, count,
+    (unsigned long long) o.num_bytes, secs > 0 ? count / secs : 0.0
+  );
+}
+
+static void
+serve(context_t *c, int port) {
+  struct sockaddr_in addr;
+  char buf[4096], *target, *end;
+  size_t len;
+  ssize_t l;
+  output_t o;
+  int fd, one = 1;
+
+  /* listen on loopback interface */
+  if ((fd = socket(AF_INET, SOCK_STREAM, 0)) == -1)
+    ptpgp_sys_die("Couldn't create socket:");
+
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  if (bind(fd, (struct sockaddr*) &addr, sizeof(addr)) || listen(fd, 16))
+    ptpgp_sys_die("Couldn't listen on port %d:", port);
+
+  while (1) {
+    memset(&o, 0, sizeof(output_t));
+    o.mode = OUT_HTTP;
+
+    if ((o.fd = accept(fd, NULL, NULL)) == -1)
+      ptpgp_sys_die("Couldn't accept connection:");
+
+    /* read request line ("GET <target> HTTP/1.x") */
+    for (len = 0; len < sizeof(buf) - 1;) {
+      if ((l = read(o.fd, buf + len, sizeof(buf) - 1 - len)) <= 0)
+        break;
+
+      len += l;
+      buf[len] = 0;
+
+      if (strstr(buf, "\r\n"))
+        break;
+    }
+
+    buf[len] = 0;
+
+    if (!strncmp(buf, "GET ", 4) && (end = strchr(buf + 4, ' ')) != NULL) {
+      target = buf + 4;
+      handle(c, &o, target, end - target);
+    } else {
+      write_all(o.fd, (u8*) "HTTP/1.0 400 Bad Request\r\n\r\n", 28);
+    }
+
+    close(o.fd);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  int i, first = 1, port = 0;
+  bool check_mode = 0;
+  long count = 0;
+  output_t o;
+  context_t c;
+
+  /* check for help option */
+  for (i = 1; i < argc; i++)
+    if (IS_HELP(argv[i]))
+      print_usage_and_exit(argv[0], USAGE);
+
+  if (argc > 2 && !strncmp(argv[1], "-n", 3)) {
+    count = atol(argv[2]);
+    first += 2;
+  } else if (argc > 2 && !strncmp(argv[1], "-p", 3)) {
+    port = atoi(argv[2]);
+    first += 2;
+  } else if (argc > 1 && !strncmp(argv[1], "-s", 3)) {
+    check_mode = 1;
+    first++;
+  }
+
+  if (argc < first + 3 || (!port && argc < first + 4))
+    print_usage_and_exit(argv[0], USAGE);
+
+  /* init engine (for fingerprints) */
+  init_gcrypt(&c.engine);
+
+  /* map keyring */
+  PTPGP_ASSERT(
+    ptpgp_source_init_file(&(c.keyring), argv[first]),
+    "open keyring \"%s\"", argv[first]
+  );
+
+  if (c.keyring.type != PTPGP_SOURCE_TYPE_MMAP)
+    ptpgp_die(0, "keyring \"%s\" isn't a mappable file", argv[first]);
+
+  /* open indexes */
+  PTPGP_ASSERT(
+    ptpgp_key_index_open(&(c.key_index), argv[first + 1]),
+    "open key index \"%s\"", argv[first + 1]
+  );
+
+  PTPGP_ASSERT(
+    ptpgp_user_id_index_open(&(c.user_id_index), argv[first + 2]),
+    "open user ID index \"%s\"", argv[first + 2]
+  );
+
+  if (port) {
+    serve(&c, port);
+  } else {
+    memset(&o, 0, sizeof(output_t));
+    o.mode = OUT_PRINT;
+
+    for (i = first + 3; i < argc; i++) {
+      if (count > 0)
+        benchmark(&c, argv[i], count);
+      else if (check_mode)
+        check(&c, argv[i]);
+      else
+        handle(&c, &o, argv[i], strlen(argv[i]));
+    }
+  }
+
+  /* return success */
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,162 @@
+#include <stdio.h>
+#include "test-common.h"
+
+#define USAGE \
+  "Usage: %s [-q] [input...]\n"                                       \
+  "\n"                                                                \
+  "Assemble transferable public keys from the given key streams and\n"\
+  "print each key, its user IDs, subkeys, and signature counts (or\n" \
+  "only the totals with -q).\n"
+
+typedef struct {
+  bool quiet;
+
+  uint64_t num_keys,
+           num_user_ids,
+           num_subkeys,
+           num_signatures,
+           num_bytes;
+} context_t;
+
+static size_t
+count_signatures(ptpgp_key_signature_t *s) {
+  size_t r;
+
+  for (r = 0; s; s = s->next)
+    r++;
+
+  return r;
+}
+
+static void
+print_public_key(char *name, ptpgp_key_public_key_t *k) {
+  u8 fp_hex[41], key_id[17];
+
+  memset(fp_hex, 0, sizeof(fp_hex));
+  memset(key_id, 0, sizeof(key_id));
+
+  if (k->has_fingerprint) {
+    PTPGP_ASSERT(
+      ptpgp_to_hex(k->fingerprint.fingerprint, k->fingerprint.fingerprint_len,
+                   fp_hex, sizeof(fp_hex)),
+      "convert fingerprint to hex"
+    );
+
+    PTPGP_ASSERT(
+      ptpgp_to_hex(k->fingerprint.key_id, 8, key_id, sizeof(key_id)),
+      "convert key id to hex"
+    );
+  }
+
+  printf(
+    "%s: version = %d, algorithm = %d, fingerprint = %s, key_id = 0x%s, "
+    "signatures = %d\n",
+    name, k->version, k->algorithm, fp_hex, key_id,
+    (int) count_signatures(k->signatures)
+  );
+}
+
+static ptpgp_err_t
+key_cb(ptpgp_key_assembler_t *a, ptpgp_key_t *key) {
+  context_t *c = (context_t*) a->user_data;
+  ptpgp_key_user_id_t *u;
+  ptpgp_key_public_key_t *k;
+
+  c->num_keys++;
+  c->num_user_ids += key->num_user_ids;
+  c->num_subkeys += key->num_subkeys;
+  c->num_signatures += key->num_signatures;
+  c->num_bytes += key->arena.num_bytes;
+
+  if (!c->quiet) {
+    print_public_key("key", &(key->primary));
+
+    if (key->num_oversized_packets > 0)
+      printf("  oversized packets: %d\n", (int) key->num_oversized_packets);
+
+    for (u = key->user_ids; u; u = u->next) {
+      if (u->tag == PTPGP_TAG_USER_ID)
+        printf("  user_id: \"%.*s\"", (int) u->data_len, u->data);
+      else
+        printf("  user_attribute: %d bytes", (int) u->data_len);
+
+      printf(", signatures = %d\n", (int) count_signatures(u->signatures));
+    }
+
+    for (k = key->subkeys; k; k = k->next)
+      print_public_key("  subkey", k);
+  }
+
+  /* keys are freed in one go */
+  return ptpgp_key_free(key);
+}
+
+static void
+read_cb(u8 *data, size_t data_len, void *user_data) {
+  ptpgp_key_assembler_t *a = (ptpgp_key_assembler_t*) user_data;
+
+  PTPGP_ASSERT(
+    ptpgp_key_assembler_push(a, data, data_len),
+    "write data to key assembler"
+  );
+}
+
+static void
+assemble(ptpgp_engine_t *engine, context_t *c, char *path) {
+  ptpgp_key_assembler_t a;
+
+  PTPGP_ASSERT(
+    ptpgp_key_assembler_init(&a, engine, key_cb, c),
+    "initialize key assembler"
+  );
+
+  file_read(path, read_cb, &a);
+
+  PTPGP_ASSERT(ptpgp_key_assembler_done(&a), "finish key assembler");
+
+  if (a.num_skipped_packets > 0)
+    printf("%s: skipped packets = %llu\n", path,
+           (unsigned long long) a.num_skipped_packets);
+}
+
+int main(int argc, char *argv[]) {
+  ptpgp_engine_t engine;
+  context_t c;
+  int i, first = 1;
+
+  memset(&c, 0, sizeof(context_t));
+
+  /* check for help option */
+  for (i = 1; i < argc; i++)
+    if (IS_HELP(argv[i]))
+      print_usage_and_exit(argv[0], USAGE);
+
+  if (argc > 1 && !strncmp(argv[1], "-q", 3)) {
+    c.quiet = 1;
+    first++;
+  }
+
+  /* init engine (for fingerprints) */
+  init_gcrypt(&engine);
+
+  if (argc > first) {
+    for (i = first; i < argc; i++)
+      assemble(&engine, &c, argv[i]);
+  } else {
+    /* read from standard input */
+    assemble(&engine, &c, "-");
+  }
+
+  printf(
+    "keys = %llu, user_ids = %llu, subkeys = %llu, signatures = %llu, "
+    "bytes = %llu\n",
+    (unsigned long long) c.num_keys,
+    (unsigned long long) c.num_user_ids,
+    (unsigned long long) c.num_subkeys,
+    (unsigned long long) c.num_signatures,
+    (unsigned long long) c.num_bytes
+  );
+
+  /* return success */
+  return EXIT_SUCCESS;
+}
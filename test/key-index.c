@@ -0,0 +1,317 @@
+#include <stdio.h>
+#include "test-common.h"
+
+#define USAGE \
+  "Usage:\n"                                                          \
+  "  %1$s <input> <index>       - Build key index of input file.\n"   \
+  "  %1$s -f <index> <id>...    - Find keys by fingerprint, key ID,\n"\
+  "                               or short key ID (hex).\n"          \
+  "  %1$s -t <data dir>         - Check ECC and secret keyrings, and\n"\
+  "                               truncated and corrupt indexes\n"   \
+  "                               (fixtures from test/data).\n"
+
+/* fingerprints of the ECC fixture (ed25519 key, cv25519 subkey) */
+#define ECC_KEY     "8DCC8647D115E25431F36A4FFC0D6212BD93088E"
+#define ECC_SUBKEY  "13777823E28A2E63EDFE45E9FB899BB8B18CC844"
+
+/* fingerprint of the plaintext secret key fixture */
+#define SECRET_KEY  "101799345779B238A1645E68181B183163E9A668"
+
+static ptpgp_err_t
+write_cb(ptpgp_key_index_builder_t *b,
+         u8 *data, size_t data_len) {
+  FILE *fh = (FILE*) b->user_data;
+
+  /* write index data to output file */
+  if (fwrite(data, 1, data_len, fh) != data_len)
+    ptpgp_sys_die("Couldn't write key index:");
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+static void
+read_cb(u8 *data, size_t data_len, void *user_data) {
+  ptpgp_key_index_builder_t *b = (ptpgp_key_index_builder_t*) user_data;
+
+  /* write file data to builder */
+  PTPGP_ASSERT(
+    ptpgp_key_index_builder_push(b, data, data_len),
+    "write data to key index builder"
+  );
+}
+
+static void
+build(char *src_path, char *dst_path) {
+  ptpgp_key_index_builder_t b;
+  ptpgp_engine_t engine;
+  FILE *fh;
+
+  /* init engine (for fingerprints) */
+  init_gcrypt(&engine);
+
+  /* open output file */
+  if ((fh = fopen(dst_path, "wb")) == NULL)
+    ptpgp_sys_die("Couldn't open output file \"%s\":", dst_path);
+
+  /* init key index builder */
+  PTPGP_ASSERT(
+    ptpgp_key_index_builder_init(&b, &engine, write_cb, fh),
+    "initialize key index builder"
+  );
+
+  /* read input file */
+  file_read(src_path, read_cb, &b);
+
+  /* finish builder */
+  PTPGP_ASSERT(
+    ptpgp_key_index_builder_done(&b),
+    "finish key index builder"
+  );
+
+  /* close output file */
+  if (fclose(fh))
+    ptpgp_sys_die("Couldn't close output file \"%s\":", dst_path);
+
+  printf(
+    "%s: %llu keys, %llu skipped\n", dst_path,
+    (unsigned long long) b.num_entries,
+    (unsigned long long) b.num_skipped_keys
+  );
+}
+
+static ptpgp_err_t
+buffer_write_cb(ptpgp_key_index_builder_t *b,
+                u8 *data, size_t data_len) {
+  buffer_append((buffer_t*) b->user_data, data, data_len);
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+/* build index of fixture in memory, and check its counts */
+static void
+build_fixture(ptpgp_engine_t *engine,
+              char *dir,
+              char *name,
+              uint64_t num_entries,
+              uint64_t num_skipped,
+              buffer_t *index) {
+  ptpgp_key_index_builder_t b;
+  char path[1024];
+
+  snprintf(path, sizeof(path), "%s/%s", dir, name);
+  memset(index, 0, sizeof(buffer_t));
+
+  PTPGP_ASSERT(
+    ptpgp_key_index_builder_init(&b, engine, buffer_write_cb, index),
+    "initialize key index builder"
+  );
+
+  file_read(path, read_cb, &b);
+
+  PTPGP_ASSERT(
+    ptpgp_key_index_builder_done(&b),
+    "finish key index builder"
+  );
+
+  if (b.num_entries != num_entries || b.num_skipped_keys != num_skipped)
+    ptpgp_die(0, "%s: got %llu keys, %llu skipped (expected %llu, %llu)",
+              name, (unsigned long long) b.num_entries,
+              (unsigned long long) b.num_skipped_keys,
+              (unsigned long long) num_entries,
+              (unsigned long long) num_skipped);
+}
+
+static size_t
+parse_id(char *s, u8 *dst) {
+  size_t i, len;
+  unsigned int v;
+
+  /* skip optional prefix */
+  if (!strncmp(s, "0x", 2) || !strncmp(s, "0X", 2))
+    s += 2;
+
+  len = strlen(s);
+  if (len != 8 && len != 16 && len != 40)
+    ptpgp_die(PTPGP_ERR_KEY_INDEX_BAD_ID_LENGTH, "invalid key ID \"%s\"", s);
+
+  for (i = 0; i < len / 2; i++) {
+    if (sscanf(s + 2 * i, "%2x", &v) != 1)
+      ptpgp_die(PTPGP_ERR_KEY_INDEX_BAD_ID_LENGTH, "invalid key ID \"%s\"", s);
+
+    dst[i] = v;
+  }
+
+  return len / 2;
+}
+
+static void
+print_entry(char *id, ptpgp_key_index_entry_t *e) {
+  u8 buf[41];
+
+  memset(buf, 0, sizeof(buf));
+
+  /* convert fingerprint (or key id of v3 keys) to hex */
+  PTPGP_ASSERT(
+    ptpgp_to_hex(
+      e->has_fingerprint ? e->fingerprint : e->key_id,
+      e->has_fingerprint ? 20 : 8,
+      buf, sizeof(buf)
+    ),
+    "convert key id to hex"
+  );
+
+  printf(
+    "%s,%llu,%d,%s\n", id,
+    (unsigned long long) e->key_offset, e->is_subkey ? 1 : 0, buf
+  );
+}
+
+static void
+find(char *path, char **ids, int num_ids) {
+  ptpgp_key_index_entry_t e;
+  ptpgp_key_index_t index;
+  ptpgp_err_t err;
+  uint64_t iter;
+  size_t id_len;
+  u8 id[20];
+  int i;
+
+  /* open index */
+  PTPGP_ASSERT(
+    ptpgp_key_index_open(&index, path),
+    "open key index \"%s\"", path
+  );
+
+  for (i = 0; i < num_ids; i++) {
+    id_len = parse_id(ids[i], id);
+
+    /* print all matching entries */
+    for (iter = 0; (err = ptpgp_key_index_find(
+                      &index, id, id_len, &iter, &e)) == PTPGP_OK;)
+      print_entry(ids[i], &e);
+
+    if (err != PTPGP_ERR_KEY_INDEX_NOT_FOUND)
+      PTPGP_ASSERT(err, "find key \"%s\"", ids[i]);
+  }
+
+  /* close index */
+  PTPGP_ASSERT(
+    ptpgp_key_index_close(&index),
+    "close key index"
+  );
+}
+
+/* find fingerprint in index (returns false if it isn't found) */
+static bool
+find_key(ptpgp_key_index_t *index, char *fp, ptpgp_key_index_entry_t *e) {
+  uint64_t iter = 0;
+  ptpgp_err_t err;
+  u8 id[20];
+
+  parse_id(fp, id);
+
+  if ((err = ptpgp_key_index_find(index, id, 20, &iter, e)) == PTPGP_ERR_KEY_INDEX_NOT_FOUND)
+    return 0;
+
+  PTPGP_ASSERT(err, "find key \"%s\"", fp);
+
+  /* return success */
+  return 1;
+}
+
+static void
+check_entry(ptpgp_key_index_t *index, char *fp, bool is_subkey) {
+  ptpgp_key_index_entry_t e;
+
+  if (!find_key(index, fp, &e))
+    ptpgp_die(0, "key %s not found", fp);
+
+  if (e.is_subkey != is_subkey || !e.has_fingerprint)
+    ptpgp_die(0, "key %s: bad entry", fp);
+}
+
+/* load index (see check_index_header()) */
+static ptpgp_err_t
+load(u8 *data, size_t data_len) {
+  ptpgp_key_index_t index;
+  return ptpgp_key_index_load(&index, data, data_len);
+}
+
+static void
+test(char *dir) {
+  ptpgp_key_index_entry_t e;
+  ptpgp_key_index_t index;
+  ptpgp_engine_t engine;
+  buffer_t b;
+  uint64_t iter;
+  size_t i;
+  u8 id[4] = { 0xff, 0xff, 0xff, 0xff };
+
+  /* init engine (for fingerprints) */
+  init_gcrypt(&engine);
+
+  /* ECC key and subkey (fingerprinted from the raw key packets) */
+  build_fixture(&engine, dir, "ecc-public_key.pgp", 2, 0, &b);
+  PTPGP_ASSERT(ptpgp_key_index_load(&index, b.data, b.data_len), "load index");
+  check_entry(&index, ECC_KEY, 0);
+  check_entry(&index, ECC_SUBKEY, 1);
+  printf("ecc key: ok\n");
+
+  /* truncated index and corrupt headers (low octet of entry count) */
+  check_index_header(&b, load, 31, PTPGP_ERR_KEY_INDEX_BAD_HEADER,
+                     PTPGP_ERR_KEY_INDEX_BAD_VERSION);
+
+  /* corrupt table without free slots (lookups still stop) */
+  for (i = PTPGP_KEY_INDEX_HEADER_SIZE; i < b.data_len; i += PTPGP_KEY_INDEX_SLOT_SIZE)
+    b.data[i + 20] = PTPGP_KEY_INDEX_FLAG_USED;
+
+  PTPGP_ASSERT(ptpgp_key_index_load(&index, b.data, b.data_len), "load index");
+  iter = 0;
+  if (ptpgp_key_index_find(&index, id, 4, &iter, &e) != PTPGP_ERR_KEY_INDEX_NOT_FOUND)
+    ptpgp_die(0, "full table: unexpected result");
+
+  printf("truncated and corrupt indexes: ok\n");
+  free(b.data);
+
+  /* secret keyring (secret keys aren't indexed) */
+  build_fixture(&engine, dir, "plaintext-secret_key.pgp", 0, 2, &b);
+  free(b.data);
+
+  /* public keys mixed with secret keys and subkeys */
+  build_fixture(&engine, dir, "mixed-secret_key.pgp", 4, 3, &b);
+  PTPGP_ASSERT(ptpgp_key_index_load(&index, b.data, b.data_len), "load index");
+  check_entry(&index, ECC_KEY, 0);
+
+  if (find_key(&index, SECRET_KEY, &e))
+    ptpgp_die(0, "secret key %s was indexed", SECRET_KEY);
+
+  printf("secret keyrings: ok\n");
+  free(b.data);
+}
+
+int main(int argc, char *argv[]) {
+  int i;
+
+  /* check for help option */
+  for (i = 1; i < argc; i++)
+    if (IS_HELP(argv[i]))
+      print_usage_and_exit(argv[0], USAGE);
+
+  if (argc > 2 && !strncmp(argv[1], "-t", 3)) {
+    /* check fixtures */
+    test(argv[2]);
+  } else if (argc > 2 && !strncmp(argv[1], "-f", 3)) {
+    /* find keys */
+    find(argv[2], argv + 3, argc - 3);
+  } else if (argc > 2) {
+    /* build index */
+    build(argv[1], argv[2]);
+  } else {
+    print_usage_and_exit(argv[0], USAGE);
+  }
+
+  /* return success */
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,280 @@
+#include <stdio.h>
+#include "test-common.h"
+
+#define USAGE \
+  "Usage: %s [megabytes]\n"                                           \
+  "\n"                                                                \
+  "Stream synthetic multi-gigabyte literal and encrypted data\n"      \
+  "packets (default: 8448 MB each) through the stream and packet\n"   \
+  "parsers in bounded memory, and check the 64-bit octet counts.\n"
+
+/* size of pushed data chunks */
+#define CHUNK_SIZE (1024 * 1024)
+
+/* partial body chunk size (2^30, the largest allowed) */
+#define PARTIAL_SIZE (((uint64_t) 1) << 30)
+
+typedef struct {
+  ptpgp_stream_parser_t sp;
+  ptpgp_packet_parser_t pp;
+
+  /* octets of current packet body seen by stream callback */
+  uint64_t body_len;
+
+  /* results of last packet */
+  ptpgp_tag_t tag;
+  uint64_t last_body_len,
+           last_data_len,
+           last_end_offset;
+} context_t;
+
+/* evil globals */
+static u8 zeros[CHUNK_SIZE];
+
+static ptpgp_err_t
+packet_cb(ptpgp_packet_parser_t *p,
+          ptpgp_packet_parser_token_t t,
+          ptpgp_packet_t *packet,
+          u8 *data, size_t data_len) {
+  context_t *c = (context_t*) p->user_data;
+
+  UNUSED(data);
+  UNUSED(data_len);
+
+  /* save data octet count at end of packet */
+  if (t == PTPGP_PACKET_PARSER_TOKEN_PACKET_END) {
+    switch (packet->tag) {
+    case PTPGP_TAG_LITERAL_DATA:
+      c->last_data_len = packet->packet.t11.data_len;
+      break;
+    case PTPGP_TAG_SYMMETRICALLY_ENCRYPTED_DATA:
+      c->last_data_len = packet->packet.t9.data_len;
+      break;
+    case PTPGP_TAG_SYM_ENCRYPTED_INTEGRITY_PROTECTED_DATA:
+      c->last_data_len = packet->packet.t18.data_len;
+      break;
+    default:
+      ptpgp_sys_die("unexpected packet tag %d", packet->tag);
+    }
+  }
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+static ptpgp_err_t
+stream_cb(ptpgp_stream_parser_t *p,
+          ptpgp_stream_parser_token_t t,
+          ptpgp_packet_header_t *header,
+          u8 *data, size_t data_len) {
+  context_t *c = (context_t*) p->cb_data;
+
+  switch (t) {
+  case PTPGP_STREAM_PARSER_TOKEN_START:
+    c->tag = header->content_tag;
+    c->body_len = 0;
+
+    return ptpgp_packet_parser_init(&(c->pp), header->content_tag, packet_cb, c);
+  case PTPGP_STREAM_PARSER_TOKEN_BODY:
+    c->body_len += data_len;
+    return ptpgp_packet_parser_push(&(c->pp), data, data_len);
+  case PTPGP_STREAM_PARSER_TOKEN_END:
+    c->last_body_len = c->body_len;
+    c->last_end_offset = p->offset;
+
+    return ptpgp_packet_parser_done(&(c->pp));
+  default:
+    /* ignore unknown tokens */
+    return PTPGP_OK;
+  }
+}
+
+static void
+push_header(context_t *c, u8 *buf, size_t buf_len) {
+  size_t i;
+
+  /* push headers one octet at a time, to exercise the slow path */
+  for (i = 0; i < buf_len; i++) {
+    PTPGP_ASSERT(
+      ptpgp_stream_parser_push(&(c->sp), buf + i, 1),
+      "push header"
+    );
+  }
+}
+
+static void
+push_data(context_t *c, uint64_t len) {
+  while (len > 0) {
+    size_t n = (len > CHUNK_SIZE) ? CHUNK_SIZE : len;
+
+    PTPGP_ASSERT(
+      ptpgp_stream_parser_push(&(c->sp), zeros, n),
+      "push data"
+    );
+
+    len -= n;
+  }
+}
+
+static void
+check(context_t *c,
+      char *name,
+      ptpgp_tag_t tag,
+      uint64_t body_len,
+      uint64_t data_len,
+      uint64_t end_offset) {
+  if (c->tag != tag ||
+      c->last_body_len != body_len ||
+      c->last_data_len != data_len ||
+      c->last_end_offset != end_offset) {
+    ptpgp_sys_die(
+      "%s: expected tag %d, body %llu, data %llu, end %llu; "
+      "got tag %d, body %llu, data %llu, end %llu", name,
+      tag, (unsigned long long) body_len,
+      (unsigned long long) data_len, (unsigned long long) end_offset,
+      c->tag, (unsigned long long) c->last_body_len,
+      (unsigned long long) c->last_data_len,
+      (unsigned long long) c->last_end_offset
+    );
+  }
+
+  printf("%s: %llu octets ok\n", name, (unsigned long long) body_len);
+}
+
+static void
+put_u32(u8 *dst, uint32_t v) {
+  dst[0] = (v >> 24) & 0xff;
+  dst[1] = (v >> 16) & 0xff;
+  dst[2] = (v >>  8) & 0xff;
+  dst[3] = v & 0xff;
+}
+
+int main(int argc, char *argv[]) {
+  context_t c;
+  uint64_t size = 8448, len, ofs = 0, num_chunks = 0;
+  u8 buf[16];
+
+  /* check for help option */
+  if (argc > 1 && IS_HELP(argv[1]))
+    print_usage_and_exit(argv[0], USAGE);
+
+  if (argc > 1)
+    size = strtoull(argv[1], NULL, 10);
+
+  size *= 1024 * 1024;
+  if (size < 16)
+    print_usage_and_exit(argv[0], USAGE);
+
+  memset(&c, 0, sizeof(context_t));
+
+  PTPGP_ASSERT(
+    ptpgp_stream_parser_init(&(c.sp), stream_cb, &c),
+    "init stream parser"
+  );
+
+  /*
+   * literal data packet with partial body lengths: new-style header,
+   * 2^30 octet chunks, and a five-octet final length
+   */
+  buf[0] = 0xc0 | PTPGP_TAG_LITERAL_DATA;
+  push_header(&c, buf, 1);
+
+  for (len = size; len > PARTIAL_SIZE; len -= PARTIAL_SIZE) {
+    num_chunks++;
+
+    buf[0] = 224 + 30;
+    push_header(&c, buf, 1);
+
+    if (len == size) {
+      /* literal data header (binary, no file name, zero date) */
+      memset(buf, 0, 6);
+      buf[0] = 'b';
+      push_header(&c, buf, 6);
+      push_data(&c, PARTIAL_SIZE - 6);
+    } else {
+      push_data(&c, PARTIAL_SIZE);
+    }
+  }
+
+  buf[0] = 255;
+  put_u32(buf + 1, len);
+  push_header(&c, buf, 5);
+  push_data(&c, len);
+
+  ofs += 1 + num_chunks * (PARTIAL_SIZE + 1) + 5 + len;
+
+  check(&c, "partial literal data", PTPGP_TAG_LITERAL_DATA, size, size - 6, ofs);
+
+  /*
+   * literal data packet with old-style four-octet length above 2^31
+   * (the high bit of the length must not be sign-extended)
+   */
+  len = 0x80000001;
+  buf[0] = 0x80 | (PTPGP_TAG_LITERAL_DATA << 2) | 2;
+  put_u32(buf + 1, len);
+  push_header(&c, buf, 5);
+
+  memset(buf, 0, 6);
+  buf[0] = 'b';
+  push_header(&c, buf, 6);
+  push_data(&c, len - 6);
+
+  ofs += 5 + len;
+  check(&c, "old-style literal data", PTPGP_TAG_LITERAL_DATA, len, len - 6, ofs);
+
+  /* integrity protected data packet with partial body lengths */
+  buf[0] = 0xc0 | PTPGP_TAG_SYM_ENCRYPTED_INTEGRITY_PROTECTED_DATA;
+  push_header(&c, buf, 1);
+
+  num_chunks = 0;
+  for (len = size; len > PARTIAL_SIZE; len -= PARTIAL_SIZE) {
+    num_chunks++;
+
+    buf[0] = 224 + 30;
+    push_header(&c, buf, 1);
+
+    if (len == size) {
+      /* version */
+      buf[0] = 1;
+      push_header(&c, buf, 1);
+      push_data(&c, PARTIAL_SIZE - 1);
+    } else {
+      push_data(&c, PARTIAL_SIZE);
+    }
+  }
+
+  /* final chunk with two-octet length */
+  len = 8000;
+  buf[0] = ((len - 192) >> 8) + 192;
+  buf[1] = (len - 192) & 0xff;
+  push_header(&c, buf, 2);
+  push_data(&c, len);
+
+  ofs += 1 + num_chunks * (PARTIAL_SIZE + 1) + 2 + len;
+  len += num_chunks * PARTIAL_SIZE;
+  check(
+    &c, "partial encrypted data",
+    PTPGP_TAG_SYM_ENCRYPTED_INTEGRITY_PROTECTED_DATA,
+    len, len - 1, ofs
+  );
+
+  /*
+   * encrypted data packet with indeterminate length (old-style
+   * headers only have room for tags up to 15)
+   */
+  buf[0] = 0x80 | (PTPGP_TAG_SYMMETRICALLY_ENCRYPTED_DATA << 2) | 3;
+  push_header(&c, buf, 1);
+  push_data(&c, size);
+
+  PTPGP_ASSERT(ptpgp_stream_parser_done(&(c.sp)), "finish stream parser");
+
+  ofs += 1 + size;
+  check(
+    &c, "indeterminate encrypted data",
+    PTPGP_TAG_SYMMETRICALLY_ENCRYPTED_DATA,
+    size, size, ofs
+  );
+
+  /* return success */
+  return EXIT_SUCCESS;
+}
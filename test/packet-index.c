@@ -0,0 +1,140 @@
+#include <stdio.h>
+#include "test-common.h"
+
+#define USAGE \
+  "Usage:\n"                                                          \
+  "  %1$s <input> <index>   - Build packet index of input file.\n"    \
+  "  %1$s -d <index> [tag]  - Dump packet index (optionally only\n"   \
+  "                           packets with given tag).\n"
+
+static ptpgp_err_t
+write_cb(ptpgp_packet_index_builder_t *b,
+         u8 *data, size_t data_len) {
+  FILE *fh = (FILE*) b->user_data;
+
+  /* write index data to output file */
+  if (fwrite(data, 1, data_len, fh) != data_len)
+    ptpgp_sys_die("Couldn't write packet index:");
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+static void
+read_cb(u8 *data, size_t data_len, void *user_data) {
+  ptpgp_packet_index_builder_t *b = (ptpgp_packet_index_builder_t*) user_data;
+
+  /* write file data to builder */
+  PTPGP_ASSERT(
+    ptpgp_packet_index_builder_push(b, data, data_len),
+    "write data to packet index builder"
+  );
+}
+
+static void
+build(char *src_path, char *dst_path) {
+  ptpgp_packet_index_builder_t b;
+  FILE *fh;
+
+  /* open output file */
+  if ((fh = fopen(dst_path, "wb")) == NULL)
+    ptpgp_sys_die("Couldn't open output file \"%s\":", dst_path);
+
+  /* init packet index builder */
+  PTPGP_ASSERT(
+    ptpgp_packet_index_builder_init(&b, write_cb, fh),
+    "initialize packet index builder"
+  );
+
+  /* read input file */
+  file_read(src_path, read_cb, &b);
+
+  /* finish builder */
+  PTPGP_ASSERT(
+    ptpgp_packet_index_builder_done(&b),
+    "finish packet index builder"
+  );
+
+  /* close output file */
+  if (fclose(fh))
+    ptpgp_sys_die("Couldn't close output file \"%s\":", dst_path);
+
+  printf("%s: %llu packets\n", dst_path, (unsigned long long) b.num_entries);
+}
+
+static void
+print_entry(ptpgp_packet_index_t *index, uint64_t n) {
+  ptpgp_packet_index_entry_t e;
+  char buf[1024];
+
+  /* get entry */
+  PTPGP_ASSERT(
+    ptpgp_packet_index_get(index, n, &e),
+    "get packet index entry %llu", (unsigned long long) n
+  );
+
+  /* get name of content tag */
+  PTPGP_ASSERT(
+    ptpgp_tag_to_s(e.tag, buf, sizeof(buf), NULL),
+    "get tag name %d", e.tag
+  );
+
+  printf(
+    "%llu,%s,%d,%d,%llu,%llu,%llu\n",
+    (unsigned long long) n, buf, e.tag, e.flags,
+    (unsigned long long) e.header_offset,
+    (unsigned long long) e.body_offset,
+    (unsigned long long) e.body_length
+  );
+}
+
+static void
+dump(char *path, char *tag) {
+  ptpgp_packet_index_t index;
+  uint64_t i;
+
+  /* open index */
+  PTPGP_ASSERT(
+    ptpgp_packet_index_open(&index, path),
+    "open packet index \"%s\"", path
+  );
+
+  if (tag) {
+    /* dump entries with matching tag */
+    for (i = 0; ptpgp_packet_index_find_tag(
+                  &index, atoi(tag), i, &i) == PTPGP_OK; i++)
+      print_entry(&index, i);
+  } else {
+    /* dump all entries */
+    for (i = 0; i < index.num_entries; i++)
+      print_entry(&index, i);
+  }
+
+  /* close index */
+  PTPGP_ASSERT(
+    ptpgp_packet_index_close(&index),
+    "close packet index"
+  );
+}
+
+int main(int argc, char *argv[]) {
+  int i;
+
+  /* check for help option */
+  for (i = 1; i < argc; i++)
+    if (IS_HELP(argv[i]))
+      print_usage_and_exit(argv[0], USAGE);
+
+  if (argc > 2 && !strncmp(argv[1], "-d", 3)) {
+    /* dump index */
+    dump(argv[2], (argc > 3) ? argv[3] : NULL);
+  } else if (argc > 2) {
+    /* build index */
+    build(argv[1], argv[2]);
+  } else {
+    print_usage_and_exit(argv[0], USAGE);
+  }
+
+  /* return success */
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,223 @@
+#include <stdio.h>
+#include "test-common.h"
+
+#define USAGE \
+  "Usage: %s [-t threads] [-s tag] [-i index] <input>\n"              \
+  "\n"                                                                \
+  "Parse input on multiple threads and print packet types and\n"      \
+  "lengths in stream order (same format as the stream test).\n"       \
+  "\n"                                                                \
+  "Options:\n"                                                        \
+  "  -t threads  Number of worker threads (default: 4).\n"            \
+  "  -s tag      Only split input before packets with given tag.\n"   \
+  "  -i index    Split input using packet index instead of scanning.\n"
+
+typedef struct {
+  /* packet parser for current packet */
+  ptpgp_packet_parser_t pp;
+
+  /* buffered output */
+  char *out;
+  size_t out_len,
+         out_size;
+
+  /* packet parser token count */
+  uint64_t num_tokens;
+} chunk_data_t;
+
+typedef struct {
+  size_t num_threads;
+  ptpgp_tag_t split_tag;
+  char *index_path;
+
+  /* totals */
+  uint64_t num_chunks,
+           num_tokens;
+} context_t;
+
+static void
+append(chunk_data_t *d, char *s, size_t len) {
+  /* grow output buffer */
+  if (d->out_len + len > d->out_size) {
+    d->out_size = 2 * (d->out_len + len);
+
+    if ((d->out = realloc(d->out, d->out_size)) == NULL)
+      ptpgp_sys_die("Couldn't allocate output buffer:");
+  }
+
+  memcpy(d->out + d->out_len, s, len);
+  d->out_len += len;
+}
+
+static ptpgp_err_t
+packet_cb(ptpgp_packet_parser_t *p,
+          ptpgp_packet_parser_token_t t,
+          ptpgp_packet_t *packet,
+          u8 *data, size_t data_len) {
+  chunk_data_t *d = (chunk_data_t*) p->user_data;
+
+  UNUSED(t);
+  UNUSED(packet);
+  UNUSED(data);
+  UNUSED(data_len);
+
+  /* count tokens */
+  d->num_tokens++;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+static ptpgp_err_t
+stream_cb(ptpgp_stream_parser_t *p,
+          ptpgp_stream_parser_token_t t,
+          ptpgp_packet_header_t *header,
+          u8 *data, size_t data_len) {
+  ptpgp_parallel_parser_chunk_t *c = (ptpgp_parallel_parser_chunk_t*) p->cb_data;
+  chunk_data_t *d = (chunk_data_t*) c->user_data;
+  char buf[1024], line[1100];
+  int len;
+
+  switch (t) {
+  case PTPGP_STREAM_PARSER_TOKEN_START:
+    /* get name of content tag */
+    PTPGP_ASSERT(
+      ptpgp_tag_to_s(header->content_tag, buf, sizeof(buf), NULL),
+      "get tag name %d", header->content_tag
+    );
+
+    /* buffer packet type and length */
+    len = snprintf(line, sizeof(line), "%s,%d,%d\n",
+                   buf, header->content_tag, (int) header->length);
+    append(d, line, len);
+
+    /* initialize packet parser */
+    return ptpgp_packet_parser_init(&(d->pp), header->content_tag, packet_cb, d);
+  case PTPGP_STREAM_PARSER_TOKEN_BODY:
+    return ptpgp_packet_parser_push(&(d->pp), data, data_len);
+  case PTPGP_STREAM_PARSER_TOKEN_END:
+    return ptpgp_packet_parser_done(&(d->pp));
+  default:
+    /* ignore unknown tokens */
+    return PTPGP_OK;
+  }
+}
+
+static ptpgp_err_t
+chunk_cb(ptpgp_parallel_parser_chunk_t *c) {
+  /* allocate chunk data */
+  if ((c->user_data = calloc(1, sizeof(chunk_data_t))) == NULL)
+    ptpgp_sys_die("Couldn't allocate chunk data:");
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+static ptpgp_err_t
+merge_cb(ptpgp_parallel_parser_chunk_t *c) {
+  context_t *ctx = (context_t*) c->parser->user_data;
+  chunk_data_t *d = (chunk_data_t*) c->user_data;
+
+  /* write buffered output */
+  if (d->out_len > 0 && !fwrite(d->out, d->out_len, 1, stdout))
+    ptpgp_sys_die("Couldn't write to standard output:");
+
+  /* update totals */
+  ctx->num_chunks++;
+  ctx->num_tokens += d->num_tokens;
+
+  /* free chunk data */
+  free(d->out);
+  free(d);
+  c->user_data = NULL;
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+static void
+read_cb(u8 *data, size_t data_len, void *user_data) {
+  context_t *ctx = (context_t*) user_data;
+  ptpgp_parallel_parser_t *p;
+  ptpgp_packet_index_t index;
+
+  /* the parser struct is fairly large, so keep it off the stack */
+  if ((p = malloc(sizeof(ptpgp_parallel_parser_t))) == NULL)
+    ptpgp_sys_die("Couldn't allocate parallel parser:");
+
+  /* init parallel parser */
+  PTPGP_ASSERT(
+    ptpgp_parallel_parser_init(
+      p, ctx->num_threads,
+      chunk_cb, stream_cb, merge_cb,
+      ctx
+    ),
+
+    "init parallel parser"
+  );
+
+  if (ctx->index_path) {
+    /* split input using packet index */
+    PTPGP_ASSERT(
+      ptpgp_packet_index_open(&index, ctx->index_path),
+      "open packet index \"%s\"", ctx->index_path
+    );
+
+    PTPGP_ASSERT(
+      ptpgp_parallel_parser_split_index(p, data, data_len, &index, ctx->split_tag),
+      "split input using packet index"
+    );
+
+    PTPGP_ASSERT(ptpgp_packet_index_close(&index), "close packet index");
+  } else {
+    /* split input with pre-scan */
+    PTPGP_ASSERT(
+      ptpgp_parallel_parser_split(p, data, data_len, ctx->split_tag),
+      "split input"
+    );
+  }
+
+  /* parse input */
+  PTPGP_ASSERT(ptpgp_parallel_parser_run(p), "run parallel parser");
+
+  free(p);
+}
+
+int main(int argc, char *argv[]) {
+  context_t ctx;
+  int i;
+
+  memset(&ctx, 0, sizeof(context_t));
+  ctx.num_threads = 4;
+
+  /* check for help option */
+  for (i = 1; i < argc; i++)
+    if (IS_HELP(argv[i]))
+      print_usage_and_exit(argv[0], USAGE);
+
+  /* parse options */
+  for (i = 1; i < argc - 2; i += 2) {
+    if (!strncmp(argv[i], "-t", 3))
+      ctx.num_threads = atoi(argv[i + 1]);
+    else if (!strncmp(argv[i], "-s", 3))
+      ctx.split_tag = atoi(argv[i + 1]);
+    else if (!strncmp(argv[i], "-i", 3))
+      ctx.index_path = argv[i + 1];
+    else
+      break;
+  }
+
+  /* the input must be mapped in one piece */
+  if (i != argc - 1 || !strncmp(argv[i], "-", 2))
+    print_usage_and_exit(argv[0], USAGE);
+
+  /* parse input file */
+  file_read(argv[i], read_cb, &ctx);
+
+  fprintf(stderr, "%s: %llu chunks, %llu packet parser tokens\n", argv[i],
+          (unsigned long long) ctx.num_chunks,
+          (unsigned long long) ctx.num_tokens);
+
+  /* return success */
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,554 @@
+#include "sign-common.h"
+
+/* signed packet body (primary key, user ID, or subkey) */
+typedef struct {
+  u8 data[4096];
+  size_t len;
+} signed_packet_t;
+
+typedef struct {
+  ptpgp_engine_t *engine;
+  char *path;
+
+  ptpgp_stream_parser_t stream;
+  ptpgp_packet_parser_t parser;
+  ptpgp_arena_t arena;
+
+  /* current packet */
+  ptpgp_tag_t tag;
+  uint64_t offset;
+
+  /* primary key and last user ID or subkey (the signed data) */
+  signed_packet_t key, sub;
+  signed_packet_t *dst;
+  ptpgp_tag_t key_tag, sub_tag;
+
+  /* primary key (MPIs are in the arena) */
+  ptpgp_pk_key_t pk;
+  size_t num_key_mpis;
+
+  /* current signature (if it is checked) */
+  bool check_sig;
+  ptpgp_hash_context_t hash;
+  ptpgp_pk_signature_t sig;
+  size_t num_sig_mpis;
+
+  size_t num_verified,
+         num_skipped;
+} keyring_t;
+
+static void
+read_cb(u8 *data, size_t data_len, void *user_data) {
+  ptpgp_hash_context_t *h = (ptpgp_hash_context_t*) user_data;
+
+  /* write file data to hash context */
+  PTPGP_ASSERT(
+    ptpgp_engine_hash_push(h, data, data_len),
+    "write data to hash context"
+  );
+}
+
+static void
+digest(ptpgp_hash_context_t *h,
+       ptpgp_engine_t *engine,
+       ptpgp_hash_type_t algorithm,
+       char *path) {
+  PTPGP_ASSERT(
+    ptpgp_engine_hash_init(h, engine, algorithm),
+    "initialize hash context for \"%s\"", path
+  );
+
+  /* hash input file */
+  file_read(path, read_cb, h);
+}
+
+#define NUM_BATCH_JOBS 1000
+
+static void
+verify_batch(ptpgp_engine_t *engine,
+             ptpgp_pk_key_t *key,
+             ptpgp_pk_signature_t *sig,
+             ptpgp_hash_type_t algorithm,
+             char *path) {
+  ptpgp_pk_verify_job_t jobs[NUM_BATCH_JOBS];
+  ptpgp_hash_context_t good, bad;
+  ptpgp_engine_t other = *engine;
+  ptpgp_err_t expected;
+  size_t i;
+
+  /* shared digests (the bad one is left for the batch to finish) */
+  digest(&good, engine, algorithm, path);
+  PTPGP_ASSERT(ptpgp_engine_hash_done(&good), "finish digest");
+
+  digest(&bad, engine, algorithm, path);
+  PTPGP_ASSERT(ptpgp_engine_hash_push(&bad, (u8*) "x", 1), "hash data");
+
+  /* every third job has a bad digest */
+  for (i = 0; i < NUM_BATCH_JOBS; i++) {
+    jobs[i].digest = (i % 3) ? &good : &bad;
+    jobs[i].key = key;
+    jobs[i].sig = sig;
+    jobs[i].err = PTPGP_ERR_LAST;
+  }
+
+  PTPGP_ASSERT(
+    ptpgp_engine_pk_verify_batch(engine, jobs, NUM_BATCH_JOBS, 4),
+    "batch verify \"%s\"", path
+  );
+
+  /* check results */
+  for (i = 0; i < NUM_BATCH_JOBS; i++) {
+    expected = (i % 3) ? PTPGP_OK : PTPGP_ERR_ENGINE_PK_VERIFY_BAD_SIGNATURE;
+
+    if (jobs[i].err != expected)
+      ptpgp_die(jobs[i].err, "batch verify \"%s\": job %u: unexpected result",
+                path, (unsigned int) i);
+  }
+
+  /* digests of another engine are rejected */
+  PTPGP_ASSERT(
+    ptpgp_engine_pk_verify_batch(&other, jobs, 1, 1),
+    "batch verify \"%s\" with another engine", path
+  );
+
+  if (jobs[0].err != PTPGP_ERR_ENGINE_PK_VERIFY_BATCH_ENGINE_MISMATCH)
+    ptpgp_die(jobs[0].err, "batch verify \"%s\" with another engine: "
+              "unexpected result", path);
+}
+
+static bool
+is_rsa_or_dsa(ptpgp_public_key_type_t algorithm) {
+  return algorithm == PTPGP_PUBLIC_KEY_TYPE_RSA ||
+         algorithm == PTPGP_PUBLIC_KEY_TYPE_DSA;
+}
+
+/* key MPI by packet order (RFC 4880 p, q, u go to q, p, iqmp) */
+static ptpgp_mpi_t *
+key_mpi(ptpgp_pk_key_t *k, size_t i) {
+  ptpgp_mpi_t *rsa[] = {
+    &(k->rsa.n), &(k->rsa.e), &(k->rsa.d),
+    &(k->rsa.q), &(k->rsa.p), &(k->rsa.iqmp)
+  }, *dsa[] = {
+    &(k->dsa.p), &(k->dsa.q), &(k->dsa.g), &(k->dsa.y), &(k->dsa.x)
+  };
+
+  switch (k->algorithm) {
+  case PTPGP_PUBLIC_KEY_TYPE_RSA:
+    return (i < 6) ? rsa[i] : NULL;
+  case PTPGP_PUBLIC_KEY_TYPE_DSA:
+    return (i < 5) ? dsa[i] : NULL;
+  default:
+    return NULL;
+  }
+}
+
+/* signature MPI by packet order */
+static ptpgp_mpi_t *
+sig_mpi(ptpgp_pk_signature_t *s, size_t i) {
+  switch (s->algorithm) {
+  case PTPGP_PUBLIC_KEY_TYPE_RSA:
+    return (i < 1) ? &(s->rsa.s) : NULL;
+  case PTPGP_PUBLIC_KEY_TYPE_DSA:
+    return (i < 2) ? (i ? &(s->dsa.s) : &(s->dsa.r)) : NULL;
+  default:
+    return NULL;
+  }
+}
+
+static void
+hash_signed_packet(keyring_t *k, signed_packet_t *s, bool is_user_id) {
+  u8 h[5];
+  size_t h_len;
+
+  if (is_user_id) {
+    /* user IDs are prefixed with 0xb4 and a four-octet length */
+    h[0] = 0xb4;
+    h[1] = (s->len >> 24) & 0xff;
+    h[2] = (s->len >> 16) & 0xff;
+    h[3] = (s->len >> 8) & 0xff;
+    h[4] = s->len & 0xff;
+    h_len = 5;
+  } else {
+    /* keys are prefixed with 0x99 and a two-octet length */
+    h[0] = 0x99;
+    h[1] = (s->len >> 8) & 0xff;
+    h[2] = s->len & 0xff;
+    h_len = 3;
+  }
+
+  PTPGP_ASSERT(
+    ptpgp_engine_hash_push(&(k->hash), h, h_len),
+    "hash signed packet header"
+  );
+
+  PTPGP_ASSERT(
+    ptpgp_engine_hash_push(&(k->hash), s->data, s->len),
+    "hash signed packet"
+  );
+}
+
+/* start digest of self-signature, or skip signature */
+static void
+start_signature(keyring_t *k, ptpgp_packet_signature_t *sig) {
+  bool check = 0;
+
+  k->check_sig = 0;
+
+  /* (the parser stores the fields of v4 signatures in the v3 fields) */
+  if (sig->version == 4 && k->key_tag == PTPGP_TAG_PUBLIC_KEY &&
+      k->key.len > 0 && is_rsa_or_dsa(k->pk.algorithm) &&
+      sig->versions.v3.public_key_algorithm == k->pk.algorithm) {
+    switch (sig->versions.v3.signature_type) {
+    case 0x10: case 0x11: case 0x12: case 0x13:
+      /* user ID certification */
+      check = k->sub_tag == PTPGP_TAG_USER_ID && k->sub.len > 0;
+      break;
+    case 0x18:
+      /* subkey binding */
+      check = k->sub_tag == PTPGP_TAG_PUBLIC_SUBKEY && k->sub.len > 0;
+      break;
+    case 0x1f:
+      /* direct key signature */
+      check = 1;
+      break;
+    default:
+      break;
+    }
+  }
+
+  if (!check) {
+    k->num_skipped++;
+
+    PTPGP_ASSERT(
+      ptpgp_packet_parser_set_signature_hash(&(k->parser), NULL),
+      "clear signature hash"
+    );
+
+    return;
+  }
+
+  /* hash signed data (the parser adds the signature fields) */
+  PTPGP_ASSERT(
+    ptpgp_engine_hash_init(&(k->hash), k->engine,
+                           sig->versions.v3.hash_algorithm),
+    "init signature hash"
+  );
+
+  hash_signed_packet(k, &(k->key), 0);
+  if (sig->versions.v3.signature_type != 0x1f)
+    hash_signed_packet(k, &(k->sub), k->sub_tag == PTPGP_TAG_USER_ID);
+
+  memset(&(k->sig), 0, sizeof(ptpgp_pk_signature_t));
+  k->sig.algorithm = k->pk.algorithm;
+  k->num_sig_mpis = 0;
+  k->check_sig = 1;
+}
+
+static ptpgp_err_t
+keyring_packet_cb(ptpgp_packet_parser_t *p,
+                  ptpgp_packet_parser_token_t t,
+                  ptpgp_packet_t *packet,
+                  u8 *data,
+                  size_t data_len) {
+  keyring_t *k = (keyring_t*) p->user_data;
+  ptpgp_mpi_t *m;
+
+  UNUSED(data_len);
+
+  switch (t) {
+  case PTPGP_PACKET_PARSER_TOKEN_PACKET_START:
+    if (k->tag == PTPGP_TAG_SIGNATURE)
+      start_signature(k, &(packet->packet.t2));
+
+    break;
+  case PTPGP_PACKET_PARSER_TOKEN_KEY_PACKET_HEADER:
+    /* (secret keys share the public key fields) */
+    if (k->tag == PTPGP_TAG_PUBLIC_KEY || k->tag == PTPGP_TAG_SECRET_KEY)
+      k->pk.algorithm = packet->packet.t6.all.public_key_algorithm;
+
+    break;
+  case PTPGP_PACKET_PARSER_TOKEN_MPI_END:
+    /* save collected MPI */
+    if (k->tag == PTPGP_TAG_PUBLIC_KEY || k->tag == PTPGP_TAG_SECRET_KEY)
+      m = key_mpi(&(k->pk), k->num_key_mpis++);
+    else if (k->tag == PTPGP_TAG_SIGNATURE && k->check_sig)
+      m = sig_mpi(&(k->sig), k->num_sig_mpis++);
+    else
+      m = NULL;
+
+    if (m)
+      *m = *((ptpgp_mpi_t*) data);
+
+    break;
+  case PTPGP_PACKET_PARSER_TOKEN_PACKET_END:
+    if (k->tag != PTPGP_TAG_SIGNATURE || !k->check_sig)
+      break;
+
+    PTPGP_ASSERT(
+      ptpgp_engine_pk_verify(&(k->hash), &(k->pk), &(k->sig)),
+      "verify signature at offset %llu of \"%s\"",
+      (unsigned long long) k->offset, k->path
+    );
+
+    k->num_verified++;
+    k->check_sig = 0;
+
+    break;
+  default:
+    /* ignore other tokens */
+    break;
+  }
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+static ptpgp_err_t
+keyring_stream_cb(ptpgp_stream_parser_t *p,
+                  ptpgp_stream_parser_token_t t,
+                  ptpgp_packet_header_t *header,
+                  u8 *data,
+                  size_t data_len) {
+  keyring_t *k = (keyring_t*) p->cb_data;
+
+  switch (t) {
+  case PTPGP_STREAM_PARSER_TOKEN_START:
+    k->tag = header->content_tag;
+    k->offset = p->header_offset;
+    k->dst = NULL;
+
+    switch (k->tag) {
+    case PTPGP_TAG_PUBLIC_KEY:
+    case PTPGP_TAG_SECRET_KEY:
+      /* start of key */
+      PTPGP_ASSERT(ptpgp_arena_clear(&(k->arena)), "clear arena");
+      memset(&(k->pk), 0, sizeof(ptpgp_pk_key_t));
+      k->num_key_mpis = 0;
+      k->key_tag = k->tag;
+      k->sub.len = 0;
+      k->dst = &(k->key);
+      break;
+    case PTPGP_TAG_USER_ID:
+    case PTPGP_TAG_PUBLIC_SUBKEY:
+      k->sub_tag = k->tag;
+      k->dst = &(k->sub);
+      break;
+    default:
+      break;
+    }
+
+    if (k->dst)
+      k->dst->len = 0;
+
+    PTPGP_ASSERT(
+      ptpgp_packet_parser_init(&(k->parser), k->tag, keyring_packet_cb, k),
+      "init packet parser"
+    );
+
+    PTPGP_ASSERT(
+      ptpgp_packet_parser_set_mpi_arena(&(k->parser), &(k->arena)),
+      "set MPI arena"
+    );
+
+    if (k->tag == PTPGP_TAG_SIGNATURE)
+      PTPGP_ASSERT(
+        ptpgp_packet_parser_set_signature_hash(&(k->parser), &(k->hash)),
+        "set signature hash"
+      );
+
+    break;
+  case PTPGP_STREAM_PARSER_TOKEN_BODY:
+    /* save signed data */
+    if (k->dst) {
+      if (data_len > sizeof(k->dst->data) - k->dst->len)
+        ptpgp_die(0, "packet at offset %llu of \"%s\" is too large",
+                  (unsigned long long) k->offset, k->path);
+
+      memcpy(k->dst->data + k->dst->len, data, data_len);
+      k->dst->len += data_len;
+    }
+
+    return ptpgp_packet_parser_push(&(k->parser), data, data_len);
+  case PTPGP_STREAM_PARSER_TOKEN_END:
+    return ptpgp_packet_parser_done(&(k->parser));
+  default:
+    /* ignore other tokens */
+    break;
+  }
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+static void
+keyring_read_cb(u8 *data, size_t data_len, void *user_data) {
+  keyring_t *k = (keyring_t*) user_data;
+
+  PTPGP_ASSERT(
+    ptpgp_stream_parser_push(&(k->stream), data, data_len),
+    "parse keyring \"%s\"", k->path
+  );
+}
+
+/* parse keyring, verifying self-signatures of public keys */
+static void
+read_keyring(keyring_t *k, ptpgp_engine_t *engine, char *path) {
+  memset(k, 0, sizeof(keyring_t));
+  k->engine = engine;
+  k->path = path;
+
+  PTPGP_ASSERT(ptpgp_arena_init(&(k->arena), 0), "init arena");
+  PTPGP_ASSERT(
+    ptpgp_stream_parser_init(&(k->stream), keyring_stream_cb, k),
+    "init stream parser"
+  );
+
+  file_read(path, keyring_read_cb, k);
+
+  PTPGP_ASSERT(
+    ptpgp_stream_parser_done(&(k->stream)),
+    "finish parsing keyring \"%s\"", path
+  );
+}
+
+static size_t
+signature_bits(ptpgp_pk_signature_t *sig) {
+  if (sig->algorithm == PTPGP_PUBLIC_KEY_TYPE_DSA)
+    return sig->dsa.r.num_bits + sig->dsa.s.num_bits;
+  else
+    return sig->rsa.s.num_bits;
+}
+
+static void
+sign(ptpgp_engine_t *engine,
+     ptpgp_pk_key_t *key,
+     ptpgp_hash_type_t algorithm,
+     char *path) {
+  ptpgp_hash_context_t h;
+  ptpgp_pk_signature_t sig;
+  ptpgp_arena_t arena;
+  ptpgp_err_t err;
+
+  PTPGP_ASSERT(ptpgp_arena_init(&arena, 0), "init arena");
+
+  /* sign file digest */
+  digest(&h, engine, algorithm, path);
+  PTPGP_ASSERT(
+    ptpgp_engine_pk_sign(&h, key, &sig, &arena),
+    "sign \"%s\"", path
+  );
+
+  /* verify signature */
+  digest(&h, engine, algorithm, path);
+  PTPGP_ASSERT(
+    ptpgp_engine_pk_verify(&h, key, &sig),
+    "verify \"%s\"", path
+  );
+
+  /* check that a different digest is rejected */
+  digest(&h, engine, algorithm, path);
+  PTPGP_ASSERT(ptpgp_engine_hash_push(&h, (u8*) "x", 1), "hash data");
+
+  err = ptpgp_engine_pk_verify(&h, key, &sig);
+  if (err != PTPGP_ERR_ENGINE_PK_VERIFY_BAD_SIGNATURE)
+    ptpgp_die(err, "bad signature of \"%s\" not detected", path);
+
+  /* verify signature on a worker pool */
+  verify_batch(engine, key, &sig, algorithm, path);
+
+  printf("%s: ok (%u-bit signature)\n",
+         path, (unsigned int) signature_bits(&sig));
+
+  PTPGP_ASSERT(ptpgp_arena_free(&arena), "free arena");
+}
+
+int
+sign_main(int argc,
+          char *argv[],
+          char *usage,
+          void (*init_engine)(ptpgp_engine_t *)) {
+  ptpgp_engine_t engine;
+  ptpgp_pk_genkey_context_t c;
+  ptpgp_pk_genkey_options_t o;
+  ptpgp_pk_key_t *key = &(c.key);
+  ptpgp_arena_t arena;
+  uint32_t hash_algo;
+  keyring_t k;
+  int i, first = 1;
+
+  /* check command-line argument count */
+  if (argc < 3)
+    print_usage_and_exit(argv[0], usage);
+
+  /* check for help */
+  for (i = 1; i < argc; i++)
+    if (IS_HELP(argv[i]))
+      print_usage_and_exit(argv[0], usage);
+
+  /* init engine */
+  init_engine(&engine);
+
+  if (!strncmp(argv[1], "-k", 3)) {
+    /* verify self-signatures of keyrings */
+    for (i = 2; i < argc; i++) {
+      read_keyring(&k, &engine, argv[i]);
+
+      if (!k.num_verified)
+        ptpgp_die(0, "no self-signatures verified in \"%s\"", argv[i]);
+
+      printf("%s: %u self-signatures ok (%u skipped)\n", argv[i],
+             (unsigned int) k.num_verified, (unsigned int) k.num_skipped);
+
+      PTPGP_ASSERT(ptpgp_arena_free(&(k.arena)), "free arena");
+    }
+
+    /* return success */
+    return EXIT_SUCCESS;
+  }
+
+  if (!strncmp(argv[1], "-s", 3)) {
+    if (argc < 5)
+      print_usage_and_exit(argv[0], usage);
+
+    /* read secret key */
+    read_keyring(&k, &engine, argv[2]);
+
+    if (!((k.pk.algorithm == PTPGP_PUBLIC_KEY_TYPE_RSA && k.pk.rsa.d.data) ||
+          (k.pk.algorithm == PTPGP_PUBLIC_KEY_TYPE_DSA && k.pk.dsa.x.data)))
+      ptpgp_die(0, "no unprotected RSA or DSA secret key in \"%s\"", argv[2]);
+
+    key = &(k.pk);
+    first += 2;
+  }
+
+  /* find hash algorithm */
+  PTPGP_ASSERT(
+    ptpgp_type_find(PTPGP_TYPE_HASH, argv[first], &hash_algo),
+    "find hash algorithm \"%s\"", argv[first]
+  );
+
+  /* generate key (unless one was read) */
+  PTPGP_ASSERT(ptpgp_arena_init(&arena, 0), "init arena");
+
+  memset(&o, 0, sizeof(ptpgp_pk_genkey_options_t));
+  o.engine    = &engine;
+  o.algorithm = PTPGP_PUBLIC_KEY_TYPE_RSA;
+  o.num_bits  = 1024;
+  o.params.rsa.e = 65537;
+  o.arena     = &arena;
+
+  if (key == &(c.key))
+    PTPGP_ASSERT(
+      ptpgp_engine_pk_generate_key(&c, &o),
+      "generate public key"
+    );
+
+  /* sign and verify input files */
+  for (i = first + 1; i < argc; i++)
+    sign(&engine, key, hash_algo, argv[i]);
+
+  PTPGP_ASSERT(ptpgp_arena_free(&arena), "free arena");
+
+  /* return success */
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,11 @@
+#include "test-common.h"
+
+/*
+ * Sign and verify input files, or verify keyring self-signatures (see
+ * gcrypt-sign.c and openssl-sign.c) with the engine set up by
+ * init_engine().
+ */
+int sign_main(int argc,
+              char *argv[],
+              char *usage,
+              void (*init_engine)(ptpgp_engine_t *));
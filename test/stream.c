@@ -1,11 +1,41 @@
 #include "test-common.h"
 
 #define USAGE \
-  "%s - Decode and print PGP packet stream.\n"
+  "Usage: %s [-r] [-k] [-d] [-s tag] [-f tag]... [input...]\n"        \
+  "\n"                                                                \
+  "Decode and print PGP packet stream.\n"                             \
+  "\n"                                                                \
+  "Options:\n"                                                        \
+  "  -r      Skip corrupt input instead of failing.\n"                  \
+  "  -k      Print key fingerprints and key IDs.\n"                     \
+  "  -d      Check key signature digests against their left 16 bits.\n" \
+  "  -s tag  Skip bodies of packets with given tag.\n"                \
+  "  -f tag  Only show packets with given tag (may be repeated).\n"
 
 /* evil globals */
 static ptpgp_packet_parser_t pp;
+static ptpgp_tag_t skip_tag = 0;
+static uint64_t tags = 0;
+static uint64_t resync_tags = 0;
+static bool bad_packet = 0;
 static ptpgp_signature_subpacket_parser_t sspp;
+static ptpgp_engine_t engine;
+static bool fingerprint_keys = 0;
+
+/* signature digests */
+static bool check_digests = 0;
+static ptpgp_hash_context_t sig_hash;
+static bool sig_hash_pending = 0;
+
+/* bodies of the last key and user id or subkey (the signed data) */
+typedef struct {
+  u8 data[8192];
+  size_t len;
+  bool overflow;
+} signed_packet_t;
+
+static signed_packet_t signed_key, signed_sub;
+static signed_packet_t *signed_dst = NULL;
 
 static char *
 algo_to_s(ptpgp_type_t t,
@@ -221,6 +251,138 @@ signature_subpacket_cb(ptpgp_signature_subpacket_parser_t *p,
 #define DUMP_TAG(t, l)
 #endif /* PTPGP_DEBUG */
 
+static void
+print_fingerprint(ptpgp_key_fingerprint_t *fp) {
+  u8 fp_hex[41], key_id[17];
+
+  memset(fp_hex, 0, sizeof(fp_hex));
+  memset(key_id, 0, sizeof(key_id));
+
+  PTPGP_ASSERT(
+    ptpgp_to_hex(fp->fingerprint, fp->fingerprint_len, fp_hex, sizeof(fp_hex)),
+    "convert fingerprint to hex"
+  );
+
+  PTPGP_ASSERT(
+    ptpgp_to_hex(fp->key_id, 8, key_id, sizeof(key_id)),
+    "convert key id to hex"
+  );
+
+  printf("  fingerprint = %s, key_id = 0x%s\n", fp_hex, key_id);
+}
+
+static void
+hash_signed_data(u8 *h, size_t h_len, signed_packet_t *s) {
+  PTPGP_ASSERT(
+    ptpgp_engine_hash_push(&sig_hash, h, h_len),
+    "hash signed packet header"
+  );
+
+  PTPGP_ASSERT(
+    ptpgp_engine_hash_push(&sig_hash, s->data, s->len),
+    "hash signed packet"
+  );
+}
+
+static void
+hash_signed_key(signed_packet_t *k) {
+  u8 h[3] = { 0x99, (k->len >> 8) & 0xff, k->len & 0xff };
+
+  hash_signed_data(h, sizeof(h), k);
+}
+
+static void
+hash_signed_user_id(signed_packet_t *u, int version) {
+  u8 h[5] = {
+    0xb4,
+    (u->len >> 24) & 0xff, (u->len >> 16) & 0xff,
+    (u->len >> 8) & 0xff, u->len & 0xff
+  };
+
+  /* (v3 signatures hash the user id without a header) */
+  hash_signed_data(h, (version == 4) ? sizeof(h) : 0, u);
+}
+
+/* start digest of signature, or skip it if its type isn't handled */
+static ptpgp_err_t
+start_digest(ptpgp_packet_parser_t *p, ptpgp_packet_signature_t *sig) {
+  signed_packet_t *sub = NULL;
+  bool sub_is_key = 0;
+
+  switch (sig->versions.v3.signature_type) {
+  case 0x10: case 0x11: case 0x12: case 0x13: case 0x30:
+    /* user id certification or revocation */
+    sub = &signed_sub;
+    break;
+  case 0x18: case 0x19: case 0x28:
+    /* subkey binding or revocation */
+    sub = &signed_sub;
+    sub_is_key = 1;
+    break;
+  case 0x1f: case 0x20:
+    /* direct key signature or key revocation */
+    break;
+  default:
+    return ptpgp_packet_parser_set_signature_hash(p, NULL);
+  }
+
+  if (!signed_key.len || signed_key.overflow ||
+      (sub && (!sub->len || sub->overflow)) ||
+      ptpgp_engine_hash_init(&sig_hash, &engine,
+                             sig->versions.v3.hash_algorithm) != PTPGP_OK)
+    return ptpgp_packet_parser_set_signature_hash(p, NULL);
+
+  sig_hash_pending = 1;
+
+  /* hash signed data */
+  hash_signed_key(&signed_key);
+  if (sub && sub_is_key)
+    hash_signed_key(sub);
+  else if (sub)
+    hash_signed_user_id(sub, sig->version);
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+/* finish digest and compare it with the left 16 bits */
+static void
+check_digest(u8 *left16) {
+  PTPGP_ASSERT(ptpgp_engine_hash_done(&sig_hash), "finish signature digest");
+  sig_hash_pending = 0;
+
+  if (memcmp(sig_hash.hash, left16, 2))
+    ptpgp_die(PTPGP_ERR_ENGINE_PK_VERIFY_BAD_SIGNATURE,
+              "signature digest doesn't match left 16 bits");
+
+  printf("  signature digest: ok\n");
+}
+
+static ptpgp_err_t
+digest_cb(ptpgp_packet_parser_t *p,
+          ptpgp_packet_parser_token_t t,
+          ptpgp_packet_t *packet,
+          u8 *data) {
+  switch (t) {
+  case PTPGP_PACKET_PARSER_TOKEN_PACKET_START:
+    return start_digest(p, &(packet->packet.t2));
+  case PTPGP_PACKET_PARSER_TOKEN_SIGNATURE_LEFT16:
+    if (sig_hash_pending)
+      check_digest(data);
+    break;
+  case PTPGP_PACKET_PARSER_TOKEN_MPI_START:
+    /* v3 signatures have no left16 token */
+    if (sig_hash_pending)
+      check_digest(packet->packet.t2.versions.v3.left16);
+    break;
+  default:
+    break;
+  }
+
+  /* return success */
+  return PTPGP_OK;
+}
+
 static ptpgp_err_t
 packet_cb(ptpgp_packet_parser_t *p,
           ptpgp_packet_parser_token_t t,
@@ -230,10 +392,19 @@ packet_cb(ptpgp_packet_parser_t *p,
   char buf[1024];
   ptpgp_signature_subpacket_header_t *subpacket_header;
 
-  UNUSED(p);
-
   DUMP_TAG(packet->tag, data_len);
 
+  if (t == PTPGP_PACKET_PARSER_TOKEN_KEY_FINGERPRINT) {
+    print_fingerprint((ptpgp_key_fingerprint_t*) data);
+    return PTPGP_OK;
+  }
+
+  if (check_digests && packet->tag == PTPGP_TAG_SIGNATURE) {
+    ptpgp_err_t err = digest_cb(p, t, packet, data);
+    if (err != PTPGP_OK)
+      return err;
+  }
+
   switch (packet->tag) {
   case PTPGP_TAG_PUBLIC_KEY_ENCRYPTED_SESSION_KEY:
     switch (t) {
@@ -428,6 +599,24 @@ packet_cb(ptpgp_packet_parser_t *p,
   return PTPGP_OK;
 }
 
+static void
+check_packet(ptpgp_stream_parser_t *p,
+             ptpgp_err_t err,
+             char *what) {
+  if (err == PTPGP_OK)
+    return;
+
+  /* errors are fatal unless corrupt input is skipped */
+  if (!resync_tags)
+    ptpgp_die(err, "Couldn't %s", what);
+
+  ptpgp_warn(err, "Couldn't %s (packet at offset %llu)",
+             what, (unsigned long long) p->header_offset);
+
+  /* ignore rest of packet */
+  bad_packet = 1;
+}
+
 static ptpgp_err_t
 stream_cb(ptpgp_stream_parser_t *p,
           ptpgp_stream_parser_token_t t,
@@ -435,8 +624,6 @@ stream_cb(ptpgp_stream_parser_t *p,
           u8 *data, size_t data_len) {
   char buf[1024];
 
-  UNUSED(p);
-
   switch (t) {
   case PTPGP_STREAM_PARSER_TOKEN_START:
     /* skip non-start tokens */
@@ -452,25 +639,88 @@ stream_cb(ptpgp_stream_parser_t *p,
     /* print packet type and length to standard output */
     printf("%s,%d,%d\n", buf, header->content_tag, (int) header->length);
 
+    /* skip packet body */
+    if (header->content_tag == skip_tag)
+      return PTPGP_ERR_STREAM_PARSER_SKIP_BODY;
+
     /* initialize packet parser */
-    PTPGP_ASSERT(
-      ptpgp_packet_parser_init(&pp, header->content_tag, packet_cb, NULL),
-      "initialize packet parser for tag %d", header->content_tag
+    bad_packet = 0;
+    check_packet(
+      p, ptpgp_packet_parser_init(&pp, header->content_tag, packet_cb, NULL),
+      "initialize packet parser"
     );
 
+    /* compute key fingerprints */
+    if (fingerprint_keys)
+      check_packet(
+        p, ptpgp_packet_parser_set_key_fingerprint(&pp, &engine, header->length),
+        "set key fingerprint"
+      );
+
+    /* save signed data and hash signatures */
+    if (check_digests) {
+      switch (header->content_tag) {
+      case PTPGP_TAG_PUBLIC_KEY:
+        signed_dst = &signed_key;
+        signed_sub.len = 0;
+        break;
+      case PTPGP_TAG_USER_ID:
+      case PTPGP_TAG_PUBLIC_SUBKEY:
+        signed_dst = &signed_sub;
+        break;
+      case PTPGP_TAG_SIGNATURE:
+        signed_dst = NULL;
+        check_packet(
+          p, ptpgp_packet_parser_set_signature_hash(&pp, &sig_hash),
+          "set signature hash"
+        );
+        break;
+      default:
+        signed_dst = NULL;
+      }
+
+      if (signed_dst) {
+        signed_dst->len = 0;
+        signed_dst->overflow = 0;
+      }
+    }
+
     break;
   case PTPGP_STREAM_PARSER_TOKEN_BODY:
-    PTPGP_ASSERT(
-      ptpgp_packet_parser_push(&pp, data, data_len),
-      "push data to packet parser"
-    );
+    if (signed_dst) {
+      if (data_len > sizeof(signed_dst->data) - signed_dst->len) {
+        signed_dst->overflow = 1;
+      } else {
+        memcpy(signed_dst->data + signed_dst->len, data, data_len);
+        signed_dst->len += data_len;
+      }
+    }
+
+    if (!bad_packet)
+      check_packet(
+        p, ptpgp_packet_parser_push(&pp, data, data_len),
+        "push data to packet parser"
+      );
 
     break;
   case PTPGP_STREAM_PARSER_TOKEN_END:
-    PTPGP_ASSERT(
-      ptpgp_packet_parser_done(&pp),
-      "finalize packet parser"
-    );
+    /* skipped packets have no packet parser */
+    if (p->skip_body || bad_packet)
+      return PTPGP_OK;
+
+    check_packet(p, ptpgp_packet_parser_done(&pp), "finalize packet parser");
+
+    /* release digest of unfinished signature */
+    if (sig_hash_pending) {
+      ptpgp_engine_hash_done(&sig_hash);
+      sig_hash_pending = 0;
+    }
+
+    break;
+  case PTPGP_STREAM_PARSER_TOKEN_CORRUPT:
+    /* print offset and size of corrupt octets */
+    printf("corrupt,%llu,%d\n",
+           (unsigned long long) p->offset, (int) data_len);
 
     break;
   default:
@@ -482,48 +732,86 @@ stream_cb(ptpgp_stream_parser_t *p,
   return PTPGP_OK;
 }
 
-static void
-read_cb(u8 *data, size_t data_len, void *user_data) {
-  ptpgp_stream_parser_t *p = (ptpgp_stream_parser_t*) user_data;
-
-  /* write file data to parser */
-  PTPGP_ASSERT(
-    ptpgp_stream_parser_push(p, data, data_len),
-    "write data to parser"
-  );
-}
-
 static void
 dump(char *path) {
   ptpgp_stream_parser_t p;
+  ptpgp_source_t src;
 
   /* init ptpgp stream parser */
   PTPGP_ASSERT(
-    ptpgp_stream_parser_init(&p, stream_cb, NULL),
+    ptpgp_stream_parser_init_tags(
+      &p, tags ? tags : PTPGP_TAG_MASK_ALL,
+      stream_cb, NULL
+    ),
+
     "initialize stream parser for \"%s\"", path
   );
 
-  /* read input file */
-  file_read(path, read_cb, &p);
+  PTPGP_ASSERT(
+    ptpgp_stream_parser_set_resync(&p, resync_tags),
+    "set stream parser resync mode"
+  );
+
+  /* open input file */
+  PTPGP_ASSERT(
+    ptpgp_source_init_file(&src, path),
+    "open input file \"%s\"", path
+  );
+
+  /* read input file (skipped bodies are never read) */
+  PTPGP_ASSERT(
+    ptpgp_source_push_stream_parser(&src, &p),
+    "write data to parser"
+  );
 
   /* finish parser */
   PTPGP_ASSERT(
     ptpgp_stream_parser_done(&p),
     "close stream parser"
   );
+
+  /* close input file */
+  PTPGP_ASSERT(
+    ptpgp_source_close(&src),
+    "close input file \"%s\"", path
+  );
 }
 
 int main(int argc, char *argv[]) {
-  if (argc > 1) {
-    int i;
+  int i, first = 1;
+
+  /* parse options */
+  while (argc > first) {
+    if (!strncmp(argv[first], "-r", 3)) {
+      resync_tags = PTPGP_TAG_MASK_ALL;
+      first++;
+    } else if (!strncmp(argv[first], "-k", 3)) {
+      init_gcrypt(&engine);
+      fingerprint_keys = 1;
+      first++;
+    } else if (!strncmp(argv[first], "-d", 3)) {
+      init_gcrypt(&engine);
+      check_digests = 1;
+      first++;
+    } else if (argc > first + 1 && !strncmp(argv[first], "-s", 3)) {
+      skip_tag = atoi(argv[first + 1]);
+      first += 2;
+    } else if (argc > first + 1 && !strncmp(argv[first], "-f", 3)) {
+      tags |= PTPGP_TAG_MASK(atoi(argv[first + 1]) & 0x3f);
+      first += 2;
+    } else {
+      break;
+    }
+  }
 
+  if (argc > first) {
     /* check for help option */
-    for (i = 1; i < argc; i++)
+    for (i = first; i < argc; i++)
       if (IS_HELP(argv[i]))
         print_usage_and_exit(argv[0], USAGE);
 
     /* dump each input file */
-    for (i = 1; i < argc; i++)
+    for (i = first; i < argc; i++)
       dump(argv[i]);
   } else {
     /* read from standard input */
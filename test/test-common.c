@@ -1,13 +1,5 @@
-#define _BSD_SOURCE     /* for madvise() */
-#define _POSIX_SOURCE   /* for fileno() */
-
-#include <sys/types.h>  /* for fstat() */
-#include <sys/stat.h>   /* for fstat() */
-#include <sys/mman.h>   /* for mmap() */
-
 #include <stdio.h>
 #include <stdlib.h>
-#include <unistd.h>
 
 #include "test-common.h"
 
@@ -17,99 +9,92 @@ print_usage_and_exit(char *app, char *fmt) {
   exit(EXIT_SUCCESS);
 }
 
-static FILE *
-file_open(char *path) {
-  FILE *r;
-
-  if (!strncmp(path, "-", 2)) {
-    r = stdin;
-  } else {
-    /* open input file */
-    if ((r = fopen(path, "rb")) == NULL)
-      ptpgp_sys_die("Couldn't open input file \"%s\":", path);
-  }
-
-  /* return result */
-  return r;
-}
+void file_read(char *path,
+               void (*cb)(u8 *, size_t, void *),
+               void *user_data) {
+  ptpgp_source_t src;
+  u8 *buf;
+  size_t len;
 
-static size_t
-file_size(FILE *fh) {
-  struct stat st;
+  /* open input file (mapped if possible) */
+  PTPGP_ASSERT(
+    ptpgp_source_init_file(&src, path),
+    "open input file \"%s\"", path
+  );
 
-  if (fstat(fileno(fh), &st))
-      ptpgp_sys_die("Couldn't stat() input file:");
+  /* pass mapped files to the callback in one piece */
+  PTPGP_ASSERT(
+    ptpgp_source_set_readahead(&src, 0),
+    "set source readahead"
+  );
 
-  return st.st_size;
-}
+  /* read input file */
+  while (1) {
+    PTPGP_ASSERT(
+      ptpgp_source_next(&src, &buf, &len),
+      "read input file \"%s\"", path
+    );
 
-static void
-file_close(FILE *fh) {
-  if (fh != stdin && fclose(fh))
-    ptpgp_sys_warn("Couldn't close file:");
-}
+    if (!len)
+      break;
 
-typedef struct {
-  void *addr;
-  size_t size;
-} file_map_t;
-
-static bool
-file_map(FILE *fh, file_map_t *r) {
-  /* check for stdin */
-  if (fh == stdin) {
-    W("can't mmap() stdin");
-    return 0;
+    cb(buf, len, user_data);
   }
 
-  /* get file size */
-  r->size = file_size(fh);
-
-  /* map file */
-  r->addr = mmap(NULL, r->size, PROT_READ, MAP_SHARED, fileno(fh), 0);
+  /* close input file */
+  PTPGP_ASSERT(ptpgp_source_close(&src), "close input file");
+}
 
-  if (r->addr == NULL) {
-    ptpgp_sys_warn("mmap() failed:");
-    return 0;
-  }
+void
+buffer_append(buffer_t *b, u8 *data, size_t data_len) {
+  if ((b->data = realloc(b->data, b->data_len + data_len)) == NULL)
+    ptpgp_sys_die("Couldn't allocate buffer:");
 
-  if (madvise(r->addr, r->size, MADV_SEQUENTIAL | MADV_WILLNEED))
-    ptpgp_sys_warn("madvise() failed:");
+  memcpy(b->data + b->data_len, data, data_len);
+  b->data_len += data_len;
+}
 
-  /* return success */
-  return 1;
+void
+buffer_append_cb(u8 *data, size_t data_len, void *user_data) {
+  buffer_append((buffer_t*) user_data, data, data_len);
 }
 
 static void
-file_unmap(file_map_t *r) {
-  if (munmap(r->addr, r->size))
-    ptpgp_sys_warn("munmap() failed:");
+check_index_load(buffer_t *b,
+                 ptpgp_err_t (*load)(u8 *, size_t),
+                 size_t len,
+                 ptpgp_err_t expected,
+                 char *what) {
+  ptpgp_err_t err;
+
+  if ((err = load(b->data, len)) != expected)
+    ptpgp_die(err, "%s: unexpected result", what);
 }
 
-void file_read(char *path,
-               void (*cb)(u8 *, size_t, void *),
-               void *user_data) {
-  FILE *fh;
-  size_t len = 0;
-  file_map_t m;
-  u8 buf[1024];
-
-  /* open input file */
-  fh = file_open(path);
-
-  /* try to mmap() the file first */
-  if (file_map(fh, &m)) {
-    /* read input file */
-    cb(m.addr, m.size, user_data);
-    file_unmap(&m);
-  } else {
-    /* if mmap() failed, then read input file sequentially */
-    while (!feof(fh) && (len = fread(buf, 1, sizeof(buf), fh)) > 0)
-      cb(buf, len, user_data);
-  }
-
-  /* close input file */
-  file_close(fh);
+void
+check_index_header(buffer_t *b,
+                   ptpgp_err_t (*load)(u8 *, size_t),
+                   size_t count_offset,
+                   ptpgp_err_t bad_header,
+                   ptpgp_err_t bad_version) {
+  size_t i;
+
+  /* truncated index */
+  for (i = 0; i < b->data_len; i++)
+    check_index_load(b, load, i, bad_header, "truncated index");
+
+  /* corrupt headers */
+  b->data[0] ^= 1;
+  check_index_load(b, load, b->data_len, bad_header, "bad magic");
+  b->data[0] ^= 1;
+
+  b->data[11] ^= 1;
+  check_index_load(b, load, b->data_len, bad_version, "bad version");
+  b->data[11] ^= 1;
+
+  b->data[count_offset] ^= 0xff;
+  check_index_load(b, load, b->data_len, bad_header, "bad entry count");
+  b->data[count_offset] ^= 0xff;
 }
 
 void 
@@ -22,5 +22,27 @@
 void print_usage_and_exit(char *app, char *fmt);
 void file_read(char *path, void (*)(u8 *, size_t, void *), void *);
 
+/* growable in-memory buffer (zero-initialize before use) */
+typedef struct {
+  u8 *data;
+  size_t data_len;
+} buffer_t;
+
+void buffer_append(buffer_t *b, u8 *data, size_t data_len);
+
+/* file_read() callback which appends file data to a buffer_t */
+void buffer_append_cb(u8 *data, size_t data_len, void *user_data);
+
+/*
+ * Check that load() rejects an index file in b which is truncated or
+ * has a corrupt magic (offset 0), version (offset 11), or entry count
+ * (count_offset).  The buffer is left unchanged.
+ */
+void check_index_header(buffer_t *b,
+                        ptpgp_err_t (*load)(u8 *, size_t),
+                        size_t count_offset,
+                        ptpgp_err_t bad_header,
+                        ptpgp_err_t bad_version);
+
 void init_gcrypt(ptpgp_engine_t *engine);
 void init_openssl(ptpgp_engine_t *engine);
@@ -1,13 +1,40 @@
 #include "test-common.h"
 
 #define USAGE \
-  "%s - Test PTPGP URI parser.\n"
+  "%s - Test PTPGP URI parser.\n"                                     \
+  "(-t: check the parser against the built-in test cases)\n"
+
+/* uris and expected tokens (for -t) */
+static const struct {
+  char *uri, *expected;
+} tests[] = {
+  { "hkp://keys.example.com:11371/pks/lookup?op=get&search=0x1234#frag",
+    "scheme: hkp|host: keys.example.com|port: 11371|path: /pks/lookup|"
+    "query: op=get&search=0x1234|fragment: frag|" },
+  { "http://user@example.com/a/b?c",
+    "scheme: http|auth: user|host: example.com|path: /a/b|query: c|" },
+
+  /* origin-form request targets */
+  { "/pks/lookup?op=get&search=0x1234",
+    "path: /pks/lookup|query: op=get&search=0x1234|" },
+  { "/pks/lookup", "path: /pks/lookup|" },
+  { "/?op=stats", "path: /|query: op=stats|" },
+  { "/x?q#f", "path: /x|query: q|fragment: f|" },
+
+  /* sentinel */
+  { NULL, NULL }
+};
+
+typedef struct {
+  char buf[1024];
+  size_t len;
+} output_t;
 
 static ptpgp_err_t
 parser_cb(ptpgp_uri_parser_t *p,
           ptpgp_uri_parser_token_t t,
           u8 *data, size_t data_len) {
-  FILE *fh = (FILE*) p->user_data;
+  output_t *o = (output_t*) p->user_data;
   char *key;
 
   switch (t) {
@@ -36,16 +63,25 @@ parser_cb(ptpgp_uri_parser_t *p,
     key = NULL;
   }
     
-  if (key) {
+  if (key && o) {
+    /* append token to output */
+    o->len += snprintf(
+      o->buf + o->len, sizeof(o->buf) - o->len,
+      "%s: %.*s|", key, (int) data_len, data
+    );
+
+    if (o->len >= sizeof(o->buf))
+      ptpgp_sys_die("test output too long");
+  } else if (key) {
     /* write key */
-    fprintf(fh, "%s: ", key);
+    printf("%s: ", key);
 
     /* write data */
-    if (!fwrite(data, data_len, 1, fh))
+    if (!fwrite(data, data_len, 1, stdout))
       ptpgp_sys_die("Couldn't write %s to output", key);
 
     /* end line */
-    fprintf(fh, "\n");
+    printf("\n");
   }
 
   /* return success */
@@ -53,26 +89,52 @@ parser_cb(ptpgp_uri_parser_t *p,
 }
 
 static void 
-dump(char *uri) {
+parse(char *uri, size_t chunk_size, output_t *o) {
   ptpgp_uri_parser_t p;
-  size_t len = strlen(uri);
+  size_t i, len = strlen(uri);
 
   PTPGP_ASSERT(
-    ptpgp_uri_parser_init(&p, parser_cb, stdout),
+    ptpgp_uri_parser_init(&p, parser_cb, o),
     "init uri parser context"
   );
 
-  PTPGP_ASSERT(
-    ptpgp_uri_parser_push(&p, (u8*) uri, len),
-    "push command-line argument"
-  );
-  
+  for (i = 0; i < len; i += chunk_size) {
+    PTPGP_ASSERT(
+      ptpgp_uri_parser_push(
+        &p, (u8*) uri + i,
+        (len - i < chunk_size) ? len - i : chunk_size
+      ),
+      "push uri \"%s\"", uri
+    );
+  }
+
   PTPGP_ASSERT(
     ptpgp_uri_parser_done(&p),
     "finish uri parser context"
   );
 }
 
+static void
+run_tests(void) {
+  output_t o;
+  size_t i, j, sizes[] = { 1, 3, 4096 };
+
+  for (i = 0; tests[i].uri; i++) {
+    for (j = 0; j < sizeof(sizes) / sizeof(size_t); j++) {
+      memset(&o, 0, sizeof(output_t));
+      parse(tests[i].uri, sizes[j], &o);
+
+      if (strcmp(o.buf, tests[i].expected))
+        ptpgp_sys_die(
+          "\"%s\" (chunk size %u): expected \"%s\", got \"%s\"",
+          tests[i].uri, (unsigned int) sizes[j], tests[i].expected, o.buf
+        );
+    }
+
+    printf("%s: ok\n", tests[i].uri);
+  }
+}
+
 int main(int argc, char *argv[]) {
   if (argc > 1) {
     int i;
@@ -82,9 +144,14 @@ int main(int argc, char *argv[]) {
       if (IS_HELP(argv[i]))
         print_usage_and_exit(argv[0], USAGE);
 
+    if (!strncmp(argv[1], "-t", 3)) {
+      run_tests();
+      return EXIT_SUCCESS;
+    }
+
     /* decode each uri */
     for (i = 1; i < argc; i++)
-      dump(argv[i]);
+      parse(argv[i], strlen(argv[i]) + 1, NULL);
   }
   
   /* return success */
@@ -0,0 +1,505 @@
+#include <stdio.h>
+#include <ctype.h>
+#include "test-common.h"
+
+#define USAGE \
+  "Usage:\n"                                                          \
+  "  %1$s <input> <index>          - Build user ID index of input\n"  \
+  "                                  file.\n"                         \
+  "  %1$s -f <index> <query>...    - Find user IDs containing query.\n"\
+  "  %1$s -e <index> <query>...    - Find user IDs equal to query.\n"\
+  "  %1$s -c <index> [query]...     - Check find results against a\n"  \
+  "                                  scan of all user IDs (queries\n"  \
+  "                                  default to parts of indexed\n"   \
+  "                                  user IDs).\n"                    \
+  "  %1$s -a <old index> <offset> <input> <index>\n"                 \
+  "                                - Build user ID index of old\n"   \
+  "                                  index and input file (keys at\n"\
+  "                                  offset in keyring).\n"           \
+  "  %1$s -t <data dir>             - Check ECC and secret keyrings,\n"\
+  "                                  appends, and truncated and\n"   \
+  "                                  corrupt indexes (fixtures from\n"\
+  "                                  test/data).\n"
+
+/* number of indexed user IDs used as default queries (-c) */
+#define NUM_CHECK_USER_IDS 16
+
+static ptpgp_err_t
+write_cb(ptpgp_user_id_index_builder_t *b,
+         u8 *data, size_t data_len) {
+  FILE *fh = (FILE*) b->user_data;
+
+  /* write index data to output file */
+  if (fwrite(data, 1, data_len, fh) != data_len)
+    ptpgp_sys_die("Couldn't write user ID index:");
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+static void
+read_cb(u8 *data, size_t data_len, void *user_data) {
+  ptpgp_user_id_index_builder_t *b = (ptpgp_user_id_index_builder_t*) user_data;
+
+  /* write file data to builder */
+  PTPGP_ASSERT(
+    ptpgp_user_id_index_builder_push(b, data, data_len),
+    "write data to user ID index builder"
+  );
+}
+
+static void
+build(char *old_path, uint64_t offset, char *src_path, char *dst_path) {
+  ptpgp_user_id_index_builder_t b;
+  ptpgp_user_id_index_t index;
+  FILE *fh;
+
+  /* open output file */
+  if ((fh = fopen(dst_path, "wb")) == NULL)
+    ptpgp_sys_die("Couldn't open output file \"%s\":", dst_path);
+
+  /* init user ID index builder */
+  PTPGP_ASSERT(
+    ptpgp_user_id_index_builder_init(&b, write_cb, fh),
+    "initialize user ID index builder"
+  );
+
+  if (old_path) {
+    /* open old index */
+    PTPGP_ASSERT(
+      ptpgp_user_id_index_open(&index, old_path),
+      "open user ID index \"%s\"", old_path
+    );
+
+    /* start with entries of old index */
+    PTPGP_ASSERT(
+      ptpgp_user_id_index_builder_append(&b, &index, offset),
+      "append to user ID index \"%s\"", old_path
+    );
+
+    /* close old index */
+    PTPGP_ASSERT(
+      ptpgp_user_id_index_close(&index),
+      "close user ID index"
+    );
+  }
+
+  /* read input file */
+  file_read(src_path, read_cb, &b);
+
+  /* finish builder */
+  PTPGP_ASSERT(
+    ptpgp_user_id_index_builder_done(&b),
+    "finish user ID index builder"
+  );
+
+  /* close output file */
+  if (fclose(fh))
+    ptpgp_sys_die("Couldn't close output file \"%s\":", dst_path);
+
+  printf(
+    "%s: %llu user IDs, %llu postings, %llu skipped\n", dst_path,
+    (unsigned long long) b.num_user_ids,
+    (unsigned long long) b.num_postings,
+    (unsigned long long) b.num_skipped_user_ids
+  );
+}
+
+static void
+find(char *path, bool exact, char **queries, int num_queries) {
+  ptpgp_user_id_index_entry_t e;
+  ptpgp_user_id_index_t index;
+  ptpgp_err_t err;
+  uint64_t iter;
+  int i;
+
+  /* open index */
+  PTPGP_ASSERT(
+    ptpgp_user_id_index_open(&index, path),
+    "open user ID index \"%s\"", path
+  );
+
+  for (i = 0; i < num_queries; i++) {
+    /* print all matching entries */
+    for (iter = 0; (err = ptpgp_user_id_index_find(
+                      &index, (u8*) queries[i], strlen(queries[i]),
+                      exact, &iter, &e)) == PTPGP_OK;)
+      printf(
+        "%s,%llu,%llu,\"%.*s\"\n", queries[i],
+        (unsigned long long) e.num, (unsigned long long) e.key_offset,
+        (int) e.user_id_len, e.user_id
+      );
+
+    if (err != PTPGP_ERR_USER_ID_INDEX_NOT_FOUND)
+      PTPGP_ASSERT(err, "find user ID \"%s\"", queries[i]);
+  }
+
+  /* close index */
+  PTPGP_ASSERT(
+    ptpgp_user_id_index_close(&index),
+    "close user ID index"
+  );
+}
+
+static bool
+scan_matches(ptpgp_user_id_index_entry_t *e,
+             u8 *query,
+             size_t query_len,
+             bool exact) {
+  size_t i, j;
+
+  if (exact && e->user_id_len != query_len)
+    return 0;
+
+  for (i = 0; i + query_len <= e->user_id_len; i++) {
+    for (j = 0; j < query_len; j++)
+      if (tolower(e->user_id[i + j]) != tolower(query[j]))
+        break;
+
+    if (j == query_len)
+      return 1;
+  }
+
+  /* no match */
+  return 0;
+}
+
+static uint64_t
+check_query(ptpgp_user_id_index_t *index,
+            u8 *query,
+            size_t query_len,
+            bool exact) {
+  ptpgp_user_id_index_entry_t e, s;
+  ptpgp_err_t err;
+  uint64_t iter = 0, num = 0, n = 0;
+
+  while ((err = ptpgp_user_id_index_find(index, query, query_len,
+                                         exact, &iter, &e)) == PTPGP_OK) {
+    /* find next match in scan */
+    for (; n < index->num_user_ids; n++) {
+      PTPGP_ASSERT(
+        ptpgp_user_id_index_get(index, n, &s),
+        "get user ID %llu", (unsigned long long) n
+      );
+
+      if (scan_matches(&s, query, query_len, exact))
+        break;
+    }
+
+    if (n != e.num)
+      ptpgp_sys_die(
+        "\"%.*s\"%s: find returned user ID %llu, scan expected %llu",
+        (int) query_len, query, exact ? " (exact)" : "",
+        (unsigned long long) e.num, (unsigned long long) n
+      );
+
+    n++;
+    num++;
+  }
+
+  if (err != PTPGP_ERR_USER_ID_INDEX_NOT_FOUND)
+    PTPGP_ASSERT(err, "find user ID \"%.*s\"", (int) query_len, query);
+
+  /* check for matches missed by find */
+  for (; n < index->num_user_ids; n++) {
+    PTPGP_ASSERT(
+      ptpgp_user_id_index_get(index, n, &s),
+      "get user ID %llu", (unsigned long long) n
+    );
+
+    if (scan_matches(&s, query, query_len, exact))
+      ptpgp_sys_die(
+        "\"%.*s\"%s: find missed user ID %llu",
+        (int) query_len, query, exact ? " (exact)" : "",
+        (unsigned long long) n
+      );
+  }
+
+  /* return number of matches */
+  return num;
+}
+
+static void
+check(char *path, char **queries, int num_queries) {
+  ptpgp_user_id_index_entry_t e;
+  ptpgp_user_id_index_t index;
+  uint64_t n, num_matches = 0, num_checked = 0;
+  u8 buf[PTPGP_USER_ID_INDEX_MAX_USER_ID_SIZE];
+  size_t len;
+  int i;
+
+  /* open index */
+  PTPGP_ASSERT(
+    ptpgp_user_id_index_open(&index, path),
+    "open user ID index \"%s\"", path
+  );
+
+  for (i = 0; i < num_queries; i++) {
+    len = strlen(queries[i]);
+    num_matches += check_query(&index, (u8*) queries[i], len, 0);
+    num_matches += check_query(&index, (u8*) queries[i], len, 1);
+    num_checked += 2;
+  }
+
+  for (n = 0; !num_queries && n < index.num_user_ids &&
+              n < NUM_CHECK_USER_IDS; n++) {
+    PTPGP_ASSERT(
+      ptpgp_user_id_index_get(&index, n, &e),
+      "get user ID %llu", (unsigned long long) n
+    );
+
+    /* copy user ID (whole, upper case) */
+    for (len = 0; len < e.user_id_len; len++)
+      buf[len] = toupper(e.user_id[len]);
+
+    /* whole user ID, both ways */
+    num_matches += check_query(&index, buf, len, 0);
+    num_matches += check_query(&index, buf, len, 1);
+
+    /* middle half of user ID (several trigrams, cut across tokens) */
+    num_matches += check_query(&index, buf + len / 4, len / 2, 0);
+
+    /* one trigram, and no trigrams */
+    num_matches += check_query(&index, buf + len / 2, (len > 3) ? 3 : len, 0);
+    num_matches += check_query(&index, buf + len / 2, (len > 2) ? 2 : len, 0);
+    num_checked += 5;
+  }
+
+  printf(
+    "%s: %llu queries ok (%llu matches)\n", path,
+    (unsigned long long) num_checked, (unsigned long long) num_matches
+  );
+
+  /* close index */
+  PTPGP_ASSERT(
+    ptpgp_user_id_index_close(&index),
+    "close user ID index"
+  );
+}
+
+static ptpgp_err_t
+buffer_write_cb(ptpgp_user_id_index_builder_t *b,
+                u8 *data, size_t data_len) {
+  buffer_append((buffer_t*) b->user_data, data, data_len);
+
+  /* return success */
+  return PTPGP_OK;
+}
+
+static void
+read_fixture(char *dir, char *name, buffer_t *b) {
+  char path[1024];
+
+  snprintf(path, sizeof(path), "%s/%s", dir, name);
+  file_read(path, buffer_append_cb, b);
+}
+
+/*
+ * build index of keyring in memory (appending to old index if given),
+ * and check its counts
+ */
+static void
+build_buffer(buffer_t *keyring,
+             ptpgp_user_id_index_t *old,
+             uint64_t offset,
+             uint64_t num_user_ids,
+             uint64_t num_skipped,
+             buffer_t *index) {
+  ptpgp_user_id_index_builder_t b;
+
+  memset(index, 0, sizeof(buffer_t));
+
+  PTPGP_ASSERT(
+    ptpgp_user_id_index_builder_init(&b, buffer_write_cb, index),
+    "initialize user ID index builder"
+  );
+
+  if (old)
+    PTPGP_ASSERT(
+      ptpgp_user_id_index_builder_append(&b, old, offset),
+      "append to user ID index"
+    );
+
+  PTPGP_ASSERT(
+    ptpgp_user_id_index_builder_push(&b, keyring->data, keyring->data_len),
+    "write data to user ID index builder"
+  );
+
+  PTPGP_ASSERT(
+    ptpgp_user_id_index_builder_done(&b),
+    "finish user ID index builder"
+  );
+
+  if (b.num_user_ids != num_user_ids || b.num_skipped_user_ids != num_skipped)
+    ptpgp_die(0, "got %llu user IDs, %llu skipped (expected %llu, %llu)",
+              (unsigned long long) b.num_user_ids,
+              (unsigned long long) b.num_skipped_user_ids,
+              (unsigned long long) num_user_ids,
+              (unsigned long long) num_skipped);
+}
+
+/* find query, and check the key offset of the only match */
+static void
+check_find(ptpgp_user_id_index_t *index, char *query, uint64_t key_offset) {
+  ptpgp_user_id_index_entry_t e;
+  uint64_t iter = 0;
+
+  PTPGP_ASSERT(
+    ptpgp_user_id_index_find(index, (u8*) query, strlen(query), 0, &iter, &e),
+    "find user ID \"%s\"", query
+  );
+
+  if (e.key_offset != key_offset)
+    ptpgp_die(0, "\"%s\": key offset %llu (expected %llu)", query,
+              (unsigned long long) e.key_offset,
+              (unsigned long long) key_offset);
+
+  if (ptpgp_user_id_index_find(index, (u8*) query, strlen(query), 0,
+                               &iter, &e) != PTPGP_ERR_USER_ID_INDEX_NOT_FOUND)
+    ptpgp_die(0, "\"%s\": more than one match", query);
+}
+
+static void
+check_not_found(ptpgp_user_id_index_t *index, char *query) {
+  ptpgp_user_id_index_entry_t e;
+  uint64_t iter = 0;
+
+  if (ptpgp_user_id_index_find(index, (u8*) query, strlen(query), 0,
+                               &iter, &e) != PTPGP_ERR_USER_ID_INDEX_NOT_FOUND)
+    ptpgp_die(0, "\"%s\": unexpected match", query);
+}
+
+/* load index (see check_index_header()) */
+static ptpgp_err_t
+load(u8 *data, size_t data_len) {
+  ptpgp_user_id_index_t index;
+  return ptpgp_user_id_index_load(&index, data, data_len);
+}
+
+static void
+test(char *dir) {
+  ptpgp_user_id_index_builder_t builder;
+  ptpgp_user_id_index_entry_t e;
+  ptpgp_user_id_index_t index;
+  buffer_t ecc, mixed, secret, both, a, b, c;
+  ptpgp_err_t err;
+  uint64_t iter = 0;
+
+  memset(&ecc, 0, sizeof(buffer_t));
+  memset(&mixed, 0, sizeof(buffer_t));
+  memset(&secret, 0, sizeof(buffer_t));
+  memset(&both, 0, sizeof(buffer_t));
+
+  read_fixture(dir, "ecc-public_key.pgp", &ecc);
+  read_fixture(dir, "mixed-secret_key.pgp", &mixed);
+  read_fixture(dir, "plaintext-secret_key.pgp", &secret);
+
+  /* ECC key */
+  build_buffer(&ecc, NULL, 0, 1, 0, &a);
+  PTPGP_ASSERT(ptpgp_user_id_index_load(&index, a.data, a.data_len), "load index");
+  check_find(&index, "Test ECC", 0);
+  printf("ecc key: ok\n");
+
+  /* secret keyring (user IDs of secret keys aren't indexed) */
+  build_buffer(&secret, NULL, 0, 0, 1, &b);
+  free(b.data);
+
+  /* public keys mixed with secret keys and subkeys */
+  build_buffer(&mixed, NULL, 0, 2, 1, &b);
+  PTPGP_ASSERT(ptpgp_user_id_index_load(&index, b.data, b.data_len), "load index");
+  check_find(&index, "alice@example.com", 0);
+  check_not_found(&index, "secret@example.com");
+  free(b.data);
+  printf("secret keyrings: ok\n");
+
+  /* appending to an index matches building the whole keyring */
+  buffer_append(&both, ecc.data, ecc.data_len);
+  buffer_append(&both, mixed.data, mixed.data_len);
+  build_buffer(&both, NULL, 0, 3, 1, &b);
+
+  PTPGP_ASSERT(ptpgp_user_id_index_load(&index, a.data, a.data_len), "load index");
+  build_buffer(&mixed, &index, ecc.data_len, 3, 1, &c);
+
+  if (b.data_len != c.data_len || memcmp(b.data, c.data, b.data_len))
+    ptpgp_die(0, "appended index doesn't match index of whole keyring");
+
+  /* (key offsets of appended keys are keyring offsets) */
+  PTPGP_ASSERT(ptpgp_user_id_index_load(&index, c.data, c.data_len), "load index");
+  check_find(&index, "alice@example.com", ecc.data_len);
+  free(b.data);
+  free(c.data);
+  printf("append: ok\n");
+
+  /* truncated index and corrupt headers (low octet of user ID count) */
+  check_index_header(&a, load, 23, PTPGP_ERR_USER_ID_INDEX_BAD_HEADER,
+                     PTPGP_ERR_USER_ID_INDEX_BAD_VERSION);
+
+  /* corrupt text offset (entries are checked when they are used) */
+  PTPGP_ASSERT(ptpgp_user_id_index_load(&index, a.data, a.data_len), "load index");
+  index.user_ids[8] ^= 0x80;
+
+  if ((err = ptpgp_user_id_index_get(&index, 0, &e)) != PTPGP_ERR_USER_ID_INDEX_BAD_ENTRY)
+    ptpgp_die(err, "bad text offset: unexpected result");
+
+  index.user_ids[8] ^= 0x80;
+
+  /* corrupt postings */
+  memset(index.postings, 0xff, index.num_postings * PTPGP_USER_ID_INDEX_POSTING_SIZE);
+
+  err = ptpgp_user_id_index_find(&index, (u8*) "ecc", 3, 0, &iter, &e);
+  if (err != PTPGP_ERR_USER_ID_INDEX_BAD_ENTRY)
+    ptpgp_die(err, "bad posting (find): unexpected result");
+
+  PTPGP_ASSERT(
+    ptpgp_user_id_index_builder_init(&builder, buffer_write_cb, &b),
+    "initialize user ID index builder"
+  );
+
+  err = ptpgp_user_id_index_builder_append(&builder, &index, 0);
+  if (err != PTPGP_ERR_USER_ID_INDEX_BAD_ENTRY)
+    ptpgp_die(err, "bad posting (append): unexpected result");
+
+  PTPGP_ASSERT(
+    ptpgp_user_id_index_builder_free(&builder),
+    "free user ID index builder"
+  );
+
+  printf("truncated and corrupt indexes: ok\n");
+
+  free(a.data);
+  free(ecc.data);
+  free(mixed.data);
+  free(secret.data);
+  free(both.data);
+}
+
+int main(int argc, char *argv[]) {
+  int i;
+
+  /* check for help option */
+  for (i = 1; i < argc; i++)
+    if (IS_HELP(argv[i]))
+      print_usage_and_exit(argv[0], USAGE);
+
+  if (argc > 2 && (!strncmp(argv[1], "-f", 3) || !strncmp(argv[1], "-e", 3))) {
+    /* find user IDs */
+    find(argv[2], argv[1][1] == 'e', argv + 3, argc - 3);
+  } else if (argc > 2 && !strncmp(argv[1], "-c", 3)) {
+    /* check find against scan */
+    check(argv[2], argv + 3, argc - 3);
+  } else if (argc > 2 && !strncmp(argv[1], "-t", 3)) {
+    /* check fixtures */
+    test(argv[2]);
+  } else if (argc > 5 && !strncmp(argv[1], "-a", 3)) {
+    /* append to index */
+    build(argv[2], strtoull(argv[3], NULL, 10), argv[4], argv[5]);
+  } else if (argc > 2) {
+    /* build index */
+    build(NULL, 0, argv[1], argv[2]);
+  } else {
+    print_usage_and_exit(argv[0], USAGE);
+  }
+
+  /* return success */
+  return EXIT_SUCCESS;
+}